@@ -0,0 +1,246 @@
+/*
+ Coroutine.cpp - C++20 coroutine support, resumed through the scheduler
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Coroutine.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include "Arduino.h"
+#include "Schedule.h"
+#include "coredecls.h"
+#include "interrupts.h"
+#include "osapi.h"
+
+namespace esp8266
+{
+namespace coro
+{
+
+struct free_frame
+{
+    free_frame* next;
+};
+
+static_assert(CORO_FRAME_BLOCK_SIZE >= sizeof(free_frame), "CORO_FRAME_BLOCK_SIZE is too small");
+
+// frames are only created and destroyed in CONT
+static free_frame* sFreeFrames = nullptr;
+static size_t sFreeFrameCount = 0;
+
+// awaiters waiting for their coroutine to be resumed, queued in any context
+static resumable* volatile sFirst = nullptr;
+static resumable* sLast = nullptr;
+// the last awaiter _drain() resumes in its run, nullptr when it is done
+static resumable* volatile sDrainLast = nullptr;
+// CONT only
+static bool sDrainScheduled = false;
+static bool sPollRegistered = false;
+
+void* frame_alloc(size_t size)
+{
+    if (size > CORO_FRAME_BLOCK_SIZE)
+    {
+        return malloc(size);
+    }
+
+    if (!sFreeFrames)
+    {
+        return malloc(CORO_FRAME_BLOCK_SIZE);
+    }
+
+    free_frame* frame = sFreeFrames;
+    sFreeFrames = frame->next;
+    --sFreeFrameCount;
+    return frame;
+}
+
+void frame_free(void* ptr, size_t size)
+{
+    if (size > CORO_FRAME_BLOCK_SIZE)
+    {
+        free(ptr);
+        return;
+    }
+
+    free_frame* frame = static_cast<free_frame*>(ptr);
+    frame->next = sFreeFrames;
+    sFreeFrames = frame;
+    ++sFreeFrameCount;
+}
+
+bool frame_reserve(size_t count)
+{
+    while (sFreeFrameCount < count)
+    {
+        void* frame = malloc(CORO_FRAME_BLOCK_SIZE);
+        if (!frame)
+        {
+            return false;
+        }
+        frame_free(frame, CORO_FRAME_BLOCK_SIZE);
+    }
+    return true;
+}
+
+resumable::~resumable()
+{
+    disarm_timeout();
+
+    esp8266::InterruptLock lock;
+
+    if (!_queued)
+    {
+        return;
+    }
+    resumable* prev = nullptr;
+    for (resumable* awaiter = sFirst; awaiter; prev = awaiter, awaiter = awaiter->_next)
+    {
+        if (awaiter == this)
+        {
+            if (prev)
+            {
+                prev->_next = _next;
+            }
+            else
+            {
+                sFirst = _next;
+            }
+            if (sLast == this)
+            {
+                sLast = prev;
+            }
+            if (sDrainLast == this)
+            {
+                sDrainLast = prev;
+            }
+            break;
+        }
+    }
+    _queued = false;
+}
+
+void IRAM_ATTR resumable::resume_later()
+{
+    esp8266::InterruptLock lock;
+
+    if (_queued || !_handle)
+    {
+        return;
+    }
+    _queued = true;
+    _next = nullptr;
+    if (sFirst)
+    {
+        sLast->_next = this;
+    }
+    else
+    {
+        sFirst = this;
+    }
+    sLast = this;
+
+    // _poll() schedules the drain, schedule_function() allocates and is not for interrupts
+    esp_schedule();
+}
+
+void resumable::suspend(std::coroutine_handle<> handle)
+{
+    _handle = handle;
+    if (!sPollRegistered)
+    {
+        // stays registered, a test of sFirst at every yield() and loop()
+        sPollRegistered = schedule_recurrent_function_us(&resumable::_poll, 0);
+    }
+}
+
+bool resumable::_poll()
+{
+    if (sFirst && !sDrainScheduled)
+    {
+        // one scheduled function for all resumptions, retried on the next poll if the scheduler is full
+        sDrainScheduled = schedule_function(&resumable::_drain);
+    }
+    return true;
+}
+
+void resumable::_drain()
+{
+    sDrainScheduled = false;
+    {
+        esp8266::InterruptLock lock;
+        sDrainLast = sLast;
+    }
+
+    // only what was queued so far, a coroutine that awaits again is resumed in the next run.
+    // The awaiters stay queued until resumed, a coroutine resumed before can destroy the next ones.
+    while (true)
+    {
+        resumable* awaiter;
+        {
+            esp8266::InterruptLock lock;
+            awaiter = sFirst;
+            if (!awaiter || !sDrainLast)
+            {
+                break;
+            }
+            sFirst = awaiter->_next;
+            if (!sFirst)
+            {
+                sLast = nullptr;
+            }
+            if (awaiter == sDrainLast)
+            {
+                sDrainLast = nullptr;
+            }
+            awaiter->_queued = false;
+        }
+        // the awaiter is gone once the coroutine resumed
+        awaiter->_handle.resume();
+    }
+}
+
+void resumable::_timer_expired(void* arg)
+{
+    resumable* awaiter = static_cast<resumable*>(arg);
+    awaiter->_armed = false;
+    awaiter->_timed_out = true;
+    awaiter->resume_later();
+}
+
+void resumable::arm_timeout(uint32_t ms)
+{
+    disarm_timeout();
+    _timed_out = false;
+    os_timer_setfn(&_timer, (os_timer_func_t*)&resumable::_timer_expired, this);
+    os_timer_arm(&_timer, ms, 0);
+    _armed = true;
+}
+
+void resumable::disarm_timeout()
+{
+    if (_armed)
+    {
+        os_timer_disarm(&_timer);
+        _armed = false;
+    }
+}
+
+} // namespace coro
+} // namespace esp8266
+
+#endif // __cpp_impl_coroutine
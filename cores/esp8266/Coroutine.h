@@ -0,0 +1,240 @@
+/*
+ Coroutine.h - C++20 coroutine support, resumed through the scheduler
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ESP_COROUTINE_H
+#define ESP_COROUTINE_H
+
+// Needs -std=gnu++20 (and -fcoroutines with GCC 10), empty otherwise.
+#if defined(__cpp_impl_coroutine)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <coroutine>
+#include <utility>
+
+#include "os_type.h"
+
+// Coroutine frames up to this size come from a pool of equal blocks, which
+// are reused instead of returned to the heap. Larger frames use malloc().
+#ifndef CORO_FRAME_BLOCK_SIZE
+#define CORO_FRAME_BLOCK_SIZE 256
+#endif
+
+namespace esp8266
+{
+namespace coro
+{
+
+void* frame_alloc(size_t size);
+void frame_free(void* ptr, size_t size);
+// Fills the pool up to count free blocks, returns false on memory shortage
+bool frame_reserve(size_t count);
+
+// Base of the awaiters: queued from SYS (lwIP or timer callbacks) or an
+// interrupt, the waiting coroutine is resumed in CONT by a scheduled function.
+class resumable
+{
+public:
+    // In IRAM and safe in an interrupt, it only queues the awaiter and wakes
+    // up CONT. Only the first call until the coroutine resumed has an effect.
+    void resume_later();
+
+protected:
+    resumable() = default;
+    resumable(const resumable&) = delete;
+    resumable& operator=(const resumable&) = delete;
+    // The frame of a suspended coroutine can be destroyed with its task, the
+    // timer and the queue must not keep pointing into it.
+    ~resumable();
+
+    // From await_suspend(), in CONT
+    void suspend(std::coroutine_handle<> handle);
+
+    // resume_later() after ms milliseconds, sets _timed_out
+    void arm_timeout(uint32_t ms);
+    void disarm_timeout();
+
+    std::coroutine_handle<> _handle;
+    bool _timed_out = false;
+
+private:
+    static void _timer_expired(void* arg);
+    static bool _poll();
+    static void _drain();
+
+    resumable* _next = nullptr;
+    bool _queued = false;
+    bool _armed = false;
+    os_timer_t _timer;
+};
+
+struct promise_base
+{
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    static void* operator new(size_t size) noexcept { return frame_alloc(size); }
+    static void operator delete(void* ptr, size_t size) { frame_free(ptr, size); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+        {
+            promise_base& promise = handle.promise();
+            if (promise.continuation)
+            {
+                return promise.continuation;
+            }
+            if (promise.detached)
+            {
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept { }
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { abort(); }
+};
+
+template <typename T>
+struct promise_result
+{
+    T value { };
+    template <typename U> void return_value(U&& result) { value = std::forward<U>(result); }
+    T take() { return std::move(value); }
+};
+
+template <>
+struct promise_result<void>
+{
+    void return_void() { }
+    void take() { }
+};
+
+// A coroutine returning T. It starts when awaited by another coroutine, or
+// when start() runs it detached. T must be default constructible, T() is
+// also the result when the frame could not be allocated.
+template <typename T = void>
+class task
+{
+public:
+    struct promise_type : promise_base, promise_result<T>
+    {
+        task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        static task get_return_object_on_allocation_failure() { return task(); }
+    };
+
+    task() = default;
+    task(task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) { }
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+    ~task() { reset(); }
+
+    explicit operator bool() const { return (bool)_handle; }
+    bool done() const { return !_handle || _handle.done(); }
+
+    // Runs until its first suspension, the frame then frees itself at the end.
+    // Returns false when the frame could not be allocated.
+    bool start() &&
+    {
+        if (!_handle)
+        {
+            return false;
+        }
+        auto handle = std::exchange(_handle, nullptr);
+        handle.promise().detached = true;
+        handle.resume();
+        return true;
+    }
+
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        _handle.promise().continuation = awaiting;
+        return _handle;
+    }
+    T await_resume()
+    {
+        if (!_handle)
+        {
+            return T();
+        }
+        return _handle.promise().take();
+    }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) : _handle(handle) { }
+
+    void reset()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// co_await sleep_ms(ms), sleep_ms(0) resumes at the next run of the scheduled functions
+class sleep_ms : public resumable
+{
+public:
+    explicit sleep_ms(uint32_t ms) : _ms(ms) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        suspend(handle);
+        if (_ms)
+        {
+            arm_timeout(_ms);
+        }
+        else
+        {
+            resume_later();
+        }
+    }
+    void await_resume() { disarm_timeout(); }
+
+private:
+    uint32_t _ms;
+};
+
+} // namespace coro
+} // namespace esp8266
+
+#endif // __cpp_impl_coroutine
+
+#endif // ESP_COROUTINE_H
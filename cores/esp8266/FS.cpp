@@ -20,6 +20,7 @@
 
 #include "FS.h"
 #include "FSImpl.h"
+#include <esp_priv.h>
 
 using namespace fs;
 
@@ -157,6 +158,41 @@ bool File::isDirectory() const {
     return _p->isDirectory();
 }
 
+bool File::mapExtent(FileExtent& extent) {
+    if (!_p)
+        return false;
+
+    return _p->mapExtent(extent);
+}
+
+bool File::hasPeekBufferAPI() const {
+    FileExtent extent;
+    return _p && _p->mapExtent(extent) && __byteAddressable(extent.addr);
+}
+
+size_t File::peekAvailable() {
+    FileExtent extent;
+    if (!_p || !_p->mapExtent(extent))
+        return 0;
+
+    return extent.len;
+}
+
+const char* File::peekBuffer() {
+    FileExtent extent;
+    if (!_p || !_p->mapExtent(extent))
+        return nullptr;
+
+    return reinterpret_cast<const char*>(extent.addr);
+}
+
+void File::peekConsume(size_t consume) {
+    if (!_p)
+        return;
+
+    _p->seek(consume, SeekCur);
+}
+
 void File::rewindDirectory() {
     if (!_fakeDir) {
         _fakeDir = std::make_shared<Dir>(_baseFS->openDir(fullName()));
@@ -349,6 +385,13 @@ bool FS::info64(FSInfo64& info){
     return _impl->info64(info);
 }
 
+bool FS::cacheStats(FSCacheStats& stats, bool reset) {
+    if (!_impl) {
+        return false;
+    }
+    return _impl->cacheStats(stats, reset);
+}
+
 File FS::open(const String& path, const char* mode) {
     return open(path.c_str(), mode);
 }
@@ -49,6 +49,13 @@ enum SeekMode {
     SeekEnd = 2
 };
 
+// A run of file data which can be read directly from memory-mapped flash.
+// On hardware flash is not byte-addressable, use memcpy_P() or pgm_read_*()
+struct FileExtent {
+    const uint8_t *addr;
+    size_t         len;
+};
+
 class File : public Stream
 {
 public:
@@ -84,6 +91,11 @@ public:
     bool isFile() const;
     bool isDirectory() const;
 
+    // Fills in the mapped flash extent starting at the current position.
+    // Returns false when the file data is not mappable (other FS, RAM-buffered
+    // data, flash outside the mapped window...), in which case use read()
+    bool mapExtent(FileExtent& extent);
+
     // Arduino "class SD" methods for compatibility
     //TODO use stream::send / check read(buf,size) result
     template<typename T> size_t write(T &src){
@@ -129,6 +141,12 @@ public:
         return false;
     }
 
+    // peekBuffer API, only when the data is mapped in byte-addressable memory
+    bool hasPeekBufferAPI () const override;
+    size_t peekAvailable () override;
+    const char* peekBuffer () override;
+    void peekConsume (size_t consume) override;
+
 protected:
     FileImplPtr _p;
     time_t (*_timeCallback)(void) = nullptr;
@@ -182,6 +200,15 @@ struct FSInfo64 {
     size_t maxPathLength;
 };
 
+// Optional buffering counters, for filesystems which implement a cache
+struct FSCacheStats {
+    uint32_t readHits;      // Reads served from RAM
+    uint32_t readMisses;    // Cache refills from the device
+    uint32_t writeHits;     // Writes absorbed by a write-behind buffer
+    uint32_t writeFlushes;  // Write-behind buffer flushes to the device
+    uint32_t bypasses;      // Transfers sent straight to the device
+};
+
 
 class FSConfig
 {
@@ -222,6 +249,7 @@ public:
     bool format();
     bool info(FSInfo& info);
     bool info64(FSInfo64& info);
+    bool cacheStats(FSCacheStats& stats, bool reset = false);
 
     File open(const char* path, const char* mode);
     File open(const String& path, const char* mode);
@@ -278,6 +306,8 @@ using fs::SeekSet;
 using fs::SeekCur;
 using fs::SeekEnd;
 using fs::FSInfo;
+using fs::FSCacheStats;
+using fs::FileExtent;
 using fs::FSConfig;
 using fs::SPIFFSConfig;
 #endif //FS_NO_GLOBALS
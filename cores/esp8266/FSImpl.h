@@ -55,6 +55,9 @@ public:
     // Same for creation time.
     virtual time_t getCreationTime() { return 0; } // Default is to not support timestamps
 
+    // Read-only files whose data sits in memory-mapped flash can report where, see File::mapExtent()
+    virtual bool mapExtent(FileExtent& extent) { (void)extent; return false; }
+
 protected:
     time_t (*_timeCallback)(void) = nullptr;
 };
@@ -106,6 +109,7 @@ public:
     virtual bool format() = 0;
     virtual bool info(FSInfo& info) = 0;
     virtual bool info64(FSInfo64& info) = 0;
+    virtual bool cacheStats(FSCacheStats& stats, bool reset) { (void)stats; (void)reset; return false; } // Only for FSes with a cache
     virtual FileImplPtr open(const char* path, OpenMode openMode, AccessMode accessMode) = 0;
     virtual bool exists(const char* path) = 0;
     virtual DirImplPtr openDir(const char* path) = 0;
@@ -1,5 +1,6 @@
 #include <FunctionalInterrupt.h>
 #include <Schedule.h>
+#include <new>
 #include "Arduino.h"
 
 // Duplicate typedefs from core_esp8266_wiring_digital_c
@@ -9,31 +10,155 @@ typedef void (*voidFuncPtrArg)(void*);
 // Helper functions for Functional interrupt routines
 extern "C" void __attachInterruptFunctionalArg(uint8_t pin, voidFuncPtr userFunc, void*fp, int mode, bool functional);
 
+// Edge capture state, pins with a ring and the drainer bookkeeping
+static ArgStructure* edgeCaptures[16] = { nullptr, };
+static volatile bool edgeCaptureDrainScheduled = false;
+static ArgStructure* edgeCaptureDraining = nullptr;
+static bool edgeCaptureDrainingDetached = false;
+
 
 void IRAM_ATTR interruptFunctional(void* arg)
 {
     ArgStructure* localArg = (ArgStructure*)arg;
-	if (localArg->functionInfo->reqScheduledFunction)
-	{
-		schedule_function(std::bind(localArg->functionInfo->reqScheduledFunction,InterruptInfo(*(localArg->interruptInfo))));
-	}
 	if (localArg->functionInfo->reqFunction)
 	{
 	  localArg->functionInfo->reqFunction();
 	}
 }
 
+static void deleteArgStructure(ArgStructure* localArg)
+{
+	if (localArg->edgeCaptureRing)
+	{
+		delete[] localArg->edgeCaptureRing->events;
+		delete localArg->edgeCaptureRing;
+	}
+	delete (FunctionInfo*)localArg->functionInfo;
+	delete (InterruptInfo*)localArg->interruptInfo;
+	delete localArg;
+}
+
+// Deliver the recorded edges of all pins, runs as a scheduled function
+static void drainEdgeCaptures()
+{
+	edgeCaptureDrainScheduled = false;
+
+	for (uint8_t pin = 0; pin < 16; ++pin)
+	{
+		ArgStructure* localArg = edgeCaptures[pin];
+		if (!localArg)
+		{
+			continue;
+		}
+
+		EdgeCaptureRing* ring = localArg->edgeCaptureRing;
+		FunctionInfo* fi = localArg->functionInfo;
+		const uint16_t head = ring->head;
+
+		// cycle count to micros() conversion for the InterruptInfo of scheduled interrupts
+		const uint32_t nowMicros = micros();
+		const uint32_t nowCycles = esp_get_cycle_count();
+
+		edgeCaptureDraining = localArg;
+		while (ring->tail != head && !edgeCaptureDrainingDetached)
+		{
+			// deliver the ring in place, in at most two linear pieces
+			const uint16_t tail = ring->tail;
+			const uint16_t start = tail & ring->mask;
+			size_t count = (uint16_t)(head - tail);
+			if (count > (size_t)ring->mask + 1 - start)
+			{
+				count = (size_t)ring->mask + 1 - start;
+			}
+
+			if (fi->reqEdgeBatchFunction)
+			{
+				fi->reqEdgeBatchFunction(&ring->events[start], count);
+			}
+			else
+			{
+				for (size_t i = 0; i < count && !edgeCaptureDrainingDetached; ++i)
+				{
+					const EdgeEvent& edge = ring->events[start + i];
+					InterruptInfo ii;
+					ii.pin = edge.pin;
+					ii.value = edge.value;
+					ii.micro = nowMicros - (nowCycles - edge.cycles) / esp_get_cpu_freq_mhz();
+					fi->reqScheduledFunction(ii);
+				}
+			}
+
+			ring->tail = tail + count;
+		}
+		edgeCaptureDraining = nullptr;
+
+		if (edgeCaptureDrainingDetached)
+		{
+			// detached from its own routine, cleanupFunctional() left the deletion to us
+			edgeCaptureDrainingDetached = false;
+			deleteArgStructure(localArg);
+		}
+	}
+}
+
 extern "C"
 {
    void cleanupFunctional(void* arg)
    {
 	 ArgStructure* localArg = (ArgStructure*)arg;
-	 delete (FunctionInfo*)localArg->functionInfo;
-     delete (InterruptInfo*)localArg->interruptInfo;
-	 delete localArg;
+	 if (localArg->edgeCaptureRing)
+	 {
+	   for (uint8_t pin = 0; pin < 16; ++pin)
+	   {
+	     if (edgeCaptures[pin] == localArg)
+	     {
+	       edgeCaptures[pin] = nullptr;
+	     }
+	   }
+	   if (localArg == edgeCaptureDraining)
+	   {
+	     edgeCaptureDrainingDetached = true;
+	     return;
+	   }
+	 }
+	 deleteArgStructure(localArg);
+   }
+
+   // Called by the GPIO interrupt after recording edges
+   void IRAM_ATTR edgeCaptureScheduleDrain()
+   {
+	 if (!edgeCaptureDrainScheduled)
+	 {
+	   // one scheduled function per batch instead of one per edge, retried on the next edge if the scheduler is full
+	   edgeCaptureDrainScheduled = schedule_function(drainEdgeCaptures);
+	 }
    }
 }
 
+static bool attachEdgeCapture(uint8_t pin, FunctionInfo* fi, int mode, size_t ringSize)
+{
+	size_t size = 2;
+	while (size < ringSize && size < 0x8000)
+	{
+		size <<= 1;
+	}
+
+	ArgStructure* as = new ArgStructure;
+	as->functionInfo = fi;
+	as->edgeCaptureRing = new EdgeCaptureRing;
+	as->edgeCaptureRing->events = new (std::nothrow) EdgeEvent[size];
+	if (!as->edgeCaptureRing->events)
+	{
+		deleteArgStructure(as);
+		return false;
+	}
+	as->edgeCaptureRing->mask = size - 1;
+
+	__attachInterruptFunctionalArg(pin, (voidFuncPtr)interruptFunctional, as, mode, true);
+	edgeCaptures[pin] = as;
+	return true;
+}
+
 void attachInterrupt(uint8_t pin, std::function<void(void)> intRoutine, int mode)
 {
 	// use the local interrupt routine which takes the ArgStructure as argument
@@ -52,14 +177,36 @@ void attachInterrupt(uint8_t pin, std::function<void(void)> intRoutine, int mode
 
 void attachScheduledInterrupt(uint8_t pin, std::function<void(InterruptInfo)> scheduledIntRoutine, int mode)
 {
-	InterruptInfo* ii = new InterruptInfo;
+	if (pin >= 16)
+	{
+		return;
+	}
 
+	// delivered edge by edge from the edge capture ring
 	FunctionInfo* fi = new FunctionInfo;
 	fi->reqScheduledFunction = scheduledIntRoutine;
 
-	ArgStructure* as = new ArgStructure;
-	as->interruptInfo = ii;
-	as->functionInfo = fi;
+	attachEdgeCapture(pin, fi, mode, SCHEDULED_FN_MAX_COUNT);
+}
 
-	__attachInterruptFunctionalArg(pin, (voidFuncPtr)interruptFunctional, as, mode, true);
+bool attachEdgeCaptureInterrupt(uint8_t pin, std::function<void(const EdgeEvent*, size_t)> batchRoutine, int mode, size_t ringSize)
+{
+	if (pin >= 16 || !batchRoutine)
+	{
+		return false;
+	}
+
+	FunctionInfo* fi = new FunctionInfo;
+	fi->reqEdgeBatchFunction = batchRoutine;
+
+	return attachEdgeCapture(pin, fi, mode, ringSize);
+}
+
+uint32_t edgeCaptureOverflows(uint8_t pin)
+{
+	if (pin >= 16 || !edgeCaptures[pin])
+	{
+		return 0;
+	}
+	return edgeCaptures[pin]->edgeCaptureRing->overflows;
 }
@@ -18,18 +18,48 @@ struct InterruptInfo {
 	uint32_t micro = 0;
 };
 
+// One edge recorded by the GPIO interrupt for edge capture
+struct EdgeEvent {
+	uint32_t cycles = 0; // esp_get_cycle_count() on entry of the GPIO interrupt
+	uint8_t pin = 0;
+	uint8_t value = 0;   // pin level sampled by the GPIO interrupt
+};
+
+// Single producer (GPIO interrupt), single consumer (edge capture drainer) ring.
+// head and tail run freely, the size is a power of two.
+struct EdgeCaptureRing {
+	EdgeEvent* events = nullptr;
+	uint16_t mask = 0;
+	volatile uint16_t head = 0;      // written by the GPIO interrupt only
+	volatile uint16_t tail = 0;      // written by the drainer only
+	volatile uint32_t overflows = 0; // edges dropped because the ring was full
+};
+
 struct FunctionInfo {
     std::function<void(void)> reqFunction = nullptr;
 	std::function<void(InterruptInfo)> reqScheduledFunction = nullptr;
+	std::function<void(const EdgeEvent*, size_t)> reqEdgeBatchFunction = nullptr;
 };
 
 struct ArgStructure {
 	InterruptInfo* interruptInfo = nullptr;
 	FunctionInfo* functionInfo = nullptr;
+	EdgeCaptureRing* edgeCaptureRing = nullptr;
 };
 
 void attachInterrupt(uint8_t pin, std::function<void(void)> intRoutine, int mode);
 void attachScheduledInterrupt(uint8_t pin, std::function<void(InterruptInfo)> scheduledIntRoutine, int mode);
 
+// Edge capture: the GPIO interrupt only appends (pin, level, cycle count) to a
+// ring of ringSize entries (rounded up to a power of two) for pin, and one
+// scheduled drainer later calls batchRoutine with the edges recorded since,
+// oldest first, possibly split in several calls. The events are only valid
+// during the call. Edges arriving while the ring is full are dropped and
+// counted. Use detachInterrupt() to stop. Returns false if the ring could not
+// be allocated.
+bool attachEdgeCaptureInterrupt(uint8_t pin, std::function<void(const EdgeEvent*, size_t)> batchRoutine, int mode, size_t ringSize = 64);
+// Number of edges dropped on pin since edge capture was attached
+uint32_t edgeCaptureOverflows(uint8_t pin);
+
 
 #endif //INTERRUPTS_H
@@ -38,13 +38,20 @@
 void serialEvent() __attribute__((weak));
 
 HardwareSerial::HardwareSerial(int uart_nr)
-    : _uart_nr(uart_nr), _rx_size(256)
+    : _uart_nr(uart_nr), _rx_size(256), _tx_size(0)
 {}
 
 void HardwareSerial::begin(unsigned long baud, SerialConfig config, SerialMode mode, uint8_t tx_pin, bool invert)
 {
     end();
     _uart = uart_init(_uart_nr, baud, (int) config, (int) mode, tx_pin, _rx_size, invert);
+    if (_tx_size) {
+        uart_resize_tx_buffer(_uart, _tx_size);
+    }
+    if (_rx_frame_idle) {
+        uart_rx_frame_mode(_uart, _rx_frame_idle);
+        uart_rx_frame_set_callback(_uart, _on_frame ? &HardwareSerial::_frameReceived : nullptr, this);
+    }
 #if defined(DEBUG_ESP_PORT) && !defined(NDEBUG)
     if (static_cast<void*>(this) == static_cast<void*>(&DEBUG_ESP_PORT))
     {
@@ -83,6 +90,40 @@ size_t HardwareSerial::setRxBufferSize(size_t size){
     return _rx_size;
 }
 
+size_t HardwareSerial::setTxBufferSize(size_t size){
+    if(_uart) {
+        _tx_size = uart_resize_tx_buffer(_uart, size);
+    } else {
+        _tx_size = size;
+    }
+    return _tx_size;
+}
+
+bool HardwareSerial::setRxFrameMode(uint8_t idleChars)
+{
+    if (_uart && !uart_rx_frame_mode(_uart, idleChars)) {
+        return false;
+    }
+    _rx_frame_idle = idleChars;
+    // the uart forgets the callback when frame mode is turned off
+    uart_rx_frame_set_callback(_uart, _on_frame ? &HardwareSerial::_frameReceived : nullptr, this);
+    return true;
+}
+
+void HardwareSerial::onReceiveFrame(std::function<void(void)> fn)
+{
+    _on_frame = std::move(fn);
+    uart_rx_frame_set_callback(_uart, _on_frame ? &HardwareSerial::_frameReceived : nullptr, this);
+}
+
+void HardwareSerial::_frameReceived(void* arg)
+{
+    HardwareSerial* self = static_cast<HardwareSerial*>(arg);
+    if (self->_on_frame) {
+        self->_on_frame();
+    }
+}
+
 void HardwareSerial::setDebugOutput(bool en)
 {
     if(!_uart) {
@@ -28,6 +28,7 @@
 #define HardwareSerial_h
 
 #include <inttypes.h>
+#include <functional>
 #include <../include/time.h> // See issue #6714
 #include "Stream.h"
 #include "uart.h"
@@ -101,6 +102,63 @@ public:
         return uart_get_rx_buffer_size(_uart);
     }
 
+    // Size of the software tx buffer, 0 to write straight into the 128 byte hardware fifo.
+    // With a buffer, write() only blocks when it is full, and flush() waits for it to drain.
+    size_t setTxBufferSize(size_t size);
+    size_t getTxBufferSize()
+    {
+        return uart_get_tx_buffer_size(_uart);
+    }
+
+    // Frame mode, for protocols that separate messages by a silent line (Modbus RTU, many sensors):
+    // a frame ends once no data came for idleChars character times (1..127), 0 turns it off.
+    // Frames are read with readFrame() or the peekFrame*() functions.
+    bool setRxFrameMode(uint8_t idleChars);
+
+    // number of complete frames not yet read
+    size_t frameCount()
+    {
+        return uart_rx_frame_count(_uart);
+    }
+
+    // size of the oldest complete frame, 0 if there is none
+    size_t frameAvailable()
+    {
+        return uart_rx_frame_available(_uart);
+    }
+
+    // copy up to size bytes of the oldest frame, what is left of it stays the oldest frame
+    size_t readFrame(char* buffer, size_t size)
+    {
+        return uart_rx_frame_read(_uart, buffer, size);
+    }
+    size_t readFrame(uint8_t* buffer, size_t size)
+    {
+        return uart_rx_frame_read(_uart, (char*)buffer, size);
+    }
+
+    // return a pointer to the oldest frame, semantic forbids any kind of read() before calling peekFrameConsume()
+    const char* peekFrameBuffer()
+    {
+        return uart_rx_frame_peek_buffer(_uart);
+    }
+
+    // return number of frame bytes accessible by peekFrameBuffer(),
+    // less than frameAvailable() when the frame wraps around the end of the rx buffer
+    size_t peekFrameAvailable()
+    {
+        return uart_rx_frame_peek_available(_uart);
+    }
+
+    // consume frame bytes after use (see peekFrameBuffer)
+    void peekFrameConsume(size_t consume)
+    {
+        uart_rx_frame_peek_consume(_uart, consume);
+    }
+
+    // fn runs as a scheduled function after one or more frames completed
+    void onReceiveFrame(std::function<void(void)> fn);
+
     bool swap()
     {
         return swap(1);
@@ -228,9 +286,14 @@ public:
     unsigned long detectBaudrate(time_t timeoutMillis);
 
 protected:
+    static void _frameReceived(void* arg);
+
     int _uart_nr;
     uart_t* _uart = nullptr;
     size_t _rx_size;
+    size_t _tx_size;
+    uint8_t _rx_frame_idle = 0;
+    std::function<void(void)> _on_frame;
 };
 
 #if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_SERIAL)
@@ -0,0 +1,252 @@
+/*
+ MovableHeap.cpp - handle based allocations the heap may move around
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdlib.h>
+
+#include "Arduino.h"
+#include "MovableHeap.h"
+#include "Schedule.h"
+#include "debug.h"
+#include "umm_malloc/umm_malloc.h"
+
+struct movable_entry_t
+{
+    void* ptr;          // nullptr for an unused handle
+    size_t size;
+    uint8_t locks;
+};
+
+#define MOVABLE_TABLE_STEP 8
+
+static movable_entry_t* sTable = nullptr;
+static uint16_t sTableSize = 0;
+static uint16_t sHandles = 0;
+
+// compactor state, sCursor is the next table index of the current pass
+static uint16_t sCursor = 0;
+static uint32_t sPassMoves = 0;
+static uint8_t sPassFragBefore = 0;
+static bool sIdle = false;
+static uint32_t sIdleFreeHeap = 0;
+static uint32_t sCompactorGeneration = 0;
+static bool sCompactorRunning = false;
+static movable_stats_t sStats = { };
+
+static movable_entry_t* getEntry(movable_t handle)
+{
+    if (handle == MOVABLE_NONE || handle > sTableSize || !sTable[handle - 1].ptr)
+    {
+        return nullptr;
+    }
+    return &sTable[handle - 1];
+}
+
+movable_t movable_malloc(size_t size)
+{
+    if (!size)
+    {
+        return MOVABLE_NONE;
+    }
+
+    uint16_t index = 0;
+    while (index < sTableSize && sTable[index].ptr)
+    {
+        ++index;
+    }
+
+    if (index == sTableSize)
+    {
+        if (sTableSize > 0xFFFF - MOVABLE_TABLE_STEP)
+        {
+            return MOVABLE_NONE;
+        }
+        movable_entry_t* table = (movable_entry_t*)realloc(sTable, (sTableSize + MOVABLE_TABLE_STEP) * sizeof(movable_entry_t));
+        if (!table)
+        {
+            return MOVABLE_NONE;
+        }
+        memset(&table[sTableSize], 0, MOVABLE_TABLE_STEP * sizeof(movable_entry_t));
+        sTable = table;
+        sTableSize += MOVABLE_TABLE_STEP;
+    }
+
+    void* ptr = malloc(size);
+    if (!ptr)
+    {
+        return MOVABLE_NONE;
+    }
+
+    sTable[index].ptr = ptr;
+    sTable[index].size = size;
+    sTable[index].locks = 0;
+    ++sHandles;
+    return index + 1;
+}
+
+bool movable_realloc(movable_t handle, size_t size)
+{
+    movable_entry_t* entry = getEntry(handle);
+    if (!entry || entry->locks || !size)
+    {
+        return false;
+    }
+
+    void* ptr = realloc(entry->ptr, size);
+    if (!ptr)
+    {
+        return false;
+    }
+
+    entry->ptr = ptr;
+    entry->size = size;
+    return true;
+}
+
+void movable_free(movable_t handle)
+{
+    movable_entry_t* entry = getEntry(handle);
+    if (!entry)
+    {
+        return;
+    }
+
+    free(entry->ptr);
+    entry->ptr = nullptr;
+    entry->size = 0;
+    entry->locks = 0;
+    --sHandles;
+    sIdle = false;
+}
+
+size_t movable_size(movable_t handle)
+{
+    movable_entry_t* entry = getEntry(handle);
+    return entry ? entry->size : 0;
+}
+
+void* movable_lock(movable_t handle)
+{
+    movable_entry_t* entry = getEntry(handle);
+    if (!entry || entry->locks == 0xFF)
+    {
+        return nullptr;
+    }
+
+    ++entry->locks;
+    return entry->ptr;
+}
+
+void movable_unlock(movable_t handle)
+{
+    movable_entry_t* entry = getEntry(handle);
+    if (entry && entry->locks && !--entry->locks)
+    {
+        // it may have been skipped by the pass that found nothing to move
+        sIdle = false;
+    }
+}
+
+size_t movable_compact(uint32_t budget_us)
+{
+    const uint32_t start = micros();
+
+    if (sCursor == 0)
+    {
+        // nothing was freed or allocated since the last pass came back empty
+        if (!sHandles || (sIdle && ESP.getFreeHeap() == sIdleFreeHeap))
+        {
+            return 0;
+        }
+        sPassMoves = 0;
+        sPassFragBefore = ESP.getHeapFragmentation();
+    }
+
+    size_t moved = 0;
+    while (sCursor < sTableSize && micros() - start < budget_us)
+    {
+        movable_entry_t& entry = sTable[sCursor++];
+        if (!entry.ptr || entry.locks)
+        {
+            continue;
+        }
+
+        void* ptr = umm_relocate(entry.ptr);
+        if (ptr != entry.ptr)
+        {
+            entry.ptr = ptr;
+            ++moved;
+            sStats.bytes += entry.size;
+        }
+    }
+    sStats.moves += moved;
+    sPassMoves += moved;
+
+    if (sCursor >= sTableSize)
+    {
+        sCursor = 0;
+        ++sStats.passes;
+        sIdle = sPassMoves == 0;
+        if (sIdle)
+        {
+            sIdleFreeHeap = ESP.getFreeHeap();
+        }
+        else
+        {
+            sStats.fragBefore = sPassFragBefore;
+            sStats.fragAfter = ESP.getHeapFragmentation();
+            DEBUGV("movable: %u blocks moved, fragmentation %u%% -> %u%%\n",
+                   (unsigned)sPassMoves, sStats.fragBefore, sStats.fragAfter);
+        }
+    }
+
+    return moved;
+}
+
+bool movable_start_compactor(uint32_t interval_ms, uint32_t budget_us)
+{
+    movable_stop_compactor();
+
+    // a recurrent function can only cancel itself, older ones see a new generation and return false
+    const uint32_t generation = ++sCompactorGeneration;
+    sCompactorRunning = schedule_recurrent_function_us([generation, budget_us]()
+    {
+        if (generation != sCompactorGeneration)
+        {
+            return false;
+        }
+        movable_compact(budget_us);
+        return true;
+    }, interval_ms * 1000);
+
+    return sCompactorRunning;
+}
+
+void movable_stop_compactor()
+{
+    if (sCompactorRunning)
+    {
+        ++sCompactorGeneration;
+        sCompactorRunning = false;
+    }
+}
+
+void movable_get_stats(movable_stats_t* stats)
+{
+    *stats = sStats;
+    stats->handles = sHandles;
+}
@@ -0,0 +1,90 @@
+/*
+ MovableHeap.h - handle based allocations the heap may move around
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MOVABLEHEAP_H
+#define MOVABLEHEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Long lived buffers are allocated through a handle instead of a pointer, so
+// that the compactor can slide them toward the bottom of the heap and merge
+// the holes left between them. A pointer is only obtained by locking the
+// handle, and a locked block is never moved. Blocks may move at every
+// yield(), delay() or return from loop() while they are unlocked.
+//
+// None of these functions may be called from an interrupt.
+
+typedef uint16_t movable_t;
+
+#define MOVABLE_NONE ((movable_t)0)
+
+struct movable_stats_t
+{
+    uint32_t moves;        // blocks moved since boot
+    uint32_t bytes;        // bytes copied by those moves
+    uint32_t passes;       // completed passes over all handles
+    uint16_t handles;      // handles currently allocated
+    uint8_t  fragBefore;   // ESP.getHeapFragmentation() at the start of the last pass that moved blocks
+    uint8_t  fragAfter;    // and at its end
+};
+
+// Returns MOVABLE_NONE when there is no memory or size is 0.
+movable_t movable_malloc(size_t size);
+// Like realloc(), the handle stays the same. Fails and returns false while locked.
+bool movable_realloc(movable_t handle, size_t size);
+void movable_free(movable_t handle);
+size_t movable_size(movable_t handle);
+
+// Pins the block and returns its address, nullptr for an invalid handle.
+// Locks nest, each movable_lock() needs its movable_unlock().
+void* movable_lock(movable_t handle);
+void movable_unlock(movable_t handle);
+
+// Moves unlocked blocks down for at most about budget_us microseconds,
+// continuing where the previous call stopped. Returns the number of blocks moved.
+size_t movable_compact(uint32_t budget_us);
+
+// Calls movable_compact() from the recurrent scheduler every interval_ms.
+// A pass over the handles is skipped while the free heap has not changed
+// since the last pass that found nothing to move.
+bool movable_start_compactor(uint32_t interval_ms = 1000, uint32_t budget_us = 100);
+void movable_stop_compactor();
+
+void movable_get_stats(movable_stats_t* stats);
+
+// Scoped lock, the pointer is valid until the object goes out of scope
+class MovableLock
+{
+public:
+    explicit MovableLock(movable_t handle) : _handle(handle), _ptr(movable_lock(handle)) { }
+    ~MovableLock() { if (_ptr) movable_unlock(_handle); }
+
+    MovableLock(const MovableLock&) = delete;
+    MovableLock& operator=(const MovableLock&) = delete;
+
+    void* get() const { return _ptr; }
+    template <typename T> T* as() const { return static_cast<T*>(_ptr); }
+    explicit operator bool() const { return _ptr != nullptr; }
+
+private:
+    movable_t _handle;
+    void* _ptr;
+};
+
+#endif // MOVABLEHEAP_H
@@ -23,6 +23,7 @@
 #include "PolledTimeout.h"
 #include "interrupts.h"
 #include "coredecls.h"
+#include "core_esp8266_profiler.h"
 
 typedef std::function<void(void)> mSchedFuncT;
 struct scheduled_fn_t
@@ -174,7 +175,9 @@ void run_scheduled_functions()
     {
         done = sFirst == stop;
 
+        PROFILER_FN_BEGIN();
         sFirst->mFunc();
+        PROFILER_FN_END(PROFILER_SCHEDULED);
 
         {
             // remove function from stack
@@ -236,7 +239,15 @@ void run_scheduled_recurrent_functions()
         const bool wakeup = current->alarm && current->alarm();
         bool callNow = current->callNow;
 
-        if ((wakeup || callNow) && !current->mFunc())
+        bool keep = true;
+        if (wakeup || callNow)
+        {
+            PROFILER_FN_BEGIN();
+            keep = current->mFunc();
+            PROFILER_FN_END(PROFILER_RECURRENT);
+        }
+
+        if (!keep)
         {
             // remove function from stack
             esp8266::InterruptLock lockAllInterruptsInThisScope;
@@ -274,7 +285,10 @@ void run_scheduled_recurrent_functions()
             // this is yield() in cont stack, but need to call cont_suspend directly
             // to prevent recursion into run_scheduled_recurrent_functions()
             esp_schedule();
+            PROFILER_YIELD_SITE();
+            PROFILER_CONT_SUSPEND();
             cont_suspend(g_pcont);
+            PROFILER_CONT_RESUME();
         }
     } while (current && !done);
 
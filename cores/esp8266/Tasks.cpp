@@ -0,0 +1,356 @@
+/*
+ Tasks.cpp - cooperative tasks on their own cont stacks
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdlib.h>
+#include <new>
+
+#include "Arduino.h"
+#include "Tasks.h"
+#include "cont.h"
+#include "coredecls.h"
+#include "core_esp8266_profiler.h"
+#include "ets_sys.h"
+#include "os_type.h"
+#include "osapi.h"
+#include "umm_malloc/umm_heap_select.h"
+
+enum task_state_t : uint8_t
+{
+    TASK_READY,
+    TASK_DELAYED,     // esp_delay() or esp_suspend(), ends early on esp_schedule() unless still blocked
+    TASK_SLEEPING,    // task_sleep()
+    TASK_WAITING,     // task_wait()
+};
+
+struct task_t
+{
+    task_t* next = nullptr;
+    std::function<void(void)> fn;
+    void* mem = nullptr;
+    cont_t* cont = nullptr;
+    task_event_t* event = nullptr;
+    bool (*blocked)(void*) = nullptr;   // of esp_delay(ms, blocked) or esp_suspend(blocked)
+    void* blocked_arg = nullptr;
+    uint32_t start_ms = 0;
+    uint32_t timeout_ms = 0;
+    uint32_t schedule_count = 0;
+    uint8_t priority = 0;
+    task_state_t state = TASK_READY;
+};
+
+static task_t* sFirst = nullptr;
+static task_t* sCurrent = nullptr;
+static bool sRunning = false;
+static size_t sCount = 0;
+static os_timer_t sWakeTimer;
+static bool sWakeTimerArmed = false;
+
+static void scheduleTasks();
+
+task_t* task_create(const std::function<void(void)>& fn, size_t stackSize, uint8_t priority, bool iramStack)
+{
+    stackSize = (stackSize + 15) & ~(size_t)15;
+
+    task_t* task = new (std::nothrow) task_t;
+    if (!task)
+    {
+        return nullptr;
+    }
+
+    if (iramStack)
+    {
+        HeapSelectIram ephemeral;
+        task->mem = malloc(CONT_SIZE(stackSize) + 15);
+    }
+    if (!task->mem)
+    {
+        task->mem = malloc(CONT_SIZE(stackSize) + 15);
+    }
+    if (!task->mem)
+    {
+        delete task;
+        return nullptr;
+    }
+
+    // the stack pointer starts at stack_end, which needs 16 byte alignment
+    task->cont = (cont_t*)(((uintptr_t)task->mem + 15) & ~(uintptr_t)15);
+    cont_init_size(task->cont, stackSize);
+    task->fn = fn;
+    task->priority = priority;
+
+    // appended, so tasks of the same priority run in creation order
+    task_t** last = &sFirst;
+    while (*last)
+    {
+        last = &(*last)->next;
+    }
+    *last = task;
+    ++sCount;
+
+    scheduleTasks();
+    return task;
+}
+
+task_t* task_current()
+{
+    return sCurrent;
+}
+
+size_t task_count()
+{
+    return sCount;
+}
+
+static bool suspendCurrent(task_state_t state, uint32_t ms, task_event_t* event = nullptr)
+{
+    task_t* task = sCurrent;
+    if (!task || !cont_can_suspend(task->cont))
+    {
+        return false;
+    }
+
+    task->state = state;
+    task->start_ms = millis();
+    task->timeout_ms = ms;
+    task->schedule_count = esp_schedule_count();
+    task->event = event;
+    cont_suspend(task->cont);
+    return true;
+}
+
+// Replaces the weak one of core_esp8266_main.cpp
+extern "C" bool task_suspend(uint32_t ms)
+{
+    if (ms == 0)
+    {
+        return suspendCurrent(TASK_READY, 0);
+    }
+    return suspendCurrent(TASK_DELAYED, ms);
+}
+
+void task_yield()
+{
+    if (!suspendCurrent(TASK_READY, 0))
+    {
+        yield();
+    }
+}
+
+void task_sleep(uint32_t ms)
+{
+    if (!suspendCurrent(TASK_SLEEPING, ms))
+    {
+        delay(ms);
+    }
+}
+
+bool task_wait(task_event_t* event, uint32_t timeout_ms)
+{
+    if (!event->signaled && !suspendCurrent(TASK_WAITING, timeout_ms, event))
+    {
+        esp_delay(timeout_ms, [event]() { return !event->signaled; });
+    }
+
+    const bool signaled = event->signaled;
+    event->signaled = false;
+    return signaled;
+}
+
+// Replaces the weak one of core_esp8266_main.cpp
+extern "C" void task_set_blocked(bool (*blocked)(void*), void* arg)
+{
+    if (sCurrent)
+    {
+        sCurrent->blocked = blocked;
+        sCurrent->blocked_arg = arg;
+    }
+}
+
+// Replaces the weak one of core_esp8266_main.cpp, for the postmortem stack dump
+extern "C" cont_t* task_find_cont(uint32_t sp)
+{
+    for (task_t* task = sFirst; task; task = task->next)
+    {
+        if (sp > (uint32_t)(uintptr_t)task->cont->stack && sp < (uint32_t)(uintptr_t)task->cont->stack_end)
+        {
+            return task->cont;
+        }
+    }
+    return nullptr;
+}
+
+void IRAM_ATTR task_signal(task_event_t* event)
+{
+    event->signaled = true;
+    esp_schedule();
+}
+
+int task_get_free_stack(task_t* task)
+{
+    if (!task)
+    {
+        task = sCurrent;
+    }
+    return cont_get_free_stack(task ? task->cont : g_pcont);
+}
+
+static void taskEntry()
+{
+    sCurrent->fn();
+}
+
+// Resumes CONT without waking the tasks that wait for an esp_schedule() from elsewhere
+static void scheduleTasks()
+{
+    const uint32_t before = esp_schedule_count();
+    esp_schedule();
+    for (task_t* task = sFirst; task; task = task->next)
+    {
+        if (task->state == TASK_DELAYED && task->schedule_count == before)
+        {
+            task->schedule_count = before + 1;
+        }
+    }
+}
+
+static void wakeTimerExpired(void* arg)
+{
+    (void)arg;
+    sWakeTimerArmed = false;
+    scheduleTasks();
+}
+
+// Makes ready what has waited long enough, returns the highest priority of ready tasks or -1
+static int wakeTasks(uint32_t* next_ms)
+{
+    const uint32_t now = millis();
+    const uint32_t scheduleCount = esp_schedule_count();
+    int top = -1;
+
+    for (task_t* task = sFirst; task; task = task->next)
+    {
+        const uint32_t elapsed = now - task->start_ms;
+        bool ready = task->state == TASK_READY || (task->timeout_ms != UINT32_MAX && elapsed >= task->timeout_ms);
+
+        if (task->state == TASK_DELAYED && task->schedule_count != scheduleCount)
+        {
+            // esp_schedule() does not say for which task, only those no longer blocked resume
+            task->schedule_count = scheduleCount;
+            ready = ready || !task->blocked || !task->blocked(task->blocked_arg);
+        }
+        else if (task->state == TASK_WAITING && task->event->signaled)
+        {
+            ready = true;
+        }
+
+        if (ready)
+        {
+            task->state = TASK_READY;
+            if ((int)task->priority > top)
+            {
+                top = task->priority;
+            }
+        }
+        else if (task->timeout_ms != UINT32_MAX && task->timeout_ms - elapsed < *next_ms)
+        {
+            *next_ms = task->timeout_ms - elapsed;
+        }
+    }
+
+    return top;
+}
+
+// Replaces the weak one of core_esp8266_main.cpp, called in CONT outside of any task
+extern "C" void run_tasks()
+{
+    if (!sFirst || sRunning)
+    {
+        return;
+    }
+    sRunning = true;
+
+    uint32_t next_ms = UINT32_MAX;
+    const int top = wakeTasks(&next_ms);
+
+    task_t** link = &sFirst;
+    while (top >= 0 && *link)
+    {
+        task_t* task = *link;
+        if (task->state != TASK_READY || task->priority != top)
+        {
+            link = &task->next;
+            continue;
+        }
+
+        sCurrent = task;
+        cont_run(task->cont, &taskEntry);
+        sCurrent = nullptr;
+        // a yield site set in the task did not end a cont slice
+        PROFILER_YIELD_SITE_CLEAR();
+        cont_check(task->cont);
+
+        if (task->cont->pc_suspend)
+        {
+            if (task->state != TASK_READY && task->timeout_ms != UINT32_MAX && task->timeout_ms < next_ms)
+            {
+                next_ms = task->timeout_ms;
+            }
+            link = &task->next;
+        }
+        else
+        {
+            // the function returned
+            *link = task->next;
+            free(task->mem);
+            delete task;
+            --sCount;
+        }
+    }
+
+    // come back for yielded and lower priority tasks right away, for the earliest timeout later
+    for (task_t* task = sFirst; task; task = task->next)
+    {
+        if (task->state == TASK_READY)
+        {
+            next_ms = 0;
+        }
+    }
+
+    if (sWakeTimerArmed)
+    {
+        os_timer_disarm(&sWakeTimer);
+        sWakeTimerArmed = false;
+    }
+    if (next_ms == 0)
+    {
+        scheduleTasks();
+    }
+    else if (next_ms != UINT32_MAX)
+    {
+        // long timeouts are split, the round after expiry arms the rest
+        if (next_ms > 60000)
+        {
+            next_ms = 60000;
+        }
+        os_timer_setfn(&sWakeTimer, (os_timer_func_t*)&wakeTimerExpired, nullptr);
+        os_timer_arm(&sWakeTimer, next_ms, 0);
+        sWakeTimerArmed = true;
+    }
+
+    sRunning = false;
+}
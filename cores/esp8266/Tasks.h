@@ -0,0 +1,78 @@
+/*
+ Tasks.h - cooperative tasks on their own cont stacks
+ Copyright (c) 2020 esp8266/Arduino
+
+ This file is part of the esp8266 core for Arduino environment.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ESP_TASKS_H
+#define ESP_TASKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+// Tasks run in CONT next to loop(), each on its own stack. A task runs
+// until it calls yield(), delay(), esp_suspend() or one of the functions
+// below, and other tasks and loop() run in the meantime. Blocking library
+// calls that wait with delay() or esp_delay(), like WiFiClient::connect(),
+// only block their own task.
+//
+// Ready tasks are resumed after every loop() and whenever loop() itself
+// yields or delays. Only the ready tasks of the highest priority level are
+// resumed, each once per round. A task is deleted when its function returns.
+//
+// None of these functions may be called from an interrupt, except task_signal().
+
+#ifndef TASK_STACKSIZE
+#define TASK_STACKSIZE 2048
+#endif
+
+struct task_t;
+
+// Set by task_signal(), cleared by the task_wait() it wakes up
+struct task_event_t
+{
+    volatile bool signaled = false;
+};
+
+// stackSize is rounded up to a multiple of 16. With iramStack, the stack is
+// taken from the IRAM heap (MMU_IRAM_HEAP) when there is room, 8 and 16 bit
+// accesses to it then go through the non32xfer exception handler.
+// Returns nullptr when there is no memory.
+task_t* task_create(const std::function<void(void)>& fn, size_t stackSize = TASK_STACKSIZE,
+    uint8_t priority = 0, bool iramStack = false);
+
+// The running task, nullptr in loop()
+task_t* task_current();
+
+// Resumes in the next round, same as yield() in a task
+void task_yield();
+
+// Resumes after ms milliseconds, same as delay() in a task
+void task_sleep(uint32_t ms);
+
+// Waits until event is signaled or timeout_ms has passed, returns true when signaled.
+// In loop(), polls the event with delay().
+bool task_wait(task_event_t* event, uint32_t timeout_ms = UINT32_MAX);
+
+void task_signal(task_event_t* event);
+
+// Stack high water mark, as cont_get_free_stack(). With nullptr, of the running task
+// or, called from loop(), of the loop() stack.
+int task_get_free_stack(task_t* task = nullptr);
+
+size_t task_count();
+
+#endif // ESP_TASKS_H
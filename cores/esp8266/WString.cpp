@@ -33,6 +33,34 @@
 #define __STRHELPER(x) #x
 #define STR(x) __STRHELPER(x) // stringifier
 
+/*********************************************/
+/*  IRAM heap buffers                        */
+/*********************************************/
+
+#if defined(MMU_IRAM_HEAP)
+// A buffer allocated from the IRAM heap only takes 32-bit access. Route the
+// copies, fills and terminators made here through the mmu_ variants, which
+// keep the library routines for DRAM and read PROGMEM with 32-bit loads.
+#undef memcpy_P
+#undef memmove_P
+#define memcpy(dst, src, n)    mmu_memcpy(dst, src, n)
+#define memcpy_P(dst, src, n)  mmu_memcpy(dst, src, n)
+#define memmove(dst, src, n)   mmu_memmove(dst, src, n)
+#define memmove_P(dst, src, n) mmu_memmove(dst, src, n)
+#define memset(dst, c, n)      mmu_memset(dst, c, n)
+
+static inline __attribute__((always_inline)) void setBufferChar(char *p, char c) {
+    if (mmu_is_iram(p))
+        mmu_set_uint8(p, (uint8_t)c);
+    else
+        *p = c;
+}
+#else
+static inline __attribute__((always_inline)) void setBufferChar(char *p, char c) {
+    *p = c;
+}
+#endif
+
 /*********************************************/
 /*  Conversion helpers                       */
 /*********************************************/
@@ -191,7 +219,7 @@ bool String::reserve(unsigned int size) {
         return true;
     if (changeBuffer(size)) {
         if (len() == 0)
-            wbuffer()[0] = 0;
+            setBufferChar(wbuffer(), 0);
         return true;
     }
     return false;
@@ -277,7 +305,7 @@ String &String::copy(const char *cstr, unsigned int length) {
     }
     setLen(length);
     memmove_P(wbuffer(), cstr, length);
-    wbuffer()[length] = 0;
+    setBufferChar(wbuffer() + length, 0);
     return *this;
 }
 
@@ -288,7 +316,7 @@ String &String::copy(const __FlashStringHelper *pstr, unsigned int length) {
     }
     setLen(length);
     memcpy_P(wbuffer(), (PGM_P)pstr, length); // We know wbuffer() cannot ever be in PROGMEM, so memcpy safe here
-    wbuffer()[length] = 0;
+    setBufferChar(wbuffer() + length, 0);
     return *this;
 }
 
@@ -353,7 +381,7 @@ bool String::concat(const String &s) {
             return false;
         memmove_P(wbuffer() + len(), buffer(), len());
         setLen(newlen);
-        wbuffer()[newlen] = 0;
+        setBufferChar(wbuffer() + newlen, 0);
         return true;
     } else {
         return concat(s.buffer(), s.len());
@@ -370,7 +398,7 @@ bool String::concat(const char *cstr, unsigned int length) {
         return false;
     memmove_P(wbuffer() + len(), cstr, length);
     setLen(newlen);
-    wbuffer()[newlen] = 0;
+    setBufferChar(wbuffer() + newlen, 0);
     return true;
 }
 
@@ -431,7 +459,7 @@ bool String::concat(const __FlashStringHelper *str) {
         return false;
     memcpy_P(wbuffer() + len(), (PGM_P)str, length);
     setLen(newlen);
-    wbuffer()[newlen] = 0;
+    setBufferChar(wbuffer() + newlen, 0);
     return true;
 }
 
@@ -454,7 +482,7 @@ String &String::insert(size_t position, const char *other, size_t other_length)
     auto *start = wbuffer() + position;
     memmove(start + other_length, start, left);
     memmove_P(start, other, other_length);
-    wbuffer()[total] = '\0';
+    setBufferChar(wbuffer() + total, '\0');
 
     return *this;
 }
@@ -661,7 +689,7 @@ bool String::endsWith(const __FlashStringHelper *suffix) const {
 
 void String::setCharAt(unsigned int loc, char c) {
     if (loc < len())
-        wbuffer()[loc] = c;
+        setBufferChar(wbuffer() + loc, c);
 }
 
 char &String::operator[](unsigned int index) {
@@ -828,7 +856,7 @@ void String::replace(const String &find, const String &replace) {
             int newLen = len() + diff;
             memmove_P(wbuffer() + index, replace.buffer(), replace.len());
             setLen(newLen);
-            wbuffer()[newLen] = 0;
+            setBufferChar(wbuffer() + newLen, 0);
             index--;
         }
     }
@@ -866,7 +894,7 @@ void String::remove(unsigned int index, unsigned int count) {
     unsigned int newlen = len() - count;
     setLen(newlen);
     memmove_P(writeTo, wbuffer() + index + count, newlen - index);
-    wbuffer()[newlen] = 0;
+    setBufferChar(wbuffer() + newlen, 0);
 }
 
 void String::toLowerCase(void) {
@@ -898,7 +926,7 @@ void String::trim(void) {
     setLen(newlen);
     if (begin > buffer())
         memmove_P(wbuffer(), begin, newlen);
-    wbuffer()[newlen] = 0;
+    setBufferChar(wbuffer() + newlen, 0);
 }
 
 /*********************************************/
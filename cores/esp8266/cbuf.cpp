@@ -21,6 +21,34 @@
 #include <new> // std::nothrow
 #include "cbuf.h"
 #include "c_types.h"
+#include "mmu_iram.h"
+
+#if defined(MMU_IRAM_HEAP)
+// A buffer allocated from the IRAM heap only takes 32-bit access, keep the
+// byte accesses out of the non32-bit exception handler.
+static inline __attribute__((always_inline)) char get_char(const char* p) {
+    return mmu_is_iram(p) ? (char)mmu_get_uint8(p) : *p;
+}
+
+static inline __attribute__((always_inline)) void set_char(char* p, char c) {
+    if(mmu_is_iram(p)) {
+        mmu_set_uint8(p, (uint8_t)c);
+    } else {
+        *p = c;
+    }
+}
+
+#define memcpy mmu_memcpy
+#define memset mmu_memset
+#else
+static inline __attribute__((always_inline)) char get_char(const char* p) {
+    return *p;
+}
+
+static inline __attribute__((always_inline)) void set_char(char* p, char c) {
+    *p = c;
+}
+#endif
 
 cbuf::cbuf(size_t size) :
     next(NULL), _size(size), _buf(new char[size]), _bufend(_buf + size), _begin(_buf), _end(_begin) {
@@ -89,7 +117,7 @@ int cbuf::peek() {
     if(empty())
         return -1;
 
-    return static_cast<int>(*_begin);
+    return static_cast<int>(get_char(_begin));
 }
 
 size_t cbuf::peek(char *dst, size_t size) {
@@ -112,7 +140,7 @@ int IRAM_ATTR cbuf::read() {
     if(empty())
         return -1;
 
-    char result = *_begin;
+    char result = get_char(_begin);
     _begin = wrap_if_bufend(_begin + 1);
     return static_cast<int>(result);
 }
@@ -137,7 +165,7 @@ size_t IRAM_ATTR cbuf::write(char c) {
     if(full())
         return 0;
 
-    *_end = c;
+    set_char(_end, c);
     _end = wrap_if_bufend(_end + 1);
     return 1;
 }
@@ -22,6 +22,7 @@
 #define CONT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifndef CONT_STACKSIZE
 #define CONT_STACKSIZE 4096
@@ -51,9 +52,17 @@ typedef struct cont_ {
 
 extern cont_t* g_pcont;
 
+// Bytes needed for a cont_t with a stack of stack_size bytes instead of CONT_STACKSIZE,
+// stack_size must be a multiple of 16
+#define CONT_SIZE(stack_size) (sizeof(cont_t) - CONT_STACKSIZE + (stack_size))
+
 // Initialize the cont_t structure before calling cont_run
 void cont_init(cont_t*);
 
+// Initialize a cont_t allocated with CONT_SIZE(stack_size) bytes, aligned to 16 bytes.
+// Only stack_guard2 and struct_start are not at their usual place, they follow stack_end.
+void cont_init_size(cont_t*, size_t stack_size);
+
 // Run function pfn in a separate stack, or continue execution
 // at the point where cont_suspend was called
 void cont_run(cont_t*, void (*pfn)(void));
@@ -32,15 +32,20 @@ extern "C"
 static constexpr unsigned int CONT_STACKGUARD { 0xfeefeffe };
 
 void cont_init(cont_t* cont) {
-    memset(cont, 0, sizeof(cont_t));
-    
+    cont_init_size(cont, sizeof(cont->stack));
+}
+
+void cont_init_size(cont_t* cont, size_t stack_size) {
+    memset(cont, 0, CONT_SIZE(stack_size));
+
     cont->stack_guard1 = CONT_STACKGUARD;
-    cont->stack_guard2 = CONT_STACKGUARD;
-    cont->stack_end = cont->stack + (sizeof(cont->stack) / 4);
-    cont->struct_start = (unsigned*) cont;
-    
+    cont->stack_end = cont->stack + (stack_size / 4);
+    // stack_guard2 and struct_start, cont.S finds struct_start right after stack_end
+    cont->stack_end[0] = CONT_STACKGUARD;
+    cont->stack_end[1] = (unsigned) (uintptr_t) cont;
+
     // fill stack with magic values to check high water mark
-    for(int pos = 0; pos < (int)(sizeof(cont->stack) / 4); pos++)
+    for(int pos = 0; pos < (int)(stack_size / 4); pos++)
     {
         cont->stack[pos] = CONT_STACKGUARD;
     }
@@ -48,7 +53,7 @@ void cont_init(cont_t* cont) {
 
 void IRAM_ATTR cont_check(cont_t* cont) {
     if ((cont->stack_guard1 == CONT_STACKGUARD)
-     && (cont->stack_guard2 == CONT_STACKGUARD))
+     && (cont->stack_end[0] == CONT_STACKGUARD))
     {
         return;
     }
@@ -42,6 +42,7 @@ extern "C" {
 #include <umm_malloc/umm_malloc.h>
 #include <core_esp8266_non32xfer.h>
 #include "core_esp8266_vm.h"
+#include "core_esp8266_profiler.h"
 
 #define LOOP_TASK_PRIORITY 1
 #define LOOP_QUEUE_SIZE    1
@@ -67,6 +68,10 @@ static os_event_t s_loop_queue[LOOP_QUEUE_SIZE];
 /* Used to implement optimistic_yield */
 static uint32_t s_cycles_at_resume;
 
+/* Counts esp_schedule() calls, cooperative tasks waiting in esp_suspend()
+ * or esp_delay() are resumed when it changes */
+static volatile uint32_t s_schedule_count;
+
 /* For ets_intr_lock_nest / ets_intr_unlock_nest
  * Max nesting seen by SDK so far is 2.
  */
@@ -116,15 +121,57 @@ extern "C" bool can_yield() {
   return cont_can_suspend(g_pcont);
 }
 
+// Replaced by Tasks.cpp once cooperative tasks are used. Within a task,
+// suspends the task for at most ms, or until the next esp_schedule()
+// when ms is TASK_SUSPEND_SCHEDULED, and returns true.
+extern "C" bool __task_suspend(uint32_t ms) {
+    (void)ms;
+    return false;
+}
+
+extern "C" bool task_suspend(uint32_t ms) __attribute__ ((weak, alias("__task_suspend")));
+
+// Within a task, what it waits for in esp_delay(ms, blocked) or esp_suspend(blocked)
+extern "C" void __task_set_blocked(bool (*blocked)(void*), void* arg) {
+    (void)blocked;
+    (void)arg;
+}
+
+extern "C" void task_set_blocked(bool (*blocked)(void*), void* arg) __attribute__ ((weak, alias("__task_set_blocked")));
+
+extern "C" void __run_tasks() {
+}
+
+extern "C" void run_tasks() __attribute__ ((weak, alias("__run_tasks")));
+
+// The cont of the task whose stack holds sp, for the postmortem stack dump
+extern "C" cont_t* __task_find_cont(uint32_t sp) {
+    (void)sp;
+    return nullptr;
+}
+
+extern "C" cont_t* task_find_cont(uint32_t sp) __attribute__ ((weak, alias("__task_find_cont")));
+
+extern "C" uint32_t esp_schedule_count() {
+    return s_schedule_count;
+}
+
 static inline void esp_suspend_within_cont() __attribute__((always_inline));
 static void esp_suspend_within_cont() {
+        PROFILER_CONT_SUSPEND();
         cont_suspend(g_pcont);
+        PROFILER_CONT_RESUME();
         s_cycles_at_resume = ESP.getCycleCount();
         run_scheduled_recurrent_functions();
+        run_tasks();
 }
 
 extern "C" void __esp_suspend() {
+    if (task_suspend(TASK_SUSPEND_SCHEDULED)) {
+        return;
+    }
     if (cont_can_suspend(g_pcont)) {
+        PROFILER_YIELD_SITE();
         esp_suspend_within_cont();
     }
 }
@@ -132,6 +179,7 @@ extern "C" void __esp_suspend() {
 extern "C" void esp_suspend() __attribute__ ((weak, alias("__esp_suspend")));
 
 extern "C" IRAM_ATTR void esp_schedule() {
+    ++s_schedule_count;
     ets_post(LOOP_TASK_PRIORITY, 0, 0);
 }
 
@@ -140,6 +188,10 @@ extern "C" IRAM_ATTR void esp_schedule() {
 // whereever only called from CONT, use esp_yield() if code is called from SYS
 // or both CONT and SYS.
 extern "C" void esp_yield() {
+    if (task_suspend(0)) {
+        return;
+    }
+    PROFILER_YIELD_SITE();
     esp_schedule();
     esp_suspend();
 }
@@ -150,6 +202,10 @@ void delay_end(void* arg) {
 }
 
 extern "C" void __esp_delay(unsigned long ms) {
+    if (task_suspend(ms)) {
+        return;
+    }
+    PROFILER_YIELD_SITE();
     if (ms) {
         os_timer_setfn(&delay_timer, (os_timer_func_t*)&delay_end, 0);
         os_timer_arm(&delay_timer, ms, ONCE);
@@ -171,6 +227,9 @@ bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uin
         return true; // expired
     }
 
+    // charged to the function the esp_delay() template was inlined into, not to this one
+    PROFILER_YIELD_SITE();
+
     // compute greatest chunked delay with respect to scheduled recurrent functions
     uint32_t grain_ms = std::gcd(intvl_ms, compute_scheduled_recurrent_grain());
 
@@ -183,7 +242,11 @@ bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uin
 }
 
 extern "C" void __yield() {
+    if (task_suspend(0)) {
+        return;
+    }
     if (cont_can_suspend(g_pcont)) {
+        PROFILER_YIELD_SITE();
         esp_schedule();
         esp_suspend_within_cont();
     }
@@ -207,6 +270,7 @@ extern "C" void optimistic_yield(uint32_t interval_us) {
     if ((ESP.getCycleCount() - s_cycles_at_resume) > intvl_cycles &&
         can_yield())
     {
+        PROFILER_YIELD_SITE();
         yield();
     }
 }
@@ -249,6 +313,7 @@ extern "C" void loop_end (void) __attribute__ ((weak, alias("__loop_end")));
 
 static void loop_wrapper() {
     static bool setup_done = false;
+    PROFILER_LOOP_BEGIN();
     preloop_update_frequency();
     if(!setup_done) {
         setup();
@@ -256,11 +321,14 @@ static void loop_wrapper() {
     }
     loop();
     loop_end();
+    run_tasks();
     cont_check(g_pcont);
     if (serialEventRun) {
         serialEventRun();
     }
-    esp_schedule();
+    PROFILER_LOOP_END();
+    // not counted by esp_schedule(), waiting tasks only resume on outside events
+    ets_post(LOOP_TASK_PRIORITY, 0, 0);
 }
 
 extern "C" void __stack_chk_fail(void);
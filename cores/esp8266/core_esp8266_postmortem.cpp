@@ -243,10 +243,16 @@ static void postmortem_report(uint32_t sp_dump) {
         sp_dump = stack_thunk_get_cont_sp();
     }
 
+    cont_t* task_cont = nullptr;
     if (sp_dump > cont_stack_start && sp_dump < cont_stack_end) {
         ets_printf_P(PSTR("\nctx: cont\n"));
         stack_end = cont_stack_end;
     }
+    else if ((task_cont = task_find_cont(sp_dump))) {
+        // a cooperative task, see Tasks.h
+        ets_printf_P(PSTR("\nctx: task\n"));
+        stack_end = (uint32_t) task_cont->stack_end;
+    }
     else {
         ets_printf_P(PSTR("\nctx: sys\n"));
         stack_end = 0x3fffffb0;
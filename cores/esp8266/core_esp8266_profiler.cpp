@@ -0,0 +1,210 @@
+/*
+ core_esp8266_profiler.cpp - CONT time per loop iteration, yield site and scheduled function
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "core_esp8266_profiler.h"
+
+#ifdef ESP_LOOP_PROFILER
+
+#include <string.h>
+#include "Arduino.h"
+#include "Print.h"
+
+// site keys that are not code addresses
+#define SITE_LOOP_RETURN ((const void*)0)
+#define SITE_UNKNOWN ((const void*)1)
+#define SITE_OTHER ((const void*)2)
+
+struct profiler_stat_t
+{
+    const void* pc;
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t hist[PROFILER_HIST_BUCKETS];
+};
+
+static profiler_stat_t sLoop;
+static profiler_stat_t sFns[2];
+// the last entry collects the sites that do not fit
+static profiler_stat_t sSites[PROFILER_SITES];
+static size_t sSiteCount = 0;
+
+static const void* sSite = nullptr;
+static bool sSiteSet = false;
+static uint32_t sResumeCycles = 0;
+static uint32_t sIterationUs = 0;
+
+static uint32_t cyclesToUs(uint32_t cycles)
+{
+    return cycles / esp_get_cpu_freq_mhz();
+}
+
+static void record(profiler_stat_t& stat, uint32_t us)
+{
+    ++stat.count;
+    stat.total_us += us;
+    if (us > stat.max_us)
+    {
+        stat.max_us = us;
+    }
+
+    size_t bucket = 0;
+    while (bucket < PROFILER_HIST_BUCKETS - 1 && us >= (64UL << bucket))
+    {
+        ++bucket;
+    }
+    ++stat.hist[bucket];
+}
+
+static profiler_stat_t& siteStat(const void* pc)
+{
+    for (size_t i = 0; i < sSiteCount; ++i)
+    {
+        if (sSites[i].pc == pc)
+        {
+            return sSites[i];
+        }
+    }
+
+    if (sSiteCount < PROFILER_SITES - 1)
+    {
+        sSites[sSiteCount].pc = pc;
+        return sSites[sSiteCount++];
+    }
+
+    sSites[PROFILER_SITES - 1].pc = SITE_OTHER;
+    return sSites[PROFILER_SITES - 1];
+}
+
+static void endSlice(const void* site)
+{
+    const uint32_t us = cyclesToUs(esp_get_cycle_count() - sResumeCycles);
+    sIterationUs += us;
+    record(siteStat(site), us);
+    sSite = nullptr;
+    sSiteSet = false;
+}
+
+extern "C" void profiler_yield_site(const void* pc)
+{
+    if (!sSiteSet)
+    {
+        sSite = pc;
+        sSiteSet = true;
+    }
+}
+
+extern "C" void profiler_yield_site_clear(void)
+{
+    sSite = nullptr;
+    sSiteSet = false;
+}
+
+extern "C" void profiler_loop_begin(void)
+{
+    sResumeCycles = esp_get_cycle_count();
+    sIterationUs = 0;
+}
+
+extern "C" void profiler_loop_end(void)
+{
+    endSlice(SITE_LOOP_RETURN);
+    record(sLoop, sIterationUs);
+}
+
+extern "C" void profiler_cont_suspend(void)
+{
+    endSlice(sSiteSet ? sSite : SITE_UNKNOWN);
+}
+
+extern "C" void profiler_cont_resume(void)
+{
+    sResumeCycles = esp_get_cycle_count();
+}
+
+extern "C" void profiler_fn_end(int kind, uint32_t start_cycles)
+{
+    record(sFns[kind], cyclesToUs(esp_get_cycle_count() - start_cycles));
+}
+
+extern "C" void profiler_reset(void)
+{
+    memset(&sLoop, 0, sizeof(sLoop));
+    memset(sFns, 0, sizeof(sFns));
+    memset(sSites, 0, sizeof(sSites));
+    sSiteCount = 0;
+}
+
+static void dumpStat(Print& out, const profiler_stat_t& stat)
+{
+    out.printf_P(PSTR(" n=%u avg=%uus max=%uus |"), stat.count,
+        stat.count ? (unsigned)(stat.total_us / stat.count) : 0, stat.max_us);
+    for (size_t bucket = 0; bucket < PROFILER_HIST_BUCKETS; ++bucket)
+    {
+        out.printf_P(PSTR(" %u"), stat.hist[bucket]);
+    }
+    out.println();
+}
+
+void profiler_dump(Print& out)
+{
+    // copied first, dumping may yield and add to the statistics
+    profiler_stat_t loop = sLoop;
+    profiler_stat_t fns[2] = { sFns[0], sFns[1] };
+    profiler_stat_t sites[PROFILER_SITES];
+    memcpy(sites, sSites, sizeof(sites));
+    size_t siteCount = sSiteCount;
+    if (sites[PROFILER_SITES - 1].pc == SITE_OTHER)
+    {
+        siteCount = PROFILER_SITES;
+    }
+
+    out.print(F("profiler: histograms from <64us, doubling, to >="));
+    out.print(64UL << (PROFILER_HIST_BUCKETS - 2));
+    out.println(F("us"));
+    out.print(F("loop iteration cont time:"));
+    dumpStat(out, loop);
+    out.print(F("scheduled functions:"));
+    dumpStat(out, fns[PROFILER_SCHEDULED]);
+    out.print(F("recurrent functions:"));
+    dumpStat(out, fns[PROFILER_RECURRENT]);
+
+    out.println(F("cont slices by yield site:"));
+    for (size_t i = 0; i < siteCount; ++i)
+    {
+        if (sites[i].pc == SITE_LOOP_RETURN)
+        {
+            out.print(F("  loop() return   "));
+        }
+        else if (sites[i].pc == SITE_UNKNOWN)
+        {
+            out.print(F("  unknown         "));
+        }
+        else if (sites[i].pc == SITE_OTHER)
+        {
+            out.print(F("  other sites     "));
+        }
+        else
+        {
+            out.printf_P(PSTR("  pc 0x%08x   "), (uint32_t)(uintptr_t)sites[i].pc);
+        }
+        dumpStat(out, sites[i]);
+    }
+}
+
+#endif // ESP_LOOP_PROFILER
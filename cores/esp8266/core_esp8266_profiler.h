@@ -0,0 +1,95 @@
+/*
+ core_esp8266_profiler.h - CONT time per loop iteration, yield site and scheduled function
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CORE_ESP8266_PROFILER_H
+#define CORE_ESP8266_PROFILER_H
+
+// Built with -DESP_LOOP_PROFILER, the core measures how long CONT runs
+// before handing the CPU back to SYS. Each such slice is charged to the
+// code that yielded, by the return address of its yield(), delay(),
+// esp_yield(), esp_suspend() or esp_delay() call, or to loop() returning.
+// Loop iterations, scheduled functions and recurrent scheduled functions
+// are measured as well. Without the define all hooks compile to nothing.
+
+#include <stdint.h>
+
+#ifndef PROFILER_SITES
+#define PROFILER_SITES 16
+#endif
+
+// Histogram bucket 0 counts durations below 64us, each next one up to twice as long,
+// the last one everything longer
+#define PROFILER_HIST_BUCKETS 12
+
+#ifdef ESP_LOOP_PROFILER
+
+#include "core_esp8266_features.h"
+
+enum profiler_fn_kind_t
+{
+    PROFILER_SCHEDULED,
+    PROFILER_RECURRENT,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void profiler_yield_site(const void* pc);
+void profiler_yield_site_clear(void);
+void profiler_loop_begin(void);
+void profiler_loop_end(void);
+void profiler_cont_suspend(void);
+void profiler_cont_resume(void);
+void profiler_fn_end(int kind, uint32_t start_cycles);
+
+// Clears all statistics
+void profiler_reset(void);
+
+#ifdef __cplusplus
+}
+
+class Print;
+void profiler_dump(Print& out);
+#endif
+
+// The first site set since the last suspension is the one charged,
+// that is the outermost of nested yield functions
+#define PROFILER_YIELD_SITE() profiler_yield_site(__builtin_return_address(0))
+#define PROFILER_YIELD_SITE_CLEAR() profiler_yield_site_clear()
+#define PROFILER_LOOP_BEGIN() profiler_loop_begin()
+#define PROFILER_LOOP_END() profiler_loop_end()
+#define PROFILER_CONT_SUSPEND() profiler_cont_suspend()
+#define PROFILER_CONT_RESUME() profiler_cont_resume()
+#define PROFILER_FN_BEGIN() const uint32_t profilerStart = esp_get_cycle_count()
+#define PROFILER_FN_END(kind) profiler_fn_end((kind), profilerStart)
+
+#else
+
+#define PROFILER_YIELD_SITE() do { } while (0)
+#define PROFILER_YIELD_SITE_CLEAR() do { } while (0)
+#define PROFILER_LOOP_BEGIN() do { } while (0)
+#define PROFILER_LOOP_END() do { } while (0)
+#define PROFILER_CONT_SUSPEND() do { } while (0)
+#define PROFILER_CONT_RESUME() do { } while (0)
+#define PROFILER_FN_BEGIN() do { } while (0)
+#define PROFILER_FN_END(kind) do { } while (0)
+
+#endif // ESP_LOOP_PROFILER
+
+#endif // CORE_ESP8266_PROFILER_H
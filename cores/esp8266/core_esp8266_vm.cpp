@@ -38,10 +38,18 @@
  and then return to the calling application.
 
  We use the hardware SPI interface to talk to an external SRAM/PSRAM, and
- implement a simple cache to minimize the amount of times we actually need
- to go out over the (slow) SPI bus.  The SPI is set up in a DIO mode which
+ implement a set-associative, write-back cache to minimize the amount of times
+ we actually need to go out over the (slow) SPI bus.  Its geometry is set by
+ VM_CACHE_SETS, VM_CACHE_WAYS and VM_CACHE_LINE_WORDS, and with
+ VM_CACHE_PREFETCH a miss that continues a sequential stream also reads the
+ following line in the same transaction.  The SPI is set up in a DIO mode which
  uses no more pins than normal SPI, but provides for ~2X faster transfers.
 
+ Every emulated load or store costs an exception.  Code moving large blocks,
+ like frame buffers, should use vm_memcpy()/vm_memset(), which stream up to
+ 64 bytes per SPI transaction and only consult the cache for coherency.
+ vm_get_stats() reports traps, cache hits, misses, prefetches and writebacks.
+
  NOTE: This works fine for processor accesses, but cannot be used by any
  of the peripherals' DMA.  For that, we'd need a real MMU.
 
@@ -66,6 +74,7 @@
 #include "esp8266_peri.h"
 #include "core_esp8266_vm.h"
 #include "core_esp8266_non32xfer.h"
+#include "interrupts.h"
 #include "umm_malloc/umm_malloc.h"
 
 
@@ -144,22 +153,48 @@ typedef enum { sio = 0, dio = 1 } iotype;
 
 constexpr int read_delay = (hspi_mode == dio) ? 4-1 : 0;
 
-constexpr int cache_ways = 4;   // N-way, fully associative cache
-constexpr int cache_words = 16; // Must be 16 words or smaller to fit in SPI buffer
+// Cache geometry, overridable from the build flags.  Lines are read and
+// written back in a single SPI transaction, so a line is at most 16 words.
+#ifndef VM_CACHE_SETS
+#define VM_CACHE_SETS 4        // Power of two, 1 makes the cache fully associative
+#endif
+#ifndef VM_CACHE_WAYS
+#define VM_CACHE_WAYS 2        // 0 disables the cache, every access goes to the SPI RAM
+#endif
+#ifndef VM_CACHE_LINE_WORDS
+#define VM_CACHE_LINE_WORDS 8  // Power of two, 16 or smaller to fit in the SPI buffer
+#endif
+#ifndef VM_CACHE_PREFETCH
+#define VM_CACHE_PREFETCH 1    // On sequential misses, also read the following line
+#endif
+
+constexpr int cache_sets = VM_CACHE_SETS;
+constexpr int cache_ways = VM_CACHE_WAYS;
+constexpr int cache_words = VM_CACHE_LINE_WORDS;
+constexpr int cache_line_bytes = cache_words * 4;
+static_assert(cache_sets > 0 && (cache_sets & (cache_sets - 1)) == 0, "VM_CACHE_SETS must be a power of two");
+static_assert(cache_words > 0 && cache_words <= 16 && (cache_words & (cache_words - 1)) == 0, "VM_CACHE_LINE_WORDS must be a power of two, at most 16");
+
+// Prefetching reads two lines in one transaction, so both must fit in the SPI buffer
+constexpr bool cache_prefetch = VM_CACHE_PREFETCH && cache_words <= 8 && cache_ways > 0;
 
 static struct cache_line {
   int32_t addr;            // Address, lower bits masked off
   int dirty;               // Needs writeback
-  struct cache_line *next; // We'll keep linked list in MRU order
+  uint32_t used;           // __vm_tick at last use, the LRU way of a set has the lowest
   union {
     uint32_t w[cache_words];
     uint16_t s[cache_words * 2];
     uint8_t  b[cache_words * 4];
   };
-} __vm_cache_line[cache_ways];
+} __vm_cache_line[cache_sets][cache_ways > 0 ? cache_ways : 1];
 static struct cache_line *__vm_cache; // Always points to MRU (hence the line being read/written)
+static uint32_t __vm_tick;
+static int32_t __vm_sequential_addr = -1; // Line a sequential stream would miss next
+
+static vm_stats_t __vm_stats;
 
-constexpr int addrmask = ~(sizeof(__vm_cache[0].w)-1); // Helper to mask off bits present in cache entry
+constexpr int addrmask = ~(cache_line_bytes-1); // Helper to mask off bits present in cache entry
 
 
 static void spi_init(spi_regs *spi1)
@@ -216,53 +251,97 @@ inline IRAM_ATTR uint32_t spi_readtransaction(spi_regs *spi1, int addr, int addr
   return spi1->spi_w[0];
 }
 
+static inline IRAM_ATTR void spi_waitidle(spi_regs *spi1)
+{
+  while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
+}
+
+static inline IRAM_ATTR struct cache_line *cache_set(int addr)
+{
+  return __vm_cache_line[(addr / cache_line_bytes) & (cache_sets - 1)];
+}
+
+// Returns the cached line holding the line aligned addr, or NULL
+static inline IRAM_ATTR struct cache_line *cache_lookup(int addr)
+{
+  struct cache_line *set = cache_set(addr);
+  for (auto i = 0; i < cache_ways; i++) {
+    if (set[i].addr == addr) return &set[i];
+  }
+  return NULL;
+}
+
+// Least recently used way in the set of addr
+static inline IRAM_ATTR struct cache_line *cache_victim(int addr)
+{
+  struct cache_line *set = cache_set(addr);
+  struct cache_line *victim = &set[0];
+  for (auto i = 1; i < cache_ways; i++) {
+    if ((int32_t)(set[i].used - victim->used) < 0) victim = &set[i];
+  }
+  return victim;
+}
+
 static inline IRAM_ATTR void cache_flushrefill(spi_regs *spi1, int addr)
 {
   addr &= addrmask;
-  struct cache_line *way = __vm_cache;
 
-  if (__vm_cache->addr == addr) return; // Fast case, it already is the MRU
-  struct cache_line *last = way;
-  way = way->next;
+  if (__vm_cache->addr == addr) { // Fast case, it already is the MRU
+    __vm_stats.hits++;
+    return;
+  }
 
-  for (auto i = 1; i < cache_ways; i++) {
-    if (way->addr == addr) {
-      last->next = way->next;
-      way->next = __vm_cache;
-      __vm_cache = way;
-      return;
-    } else {
-      last = way;
-      way = way->next;
-    }
+  struct cache_line *line = cache_lookup(addr);
+  if (line) {
+    __vm_stats.hits++;
+    line->used = ++__vm_tick;
+    __vm_cache = line;
+    return;
   }
 
-  // At this point we know the line is not in the cache and way points to the LRU.
+  // At this point we know the line is not in the cache, replace the LRU way of its set
+  __vm_stats.misses++;
+  line = cache_victim(addr);
+
+  // A miss right after the previous miss' lines is a sequential stream, bring in the following
+  // line in the same transaction unless it is cached or that would evict a dirty line
+  struct cache_line *next = NULL;
+  if (cache_prefetch && addr == __vm_sequential_addr && !cache_lookup(addr + cache_line_bytes)) {
+    next = cache_victim(addr + cache_line_bytes);
+    if (next == line || next->dirty) next = NULL;
+  }
+  __vm_sequential_addr = addr + (next ? 2 : 1) * cache_line_bytes;
 
   // We allow reads to go before writes since the write can happen in the background.
   // We need to keep the data to be written back since it will be overwritten with read data
   uint32_t wb[cache_words];
-  if (last->dirty) {
-    memcpy(wb, last->w, sizeof(last->w));
+  if (line->dirty) {
+    memcpy(wb, line->w, sizeof(line->w));
   }
 
-  // Update MRU info, list
-  last->next = __vm_cache;
-  __vm_cache = last;
-
   // Do the actual read
-  spi_readtransaction(spi1, (0x03 << 24) | addr, 32-1, read_delay, sizeof(last->w) * 8 - 1, hspi_mode);
-  memcpy(last->w, spi1->spi_w, sizeof(last->w));
+  int read_bytes = (next ? 2 : 1) * sizeof(line->w);
+  spi_readtransaction(spi1, (0x03 << 24) | addr, 32-1, read_delay, read_bytes * 8 - 1, hspi_mode);
+  memcpy(line->w, spi1->spi_w, sizeof(line->w));
+  if (next) {
+    memcpy(next->w, &spi1->spi_w[cache_words], sizeof(next->w));
+    next->addr = addr + cache_line_bytes;
+    next->used = __vm_tick; // Not used yet, so older than line
+    __vm_stats.prefetches++;
+  }
 
   // We fire a background writeback now, if needed
-  if (last->dirty) {
+  if (line->dirty) {
     memcpy(spi1->spi_w, wb, sizeof(wb));
-    spi_writetransaction(spi1, (0x02 << 24) | last->addr, 32-1, 0, sizeof(last->w) * 8 - 1, hspi_mode);
-    last->dirty = 0;
+    spi_writetransaction(spi1, (0x02 << 24) | line->addr, 32-1, 0, sizeof(line->w) * 8 - 1, hspi_mode);
+    line->dirty = 0;
+    __vm_stats.writebacks++;
   }
 
   // Update the addr at this point since we no longer need the old one
-  last->addr = addr;
+  line->addr = addr;
+  line->used = ++__vm_tick;
+  __vm_cache = line;
 }
 
 static inline IRAM_ATTR void spi_ramwrite(spi_regs *spi1, int addr, int data_bits, uint32_t val)
@@ -318,6 +397,7 @@ static IRAM_ATTR void loadstore_exception_handler(struct __exception_frame *ef,
 
   DECLARE_SPI1;
   ef->epc += (insn & SHORT_MASK) ? 2 : 3; // resume at following instruction
+  __vm_stats.traps++;
 
   int regno = (insn & 0x0000f0u) >> 4;
   if (regno != 0) --regno;  // account for skipped a1 in exception_frame
@@ -345,6 +425,138 @@ static IRAM_ATTR void loadstore_exception_handler(struct __exception_frame *ef,
   }
 }
 
+static inline bool is_vm(const void *p)
+{
+  return ((uint32_t)p >> 28) == 1;
+}
+
+// Copy up to one SPI buffer (64 bytes) between VM and RAM without going through
+// the exception handler.  Cached lines in the range are used for reads and kept
+// up to date on writes, other lines are streamed without being cached so bulk
+// transfers do not evict the working set.
+static void vm_read_chunk(spi_regs *spi1, uint8_t *dst, int addr, size_t len)
+{
+  int line_addr = addr & addrmask;
+  struct cache_line *line = cache_lookup(line_addr);
+  if (line && addr + (int)len <= line_addr + cache_line_bytes) {
+    __vm_stats.hits++;
+    memcpy(dst, &line->b[addr - line_addr], len);
+    return;
+  }
+
+  // Word aligned read, the SPI buffer can only be accessed 32 bits at a time
+  int start = addr & ~3;
+  int words = (addr + len - start + 3) / 4;
+  uint32_t buf[16];
+  spi_readtransaction(spi1, (0x03 << 24) | start, 32-1, read_delay, words * 32 - 1, hspi_mode);
+  for (int i = 0; i < words; i++) buf[i] = spi1->spi_w[i];
+
+  // Dirty lines hold newer data than the SPI RAM
+  for (int a = start & addrmask; a < start + words * 4; a += cache_line_bytes) {
+    struct cache_line *cached = cache_lookup(a);
+    if (cached && cached->dirty) {
+      int from = a > start ? a : start;
+      int to = a + cache_line_bytes < start + words * 4 ? a + cache_line_bytes : start + words * 4;
+      memcpy((uint8_t *)buf + from - start, &cached->b[from - a], to - from);
+    }
+  }
+  memcpy(dst, (uint8_t *)buf + addr - start, len);
+}
+
+static void vm_write_chunk(spi_regs *spi1, int addr, const uint8_t *src, size_t len)
+{
+  // Keep cached copies current, their dirty state does not change
+  for (int a = addr & addrmask; a < addr + (int)len; a += cache_line_bytes) {
+    struct cache_line *cached = cache_lookup(a);
+    if (cached) {
+      int from = a > addr ? a : addr;
+      int to = a + cache_line_bytes < addr + (int)len ? a + cache_line_bytes : addr + len;
+      memcpy(&cached->b[from - a], src + from - addr, to - from);
+    }
+  }
+
+  uint32_t buf[16];
+  memcpy(buf, src, len);
+  spi_waitidle(spi1); // A background write may still be sending the SPI buffer
+  for (size_t i = 0; i < (len + 3) / 4; i++) spi1->spi_w[i] = buf[i];
+  spi_writetransaction(spi1, (0x02 << 24) | addr, 32-1, 0, len * 8 - 1, hspi_mode);
+}
+
+void *vm_memcpy(void *dst, const void *src, size_t n)
+{
+  if (!is_vm(dst) && !is_vm(src)) {
+    return memcpy(dst, src, n);
+  }
+
+  DECLARE_SPI1;
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  __vm_stats.bulk_bytes += n;
+
+  while (n) {
+    // Chunks never cross a 64 byte boundary on the VM side so they fit in the SPI buffer
+    const uint8_t *vm = is_vm(d) ? d : s;
+    size_t len = 64 - ((uint32_t)vm & 63);
+    if (len > n) len = n;
+    if (is_vm(s) && is_vm(d)) {
+      size_t dlen = 64 - ((uint32_t)d & 63);
+      size_t slen = 64 - ((uint32_t)s & 63);
+      len = dlen < slen ? dlen : slen;
+      if (len > n) len = n;
+    }
+
+    esp8266::InterruptLock irqLock; // The exception handler shares the cache and the SPI bus
+    if (is_vm(s) && is_vm(d)) {
+      uint8_t buf[64];
+      vm_read_chunk(spi1, buf, (uint32_t)s & VM_OFFSET_MASK, len);
+      vm_write_chunk(spi1, (uint32_t)d & VM_OFFSET_MASK, buf, len);
+    } else if (is_vm(s)) {
+      vm_read_chunk(spi1, d, (uint32_t)s & VM_OFFSET_MASK, len);
+    } else {
+      vm_write_chunk(spi1, (uint32_t)d & VM_OFFSET_MASK, s, len);
+    }
+    d += len;
+    s += len;
+    n -= len;
+  }
+  return dst;
+}
+
+void *vm_memset(void *dst, int c, size_t n)
+{
+  if (!is_vm(dst)) {
+    return memset(dst, c, n);
+  }
+
+  DECLARE_SPI1;
+  uint8_t buf[64];
+  memset(buf, c, sizeof(buf));
+  uint8_t *d = (uint8_t *)dst;
+  __vm_stats.bulk_bytes += n;
+
+  while (n) {
+    size_t len = 64 - ((uint32_t)d & 63);
+    if (len > n) len = n;
+    esp8266::InterruptLock irqLock;
+    vm_write_chunk(spi1, (uint32_t)d & VM_OFFSET_MASK, buf, len);
+    d += len;
+    n -= len;
+  }
+  return dst;
+}
+
+void vm_get_stats(vm_stats_t *stats)
+{
+  esp8266::InterruptLock irqLock;
+  *stats = __vm_stats;
+}
+
+void vm_reset_stats()
+{
+  esp8266::InterruptLock irqLock;
+  memset(&__vm_stats, 0, sizeof(__vm_stats));
+}
+
 void install_vm_exception_handler()
 {
   __old_handler = _xtos_set_exception_handler(EXCCAUSE_LOAD_PROHIBITED, loadstore_exception_handler);
@@ -383,12 +595,14 @@ void install_vm_exception_handler()
 
   // Bring cache structures to baseline
   if (cache_ways > 0) {
-    for (auto i = 0; i < cache_ways; i++) {
-      __vm_cache_line[i].addr = -1; // Invalid, bits set in lower region so will never match
-      __vm_cache_line[i].next = &__vm_cache_line[i+1];
+    for (auto set = 0; set < cache_sets; set++) {
+      for (auto i = 0; i < cache_ways; i++) {
+        __vm_cache_line[set][i].addr = -1; // Invalid, bits set in lower region so will never match
+        __vm_cache_line[set][i].dirty = 0;
+        __vm_cache_line[set][i].used = 0;
+      }
     }
-    __vm_cache = &__vm_cache_line[0];
-    __vm_cache_line[cache_ways - 1].next = NULL;
+    __vm_cache = &__vm_cache_line[0][0];
   }
 
   // Our umm_malloc configuration can only support a maximum of 256K RAM. A
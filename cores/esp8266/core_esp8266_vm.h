@@ -1,11 +1,45 @@
+#ifndef CORE_ESP8266_VM_H
+#define CORE_ESP8266_VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern void install_vm_exception_handler();
 
+#ifdef MMU_EXTERNAL_HEAP
+
+typedef struct {
+  uint32_t traps;      // Loads and stores emulated by the exception handler
+  uint32_t hits;       // Accesses served from the cache
+  uint32_t misses;     // Lines read from the external RAM on demand
+  uint32_t prefetches; // Lines read ahead of a sequential miss
+  uint32_t writebacks; // Dirty lines written back to the external RAM
+  uint32_t bulk_bytes; // Bytes moved by vm_memcpy() and vm_memset()
+} vm_stats_t;
+
+// Bulk transfers to, from or within the external RAM window, streamed over
+// the SPI bus 64 bytes at a time instead of trapping on every word.  They
+// fall back to memcpy()/memset() for ordinary memory.
+extern void *vm_memcpy(void *dst, const void *src, size_t n);
+extern void *vm_memset(void *dst, int c, size_t n);
+
+extern void vm_get_stats(vm_stats_t *stats);
+extern void vm_reset_stats();
+
+#else
+
+static inline void *vm_memcpy(void *dst, const void *src, size_t n) { return memcpy(dst, src, n); }
+static inline void *vm_memset(void *dst, int c, size_t n) { return memset(dst, c, n); }
+
+#endif
 
 #ifdef __cplusplus
 };
 #endif
 
+#endif
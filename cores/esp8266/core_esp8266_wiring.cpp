@@ -24,6 +24,7 @@
 #include "osapi.h"
 #include "user_interface.h"
 #include "coredecls.h"
+#include "core_esp8266_profiler.h"
 
 extern "C" {
 
@@ -34,6 +35,7 @@ static uint32_t micros_overflow_count = 0;
 #define REPEAT 1
 
 void __delay(unsigned long ms) {
+    PROFILER_YIELD_SITE();
     // Use API letting recurrent scheduled functions run in background
     // but stay blocked in delay until ms is expired.
     esp_delay(ms, [](){ return true; });
@@ -27,6 +27,7 @@
 #include "user_interface.h"
 #include "core_esp8266_waveform.h"
 #include "interrupts.h"
+#include "FunctionalInterrupt.h"
 
 extern "C" {
 
@@ -116,31 +117,38 @@ typedef struct {
   bool functional;
 } interrupt_handler_t;
 
-//duplicate from functionalInterrupt.h keep in sync
-typedef struct InterruptInfo {
-	uint8_t pin;
-	uint8_t value;
-	uint32_t micro;
-} InterruptInfo;
-
-typedef struct {
-	InterruptInfo* interruptInfo;
-	void* functionInfo;
-} ArgStructure;
-
 static interrupt_handler_t interrupt_handlers[16] = { {0, 0, 0, 0}, };
 static uint32_t interrupt_reg = 0;
 
+extern void edgeCaptureScheduleDrain();
+
+// Append one edge to an edge capture ring, see attachEdgeCaptureInterrupt()
+static inline void IRAM_ATTR edge_capture_record(EdgeCaptureRing* ring, uint8_t pin, uint8_t value, uint32_t cycles)
+{
+  uint16_t head = ring->head;
+  if ((uint16_t)(head - ring->tail) > ring->mask) {
+    ring->overflows = ring->overflows + 1;
+    return;
+  }
+  EdgeEvent* edge = &ring->events[head & ring->mask];
+  edge->cycles = cycles;
+  edge->pin = pin;
+  edge->value = value;
+  ring->head = head + 1; // publish only once the event is written
+}
+
 void IRAM_ATTR interrupt_handler(void *arg, void *frame)
 {
   (void) arg;
   (void) frame;
+  uint32_t cycles = esp_get_cycle_count();
   uint32_t status = GPIE;
   GPIEC = status;//clear them interrupts
   uint32_t levels = GPI;
   if(status == 0 || interrupt_reg == 0) return;
   ETS_GPIO_INTR_DISABLE();
   int i = 0;
+  bool captured = false;
   uint32_t changedbits = status & interrupt_reg;
   while(changedbits){
     while(!(changedbits & (1 << i))) i++;
@@ -149,19 +157,20 @@ void IRAM_ATTR interrupt_handler(void *arg, void *frame)
     if (handler->fn && 
         (handler->mode == CHANGE || 
          (handler->mode & 1) == !!(levels & (1 << i)))) {
-          // to make ISR compatible to Arduino AVR model where interrupts are disabled
-          // we disable them before we call the client ISR
-          esp8266::InterruptLock irqLock; // stop other interrupts
           if (handler->functional)
           {
               ArgStructure* localArg = (ArgStructure*)handler->arg;
-              if (localArg && localArg->interruptInfo)
+              if (localArg && localArg->edgeCaptureRing)
               {
-                  localArg->interruptInfo->pin = i;
-                  localArg->interruptInfo->value = __digitalRead(i);
-                  localArg->interruptInfo->micro = micros();
+                  // no user code in the ISR, the edge is delivered later by the drainer
+                  edge_capture_record(localArg->edgeCaptureRing, i, !!(levels & (1 << i)), cycles);
+                  captured = true;
+                  continue;
               }
           }
+          // to make ISR compatible to Arduino AVR model where interrupts are disabled
+          // we disable them before we call the client ISR
+          esp8266::InterruptLock irqLock; // stop other interrupts
           if (handler->arg)
           {
               ((voidFuncPtrArg)handler->fn)(handler->arg);
@@ -172,6 +181,9 @@ void IRAM_ATTR interrupt_handler(void *arg, void *frame)
           }
       }
   }
+  if (captured) {
+    edgeCaptureScheduleDrain();
+  }
   ETS_GPIO_INTR_ENABLE();
 }
 
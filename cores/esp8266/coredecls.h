@@ -18,6 +18,15 @@ void esp_suspend();
 void esp_delay(unsigned long ms);
 void esp_schedule();
 void esp_yield();
+uint32_t esp_schedule_count();
+
+// cooperative task hooks, see Tasks.h
+#define TASK_SUSPEND_SCHEDULED 0xffffffff
+bool task_suspend(uint32_t ms);
+void task_set_blocked(bool (*blocked)(void*), void* arg);
+void run_tasks();
+cont_t* task_find_cont(uint32_t sp);
+
 void tune_timeshift64 (uint64_t now_us);
 bool sntp_set_timezone_in_seconds(int32_t timezone);
 
@@ -42,10 +51,29 @@ void settimeofday_cb (BoolCB&& cb);
 void settimeofday_cb (const BoolCB& cb);
 void settimeofday_cb (const TrivialCB& cb);
 
+// While a cooperative task waits in one of the overloads below, esp_schedule()
+// only resumes it once its blocked callback returns false.
+template <typename T>
+class esp_task_blocked {
+public:
+    explicit esp_task_blocked(T& blocked) {
+        task_set_blocked(&call, &blocked);
+    }
+    ~esp_task_blocked() {
+        task_set_blocked(nullptr, nullptr);
+    }
+
+private:
+    static bool call(void* blocked) {
+        return (*static_cast<T*>(blocked))();
+    }
+};
+
 // This overload of esp_suspend() performs the blocked callback whenever it is resumed,
 // and if that returns true, it immediately suspends again.
 template <typename T>
 inline void esp_suspend(T&& blocked) {
+    const esp_task_blocked<std::remove_reference_t<T>> task_blocked(blocked);
     do {
         esp_suspend();
     } while (blocked());
@@ -57,7 +85,8 @@ inline void esp_suspend(T&& blocked) {
 // remainder of timeout_ms, or an absolute intvl_ms, whichever is shorter
 // and possibly amended by recurrent scheduled functions timing grain.
 // The delay may be asynchronously cancelled, before that timeout is reached.
-bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uint32_t intvl_ms);
+// With ESP_LOOP_PROFILER, the delay is charged to the caller of esp_try_delay().
+bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uint32_t intvl_ms) __attribute__((noinline));
 
 // This overload of esp_delay() delays for a duration of at most timeout_ms milliseconds.
 // Whenever it is resumed, as well as at most every intvl_ms millisconds and depending on
@@ -65,6 +94,7 @@ bool esp_try_delay(const uint32_t start_ms, const uint32_t timeout_ms, const uin
 // it keeps delaying for the remainder of the original timeout_ms period.
 template <typename T>
 inline void esp_delay(const uint32_t timeout_ms, T&& blocked, const uint32_t intvl_ms) {
+    const esp_task_blocked<std::remove_reference_t<T>> task_blocked(blocked);
     const auto start_ms = millis();
     while (!esp_try_delay(start_ms, timeout_ms, intvl_ms) && blocked()) {
     }
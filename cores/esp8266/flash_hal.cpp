@@ -40,6 +40,14 @@ int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst) {
     }
 }
 
+const uint8_t *flash_hal_map(uint32_t addr, uint32_t size) {
+    // The cache always maps the first MB of flash
+    if ((addr >= 0x100000) || (size > 0x100000 - addr)) {
+        return nullptr;
+    }
+    return reinterpret_cast<const uint8_t *>(0x40200000 + addr);
+}
+
 int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src) {
     optimistic_yield(10000);
 
@@ -91,6 +91,11 @@ extern int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src)
 extern int32_t flash_hal_erase(uint32_t addr, uint32_t size);
 extern int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst);
 
+// Returns a pointer to the range in the memory-mapped flash window (first MB
+// at 0x40200000), or NULL if it is not entirely mapped.  On hardware the
+// result is not byte-addressable: use pgm_read_*() or memcpy_P().
+extern const uint8_t *flash_hal_map(uint32_t addr, uint32_t size);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
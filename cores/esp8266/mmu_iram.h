@@ -18,6 +18,7 @@
 #define __MMU_IRAM_H
 
 #include <stdint.h>
+#include <string.h>
 #include <c_types.h>
 #include <assert.h>
 #include <esp8266_undocumented.h>
@@ -282,6 +283,196 @@ int16_t mmu_set_int16(int16_t *p16, const int16_t val) {
   return val;
 }
 
+/*
+ * IRAM, the Boot ROM and ICACHE all sit on the instruction bus, where any
+ * access that is not an aligned 32-bit word raises an exception.
+ */
+static inline __attribute__((always_inline))
+bool mmu_is_32bit_only(const void *addr) {
+  const uintptr_t ibus_start = (uintptr_t)XCHAL_INSTRAM0_VADDR;
+  // The flash is mapped as a 1MB window starting at the ICACHE base
+  const uintptr_t ibus_end = (uintptr_t)XCHAL_INSTROM0_VADDR + 0x100000ul;
+  return (ibus_start <= (uintptr_t)addr && ibus_end > (uintptr_t)addr);
+}
+
+/*
+ * Aligned 32-bit word access for the block functions below. Masking the
+ * address tells the compiler the pointer is aligned, so __builtin_memcpy
+ * becomes a single `l32i`/`s32i`.
+ */
+static inline __attribute__((always_inline))
+uint32_t mmu_get_uint32_aligned(const void *p32) {
+  const void *v32 = (const void *)((uintptr_t)p32 & ~(uintptr_t)3u);
+  uint32_t val;
+  __builtin_memcpy(&val, v32, sizeof(uint32_t));
+  asm volatile ("" :"+r"(val));
+  return val;
+}
+
+static inline __attribute__((always_inline))
+void mmu_set_uint32_aligned(void *p32, uint32_t val) {
+  void *v32 = (void *)((uintptr_t)p32 & ~(uintptr_t)3u);
+  asm volatile ("" :"+r"(val));
+  __builtin_memcpy(v32, &val, sizeof(uint32_t));
+}
+
+/*
+ * Block operations built only from aligned 32-bit loads and stores. Whole
+ * words are moved a word at a time, only the unaligned ends fall back to the
+ * read-modify-write byte inlines above. Roughly 2 to 3 cycles per byte against
+ * the 230 or so cycles per byte taken through the non32-bit exception handler.
+ *
+ * Use these when one of the pointers is known to be in IRAM or ICACHE, else
+ * use the mmu_memcpy() family below which only take this path when needed.
+ *
+ * They are called from ISR paths (cbuf) and the heap, so when not inlined
+ * the out-of-line copies must be in IRAM too.
+ */
+static inline IRAM_ATTR
+void *mmu_memcpy32(void *dst, const void *src, size_t n) {
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+
+  for (; n && ((uintptr_t)d & 3u); --n) {
+    mmu_set_uint8(d++, mmu_get_uint8(s++));
+  }
+
+  if (n >= 4u) {
+    const uint32_t shift = ((uintptr_t)s & 3u) * 8u;
+    const uint8_t *sa = s - shift / 8u;
+    if (0u == shift) {
+      for (; n >= 4u; n -= 4u, d += 4u, sa += 4u) {
+        mmu_set_uint32_aligned(d, mmu_get_uint32_aligned(sa));
+      }
+    } else {
+      // Funnel each destination word out of two source words
+      uint32_t lo = mmu_get_uint32_aligned(sa);
+      for (; n >= 4u; n -= 4u, d += 4u, sa += 4u) {
+        uint32_t hi = mmu_get_uint32_aligned(sa + 4u);
+        mmu_set_uint32_aligned(d, (lo >> shift) | (hi << (32u - shift)));
+        lo = hi;
+      }
+    }
+    s = sa + shift / 8u;
+  }
+
+  for (; n; --n) {
+    mmu_set_uint8(d++, mmu_get_uint8(s++));
+  }
+  return dst;
+}
+
+static inline IRAM_ATTR
+void *mmu_memmove32(void *dst, const void *src, size_t n) {
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+
+  if (d <= s || d >= s + n) {
+    // A forward copy never overwrites source bytes it has yet to read
+    return mmu_memcpy32(dst, src, n);
+  }
+
+  d += n;
+  s += n;
+  if (0u == (((uintptr_t)d ^ (uintptr_t)s) & 3u)) {
+    for (; n && ((uintptr_t)d & 3u); --n) {
+      mmu_set_uint8(--d, mmu_get_uint8(--s));
+    }
+    for (; n >= 4u; n -= 4u) {
+      d -= 4u;
+      s -= 4u;
+      mmu_set_uint32_aligned(d, mmu_get_uint32_aligned(s));
+    }
+  }
+  for (; n; --n) {
+    mmu_set_uint8(--d, mmu_get_uint8(--s));
+  }
+  return dst;
+}
+
+static inline IRAM_ATTR
+void *mmu_memset32(void *dst, int c, size_t n) {
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t val = (uint8_t)c;
+
+  for (; n && ((uintptr_t)d & 3u); --n) {
+    mmu_set_uint8(d++, val);
+  }
+  const uint32_t val32 = 0x01010101u * val;
+  for (; n >= 4u; n -= 4u, d += 4u) {
+    mmu_set_uint32_aligned(d, val32);
+  }
+  for (; n; --n) {
+    mmu_set_uint8(d++, val);
+  }
+  return dst;
+}
+
+static inline IRAM_ATTR
+int mmu_memcmp32(const void *p1, const void *p2, size_t n) {
+  const uint8_t *a = (const uint8_t *)p1;
+  const uint8_t *b = (const uint8_t *)p2;
+
+  if (0u == (((uintptr_t)a ^ (uintptr_t)b) & 3u)) {
+    for (; n && ((uintptr_t)a & 3u); --n, ++a, ++b) {
+      int diff = (int)mmu_get_uint8(a) - (int)mmu_get_uint8(b);
+      if (diff) {
+        return diff;
+      }
+    }
+    // Skip over equal words, the byte loop below orders the first difference
+    for (; n >= 4u; n -= 4u, a += 4u, b += 4u) {
+      if (mmu_get_uint32_aligned(a) != mmu_get_uint32_aligned(b)) {
+        break;
+      }
+    }
+  }
+  for (; n; --n, ++a, ++b) {
+    int diff = (int)mmu_get_uint8(a) - (int)mmu_get_uint8(b);
+    if (diff) {
+      return diff;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Drop-in replacements for memcpy, memmove, memset and memcmp that keep the
+ * library versions for DRAM and switch to the 32-bit variants above when a
+ * pointer is in IRAM or ICACHE.
+ */
+static inline __attribute__((always_inline))
+void *mmu_memcpy(void *dst, const void *src, size_t n) {
+  if (mmu_is_32bit_only(dst) || mmu_is_32bit_only(src)) {
+    return mmu_memcpy32(dst, src, n);
+  }
+  return memcpy(dst, src, n);
+}
+
+static inline __attribute__((always_inline))
+void *mmu_memmove(void *dst, const void *src, size_t n) {
+  if (mmu_is_32bit_only(dst) || mmu_is_32bit_only(src)) {
+    return mmu_memmove32(dst, src, n);
+  }
+  return memmove(dst, src, n);
+}
+
+static inline __attribute__((always_inline))
+void *mmu_memset(void *dst, int c, size_t n) {
+  if (mmu_is_32bit_only(dst)) {
+    return mmu_memset32(dst, c, n);
+  }
+  return memset(dst, c, n);
+}
+
+static inline __attribute__((always_inline))
+int mmu_memcmp(const void *p1, const void *p2, size_t n) {
+  if (mmu_is_32bit_only(p1) || mmu_is_32bit_only(p2)) {
+    return mmu_memcmp32(p1, p2, n);
+  }
+  return memcmp(p1, p2, n);
+}
+
 #if (MMU_IRAM_SIZE > 32*1024) && !defined(MMU_SEC_HEAP)
 #define MMU_SEC_HEAP mmu_sec_heap()
 #define MMU_SEC_HEAP_SIZE mmu_sec_heap_size()
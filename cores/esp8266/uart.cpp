@@ -48,6 +48,7 @@
 #include "esp8266_peri.h"
 #include "user_interface.h"
 #include "uart_register.h"
+#include "Schedule.h"
 
 #define MODE2WIDTH(mode) (((mode%16)>>2)+5)
 #define MODE2STOP(mode) (((mode)>>5)+1)
@@ -81,6 +82,28 @@ extern "C" {
 static int s_uart_debug_nr = UART0;
 
 struct uart_rx_buffer_
+{
+    size_t size;
+    size_t rpos;
+    size_t wpos;
+    uint32_t in; // bytes ever stored, frame ends are counted in it
+    uint8_t * buffer;
+};
+
+// Frame mode state, ends[] holds rx_buffer->in as it was at each frame end
+struct uart_rx_frames_
+{
+    uint32_t ends[UART_RX_FRAMES];
+    uint8_t first;
+    uint8_t count;
+    uint8_t idle_chars;
+    volatile bool scheduled;
+    uart_rx_frame_cb_t callback;
+    void * callback_arg;
+};
+
+// Optional software TX ring, drained into the TX fifo by the TX-fifo-empty interrupt
+struct uart_tx_buffer_
 {
     size_t size;
     size_t rpos;
@@ -99,8 +122,13 @@ struct uart_
     uint8_t rx_pin;
     uint8_t tx_pin;
     struct uart_rx_buffer_ * rx_buffer;
+    struct uart_tx_buffer_ * tx_buffer; // NULL unless uart_resize_tx_buffer() was called
+    struct uart_rx_frames_ * rx_frames; // NULL unless uart_rx_frame_mode() was called
 };
 
+// UART0 and UART1 share one interrupt, uart_isr() serves the ones registered here
+static uart_t* s_uart_isr[2] = { NULL, NULL };
+
 
 /*
    In the context of the naming conventions in this file, "_unsafe" means two things:
@@ -122,11 +150,40 @@ uart_rx_fifo_available(const int uart_nr)
     return (USS(uart_nr) >> USRXC) & 0xFF;
 }
 
+// In frame mode the last fifo byte is left to the isr,
+// the rx-timeout interrupt only fires while the fifo holds data
+// called by ISR
+inline size_t IRAM_ATTR
+uart_rx_fifo_readable(const uart_t* uart)
+{
+    size_t avail = uart_rx_fifo_available(uart->uart_nr);
+    return (uart->rx_frames && avail)? avail - 1: avail;
+}
+
+/*
+  Reference for uart_tx_fifo_available() and uart_tx_fifo_full():
+  -Espressif Techinical Reference doc, chapter 11.3.7
+  -tools/sdk/uart_register.h
+  -cores/esp8266/esp8266_peri.h
+  */
+inline __attribute__((always_inline)) size_t
+uart_tx_fifo_available(const int uart_nr)
+{
+    return (USS(uart_nr) >> USTXC) & 0xff;
+}
+
+inline __attribute__((always_inline)) bool
+uart_tx_fifo_full(const int uart_nr)
+{
+    return uart_tx_fifo_available(uart_nr) >= 0x7f;
+}
+
 
 /**********************************************************/
 /************ UNSAFE FUNCTIONS ****************************/
 /**********************************************************/
-inline size_t
+// called by ISR
+inline size_t IRAM_ATTR
 uart_rx_buffer_available_unsafe(const struct uart_rx_buffer_ * rx_buffer)
 {
     if(rx_buffer->wpos < rx_buffer->rpos)
@@ -138,48 +195,167 @@ uart_rx_buffer_available_unsafe(const struct uart_rx_buffer_ * rx_buffer)
 inline size_t
 uart_rx_available_unsafe(uart_t* uart)
 {
-    return uart_rx_buffer_available_unsafe(uart->rx_buffer) + uart_rx_fifo_available(uart->uart_nr);
+    return uart_rx_buffer_available_unsafe(uart->rx_buffer) + uart_rx_fifo_readable(uart);
 }
 
 //#define UART_DISCARD_NEWEST
 
-// Copy all the rx fifo bytes that fit into the rx buffer
+// Store one byte read from the rx fifo, false when it was dropped
 // called by ISR
-inline void IRAM_ATTR
-uart_rx_copy_fifo_to_buffer_unsafe(uart_t* uart)
+inline bool IRAM_ATTR
+uart_rx_buffer_store_unsafe(uart_t* uart, uint8_t data)
 {
     struct uart_rx_buffer_ *rx_buffer = uart->rx_buffer;
 
-    while(uart_rx_fifo_available(uart->uart_nr))
+    size_t nextPos = (rx_buffer->wpos + 1) % rx_buffer->size;
+    if(nextPos == rx_buffer->rpos)
     {
-        size_t nextPos = (rx_buffer->wpos + 1) % rx_buffer->size;
-        if(nextPos == rx_buffer->rpos)
+        if (!uart->rx_overrun)
         {
-            if (!uart->rx_overrun)
-            {
-                uart->rx_overrun = true;
-                //os_printf_plus(overrun_str);
-            }
+            uart->rx_overrun = true;
+            //os_printf_plus(overrun_str);
+        }
 
-            // a choice has to be made here,
-            // do we discard newest or oldest data?
+        // a choice has to be made here,
+        // do we discard newest or oldest data?
 #ifdef UART_DISCARD_NEWEST
-            // discard newest data
-            // Stop copying if rx buffer is full
-            USF(uart->uart_nr);
-            break;
+        // discard newest data
+        return false;
 #else
-            // discard oldest data
-            if (++rx_buffer->rpos == rx_buffer->size)
-                rx_buffer->rpos = 0;
+        // discard oldest data
+        if (++rx_buffer->rpos == rx_buffer->size)
+            rx_buffer->rpos = 0;
 #endif
-        }
-        uint8_t data = USF(uart->uart_nr);
-        rx_buffer->buffer[rx_buffer->wpos] = data;
-        rx_buffer->wpos = nextPos;
+    }
+    rx_buffer->buffer[rx_buffer->wpos] = data;
+    rx_buffer->wpos = nextPos;
+    ++rx_buffer->in;
+    return true;
+}
+
+// Copy all the rx fifo bytes that fit into the rx buffer
+// called by ISR
+inline void IRAM_ATTR
+uart_rx_copy_fifo_to_buffer_unsafe(uart_t* uart)
+{
+    while(uart_rx_fifo_readable(uart))
+    {
+        // Stop copying if rx buffer is full
+        if(!uart_rx_buffer_store_unsafe(uart, USF(uart->uart_nr)))
+            break;
+    }
+}
+
+// bytes not yet read up to the frame end `end`, <= 0 once all are read
+// called by ISR
+inline int32_t IRAM_ATTR
+uart_rx_frame_left_unsafe(uart_t* uart, uint32_t end)
+{
+    uint32_t out = uart->rx_buffer->in - uart_rx_buffer_available_unsafe(uart->rx_buffer);
+    return (int32_t)(end - out);
+}
+
+// Size of the oldest frame. Frames read through the byte API, or discarded by
+// an overrun, are dropped here.
+static size_t
+uart_rx_frame_size_unsafe(uart_t* uart)
+{
+    struct uart_rx_frames_ *frames = uart->rx_frames;
+
+    while(frames->count)
+    {
+        int32_t left = uart_rx_frame_left_unsafe(uart, frames->ends[frames->first]);
+        if(left > 0)
+            return left;
+        frames->first = (frames->first + 1) % UART_RX_FRAMES;
+        --frames->count;
+    }
+    return 0;
+}
+
+// After the rx buffer was resized, frame ends past what it kept are gone.
+// A frame cut short now ends with the buffer.
+static void
+uart_rx_frame_rebase_unsafe(uart_t* uart)
+{
+    struct uart_rx_frames_ *frames = uart->rx_frames;
+    const uint32_t in = uart->rx_buffer->in;
+
+    size_t kept = 0;
+    while(kept < frames->count && (int32_t)(frames->ends[(frames->first + kept) % UART_RX_FRAMES] - in) <= 0)
+        ++kept;
+    const size_t last = (frames->first + kept + UART_RX_FRAMES - 1) % UART_RX_FRAMES;
+    if(kept < frames->count && (kept? frames->ends[last] != in: uart_rx_frame_left_unsafe(uart, in) > 0))
+        frames->ends[(frames->first + kept++) % UART_RX_FRAMES] = in;
+    frames->count = kept;
+}
+
+static void uart_rx_frame_notify(int uart_nr);
+
+// The line went idle, all received bytes make up the newest frame
+// called by ISR
+static void IRAM_ATTR
+uart_rx_frame_end_unsafe(uart_t* uart)
+{
+    struct uart_rx_frames_ *frames = uart->rx_frames;
+
+    // including the byte uart_rx_copy_fifo_to_buffer_unsafe() left
+    while(uart_rx_fifo_available(uart->uart_nr))
+        uart_rx_buffer_store_unsafe(uart, USF(uart->uart_nr));
+
+    const uint32_t in = uart->rx_buffer->in;
+    const size_t last = (frames->first + frames->count + UART_RX_FRAMES - 1) % UART_RX_FRAMES;
+    if(frames->count? frames->ends[last] == in: uart_rx_frame_left_unsafe(uart, in) <= 0)
+        return; // nothing received since the last frame end
+
+    if(frames->count == UART_RX_FRAMES)
+    {
+        // no room for another frame end, the newest frame grows
+        frames->ends[last] = in;
+        uart->rx_overrun = true;
+    }
+    else
+    {
+        frames->ends[(frames->first + frames->count) % UART_RX_FRAMES] = in;
+        ++frames->count;
+    }
+
+    if(frames->callback && !frames->scheduled)
+    {
+        // one call for all frames completed until it runs, retried on the next frame if the scheduler is full
+        const int uart_nr = uart->uart_nr;
+        frames->scheduled = schedule_function([uart_nr]() { uart_rx_frame_notify(uart_nr); });
     }
 }
 
+inline size_t
+uart_tx_buffer_used_unsafe(const struct uart_tx_buffer_ * tx_buffer)
+{
+    if(tx_buffer->wpos < tx_buffer->rpos)
+      return (tx_buffer->wpos + tx_buffer->size) - tx_buffer->rpos;
+
+    return tx_buffer->wpos - tx_buffer->rpos;
+}
+
+// Move as many tx buffer bytes as fit into the tx fifo, and stop the
+// tx-fifo-empty interrupt once there is nothing left to move
+// called by ISR
+inline void IRAM_ATTR
+uart_tx_copy_buffer_to_fifo_unsafe(uart_t* uart)
+{
+    struct uart_tx_buffer_ *tx_buffer = uart->tx_buffer;
+
+    while(tx_buffer->rpos != tx_buffer->wpos && !uart_tx_fifo_full(uart->uart_nr))
+    {
+        USF(uart->uart_nr) = tx_buffer->buffer[tx_buffer->rpos];
+        if (++tx_buffer->rpos == tx_buffer->size)
+            tx_buffer->rpos = 0;
+    }
+
+    if(tx_buffer->rpos == tx_buffer->wpos)
+        USIE(uart->uart_nr) &= ~(1 << UIFE);
+}
+
 inline int
 uart_peek_char_unsafe(uart_t* uart)
 {
@@ -226,7 +402,7 @@ uart_rx_available(uart_t* uart)
     int uartrxbufferavailable = uart_rx_buffer_available_unsafe(uart->rx_buffer);
     ETS_UART_INTR_ENABLE();
 
-    return uartrxbufferavailable + uart_rx_fifo_available(uart->uart_nr);
+    return uartrxbufferavailable + uart_rx_fifo_readable(uart);
 }
 
 int
@@ -298,7 +474,7 @@ uart_read(uart_t* uart, char* userbuffer, size_t usersize)
         if (!uart_rx_buffer_available_unsafe(uart->rx_buffer))
         {
             // no more data in sw buffer, take them from hw fifo
-            while (ret < usersize && uart_rx_fifo_available(uart->uart_nr))
+            while (ret < usersize && uart_rx_fifo_readable(uart))
                 userbuffer[ret++] = USF(uart->uart_nr);
 
 	    // no more sw/hw data available
@@ -356,6 +532,7 @@ static void IRAM_ATTR uart_isr_handle_data(void* arg, uint8_t data)
     }
     rx_buffer->buffer[rx_buffer->wpos] = data;
     rx_buffer->wpos = nextPos;
+    ++rx_buffer->in;
 
     // Check the UART flags and note hardware overflow/etc.
     uint32_t usis = USIS(uart->uart_nr);
@@ -384,16 +561,20 @@ uart_resize_rx_buffer(uart_t* uart, size_t new_size)
 
     size_t new_wpos = 0;
     ETS_UART_INTR_DISABLE();
-    while(uart_rx_available_unsafe(uart) && new_wpos < new_size)
-        new_buf[new_wpos++] = uart_read_char_unsafe(uart); //if uart_rx_available_unsafe() returns non-0, uart_read_char_unsafe() can't return -1
-    if (new_wpos == new_size)
-        new_wpos = 0;
+    const uint32_t out = uart->rx_buffer->in - uart_rx_buffer_available_unsafe(uart->rx_buffer);
+    // the fifo is left to the isr, a full ring holds one byte less than its size
+    while(uart_rx_buffer_available_unsafe(uart->rx_buffer) && new_wpos + 1 < new_size)
+        new_buf[new_wpos++] = uart_read_char_unsafe(uart); //if uart_rx_buffer_available_unsafe() returns non-0, uart_read_char_unsafe() can't return -1
 
     uint8_t * old_buf = uart->rx_buffer->buffer;
     uart->rx_buffer->rpos = 0;
     uart->rx_buffer->wpos = new_wpos;
     uart->rx_buffer->size = new_size;
     uart->rx_buffer->buffer = new_buf;
+    // only what was kept counts as stored
+    uart->rx_buffer->in = out + new_wpos;
+    if(uart->rx_frames)
+        uart_rx_frame_rebase_unsafe(uart);
     ETS_UART_INTR_ENABLE();
     free(old_buf);
     return uart->rx_buffer->size;
@@ -405,44 +586,68 @@ uart_get_rx_buffer_size(uart_t* uart)
     return uart && uart->rx_enabled? uart->rx_buffer->size: 0;
 }
 
-// The default ISR handler called when GDB is not enabled
-void IRAM_ATTR
-uart_isr(void * arg, void * frame)
+static void IRAM_ATTR
+uart_isr_handle_uart(uart_t* uart)
 {
-    (void) frame;
-    uart_t* uart = (uart_t*)arg;
     uint32_t usis = USIS(uart->uart_nr);
 
-    if(uart == NULL || !uart->rx_enabled)
+    if(uart->rx_enabled)
     {
-        USIC(uart->uart_nr) = usis;
-        ETS_UART_INTR_DISABLE();
-        return;
-    }
+        if(usis & (1 << UIFF))
+            uart_rx_copy_fifo_to_buffer_unsafe(uart);
 
-    if(usis & (1 << UIFF))
-        uart_rx_copy_fifo_to_buffer_unsafe(uart);
+        if((usis & (1 << UITO)) && uart->rx_frames)
+            uart_rx_frame_end_unsafe(uart);
 
-    if(usis & (1 << UIOF))
-    {
-        uart->rx_overrun = true;
-        //os_printf_plus(overrun_str);
+        if(usis & (1 << UIOF))
+        {
+            uart->rx_overrun = true;
+            //os_printf_plus(overrun_str);
+        }
+
+        // in frame mode the rx timeout marks frame ends and is no error
+        if (usis & ((1 << UIFR) | (1 << UIPE) | (uart->rx_frames? 0: (1 << UITO))))
+            uart->rx_error = true;
     }
 
-    if (usis & ((1 << UIFR) | (1 << UIPE) | (1 << UITO)))
-        uart->rx_error = true;
+    if((usis & (1 << UIFE)) && uart->tx_buffer)
+        uart_tx_copy_buffer_to_fifo_unsafe(uart);
 
     USIC(uart->uart_nr) = usis;
 }
 
+// The default ISR handler called when GDB is not enabled
+void IRAM_ATTR
+uart_isr(void * arg, void * frame)
+{
+    (void) arg;
+    (void) frame;
+
+    if(s_uart_isr[UART0])
+        uart_isr_handle_uart(s_uart_isr[UART0]);
+
+    if(s_uart_isr[UART1])
+        uart_isr_handle_uart(s_uart_isr[UART1]);
+}
+
+// UCTOT is the idle time in character times after which the rx-timeout interrupt fires
+static uint32_t
+uart_rx_timeout_conf(const uart_t* uart)
+{
+    if(uart->rx_frames == NULL)
+        return 0;
+    return ((uint32_t)uart->rx_frames->idle_chars << UCTOT) | (1UL << UCTOE);
+}
+
 static void
 uart_start_isr(uart_t* uart)
 {
-    if(uart == NULL || !uart->rx_enabled)
+    if(uart == NULL)
         return;
 
     if(gdbstub_has_uart_isr_control()) {
-        gdbstub_set_uart_isr_callback(uart_isr_handle_data,  (void *)uart);
+        if(uart->rx_enabled)
+            gdbstub_set_uart_isr_callback(uart_isr_handle_data,  (void *)uart);
         return;
     }
 
@@ -456,63 +661,121 @@ uart_start_isr(uart_t* uart)
     // was 100, use 16 to stay away from overrun
     #define INTRIGG 16
 
+    // UCFET value is the tx fifo level below which the tx-fifo-empty interrupt
+    // triggers. It is only enabled while the tx buffer holds data, and must
+    // leave enough bytes in flight to cover the interrupt latency.
+    #define TXTRIGG 32
+
+    ETS_UART_INTR_DISABLE();
     //was:USC1(uart->uart_nr) = (INTRIGG << UCFFT) | (0x02 << UCTOT) | (1 <<UCTOE);
-    USC1(uart->uart_nr) = (INTRIGG << UCFFT);
+    USC1(uart->uart_nr) = (INTRIGG << UCFFT) | (TXTRIGG << UCFET) | uart_rx_timeout_conf(uart);
     USIC(uart->uart_nr) = 0xffff;
     //was: USIE(uart->uart_nr) = (1 << UIFF) | (1 << UIFR) | (1 << UITO);
     // UIFF: rx fifo full
     // UIOF: rx fifo overflow (=overrun)
     // UIFR: frame error
     // UIPE: parity error
-    // UITO: rx fifo timeout
-    USIE(uart->uart_nr) = (1 << UIFF) | (1 << UIOF) | (1 << UIFR) | (1 << UIPE) | (1 << UITO);
-    ETS_UART_INTR_ATTACH(uart_isr,  (void *)uart);
+    // UITO: rx fifo timeout, only enabled by UCTOE in frame mode
+    // UIFE: tx fifo empty, enabled by uart_write() when the tx buffer is used
+    if(uart->rx_enabled)
+        USIE(uart->uart_nr) = (1 << UIFF) | (1 << UIOF) | (1 << UIFR) | (1 << UIPE) | (1 << UITO);
+    else
+        USIE(uart->uart_nr) = 0;
+    s_uart_isr[uart->uart_nr] = uart;
+    ETS_UART_INTR_ATTACH(uart_isr,  NULL);
     ETS_UART_INTR_ENABLE();
 }
 
 static void
 uart_stop_isr(uart_t* uart)
 {
-    if(uart == NULL || !uart->rx_enabled)
+    if(uart == NULL)
         return;
 
     if(gdbstub_has_uart_isr_control()) {
-        gdbstub_set_uart_isr_callback(NULL, NULL);
+        if(uart->rx_enabled)
+            gdbstub_set_uart_isr_callback(NULL, NULL);
         return;
     }
 
+    if(s_uart_isr[uart->uart_nr] != uart)
+        return;
+
     ETS_UART_INTR_DISABLE();
     USC1(uart->uart_nr) = 0;
     USIC(uart->uart_nr) = 0xffff;
     USIE(uart->uart_nr) = 0;
-    ETS_UART_INTR_ATTACH(NULL, NULL);
+    s_uart_isr[uart->uart_nr] = NULL;
+    if(s_uart_isr[UART0] || s_uart_isr[UART1])
+        ETS_UART_INTR_ENABLE(); // the other uart still needs the shared interrupt
+    else
+        ETS_UART_INTR_ATTACH(NULL, NULL);
 }
 
-/*
-  Reference for uart_tx_fifo_available() and uart_tx_fifo_full():
-  -Espressif Techinical Reference doc, chapter 11.3.7
-  -tools/sdk/uart_register.h
-  -cores/esp8266/esp8266_peri.h
-  */
-inline __attribute__((always_inline)) size_t
-uart_tx_fifo_available(const int uart_nr)
+
+static void
+uart_do_write_char(const int uart_nr, char c)
 {
-    return (USS(uart_nr) >> USTXC) & 0xff;
+    while(uart_tx_fifo_full(uart_nr));
+
+    USF(uart_nr) = c;
 }
 
-inline __attribute__((always_inline)) bool
-uart_tx_fifo_full(const int uart_nr)
+// Queue buf into the tx fifo and the tx buffer. Only blocks, yielding, while
+// both are full. Bytes are queued through the tx buffer whenever it is not
+// empty, so the output order is kept.
+static size_t
+uart_tx_buffer_write(uart_t* uart, const char* buf, size_t size)
 {
-    return uart_tx_fifo_available(uart_nr) >= 0x7f;
-}
+    struct uart_tx_buffer_ *tx_buffer = uart->tx_buffer;
+    const int uart_nr = uart->uart_nr;
+    size_t ret = size;
 
+    while(size)
+    {
+        ETS_UART_INTR_DISABLE();
+        uart_tx_copy_buffer_to_fifo_unsafe(uart);
+        if(tx_buffer->rpos == tx_buffer->wpos)
+        {
+            while(size && !uart_tx_fifo_full(uart_nr))
+            {
+                USF(uart_nr) = pgm_read_byte(buf++);
+                --size;
+            }
+        }
+        while(size)
+        {
+            size_t nextPos = (tx_buffer->wpos + 1) % tx_buffer->size;
+            if(nextPos == tx_buffer->rpos)
+                break;
+            tx_buffer->buffer[tx_buffer->wpos] = pgm_read_byte(buf++);
+            tx_buffer->wpos = nextPos;
+            --size;
+        }
+        if(tx_buffer->rpos != tx_buffer->wpos)
+            USIE(uart_nr) |= (1 << UIFE);
+        ETS_UART_INTR_ENABLE();
+
+        if(size)
+            optimistic_yield(10000UL);
+    }
+
+    return ret;
+}
 
+// Wait until the isr has moved all tx buffer bytes into the tx fifo
 static void
-uart_do_write_char(const int uart_nr, char c)
+uart_tx_buffer_drain(uart_t* uart)
 {
-    while(uart_tx_fifo_full(uart_nr));
-
-    USF(uart_nr) = c;
+    while(true)
+    {
+        ETS_UART_INTR_DISABLE();
+        bool empty = (uart->tx_buffer->rpos == uart->tx_buffer->wpos);
+        ETS_UART_INTR_ENABLE();
+        if(empty)
+            return;
+        esp_yield();
+    }
 }
 
 size_t
@@ -525,6 +788,8 @@ uart_write_char(uart_t* uart, char c)
         gdbstub_write_char(c);
         return 1;
     }
+    if(uart->tx_buffer)
+        return uart_tx_buffer_write(uart, &c, 1);
     uart_do_write_char(uart->uart_nr, c);
     return 1;
 }
@@ -540,6 +805,9 @@ uart_write(uart_t* uart, const char* buf, size_t size)
         return 0;
     }
 
+    if(uart->tx_buffer)
+        return uart_tx_buffer_write(uart, buf, size);
+
     size_t ret = size;
     const int uart_nr = uart->uart_nr;
     while (size--) {
@@ -557,6 +825,16 @@ uart_tx_free(uart_t* uart)
     if(uart == NULL || !uart->tx_enabled)
         return 0;
 
+    if(uart->tx_buffer)
+    {
+        // uart_write() tops up the fifo from the buffer first, so both free spaces add up
+        ETS_UART_INTR_DISABLE();
+        size_t buffered = uart_tx_buffer_used_unsafe(uart->tx_buffer);
+        size_t fifo = uart_tx_fifo_available(uart->uart_nr);
+        ETS_UART_INTR_ENABLE();
+        return (uart->tx_buffer->size - 1 - buffered) + (fifo < UART_TX_FIFO_SIZE? UART_TX_FIFO_SIZE - 1 - fifo: 0);
+    }
+
     return UART_TX_FIFO_SIZE - uart_tx_fifo_available(uart->uart_nr);
 }
 
@@ -566,11 +844,231 @@ uart_wait_tx_empty(uart_t* uart)
     if(uart == NULL || !uart->tx_enabled)
         return;
 
+    if(uart->tx_buffer)
+        uart_tx_buffer_drain(uart);
+
     while(uart_tx_fifo_available(uart->uart_nr) > 0)
         esp_yield();
 
 }
 
+size_t
+uart_resize_tx_buffer(uart_t* uart, size_t new_size)
+{
+    // the tx buffer needs the uart interrupt, which GDB owns when enabled
+    if(uart == NULL || !uart->tx_enabled || gdbstub_has_uart_isr_control())
+        return 0;
+
+    if(new_size == 1) // one slot always stays free to tell full from empty
+        new_size = 2;
+
+    size_t old_size = uart_get_tx_buffer_size(uart);
+    if(old_size == new_size)
+        return old_size;
+
+    struct uart_tx_buffer_ * tx_buffer = uart->tx_buffer;
+    uint8_t * new_buf = NULL;
+    if(new_size)
+    {
+        new_buf = (uint8_t*)malloc(new_size);
+        if(!new_buf)
+            return old_size;
+        if(tx_buffer == NULL)
+        {
+            tx_buffer = (struct uart_tx_buffer_ *)malloc(sizeof(struct uart_tx_buffer_));
+            if(tx_buffer == NULL)
+            {
+                free(new_buf);
+                return old_size;
+            }
+            tx_buffer->buffer = NULL;
+        }
+    }
+
+    if(uart->tx_buffer)
+    {
+        // pending bytes go out before the buffer is swapped
+        uart_tx_buffer_drain(uart);
+        ETS_UART_INTR_DISABLE();
+    }
+
+    uint8_t * old_buf = tx_buffer->buffer;
+    tx_buffer->size = new_size;
+    tx_buffer->rpos = 0;
+    tx_buffer->wpos = 0;
+    tx_buffer->buffer = new_buf;
+    bool was_buffered = (uart->tx_buffer != NULL);
+    uart->tx_buffer = new_size? tx_buffer: NULL;
+
+    if(was_buffered)
+        ETS_UART_INTR_ENABLE();
+    free(old_buf);
+
+    if(!new_size)
+    {
+        free(tx_buffer);
+        if(!uart->rx_enabled)
+            uart_stop_isr(uart);
+    }
+    else if(s_uart_isr[uart->uart_nr] != uart)
+        uart_start_isr(uart);
+
+    return new_size;
+}
+
+size_t
+uart_get_tx_buffer_size(uart_t* uart)
+{
+    return uart && uart->tx_buffer? uart->tx_buffer->size: 0;
+}
+
+bool
+uart_rx_frame_mode(uart_t* uart, uint8_t idle_chars)
+{
+    // frame ends come from the uart interrupt, which GDB owns when enabled
+    if(uart == NULL || !uart->rx_enabled || gdbstub_has_uart_isr_control() || idle_chars > 0x7f)
+        return false;
+
+    struct uart_rx_frames_ * frames = uart->rx_frames;
+    if(idle_chars && frames == NULL)
+    {
+        frames = (struct uart_rx_frames_ *)malloc(sizeof(struct uart_rx_frames_));
+        if(frames == NULL)
+            return false;
+        frames->first = 0;
+        frames->count = 0;
+        frames->scheduled = false;
+        frames->callback = NULL;
+        frames->callback_arg = NULL;
+    }
+
+    ETS_UART_INTR_DISABLE();
+    if(idle_chars)
+        frames->idle_chars = idle_chars;
+    uart->rx_frames = idle_chars? frames: NULL;
+    USC1(uart->uart_nr) = (USC1(uart->uart_nr) & ~((0x7fUL << UCTOT) | (1UL << UCTOE))) | uart_rx_timeout_conf(uart);
+    ETS_UART_INTR_ENABLE();
+
+    if(!idle_chars)
+        free(frames);
+    return true;
+}
+
+void
+uart_rx_frame_set_callback(uart_t* uart, uart_rx_frame_cb_t cb, void* arg)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return;
+
+    ETS_UART_INTR_DISABLE();
+    uart->rx_frames->callback = cb;
+    uart->rx_frames->callback_arg = arg;
+    ETS_UART_INTR_ENABLE();
+}
+
+// Scheduled by the isr, the uart may have been closed since
+static void
+uart_rx_frame_notify(int uart_nr)
+{
+    uart_t* uart = s_uart_isr[uart_nr];
+    if(uart == NULL || uart->rx_frames == NULL)
+        return;
+
+    ETS_UART_INTR_DISABLE();
+    uart->rx_frames->scheduled = false;
+    uart_rx_frame_cb_t cb = uart->rx_frames->callback;
+    void* arg = uart->rx_frames->callback_arg;
+    bool pending = uart_rx_frame_size_unsafe(uart) > 0;
+    ETS_UART_INTR_ENABLE();
+
+    if(cb && pending)
+        cb(arg);
+}
+
+size_t
+uart_rx_frame_count(uart_t* uart)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return 0;
+
+    ETS_UART_INTR_DISABLE();
+    // later frames end after the oldest one, they are all unread once it is
+    size_t count = uart_rx_frame_size_unsafe(uart)? uart->rx_frames->count: 0;
+    ETS_UART_INTR_ENABLE();
+    return count;
+}
+
+size_t
+uart_rx_frame_available(uart_t* uart)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return 0;
+
+    ETS_UART_INTR_DISABLE();
+    size_t size = uart_rx_frame_size_unsafe(uart);
+    ETS_UART_INTR_ENABLE();
+    return size;
+}
+
+size_t
+uart_rx_frame_read(uart_t* uart, char* userbuffer, size_t usersize)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return 0;
+
+    struct uart_rx_buffer_ *rx_buffer = uart->rx_buffer;
+    ETS_UART_INTR_DISABLE();
+    size_t size = uart_rx_frame_size_unsafe(uart);
+    if(size > usersize)
+        size = usersize;
+    // at most two chunks, up to the end of the rx buffer and from its start
+    size_t chunk = rx_buffer->size - rx_buffer->rpos;
+    if(chunk > size)
+        chunk = size;
+    memcpy(userbuffer, rx_buffer->buffer + rx_buffer->rpos, chunk);
+    memcpy(userbuffer + chunk, rx_buffer->buffer, size - chunk);
+    rx_buffer->rpos = (rx_buffer->rpos + size) % rx_buffer->size;
+    ETS_UART_INTR_ENABLE();
+    return size;
+}
+
+size_t
+uart_rx_frame_peek_available(uart_t* uart)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return 0;
+
+    ETS_UART_INTR_DISABLE();
+    size_t size = uart_rx_frame_size_unsafe(uart);
+    size_t linear = uart->rx_buffer->size - uart->rx_buffer->rpos;
+    ETS_UART_INTR_ENABLE();
+    return size < linear? size: linear;
+}
+
+// complete frames are in the rx buffer, the isr only appends to it
+const char*
+uart_rx_frame_peek_buffer(uart_t* uart)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return NULL;
+
+    return (const char*)&uart->rx_buffer->buffer[uart->rx_buffer->rpos];
+}
+
+void
+uart_rx_frame_peek_consume(uart_t* uart, size_t consume)
+{
+    if(uart == NULL || uart->rx_frames == NULL)
+        return;
+
+    ETS_UART_INTR_DISABLE();
+    size_t size = uart_rx_frame_size_unsafe(uart);
+    if(consume > size)
+        consume = size;
+    uart->rx_buffer->rpos = (uart->rx_buffer->rpos + consume) % uart->rx_buffer->size;
+    ETS_UART_INTR_ENABLE();
+}
+
 void
 uart_flush(uart_t* uart)
 {
@@ -584,11 +1082,23 @@ uart_flush(uart_t* uart)
         ETS_UART_INTR_DISABLE();
         uart->rx_buffer->rpos = 0;
         uart->rx_buffer->wpos = 0;
+        if(uart->rx_frames)
+            uart->rx_frames->count = 0;
         ETS_UART_INTR_ENABLE();
     }
 
     if(uart->tx_enabled)
+    {
         tmp |= (1 << UCTXRST);
+        if(uart->tx_buffer)
+        {
+            ETS_UART_INTR_DISABLE();
+            uart->tx_buffer->rpos = 0;
+            uart->tx_buffer->wpos = 0;
+            USIE(uart->uart_nr) &= ~(1 << UIFE);
+            ETS_UART_INTR_ENABLE();
+        }
+    }
 
     if(!gdbstub_has_uart_isr_control() || uart->uart_nr != UART0) {
         USC0(uart->uart_nr) |= (tmp);
@@ -625,13 +1135,17 @@ uart_init(int uart_nr, int baudrate, int config, int mode, int tx_pin, size_t rx
     uart->uart_nr = uart_nr;
     uart->rx_overrun = false;
     uart->rx_error = false;
+    uart->tx_buffer = NULL;
+    uart->rx_frames = NULL;
 
     switch(uart->uart_nr)
     {
     case UART0:
         ETS_UART_INTR_DISABLE();
         if(!gdbstub_has_uart_isr_control()) {
-            ETS_UART_INTR_ATTACH(NULL, NULL);
+            s_uart_isr[UART0] = NULL;
+            if(s_uart_isr[UART1] == NULL)
+                ETS_UART_INTR_ATTACH(NULL, NULL);
         }
         uart->rx_enabled = (mode != UART_TX_ONLY);
         uart->tx_enabled = (mode != UART_RX_ONLY);
@@ -647,6 +1161,7 @@ uart_init(int uart_nr, int baudrate, int config, int mode, int tx_pin, size_t rx
             rx_buffer->size = rx_size;//var this
             rx_buffer->rpos = 0;
             rx_buffer->wpos = 0;
+            rx_buffer->in = 0;
             rx_buffer->buffer = (uint8_t *)malloc(rx_buffer->size);
             if(rx_buffer->buffer == NULL)
             {
@@ -712,7 +1227,7 @@ uart_init(int uart_nr, int baudrate, int config, int mode, int tx_pin, size_t rx
         if(uart->rx_enabled) {
             uart_start_isr(uart);
         }
-        if(gdbstub_has_uart_isr_control()) {
+        if(gdbstub_has_uart_isr_control() || s_uart_isr[UART1]) {
             ETS_UART_INTR_ENABLE(); // Undo the disable in the switch() above
         }
     }
@@ -726,6 +1241,11 @@ uart_uninit(uart_t* uart)
     if(uart == NULL)
         return;
 
+    if(uart->tx_buffer) {
+        // let the isr send what is still buffered before it goes away
+        uart_tx_buffer_drain(uart);
+    }
+
     uart_stop_isr(uart);
 
     if(uart->tx_enabled && (!gdbstub_has_uart_isr_control() || uart->uart_nr != UART0)) {
@@ -758,6 +1278,11 @@ uart_uninit(uart_t* uart)
             }
         }
     }
+    if(uart->tx_buffer) {
+        free(uart->tx_buffer->buffer);
+        free(uart->tx_buffer);
+    }
+    free(uart->rx_frames);
     free(uart);
 }
 
@@ -127,6 +127,10 @@ int uart_get_baudrate(uart_t* uart);
 
 size_t uart_resize_rx_buffer(uart_t* uart, size_t new_size);
 size_t uart_get_rx_buffer_size(uart_t* uart);
+// 0 (the default) writes straight into the hardware fifo, blocking while it is full.
+// Other sizes queue writes in a software ring drained by the tx-fifo-empty interrupt.
+size_t uart_resize_tx_buffer(uart_t* uart, size_t new_size);
+size_t uart_get_tx_buffer_size(uart_t* uart);
 
 size_t uart_write_char(uart_t* uart, char c);
 size_t uart_write(uart_t* uart, const char* buf, size_t size);
@@ -159,6 +163,37 @@ void uart_peek_consume (uart_t* uart, size_t consume);
 
 uint8_t uart_get_bit_length(const int uart_nr);
 
+// Frame mode: the rx-timeout interrupt marks the end of a frame once the line
+// has been idle for idle_chars character times (1..127), 0 turns it off.
+// Not available on UART1 or while GDB owns the uart interrupt.
+#ifndef UART_RX_FRAMES
+#define UART_RX_FRAMES 8 // frame ends kept until read, more are merged into the last one
+#endif
+bool uart_rx_frame_mode(uart_t* uart, uint8_t idle_chars);
+
+typedef void (*uart_rx_frame_cb_t)(void* arg);
+// cb is run as a scheduled function after frames completed, NULL turns it off
+void uart_rx_frame_set_callback(uart_t* uart, uart_rx_frame_cb_t cb, void* arg);
+
+// number of complete frames not yet read
+size_t uart_rx_frame_count(uart_t* uart);
+
+// size of the oldest complete frame, 0 if there is none
+size_t uart_rx_frame_available(uart_t* uart);
+
+// copy up to size bytes of the oldest complete frame, what is left of it stays the oldest frame
+size_t uart_rx_frame_read(uart_t* uart, char* buffer, size_t size);
+
+// return number of frame bytes accessible by uart_rx_frame_peek_buffer(),
+// less than uart_rx_frame_available() when the frame wraps around the end of the rx buffer
+size_t uart_rx_frame_peek_available(uart_t* uart);
+
+// return a pointer to the oldest complete frame, NULL when not in frame mode
+const char* uart_rx_frame_peek_buffer(uart_t* uart);
+
+// consume frame bytes after use (see uart_rx_frame_peek_buffer)
+void uart_rx_frame_peek_consume(uart_t* uart, size_t consume);
+
 #if defined (__cplusplus)
 } // extern "C"
 #endif
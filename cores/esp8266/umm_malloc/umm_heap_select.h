@@ -41,17 +41,20 @@ MAYBE_ALWAYS_INLINE
 }
 #else
 MAYBE_ALWAYS_INLINE
-HeapSelect(size_t id) : _heap_id(umm_get_current_heap_id()) {
+HeapSelect(size_t id) : _heap_id(umm_get_current_heap_id()),
+    _placement(umm_placement_set_current(UMM_PLACEMENT_NONE)) {
     umm_set_heap_by_id(id);
 }
 
 MAYBE_ALWAYS_INLINE
 ~HeapSelect() {
     umm_set_heap_by_id(_heap_id);
+    umm_placement_set_current(_placement);
 }
 
 protected:
 size_t _heap_id;
+uint8_t _placement;
 #endif
 };
 
@@ -92,17 +95,58 @@ MAYBE_ALWAYS_INLINE
 }
 #else
 MAYBE_ALWAYS_INLINE
-HeapSelectDram() : _heap_id(umm_get_current_heap_id()) {
+HeapSelectDram() : _heap_id(umm_get_current_heap_id()),
+    _placement(umm_placement_set_current(UMM_PLACEMENT_NONE)) {
     umm_set_heap_by_id(UMM_HEAP_DRAM);
 }
 
 MAYBE_ALWAYS_INLINE
 ~HeapSelectDram() {
     umm_set_heap_by_id(_heap_id);
+    umm_placement_set_current(_placement);
 }
 
 protected:
 size_t _heap_id;
+uint8_t _placement;
+#endif
+};
+
+/*
+  HeapPlacement is used to temporarily route allocations through a placement
+  policy, instead of selecting a heap. See umm_placement_set_rule() in
+  umm_malloc.h for the policies.
+
+  {
+      HeapPlacement lock(UMM_PLACEMENT_LONG_LIVED);
+      // buffers allocated here go to IRAM or the external heap first
+  }
+
+  An explicit heap selection, HeapSelect... or ESP.setIramHeap(), made while
+  a HeapPlacement is active takes priority until it is released.
+ */
+class HeapPlacement {
+public:
+#if (UMM_NUM_HEAPS == 1)
+MAYBE_ALWAYS_INLINE
+HeapPlacement(uint8_t tag) {
+    (void)tag;
+}
+MAYBE_ALWAYS_INLINE
+~HeapPlacement() {
+}
+#else
+MAYBE_ALWAYS_INLINE
+HeapPlacement(uint8_t tag) : _placement(umm_placement_set_current(tag)) {
+}
+
+MAYBE_ALWAYS_INLINE
+~HeapPlacement() {
+    umm_placement_set_current(_placement);
+}
+
+protected:
+uint8_t _placement;
 #endif
 };
 
@@ -49,10 +49,10 @@ void *umm_info(void *ptr, bool force) {
         DBGLOG_32_BIT_PTR(&UMM_BLOCK(blockNo)),
         blockNo,
         UMM_NBLOCK(blockNo) & UMM_BLOCKNO_MASK,
-        UMM_PBLOCK(blockNo),
+        (uint16_t)UMM_PBLOCK(blockNo),
         (UMM_NBLOCK(blockNo) & UMM_BLOCKNO_MASK) - blockNo,
-        UMM_NFREE(blockNo),
-        UMM_PFREE(blockNo));
+        (uint16_t)UMM_NFREE(blockNo),
+        (uint16_t)UMM_PFREE(blockNo));
 
     /*
      * Now loop through the block lists, and keep track of the number and size
@@ -83,10 +83,10 @@ void *umm_info(void *ptr, bool force) {
                 DBGLOG_32_BIT_PTR(&UMM_BLOCK(blockNo)),
                 blockNo,
                 UMM_NBLOCK(blockNo) & UMM_BLOCKNO_MASK,
-                UMM_PBLOCK(blockNo),
+                (uint16_t)UMM_PBLOCK(blockNo),
                 (uint16_t)curBlocks,
-                UMM_NFREE(blockNo),
-                UMM_PFREE(blockNo));
+                (uint16_t)UMM_NFREE(blockNo),
+                (uint16_t)UMM_PFREE(blockNo));
 
             /* Does this block address match the ptr we may be trying to free? */
 
@@ -105,7 +105,7 @@ void *umm_info(void *ptr, bool force) {
                 DBGLOG_32_BIT_PTR(&UMM_BLOCK(blockNo)),
                 blockNo,
                 UMM_NBLOCK(blockNo) & UMM_BLOCKNO_MASK,
-                UMM_PBLOCK(blockNo),
+                (uint16_t)UMM_PBLOCK(blockNo),
                 (uint16_t)curBlocks);
         }
 
@@ -123,10 +123,10 @@ void *umm_info(void *ptr, bool force) {
         DBGLOG_32_BIT_PTR(&UMM_BLOCK(blockNo)),
         blockNo,
         UMM_NBLOCK(blockNo) & UMM_BLOCKNO_MASK,
-        UMM_PBLOCK(blockNo),
+        (uint16_t)UMM_PBLOCK(blockNo),
         UMM_NUMBLOCKS - blockNo,
-        UMM_NFREE(blockNo),
-        UMM_PFREE(blockNo));
+        (uint16_t)UMM_NFREE(blockNo),
+        (uint16_t)UMM_PFREE(blockNo));
 
     DBGLOG_FORCE(force, "+----------+-------+--------+--------+-------+--------+--------+\n");
 
@@ -48,7 +48,7 @@ bool umm_integrity_check(void) {
         if (cur >= UMM_NUMBLOCKS) {
             DBGLOG_FUNCTION("heap integrity broken: too large next free num: %d "
                 "(in block %d, addr 0x%08x)\n", cur, prev,
-                DBGLOG_32_BIT_PTR(&UMM_NBLOCK(prev)));
+                DBGLOG_32_BIT_PTR(&UMM_BLOCK(prev)));
             ok = false;
             goto clean;
         }
@@ -61,7 +61,7 @@ bool umm_integrity_check(void) {
         if (UMM_PFREE(cur) != prev) {
             DBGLOG_FUNCTION("heap integrity broken: free links don't match: "
                 "%d -> %d, but %d -> %d\n",
-                prev, cur, cur, UMM_PFREE(cur));
+                prev, cur, cur, (uint16_t)UMM_PFREE(cur));
             ok = false;
             goto clean;
         }
@@ -80,7 +80,7 @@ bool umm_integrity_check(void) {
         if (cur >= UMM_NUMBLOCKS) {
             DBGLOG_FUNCTION("heap integrity broken: too large next block num: %d "
                 "(in block %d, addr 0x%08x)\n", cur, prev,
-                DBGLOG_32_BIT_PTR(&UMM_NBLOCK(prev)));
+                DBGLOG_32_BIT_PTR(&UMM_BLOCK(prev)));
             ok = false;
             goto clean;
         }
@@ -93,7 +93,7 @@ bool umm_integrity_check(void) {
         if ((UMM_NBLOCK(cur) & UMM_FREELIST_MASK)
             != (UMM_PBLOCK(cur) & UMM_FREELIST_MASK)) {
             DBGLOG_FUNCTION("heap integrity broken: mask wrong at addr 0x%08x: n=0x%x, p=0x%x\n",
-                DBGLOG_32_BIT_PTR(&UMM_NBLOCK(cur)),
+                DBGLOG_32_BIT_PTR(&UMM_BLOCK(cur)),
                 (UMM_NBLOCK(cur) & UMM_FREELIST_MASK),
                 (UMM_PBLOCK(cur) & UMM_FREELIST_MASK));
             ok = false;
@@ -104,7 +104,7 @@ bool umm_integrity_check(void) {
         if (cur <= prev) {
             DBGLOG_FUNCTION("heap integrity broken: next block %d is before prev this one "
                 "(in block %d, addr 0x%08x)\n", cur, prev,
-                DBGLOG_32_BIT_PTR(&UMM_NBLOCK(prev)));
+                DBGLOG_32_BIT_PTR(&UMM_BLOCK(prev)));
             ok = false;
             goto clean;
         }
@@ -116,7 +116,7 @@ bool umm_integrity_check(void) {
         if (UMM_PBLOCK(cur) != prev) {
             DBGLOG_FUNCTION("heap integrity broken: block links don't match: "
                 "%d -> %d, but %d -> %d\n",
-                prev, cur, cur, UMM_PBLOCK(cur));
+                prev, cur, cur, (uint16_t)UMM_PBLOCK(cur));
             ok = false;
             goto clean;
         }
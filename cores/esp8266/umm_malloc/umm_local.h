@@ -10,9 +10,37 @@
 #undef memcpy
 #undef memmove
 #undef memset
+#ifdef UMM_HEAP_IRAM
+/*
+ * Blocks in the IRAM heap only take 32-bit access. Keep realloc's copy and
+ * calloc's clear of IRAM blocks out of the non32-bit exception handler.
+ */
+static inline void *umm_memcpy(void *dst, const void *src, size_t n) {
+    if (mmu_is_iram(dst) || mmu_is_iram(src)) {
+        return mmu_memcpy32(dst, src, n);
+    }
+    return ets_memcpy(dst, src, n);
+}
+static inline void *umm_memmove(void *dst, const void *src, size_t n) {
+    if (mmu_is_iram(dst) || mmu_is_iram(src)) {
+        return mmu_memmove32(dst, src, n);
+    }
+    return ets_memmove(dst, src, n);
+}
+static inline void *umm_memset(void *dst, int c, size_t n) {
+    if (mmu_is_iram(dst)) {
+        return mmu_memset32(dst, c, n);
+    }
+    return ets_memset(dst, c, n);
+}
+#define memcpy umm_memcpy
+#define memmove umm_memmove
+#define memset umm_memset
+#else
 #define memcpy ets_memcpy
 #define memmove ets_memmove
 #define memset ets_memset
+#endif
 
 
 /*
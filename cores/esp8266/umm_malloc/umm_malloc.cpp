@@ -220,6 +220,138 @@ int umm_get_heap_stack_index(void) {
     return umm_heap_stack_ptr;
 }
 #endif
+
+/* ------------------------------------------------------------------------ */
+/*
+ * Placement policies, see umm_malloc.h
+ *
+ */
+
+#if (UMM_NUM_HEAPS == 1)
+uint8_t umm_placement_set_current(uint8_t tag) {
+    (void)tag;
+    return UMM_PLACEMENT_NONE;
+}
+
+uint8_t umm_placement_get_current(void) {
+    return UMM_PLACEMENT_NONE;
+}
+
+bool umm_placement_set_rule(uint8_t tag, const umm_placement_rule_t *rule) {
+    (void)tag;
+    (void)rule;
+    return false;
+}
+
+bool umm_placement_get_rule(uint8_t tag, umm_placement_rule_t *rule) {
+    (void)tag;
+    (void)rule;
+    return false;
+}
+
+bool umm_placement_get_stats(uint8_t tag, umm_placement_stats_t *stats) {
+    (void)tag;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    return false;
+}
+
+void umm_placement_reset_stats(void) {
+}
+#else
+#ifdef UMM_HEAP_IRAM
+#define UMM_PLACEMENT_IRAM_ UMM_HEAP_IRAM,
+#else
+#define UMM_PLACEMENT_IRAM_
+#endif
+#ifdef UMM_HEAP_EXTERNAL
+#define UMM_PLACEMENT_EXTERNAL_ UMM_HEAP_EXTERNAL,
+#else
+#define UMM_PLACEMENT_EXTERNAL_
+#endif
+#define UMM_PLACEMENT_DRAM_FIRST { UMM_HEAP_DRAM, UMM_PLACEMENT_IRAM_ UMM_PLACEMENT_EXTERNAL_ }
+#define UMM_PLACEMENT_DRAM_LAST  { UMM_PLACEMENT_IRAM_ UMM_PLACEMENT_EXTERNAL_ UMM_HEAP_DRAM }
+#define UMM_PLACEMENT_RULE_BY_SIZE { UMM_PLACEMENT_LARGE_SIZE, UMM_PLACEMENT_DRAM_FIRST, UMM_PLACEMENT_DRAM_LAST }
+
+static uint8_t umm_placement_cur = UMM_PLACEMENT_NONE;
+
+// Short lived blocks come and go in DRAM, long lived ones are kept out of it
+// where possible so they do not pin down islands between the short lived ones.
+static umm_placement_rule_t umm_placement_rules[UMM_PLACEMENT_TAGS] = {
+    { 0, UMM_PLACEMENT_DRAM_FIRST, UMM_PLACEMENT_DRAM_FIRST },  // UMM_PLACEMENT_NONE, unused
+    { 0, UMM_PLACEMENT_DRAM_FIRST, UMM_PLACEMENT_DRAM_FIRST },  // UMM_PLACEMENT_SHORT_LIVED
+    { 0, UMM_PLACEMENT_DRAM_LAST, UMM_PLACEMENT_DRAM_LAST },    // UMM_PLACEMENT_LONG_LIVED
+    UMM_PLACEMENT_RULE_BY_SIZE,                                 // UMM_PLACEMENT_BY_SIZE
+    UMM_PLACEMENT_RULE_BY_SIZE,                                 // UMM_PLACEMENT_USER
+    UMM_PLACEMENT_RULE_BY_SIZE,
+    UMM_PLACEMENT_RULE_BY_SIZE,
+    UMM_PLACEMENT_RULE_BY_SIZE,
+};
+
+static umm_placement_stats_t umm_placement_stats[UMM_PLACEMENT_TAGS];
+
+uint8_t umm_placement_set_current(uint8_t tag) {
+    uint8_t prev = umm_placement_cur;
+    if (tag < UMM_PLACEMENT_TAGS) {
+        umm_placement_cur = tag;
+    }
+    return prev;
+}
+
+uint8_t umm_placement_get_current(void) {
+    return umm_placement_cur;
+}
+
+bool umm_placement_set_rule(uint8_t tag, const umm_placement_rule_t *rule) {
+    if (UMM_PLACEMENT_NONE == tag || tag >= UMM_PLACEMENT_TAGS || NULL == rule) {
+        return false;
+    }
+    for (size_t i = 0; i < UMM_NUM_HEAPS; ++i) {
+        if ((rule->small_order[i] >= UMM_NUM_HEAPS && rule->small_order[i] != UMM_PLACEMENT_END) ||
+            (rule->large_order[i] >= UMM_NUM_HEAPS && rule->large_order[i] != UMM_PLACEMENT_END)) {
+            return false;
+        }
+    }
+
+    UMM_CRITICAL_DECL(id_no_tag);
+    UMM_CRITICAL_ENTRY(id_no_tag);
+    umm_placement_rules[tag] = *rule;
+    UMM_CRITICAL_EXIT(id_no_tag);
+    return true;
+}
+
+bool umm_placement_get_rule(uint8_t tag, umm_placement_rule_t *rule) {
+    if (tag >= UMM_PLACEMENT_TAGS || NULL == rule) {
+        return false;
+    }
+    *rule = umm_placement_rules[tag];
+    return true;
+}
+
+bool umm_placement_get_stats(uint8_t tag, umm_placement_stats_t *stats) {
+    if (NULL == stats || (tag >= UMM_PLACEMENT_TAGS && tag != UMM_PLACEMENT_ALL)) {
+        return false;
+    }
+    memset(stats, 0, sizeof(*stats));
+    for (size_t t = 0; t < UMM_PLACEMENT_TAGS; ++t) {
+        if (tag == t || tag == UMM_PLACEMENT_ALL) {
+            const umm_placement_stats_t *cur = &umm_placement_stats[t];
+            for (size_t id = 0; id < UMM_NUM_HEAPS; ++id) {
+                stats->allocs[id] += cur->allocs[id];
+                stats->bytes[id] += cur->bytes[id];
+            }
+            stats->fallbacks += cur->fallbacks;
+            stats->failures += cur->failures;
+        }
+    }
+    return true;
+}
+
+void umm_placement_reset_stats(void) {
+    memset(umm_placement_stats, 0, sizeof(umm_placement_stats));
+}
+#endif
 /* ------------------------------------------------------------------------ */
 /*
  * Returns the correct heap context for a given pointer.  Useful for
@@ -280,10 +412,50 @@ static umm_heap_context_t *umm_get_ptr_context(const void *const ptr) {
 
 /* ------------------------------------------------------------------------ */
 
+#ifdef UMM_HEAP_IRAM
+/*
+ * IRAM only takes aligned 32-bit access. Every 16-bit block index read or
+ * written in the IRAM heap would otherwise go through the non32-bit exception
+ * handler, at about 230 cycles each, while walking the block and free lists.
+ *
+ * umm_blockno_ref stands in for the uint16_t lvalue the macros below expand
+ * to and accesses it with the mmu_get_uint16()/mmu_set_uint16() inlines. The
+ * index is addressed from the block, not the packed member, so the pointer
+ * keeps its 16-bit alignment. Pass it through `...` with a (uint16_t) cast.
+ */
+struct umm_blockno_ref {
+    uint16_t *p;
+
+    operator uint16_t() const {
+        return mmu_get_uint16(p);
+    }
+    umm_blockno_ref &operator=(const uint16_t v) {
+        mmu_set_uint16(p, v);
+        return *this;
+    }
+    umm_blockno_ref &operator=(const umm_blockno_ref &r) {
+        return *this = (uint16_t)r;
+    }
+    umm_blockno_ref &operator&=(const int v) {
+        return *this = (uint16_t)(mmu_get_uint16(p) & v);
+    }
+    umm_blockno_ref &operator|=(const int v) {
+        return *this = (uint16_t)(mmu_get_uint16(p) | v);
+    }
+};
+
+#define UMM_BLOCKNO(b, i) (umm_blockno_ref{(uint16_t *)(void *)&UMM_BLOCK(b) + (i)})
+
+#define UMM_NBLOCK(b) UMM_BLOCKNO(b, 0) // header.used.next
+#define UMM_PBLOCK(b) UMM_BLOCKNO(b, 1) // header.used.prev
+#define UMM_NFREE(b)  UMM_BLOCKNO(b, 2) // body.free.next
+#define UMM_PFREE(b)  UMM_BLOCKNO(b, 3) // body.free.prev
+#else
 #define UMM_NBLOCK(b) (UMM_BLOCK(b).header.used.next)
 #define UMM_PBLOCK(b) (UMM_BLOCK(b).header.used.prev)
 #define UMM_NFREE(b)  (UMM_BLOCK(b).body.free.next)
 #define UMM_PFREE(b)  (UMM_BLOCK(b).body.free.prev)
+#endif
 
 /* -------------------------------------------------------------------------
  * There are additional files that may be included here - normally it's
@@ -691,9 +863,12 @@ void umm_free(void *ptr) {
 /* ------------------------------------------------------------------------
  * Must be called only from within critical sections guarded by
  * UMM_CRITICAL_ENTRY() and UMM_CRITICAL_EXIT().
+ *
+ * count_oom is false when the caller tries other heaps after this one, and
+ * counts the OOM itself if none of them can serve the request.
  */
 
-static void *umm_malloc_core(umm_heap_context_t *_context, size_t size) {
+static void *umm_malloc_core(umm_heap_context_t *_context, size_t size, bool count_oom = true) {
     uint16_t blocks;
     uint16_t blockSize = 0;
 
@@ -802,7 +977,9 @@ static void *umm_malloc_core(umm_heap_context_t *_context, size_t size) {
         STATS__FREE_BLOCKS_MIN();
     } else {
         /* Out of memory */
-        STATS__OOM_UPDATE();
+        if (count_oom) {
+            STATS__OOM_UPDATE();
+        }
 
         DBGLOG_DEBUG("Can't allocate %5d blocks\n", blocks);
 
@@ -814,6 +991,50 @@ static void *umm_malloc_core(umm_heap_context_t *_context, size_t size) {
 
 /* ------------------------------------------------------------------------ */
 
+#if (UMM_NUM_HEAPS > 1)
+/*
+ * Serve size from the first heap of the tag's order that can, skipping heaps
+ * that were never initialized. Called within the umm_malloc critical section.
+ *
+ * A heap that could not serve the request only counts an OOM when no later
+ * heap could either, a fallback is not an out of memory condition.
+ */
+static void *umm_placement_malloc_core(const uint8_t tag, size_t size) {
+    const umm_placement_rule_t *rule = &umm_placement_rules[tag];
+    const uint8_t *order = (size >= rule->large_size) ? rule->large_order : rule->small_order;
+    umm_placement_stats_t *stats = &umm_placement_stats[tag];
+
+    for (size_t i = 0; i < UMM_NUM_HEAPS && order[i] != UMM_PLACEMENT_END; ++i) {
+        umm_heap_context_t *_context = umm_get_heap_by_id(order[i]);
+        if (NULL == _context || NULL == _context->heap) {
+            continue;
+        }
+
+        void *ptr = umm_malloc_core(_context, size, false);
+        if (ptr) {
+            stats->allocs[order[i]]++;
+            stats->bytes[order[i]] += size;
+            if (i) {
+                stats->fallbacks++;
+            }
+            return ptr;
+        }
+    }
+
+    for (size_t i = 0; i < UMM_NUM_HEAPS && order[i] != UMM_PLACEMENT_END; ++i) {
+        umm_heap_context_t *_context = umm_get_heap_by_id(order[i]);
+        if (NULL != _context && NULL != _context->heap) {
+            STATS__OOM_UPDATE();
+        }
+    }
+
+    stats->failures++;
+    return NULL;
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+
 void *umm_malloc(size_t size) {
     UMM_CRITICAL_DECL(id_malloc);
 
@@ -906,7 +1127,19 @@ void *umm_malloc(size_t size) {
     if (UMM_CRITICAL_WITHINISR(id_malloc)) {
         _context = umm_get_heap_by_id(UMM_HEAP_DRAM);
     }
+    #if (UMM_NUM_HEAPS > 1)
+    /*
+     * A placement tag only applies while DRAM, the default, is selected. An
+     * explicit selection of another heap, or an ISR, keeps the single heap.
+     */
+    else if (UMM_PLACEMENT_NONE != umm_placement_cur && UMM_HEAP_DRAM == umm_heap_cur) {
+        _context = NULL;
+    }
 
+    if (NULL == _context) {
+        ptr = umm_placement_malloc_core(umm_placement_cur, size);
+    } else
+    #endif
     ptr = umm_malloc_core(_context, size);
 
     ptr = POISON_CHECK_SET_POISON(ptr, size);
@@ -1266,6 +1499,98 @@ void *umm_realloc(void *ptr, size_t size) {
     return ptr;
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ * Moves the allocation at ptr to a lower address of the same heap, when there
+ * is room below it, and returns the new address. Otherwise ptr is returned.
+ *
+ * With a free block right below, the allocation slides down into it and the
+ * space left over at the top is freed again. Otherwise it moves to the lowest
+ * free block below it that is large enough. The whole block is copied, poison
+ * and length fields included, so ptr may come from any of the heap.cpp
+ * allocators.
+ *
+ * The caller must hold the only reference to the allocation, see
+ * MovableHeap.h. Interrupts stay disabled for the copy.
+ */
+void *umm_relocate(void *ptr) {
+    UMM_CRITICAL_DECL(id_realloc);
+
+    if (NULL == ptr) {
+        return NULL;
+    }
+
+    UMM_CHECK_INITIALIZED();
+
+    const uintptr_t offset = (uintptr_t)UMM_POISON_SKETCH_PTR((void *)0);
+    void *data = (void *)((uintptr_t)ptr - offset);
+    umm_heap_context_t *_context = umm_get_ptr_context(data);
+
+    const uint16_t c = (((uintptr_t)data) - (uintptr_t)(&(_context->heap[0]))) / sizeof(umm_block);
+    uint16_t to = 0;
+
+    UMM_CRITICAL_ENTRY(id_realloc);
+
+    const uint16_t blocks = UMM_NBLOCK(c) - c;
+    const size_t bytes = (blocks * sizeof(umm_block)) - (sizeof(((umm_block *)0)->header));
+
+    if (UMM_NBLOCK(UMM_PBLOCK(c)) & UMM_FREELIST_MASK) {
+        const uint16_t prevBlockSize = c - UMM_PBLOCK(c);
+
+        umm_disconnect_from_free_list(_context, UMM_PBLOCK(c));
+        to = umm_assimilate_down(_context, c, 0);
+        STATS__FREE_BLOCKS_UPDATE(-prevBlockSize);
+
+        memmove((void *)&UMM_DATA(to), (void *)&UMM_DATA(c), bytes);
+
+        /* Give back what the block no longer covers, it joins a free next block */
+        umm_split_block(_context, to, blocks, 0);
+        umm_free_core(_context, (void *)&UMM_DATA(to + blocks));
+    } else {
+        uint16_t cf = UMM_NFREE(0);
+        uint16_t lowest = 0;
+
+        while (cf) {
+            if (cf < c && (0 == lowest || cf < lowest) &&
+                ((UMM_NBLOCK(cf) & UMM_BLOCKNO_MASK) - cf) >= blocks) {
+                lowest = cf;
+            }
+            cf = UMM_NFREE(cf);
+        }
+
+        if (lowest) {
+            const uint16_t blockSize = (UMM_NBLOCK(lowest) & UMM_BLOCKNO_MASK) - lowest;
+
+            /* Same as umm_malloc_core(), with the free block chosen by address */
+            UMM_FRAGMENTATION_METRIC_REMOVE(lowest);
+            if (blockSize == blocks) {
+                umm_disconnect_from_free_list(_context, lowest);
+            } else {
+                umm_split_block(_context, lowest, blocks, UMM_FREELIST_MASK);
+                UMM_FRAGMENTATION_METRIC_ADD(UMM_NBLOCK(lowest));
+
+                UMM_NFREE(UMM_PFREE(lowest)) = lowest + blocks;
+                UMM_PFREE(lowest + blocks) = UMM_PFREE(lowest);
+
+                UMM_PFREE(UMM_NFREE(lowest)) = lowest + blocks;
+                UMM_NFREE(lowest + blocks) = UMM_NFREE(lowest);
+            }
+            STATS__FREE_BLOCKS_UPDATE(-blocks);
+
+            memcpy((void *)&UMM_DATA(lowest), (void *)&UMM_DATA(c), bytes);
+            umm_free_core(_context, (void *)&UMM_DATA(c));
+            to = lowest;
+        }
+    }
+
+    UMM_CRITICAL_EXIT(id_realloc);
+
+    if (0 == to) {
+        return ptr;
+    }
+    return (void *)((uintptr_t)&UMM_DATA(to) + offset);
+}
+
 /* ------------------------------------------------------------------------ */
 
 #if !defined(UMM_POISON_CHECK) && !defined(UMM_POISON_CHECK_LITE)
@@ -34,6 +34,7 @@ extern void *umm_malloc(size_t size);
 extern void *umm_calloc(size_t num, size_t size);
 extern void *umm_realloc(void *ptr, size_t size);
 extern void  umm_free(void *ptr);
+extern void *umm_relocate(void *ptr);
 
 /* ------------------------------------------------------------------------ */
 
@@ -44,6 +45,53 @@ extern umm_heap_context_t *umm_set_heap_by_id(size_t which);
 extern size_t umm_get_current_heap_id(void);
 extern umm_heap_context_t *umm_get_current_heap(void);
 
+/* ------------------------------------------------------------------------ */
+/*
+ * Placement policies route an allocation made while the DRAM heap is selected
+ * to the first heap, of an ordered list, that can serve it. A rule holds one
+ * order for requests below `large_size` bytes and one for larger requests.
+ *
+ * The current placement tag is UMM_PLACEMENT_NONE unless changed with
+ * umm_placement_set_current() or the HeapPlacement class, and allocations are
+ * then served from the selected heap only, as before. Allocations from an ISR
+ * and those made with a heap explicitly selected (HeapSelect...) ignore the
+ * placement tag.
+ */
+#define UMM_PLACEMENT_NONE        0 // selected heap only
+#define UMM_PLACEMENT_SHORT_LIVED 1 // DRAM first, then the other heaps
+#define UMM_PLACEMENT_LONG_LIVED  2 // IRAM and external heaps first, DRAM last
+#define UMM_PLACEMENT_BY_SIZE     3 // short lived below UMM_PLACEMENT_LARGE_SIZE, long lived above
+#define UMM_PLACEMENT_USER        4 // first application defined tag, starts as BY_SIZE
+
+#define UMM_PLACEMENT_TAGS        8
+
+#ifndef UMM_PLACEMENT_LARGE_SIZE
+#define UMM_PLACEMENT_LARGE_SIZE  256
+#endif
+
+#define UMM_PLACEMENT_ALL      0xFF // umm_placement_get_stats() totals over all tags
+#define UMM_PLACEMENT_END      0xFF // ends a heap order with fewer than UMM_NUM_HEAPS entries
+
+typedef struct umm_placement_rule_t {
+    size_t large_size;
+    uint8_t small_order[UMM_NUM_HEAPS];  // heap IDs, tried in turn
+    uint8_t large_order[UMM_NUM_HEAPS];
+} umm_placement_rule_t;
+
+typedef struct umm_placement_stats_t {
+    uint32_t allocs[UMM_NUM_HEAPS];      // allocations served, by heap ID
+    uint32_t bytes[UMM_NUM_HEAPS];       // bytes requested by those allocations
+    uint32_t fallbacks;                  // allocations not served by the first heap of the order
+    uint32_t failures;                   // allocations that no heap of the order could serve
+} umm_placement_stats_t;
+
+extern uint8_t umm_placement_set_current(uint8_t tag);  // returns the previous tag
+extern uint8_t umm_placement_get_current(void);
+extern bool umm_placement_set_rule(uint8_t tag, const umm_placement_rule_t *rule);
+extern bool umm_placement_get_rule(uint8_t tag, umm_placement_rule_t *rule);
+extern bool umm_placement_get_stats(uint8_t tag, umm_placement_stats_t *stats);
+extern void umm_placement_reset_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,10 @@
 #include <StreamDev.h>
 #include <base64.h>
 
+extern "C" {
+#include "../../../tools/sdk/uzlib/src/uzlib.h"
+}
+
 // per https://github.com/esp8266/Arduino/issues/8231
 // make sure HTTPClient can be utilized as a movable class member
 static_assert(std::is_default_constructible_v<HTTPClient>, "");
@@ -86,6 +90,8 @@ bool HTTPClient::begin(WiFiClient &client, const String& url) {
 
     _port = (protocol == "https" ? 443 : 80);
     _client = client.clone();
+    _clientOwner = client.instanceId();
+    _ownClient = false;
 
     return beginInternal(url, protocol.c_str());
 }
@@ -109,6 +115,8 @@ bool HTTPClient::begin(WiFiClient &client, const String& host, uint16_t port, co
     }
 
     _client = client.clone();
+    _clientOwner = client.instanceId();
+    _ownClient = false;
 
     clear();
 
@@ -217,6 +225,9 @@ void HTTPClient::disconnect(bool preserveClient)
 
         if(_reuse && _canReuse) {
             DEBUG_HTTPCLIENT("[HTTP-Client][end] tcp keep open for reuse\n");
+            if (!preserveClient && _ownClient && HTTPConnectionPool::enabled()) {
+                HTTPConnectionPool::park(HTTPConnectionPool::makeKey(_protocol, _host, _port, _clientOwner), _client);
+            }
         } else {
             DEBUG_HTTPCLIENT("[HTTP-Client][end] tcp stop\n");
             if(_client) {
@@ -302,6 +313,18 @@ void HTTPClient::setAuthorization(String auth)
     _base64Authorization.replace(String('\n'), emptyString);
 }
 
+/**
+ * ask for gzip content coding and inflate it while reading the body
+ * @param gzip bool
+ * @param window size_t inflate dictionary size, 32KB for standard gzip,
+ *        smaller windows only work with servers compressing for them
+ */
+void HTTPClient::setAcceptGzip(bool gzip, size_t window)
+{
+    _acceptGzip = gzip;
+    _gzipWindow = window;
+}
+
 /**
  * set the timeout for the TCP connection
  * @param timeout unsigned int
@@ -681,6 +704,8 @@ String HTTPClient::errorToString(int error)
         return F("Stream write error");
     case HTTPC_ERROR_READ_TIMEOUT:
         return F("read Timeout");
+    case HTTPC_ERROR_DECOMPRESSION:
+        return F("gzip decompression failed");
     default:
         return String();
     }
@@ -794,6 +819,27 @@ bool HTTPClient::connect(void)
         return false;
     }
 
+    if(_reuse && HTTPConnectionPool::enabled()) {
+        // Only connections made by the same WiFiClient, they carry its TLS settings
+        std::unique_ptr<WiFiClient> pooled = HTTPConnectionPool::take(HTTPConnectionPool::makeKey(_protocol, _host, _port, _clientOwner));
+        if(pooled) {
+            DEBUG_HTTPCLIENT("[HTTP-Client] connect: reusing pooled connection to %s:%u\n", _host.c_str(), _port);
+            _client = std::move(pooled);
+            _ownClient = true;
+            _client->setTimeout(_tcpTimeout);
+            return true;
+        }
+        if(!_ownClient) {
+            // The clone made by begin() may share its connection with the caller's
+            // client (a WiFiClientSecure shares its context), connect a copy instead
+            std::unique_ptr<WiFiClient> own = _client->cloneSettings();
+            if(own) {
+                _client = std::move(own);
+                _ownClient = true;
+            }
+        }
+    }
+
     _client->setTimeout(_tcpTimeout);
 
     if(!_client->connect(_host.c_str(), _port)) {
@@ -851,7 +897,9 @@ bool HTTPClient::sendHeader(const char * type)
         header += _userAgent;
     }
 
-    if (!_useHTTP10) {
+    if (_acceptGzip) {
+        header += F("\r\nAccept-Encoding: gzip;q=1,identity;q=0.5,*;q=0");
+    } else if (!_useHTTP10) {
         header += F("\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0");
     }
 
@@ -891,6 +939,7 @@ int HTTPClient::handleHeaderResponse()
     String transferEncoding;
 
     _transferEncoding = HTTPC_TE_IDENTITY;
+    _contentGzip = false;
     unsigned long lastDataTime = millis();
 
     while(connected()) {
@@ -930,6 +979,10 @@ int HTTPClient::handleHeaderResponse()
                     transferEncoding = headerValue;
                 }
 
+                if(_acceptGzip && headerName.equalsIgnoreCase(F("Content-Encoding"))) {
+                    _contentGzip = headerValue.equalsIgnoreCase(F("gzip")) || headerValue.equalsIgnoreCase(F("x-gzip"));
+                }
+
                 if(headerName.equalsIgnoreCase(F("Location"))) {
                     _location = headerValue;
                 }
@@ -988,6 +1041,290 @@ int HTTPClient::handleHeaderResponse()
     return HTTPC_ERROR_CONNECTION_LOST;
 }
 
+namespace
+{
+
+// Hands out the entity body of a response as contiguous spans taken straight
+// from the client's peek buffer, undoing chunked framing on the way.  Chunk
+// headers, extensions and trailers are parsed one byte at a time so nothing
+// is copied into a String.
+class BodyDecoder
+{
+public:
+    BodyDecoder(WiFiClient& in, bool chunked, int size, uint16_t timeout):
+        _in(in), _timeout(timeout), _chunked(chunked),
+        _state(chunked ? State::Size : (size == 0 ? State::Done : State::Data)),
+        _remaining(chunked ? 0 : size) { }
+
+    // > 0: bytes available at data, 0: end of body, < 0: HTTPC_ERROR_*
+    int span(const uint8_t*& data)
+    {
+        while (_state != State::Done) {
+            if (!_n) {
+                int r = pull();
+                if (r <= 0) {
+                    if (r == 0 && !_chunked && _remaining < 0) {
+                        // no Content-Length, the body ends with the connection
+                        _state = State::Done;
+                        return 0;
+                    }
+                    return r == 0 ? HTTPC_ERROR_CONNECTION_LOST : HTTPC_ERROR_READ_TIMEOUT;
+                }
+            }
+            if (_state == State::Data) {
+                data = _p;
+                return (_remaining >= 0 && (size_t)_remaining < _n) ? _remaining : _n;
+            }
+            if (!framing(*_p)) {
+                return HTTPC_ERROR_ENCODING;
+            }
+            take(1);
+        }
+        return 0;
+    }
+
+    // count bytes of the last span were used
+    void consume(size_t count)
+    {
+        take(count);
+        _total += count;
+        if (_remaining >= 0) {
+            _remaining -= count;
+            if (!_remaining) {
+                _state = _chunked ? State::DataCR : State::Done;
+            }
+        }
+    }
+
+    // give the consumed bytes back to the client
+    void release()
+    {
+        if (_taken) {
+            _in.peekConsume(_taken);
+            _taken = 0;
+        }
+        _n = 0;
+    }
+
+    size_t total() const { return _total; }
+
+protected:
+    enum class State: uint8_t { Size, Extension, SizeLF, Data, DataCR, DataLF, Trailer, Done };
+
+    // 1: data in the window, 0: connection closed, -1: timeout
+    int pull()
+    {
+        release();
+        if (!_in.available()) {
+            esp_delay(_timeout, [this]() { return !_in.available() && _in.connected(); }, 1);
+            if (!_in.available()) {
+                return _in.connected() ? -1 : 0;
+            }
+        } else {
+            optimistic_yield(1000);
+        }
+        _p = reinterpret_cast<const uint8_t*>(_in.peekBuffer());
+        _n = _in.peekAvailable();
+        return _n ? 1 : -1;
+    }
+
+    void take(size_t count)
+    {
+        _p += count;
+        _n -= count;
+        _taken += count;
+    }
+
+    // chunk-size [ chunk-ext ] CRLF chunk-data CRLF ... 0 CRLF *( trailer CRLF ) CRLF
+    bool framing(uint8_t c)
+    {
+        switch (_state) {
+        case State::Size:
+            if (isxdigit(c)) {
+                if (_remaining > 0x7ffffff) {
+                    return false;
+                }
+                _remaining = (_remaining << 4) | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                _digits++;
+                return true;
+            }
+            if (!_digits) {
+                return false;
+            }
+            if (c == ';' || c == ' ' || c == '\t') {
+                _state = State::Extension;
+                return true;
+            }
+            if (c == '\r') {
+                _state = State::SizeLF;
+                return true;
+            }
+            return c == '\n' && sized();
+        case State::Extension:
+            if (c == '\r') {
+                _state = State::SizeLF;
+            } else if (c == '\n') {
+                return sized();
+            }
+            return true;
+        case State::SizeLF:
+            return c == '\n' && sized();
+        case State::DataCR:
+            _state = State::DataLF;
+            return c == '\r';
+        case State::DataLF:
+            _state = State::Size;
+            _remaining = 0;
+            _digits = 0;
+            return c == '\n';
+        case State::Trailer:
+            // trailer fields are dropped, an empty line ends the message
+            if (c == '\n') {
+                if (!_line) {
+                    _state = State::Done;
+                }
+                _line = 0;
+            } else if (c != '\r') {
+                _line++;
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool sized()
+    {
+        DEBUG_HTTPCLIENT("[HTTP-Client] read chunk len: %d\n", (int)_remaining);
+        _state = _remaining ? State::Data : State::Trailer;
+        _line = 0;
+        return true;
+    }
+
+    WiFiClient& _in;
+    uint16_t _timeout;
+    bool _chunked;
+    State _state;
+    int _remaining; // in the current chunk or the body, < 0 when unknown
+    uint8_t _digits = 0;
+    uint16_t _line = 0;
+    const uint8_t* _p = nullptr;
+    size_t _n = 0;
+    size_t _taken = 0;
+    size_t _total = 0;
+};
+
+// uzlib pulls compressed input through source_read_cb once the current span
+// is used up, the span itself is read in place by the inflater
+struct GzipInflater
+{
+    uzlib_uncomp d; // must stay first, the callback gets its address
+    BodyDecoder* body;
+    const uint8_t* span;
+    int error;
+
+    void settle()
+    {
+        if (span) {
+            body->consume(d.source - span);
+            span = nullptr;
+        }
+    }
+
+    static int next(uzlib_uncomp* d)
+    {
+        GzipInflater* self = reinterpret_cast<GzipInflater*>(d);
+        self->settle();
+        const uint8_t* data;
+        int n = self->body->span(data);
+        if (n <= 0) {
+            self->error = n;
+            return -1;
+        }
+        self->span = data;
+        d->source = data + 1;
+        d->source_limit = data + n;
+        return data[0];
+    }
+};
+
+} // namespace
+
+/**
+ * write the body to output, removing chunk framing and gzip coding
+ * @param output Print *
+ * @return bytes written ( negative values are error codes )
+ */
+int HTTPClient::writeToStreamDecoded(Print * output)
+{
+    BodyDecoder body(*_client, _transferEncoding == HTTPC_TE_CHUNKED, _size, _tcpTimeout);
+    const uint8_t* data;
+    int ret = 0;
+    int n = 0;
+
+    if(!_contentGzip) {
+        while((n = body.span(data)) > 0) {
+            size_t written = output->write(data, n);
+            body.consume(written);
+            ret += written;
+            if(written != (size_t)n) {
+                body.release();
+                return HTTPC_ERROR_STREAM_WRITE;
+            }
+        }
+    } else {
+        std::unique_ptr<uint8_t[]> dict(new (std::nothrow) uint8_t[_gzipWindow]);
+        std::unique_ptr<GzipInflater> inflater(new (std::nothrow) GzipInflater());
+        if(!dict || !inflater) {
+            return HTTPC_ERROR_TOO_LESS_RAM;
+        }
+        GzipInflater& gz = *inflater;
+        gz.body = &body;
+        gz.span = nullptr;
+        gz.error = 0;
+
+        uzlib_init();
+        uzlib_uncompress_init(&gz.d, dict.get(), _gzipWindow);
+        gz.d.source = nullptr;
+        gz.d.source_limit = nullptr;
+        gz.d.source_read_cb = GzipInflater::next;
+
+        int res = uzlib_gzip_parse_header(&gz.d);
+        uint8_t out[256];
+        while(res == TINF_OK) {
+            gz.d.dest_start = gz.d.dest = out;
+            gz.d.dest_limit = out + sizeof(out);
+            res = uzlib_uncompress_chksum(&gz.d);
+            size_t produced = gz.d.dest - out;
+            if(produced && output->write(out, produced) != produced) {
+                body.release();
+                return HTTPC_ERROR_STREAM_WRITE;
+            }
+            ret += produced;
+        }
+        gz.settle();
+        if(res != TINF_DONE) {
+            DEBUG_HTTPCLIENT("[HTTP-Client] inflate failed: %d\n", res);
+            body.release();
+            return gz.error ? gz.error : HTTPC_ERROR_DECOMPRESSION;
+        }
+        // anything after the gzip member is dropped, the framing still has to be read
+        while((n = body.span(data)) > 0) {
+            body.consume(n);
+        }
+    }
+    body.release();
+    if(n < 0) {
+        return n;
+    }
+
+    // if no length Header use global chunk size
+    if(_size <= 0) {
+        _size = body.total();
+    }
+    return ret;
+}
+
 /**
  * called to handle error return, may disconnect the connection if still exists
  * @param error
@@ -31,6 +31,7 @@
 #include <WiFiClient.h>
 
 #include <memory>
+#include <vector>
 
 #ifdef DEBUG_ESP_HTTP_CLIENT
 #ifdef DEBUG_ESP_PORT
@@ -44,6 +45,11 @@
 
 #define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
 
+// inflate dictionary for setAcceptGzip(), must cover the server's deflate window
+#ifndef HTTPCLIENT_GZIP_WINDOW
+#define HTTPCLIENT_GZIP_WINDOW (32768)
+#endif
+
 /// HTTP client errors
 #define HTTPC_ERROR_CONNECTION_FAILED   (-1)
 #define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
@@ -56,6 +62,7 @@
 #define HTTPC_ERROR_ENCODING            (-9)
 #define HTTPC_ERROR_STREAM_WRITE        (-10)
 #define HTTPC_ERROR_READ_TIMEOUT        (-11)
+#define HTTPC_ERROR_DECOMPRESSION       (-12)
 
 constexpr int HTTPC_ERROR_CONNECTION_REFUSED __attribute__((deprecated)) = HTTPC_ERROR_CONNECTION_FAILED;
 
@@ -149,6 +156,62 @@ typedef enum {
 class TransportTraits;
 typedef std::unique_ptr<TransportTraits> TransportTraitsPtr;
 
+/**
+ * Process-wide pool of idle keep-alive connections, keyed by scheme, host,
+ * port and the WiFiClient given to HTTPClient::begin().  HTTPClient::end()
+ * parks a reusable connection here and HTTPClient::connect() borrows it back,
+ * whichever HTTPClient object is used, as long as it was begun with the same
+ * WiFiClient.  Pooled connections are made with a copy of that client's
+ * settings (WiFiClient::cloneSettings()), so they are not affected by what
+ * the application does with its client later.  Call clear() after changing
+ * the TLS settings of a client.
+ * Disabled until setLimits() is called with a non-zero total.
+ */
+class HTTPConnectionPool
+{
+public:
+    struct Stats {
+        uint32_t hits;      // connections borrowed from the pool
+        uint32_t misses;    // connects with nothing usable pooled
+        uint32_t parked;    // connections returned to the pool
+        uint32_t expired;   // closed after the idle timeout
+        uint32_t evicted;   // closed to respect the limits
+        uint32_t unhealthy; // closed by the server or with stray data
+    };
+
+    static void setLimits(uint8_t maxPerHost, uint8_t maxTotal);
+    static void setIdleTimeout(uint32_t timeoutMs);
+    static void clear();
+    static size_t idle();
+
+    static const Stats& stats() { return _stats; }
+    static void resetStats() { _stats = Stats(); }
+
+protected:
+    friend class HTTPClient;
+
+    struct Entry {
+        String key;
+        std::unique_ptr<WiFiClient> client;
+        uint32_t since;
+        IPAddress ip;   // peer when parked
+        uint16_t port;
+    };
+
+    static bool enabled() { return _maxTotal > 0; }
+    static String makeKey(const String& protocol, const String& host, uint16_t port, uint32_t owner);
+    static std::unique_ptr<WiFiClient> take(const String& key);
+    static void park(const String& key, std::unique_ptr<WiFiClient>& client);
+    static void expire();
+    static bool healthy(WiFiClient& client);
+
+    static std::vector<Entry> _idle;
+    static uint8_t _maxPerHost;
+    static uint8_t _maxTotal;
+    static uint32_t _idleTimeout;
+    static Stats _stats;
+};
+
 class HTTPClient
 {
 public:
@@ -179,6 +242,10 @@ public:
     void setAuthorization(String auth);
     void setTimeout(uint16_t timeout);
 
+    // Advertise gzip and inflate gzip responses in writeToStream() / getString().
+    // window bytes are allocated per response, getSize() stays the compressed size.
+    void setAcceptGzip(bool gzip, size_t window = HTTPCLIENT_GZIP_WINDOW);
+
     // Redirections
     void setFollowRedirects(followRedirects_t follow);
     void setRedirectLimit(uint16_t limit); // max redirects to follow for a single request
@@ -240,6 +307,7 @@ protected:
     bool sendHeader(const char * type);
     int handleHeaderResponse();
     int writeToStreamDataBlock(Stream * stream, int len);
+    int writeToStreamDecoded(Print * output);
     static int StreamReportToHttpClientReport (Stream::Report streamSendError);
 
     // The common pattern to use the class is to
@@ -251,6 +319,8 @@ protected:
     // Make sure it's not possible to break things in an opposite direction
 
     std::unique_ptr<WiFiClient> _client;
+    uint32_t _clientOwner = 0; // instanceId() of the client given to begin(), part of the pool key
+    bool _ownClient = false;   // _client shares no connection with that client and may be pooled
 
     /// request handling
     String _host;
@@ -258,6 +328,8 @@ protected:
     bool _reuse = true;
     uint16_t _tcpTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
     bool _useHTTP10 = false;
+    bool _acceptGzip = false;
+    size_t _gzipWindow = HTTPCLIENT_GZIP_WINDOW;
 
     String _uri;
     String _protocol;
@@ -278,6 +350,7 @@ protected:
     uint16_t _redirectLimit = 10;
     String _location;
     transferEncoding_t _transferEncoding = HTTPC_TE_IDENTITY;
+    bool _contentGzip = false;
     std::unique_ptr<StreamString> _payload;
 };
 
@@ -303,7 +376,7 @@ int HTTPClient::writeToStream(S * output)
     int len = _size;
     int ret = 0;
 
-    if(_transferEncoding == HTTPC_TE_IDENTITY) {
+    if(_transferEncoding == HTTPC_TE_IDENTITY && !_contentGzip) {
         // len < 0: transfer all of it, with timeout
         // len >= 0: max:len, with timeout
         ret = _client->sendSize(output, len);
@@ -312,55 +385,11 @@ int HTTPClient::writeToStream(S * output)
         if(_client->getLastSendReport() != Stream::Report::Success) {
             return returnError(StreamReportToHttpClientReport(_client->getLastSendReport()));
         }
-    } else if(_transferEncoding == HTTPC_TE_CHUNKED) {
-        int size = 0;
-        while(1) {
-            if(!connected()) {
-                return returnError(HTTPC_ERROR_CONNECTION_LOST);
-            }
-            String chunkHeader = _client->readStringUntil('\n');
-
-            if(chunkHeader.length() <= 0) {
-                return returnError(HTTPC_ERROR_READ_TIMEOUT);
-            }
-
-            chunkHeader.trim(); // remove \r
-
-            // read size of chunk
-            len = (uint32_t) strtol((const char *) chunkHeader.c_str(), NULL, 16);
-            size += len;
-            DEBUG_HTTPCLIENT("[HTTP-Client] read chunk len: %d\n", len);
-
-            // data left?
-            if(len > 0) {
-                // read len bytes with timeout
-                int r = _client->sendSize(output, len);
-                if (_client->getLastSendReport() != Stream::Report::Success)
-                    // not all data transferred
-                    return returnError(StreamReportToHttpClientReport(_client->getLastSendReport()));
-                ret += r;
-            } else {
-
-                // if no length Header use global chunk size
-                if(_size <= 0) {
-                    _size = size;
-                }
-
-                // check if we have write all data out
-                if(ret != _size) {
-                    return returnError(HTTPC_ERROR_STREAM_WRITE);
-                }
-                break;
-            }
-
-            // read trailing \r\n at the end of the chunk
-            char buf[2];
-            auto trailing_seq_len = _client->readBytes((uint8_t*)buf, 2);
-            if (trailing_seq_len != 2 || buf[0] != '\r' || buf[1] != '\n') {
-                return returnError(HTTPC_ERROR_READ_TIMEOUT);
-            }
-
-            esp_yield();
+    } else if(_transferEncoding == HTTPC_TE_IDENTITY || _transferEncoding == HTTPC_TE_CHUNKED) {
+        // chunk framing and/or gzip are undone in place, from the peek buffer
+        ret = writeToStreamDecoded(output);
+        if(ret < 0) {
+            return returnError(ret);
         }
     } else {
         return returnError(HTTPC_ERROR_ENCODING);
@@ -0,0 +1,177 @@
+/**
+ * HTTPConnectionPool.cpp - idle keep-alive connections shared by HTTPClient objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <Arduino.h>
+
+#include "ESP8266HTTPClient.h"
+
+std::vector<HTTPConnectionPool::Entry> HTTPConnectionPool::_idle;
+uint8_t HTTPConnectionPool::_maxPerHost = 2;
+uint8_t HTTPConnectionPool::_maxTotal = 0;
+uint32_t HTTPConnectionPool::_idleTimeout = 30000;
+HTTPConnectionPool::Stats HTTPConnectionPool::_stats;
+
+/**
+ * set how many idle connections are kept, 0 total disables the pool
+ * @param maxPerHost uint8_t per scheme/host/port
+ * @param maxTotal uint8_t
+ */
+void HTTPConnectionPool::setLimits(uint8_t maxPerHost, uint8_t maxTotal)
+{
+    _maxPerHost = maxPerHost;
+    _maxTotal = maxTotal;
+    if (!_maxTotal) {
+        clear();
+    }
+}
+
+/**
+ * idle connections older than this are closed
+ * @param timeoutMs uint32_t
+ */
+void HTTPConnectionPool::setIdleTimeout(uint32_t timeoutMs)
+{
+    _idleTimeout = timeoutMs;
+}
+
+/**
+ * close all pooled connections
+ */
+void HTTPConnectionPool::clear()
+{
+    for (auto& entry : _idle) {
+        entry.client->stop();
+    }
+    _idle.clear();
+}
+
+/**
+ * @return number of pooled connections
+ */
+size_t HTTPConnectionPool::idle()
+{
+    expire();
+    return _idle.size();
+}
+
+/**
+ * @param owner uint32_t instanceId() of the client given to HTTPClient::begin(),
+ *        connections made with other clients (maybe other TLS settings) never match
+ */
+String HTTPConnectionPool::makeKey(const String& protocol, const String& host, uint16_t port, uint32_t owner)
+{
+    String key;
+    key.reserve(protocol.length() + host.length() + 20);
+    key += protocol;
+    key += F("://");
+    key += host;
+    key += ':';
+    key += port;
+    key += '@';
+    key += owner;
+    return key;
+}
+
+/**
+ * a pooled connection is usable if the server did not close it and did not
+ * send anything since the last response (that would desync the next one)
+ */
+bool HTTPConnectionPool::healthy(WiFiClient& client)
+{
+    return client.connected() && (client.available() == 0);
+}
+
+void HTTPConnectionPool::expire()
+{
+    for (auto it = _idle.begin(); it != _idle.end(); ) {
+        if (millis() - it->since >= _idleTimeout) {
+            DEBUG_HTTPCLIENT("[HTTP-Client][pool] expired %s\n", it->key.c_str());
+            it->client->stop();
+            it = _idle.erase(it);
+            _stats.expired++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::unique_ptr<WiFiClient> HTTPConnectionPool::take(const String& key)
+{
+    expire();
+    // Most recently parked first, it is the least likely to be closed by the server
+    for (auto it = _idle.end(); it != _idle.begin(); ) {
+        --it;
+        if (it->key != key) {
+            continue;
+        }
+        std::unique_ptr<WiFiClient> client = std::move(it->client);
+        IPAddress ip = it->ip;
+        uint16_t port = it->port;
+        it = _idle.erase(it);
+        if (client->connected() && ((client->remoteIP() != ip) || (client->remotePort() != port))) {
+            // Connected elsewhere since, not ours to close
+            DEBUG_HTTPCLIENT("[HTTP-Client][pool] dropping moved connection to %s\n", key.c_str());
+            _stats.unhealthy++;
+            continue;
+        }
+        if (healthy(*client)) {
+            _stats.hits++;
+            return client;
+        }
+        DEBUG_HTTPCLIENT("[HTTP-Client][pool] dropping stale connection to %s\n", key.c_str());
+        client->stop();
+        _stats.unhealthy++;
+    }
+    _stats.misses++;
+    return nullptr;
+}
+
+void HTTPConnectionPool::park(const String& key, std::unique_ptr<WiFiClient>& client)
+{
+    if (!client || !_maxPerHost || !healthy(*client)) {
+        return;
+    }
+    expire();
+
+    // Oldest connection to the same host goes first, then the oldest overall
+    size_t perHost = 0;
+    for (auto& entry : _idle) {
+        perHost += (entry.key == key);
+    }
+    if (perHost >= _maxPerHost) {
+        for (auto it = _idle.begin(); it != _idle.end(); ++it) {
+            if (it->key == key) {
+                it->client->stop();
+                _idle.erase(it);
+                _stats.evicted++;
+                break;
+            }
+        }
+    }
+    if (_idle.size() >= _maxTotal) {
+        _idle.front().client->stop();
+        _idle.erase(_idle.begin());
+        _stats.evicted++;
+    }
+
+    DEBUG_HTTPCLIENT("[HTTP-Client][pool] parking connection to %s\n", key.c_str());
+    IPAddress ip = client->remoteIP();
+    uint16_t port = client->remotePort();
+    _idle.push_back(Entry{ key, std::move(client), (uint32_t)millis(), ip, port });
+    _stats.parked++;
+}
@@ -0,0 +1,4 @@
+// uzlib lives in tools/sdk/uzlib (shared with eboot), Arduino only builds
+// sources below src/ so just have a stub here that redirects to it
+
+#include "../../../tools/sdk/uzlib/src/tinfgzip.c"
@@ -278,6 +278,11 @@ void ESP8266WebServerTemplate<ServerType>::serveStatic(const char* uri, FS& fs,
   }
 }
 
+template <typename ServerType>
+void ESP8266WebServerTemplate<ServerType>::serveBundle(const char* uri, const uint8_t* bundle, const char* cache_header) {
+  _addRequestHandler(new StaticBundleRequestHandler<ServerType>(bundle, uri, cache_header));
+}
+
 template <typename ServerType>
 void ESP8266WebServerTemplate<ServerType>::handleClient() {
   if (_currentStatus == HC_NONE) {
@@ -0,0 +1,119 @@
+/*
+  AssetBundle.h - read-only web asset bundles built by tools/mkassetbundle.py
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ASSETBUNDLE_H
+#define ASSETBUNDLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <pgmspace.h>
+
+namespace esp8266webserver {
+
+// Read-only asset bundle produced by tools/mkassetbundle.py.  The image may
+// live in PROGMEM or in any mapped flash range (e.g. flash_hal_map()), so
+// every access goes through the pgm_read_* / *_P helpers.
+//
+// Layout, little endian and 4-byte aligned:
+//   AssetBundleHeader
+//   AssetBundleEntry[count], sorted by path (strcmp order)
+//   NUL-terminated strings (path, content type, quoted ETag)
+//   file bodies
+// All offsets are relative to the start of the bundle.
+
+struct AssetBundleHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+struct AssetBundleEntry {
+    uint32_t path;
+    uint32_t mime;
+    uint32_t etag;
+    uint32_t data;
+    uint32_t len;
+    uint32_t flags;
+};
+
+class AssetBundle {
+public:
+    static constexpr uint32_t MAGIC = 0x42505345; // "ESPB"
+    static constexpr uint16_t VERSION = 1;
+    static constexpr uint32_t FLAG_GZIP = 1;
+
+    struct Asset {
+        PGM_P path;
+        PGM_P contentType;
+        PGM_P eTag;
+        PGM_P data;
+        size_t len;
+        bool gzip;
+    };
+
+    explicit AssetBundle(const uint8_t* bundle) : _base(bundle), _count(0) {
+        if (!bundle || ((uintptr_t)bundle & 3))
+            return;
+        const AssetBundleHeader* h = reinterpret_cast<const AssetBundleHeader*>(bundle);
+        if (pgm_read_dword(&h->magic) != MAGIC || pgm_read_word(&h->version) != VERSION)
+            return;
+        _count = pgm_read_word(&h->count);
+    }
+
+    bool valid() const { return _count != 0; }
+    uint16_t count() const { return _count; }
+
+    // Binary search for an exact path match, one strcmp_P per probe
+    bool find(const char* path, Asset& asset) const {
+        const AssetBundleEntry* entries = reinterpret_cast<const AssetBundleEntry*>(_base + sizeof(AssetBundleHeader));
+        int lo = 0;
+        int hi = (int)_count - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            const AssetBundleEntry* e = &entries[mid];
+            // strcmp_P compares RAM (first) against flash (second)
+            int cmp = strcmp_P(path, _str(pgm_read_dword(&e->path)));
+            if (cmp == 0) {
+                asset.path = _str(pgm_read_dword(&e->path));
+                asset.contentType = _str(pgm_read_dword(&e->mime));
+                asset.eTag = _str(pgm_read_dword(&e->etag));
+                asset.data = _str(pgm_read_dword(&e->data));
+                asset.len = pgm_read_dword(&e->len);
+                asset.gzip = pgm_read_dword(&e->flags) & FLAG_GZIP;
+                return true;
+            }
+            if (cmp < 0)
+                hi = mid - 1;
+            else
+                lo = mid + 1;
+        }
+        return false;
+    }
+
+protected:
+    PGM_P _str(uint32_t off) const { return reinterpret_cast<PGM_P>(_base + off); }
+
+    const uint8_t* _base;
+    uint16_t _count;
+};
+
+} // namespace
+
+#endif //ASSETBUNDLE_H
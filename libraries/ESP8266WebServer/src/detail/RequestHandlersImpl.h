@@ -4,6 +4,7 @@
 #include <ESP8266WebServer.h>
 #include "RequestHandler.h"
 #include "mimetable.h"
+#include "AssetBundle.h"
 #include "WString.h"
 #include "Uri.h"
 
@@ -11,7 +12,7 @@ namespace esp8266webserver {
 
 // calculate an ETag for a file in filesystem based on md5 checksum
 // that can be used in the http headers - include quotes.
-static String calcETag(FS &fs, const String &path) {
+inline String calcETag(FS &fs, const String &path) {
     String result;
 
     // calculate eTag using md5 checksum
@@ -270,6 +271,69 @@ protected:
     String _eTagCode; // ETag code calculated for this file as used in http header include quotes.
 };
 
+// Serve files out of a read-only asset bundle (see tools/mkassetbundle.py).
+// Content type, compression and ETag are resolved when the bundle is built,
+// so a request costs one binary search and a single copy out of flash.
+template<typename ServerType>
+class StaticBundleRequestHandler : public RequestHandler<ServerType> {
+
+    using WebServerType = ESP8266WebServerTemplate<ServerType>;
+
+public:
+    StaticBundleRequestHandler(const uint8_t* bundle, const char* uri, const char* cache_header)
+        :
+    _bundle(bundle),
+    _uri(uri),
+    _cache_header(cache_header)
+    {
+        if (_uri.endsWith("/"))
+            _uri.remove(_uri.length() - 1);
+        DEBUGV("StaticBundleRequestHandler: uri=%s assets=%u\r\n", _uri.c_str(), _bundle.count());
+    }
+
+    bool canHandle(HTTPMethod requestMethod, const String& requestUri) override {
+        return (requestMethod == HTTP_GET || requestMethod == HTTP_HEAD) && _bundle.valid() && requestUri.startsWith(_uri);
+    }
+
+    bool handle(WebServerType& server, HTTPMethod requestMethod, const String& requestUri) override {
+        if (!canHandle(requestMethod, requestUri))
+            return false;
+
+        // Paths in the bundle are absolute, "/dir/" entries alias the index page
+        const char* path = requestUri.c_str() + _uri.length();
+        if (!*path)
+            path = "/";
+
+        AssetBundle::Asset asset;
+        if (!_bundle.find(path, asset))
+            return false;
+
+        DEBUGV("StaticBundleRequestHandler::handle: path=%s len=%u\r\n", path, (unsigned)asset.len);
+
+        if (server.header("If-None-Match").equals(FPSTR(asset.eTag))) {
+            server.send(304);
+            return true;
+        }
+
+        if (_cache_header.length() != 0)
+            server.sendHeader("Cache-Control", _cache_header);
+        server.sendHeader("ETag", FPSTR(asset.eTag));
+        if (asset.gzip)
+            server.sendHeader(F("Content-Encoding"), F("gzip"));
+
+        server.setContentLength(asset.len);
+        server.send(200, String(FPSTR(asset.contentType)), emptyString);
+        if (requestMethod == HTTP_GET)
+            server.sendContent_P(asset.data, asset.len);
+        return true;
+    }
+
+protected:
+    AssetBundle _bundle;
+    String _uri;
+    String _cache_header;
+};
+
 } // namespace
 
 #endif //REQUESTHANDLERSIMPL_H
\ No newline at end of file
@@ -30,6 +30,11 @@
 #include <Arduino.h>
 #include <StackThunk.h>
 #include <Updater_Signing.h>
+#include <umm_malloc/umm_malloc.h>
+#include <umm_malloc/umm_heap_select.h>
+#include <flash_hal.h>
+#include <Schedule.h>
+#include <stddef.h>
 #ifndef ARDUINO_SIGNING
   #define ARDUINO_SIGNING 0
 #endif
@@ -884,13 +889,695 @@ ServerSessions::~ServerSessions() {
 
 ServerSessions::ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic) :
   _size(sessions != nullptr ? size : 0),
-  _store(sessions), _isDynamic(isDynamic) {
+  _store(sessions), _isDynamic(isDynamic), _backend(nullptr) {
     if (_size > 0)
       br_ssl_session_cache_lru_init(&_cache, (uint8_t*)_store, size * sizeof(ServerSession));
+    resetStats();
+}
+
+ServerSessions::ServerSessions(ServerSessionsBackend *backend) :
+  _size(0),
+  _store(nullptr), _isDynamic(false), _backend(backend) {
+    resetStats();
 }
 
 const br_ssl_session_cache_class **ServerSessions::getCache() {
-  return _size > 0 ? &_cache.vtable : nullptr;
+  if ((_size == 0) && !_backend) {
+    return nullptr;
+  }
+  static const br_ssl_session_cache_class vtable = {
+    sizeof(_dispatch), ServerSessions::_save, ServerSessions::_load
+  };
+  _dispatch.vtable = &vtable;
+  _dispatch.self = this;
+  return &_dispatch.vtable;
+}
+
+void ServerSessions::_save(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx,
+                           const br_ssl_session_parameters *params) {
+  ServerSessions *self = ((decltype(_dispatch) *)ctx)->self;
+  self->_stats.saves++;
+  if (self->_backend) {
+    self->_stats.evictions += self->_backend->save(params);
+  } else {
+    // Session IDs are random and never repeat, so once the LRU is full each save drops one
+    if (self->_stats.saves > self->_size) {
+      self->_stats.evictions++;
+    }
+    self->_cache.vtable->save(&self->_cache.vtable, server_ctx, params);
+  }
+}
+
+int ServerSessions::_load(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx,
+                          br_ssl_session_parameters *params) {
+  ServerSessions *self = ((decltype(_dispatch) *)ctx)->self;
+  bool found;
+  if (self->_backend) {
+    found = self->_backend->load(params);
+  } else {
+    found = self->_cache.vtable->load(&self->_cache.vtable, server_ctx, params);
+  }
+  if (found) {
+    self->_stats.hits++;
+  } else {
+    self->_stats.misses++;
+  }
+  return found ? 1 : 0;
+}
+
+namespace {
+  constexpr uint32_t SERVER_SESSIONS_RTC_MAGIC = 0x52535342;   // "BSSR"
+  constexpr uint32_t SERVER_SESSIONS_FLASH_MAGIC = 0x46535342; // "BSSF"
+};
+
+void ServerSessionsBackend::setKey(const uint8_t *key, size_t len) {
+  _hasKey = key && len;
+  // Normalize any key length to 32 bytes
+  br_sha256_context sha;
+  br_sha256_init(&sha);
+  if (_hasKey) {
+    br_sha256_update(&sha, key, len);
+  }
+  br_sha256_out(&sha, _key);
+}
+
+void ServerSessionsBackend::_seal(br_ssl_session_parameters *params) const {
+  if (_hasKey) {
+    // Session IDs are random, so their first bytes make a unique nonce.
+    // A tampered secret only makes the resumed handshake fail.
+    br_chacha20_ct_run(_key, params->session_id, 0, params->master_secret, sizeof(params->master_secret));
+  }
+}
+
+uint32_t ServerSessionsRTC::_entryOffset(uint8_t i) const {
+  // One header block, then the entries
+  return _offset + 1 + i * (sizeof(Entry) / 4);
+}
+
+void ServerSessionsRTC::_begin() {
+  if (_init) {
+    return;
+  }
+  _init = true;
+  static_assert((sizeof(Entry) % 4) == 0, "RTC entries must be whole blocks");
+
+  uint32_t magic;
+  ESP.rtcUserMemoryRead(_offset, &magic, sizeof(magic));
+  if (magic != SERVER_SESSIONS_RTC_MAGIC) {
+    // Cold boot, RTC memory holds garbage
+    uint32_t empty = 0;
+    for (uint8_t i = 0; i < _entries; i++) {
+      ESP.rtcUserMemoryWrite(_entryOffset(i), &empty, sizeof(empty));
+    }
+    magic = SERVER_SESSIONS_RTC_MAGIC;
+    ESP.rtcUserMemoryWrite(_offset, &magic, sizeof(magic));
+    return;
+  }
+  // Continue LRU ordering across deep sleep
+  for (uint8_t i = 0; i < _entries; i++) {
+    uint32_t stamp;
+    ESP.rtcUserMemoryRead(_entryOffset(i), &stamp, sizeof(stamp));
+    _stamp = std::max(_stamp, stamp);
+  }
+}
+
+uint32_t ServerSessionsRTC::save(const br_ssl_session_parameters *params) {
+  _begin();
+  if (!_entries) {
+    return 0;
+  }
+  // Empty entry, else the least recently used one
+  uint8_t slot = 0;
+  uint32_t oldest = UINT32_MAX;
+  for (uint8_t i = 0; i < _entries; i++) {
+    uint32_t stamp;
+    ESP.rtcUserMemoryRead(_entryOffset(i), &stamp, sizeof(stamp));
+    if (stamp < oldest) {
+      oldest = stamp;
+      slot = i;
+    }
+  }
+  Entry e;
+  e.stamp = ++_stamp;
+  memcpy(&e.params, params, sizeof(e.params));
+  e.crc = crc32(&e.params, sizeof(e.params));
+  _seal(&e.params);
+  ESP.rtcUserMemoryWrite(_entryOffset(slot), (uint32_t *)&e, sizeof(e));
+  memset(&e, 0, sizeof(e));
+  return oldest ? 1 : 0;
+}
+
+bool ServerSessionsRTC::load(br_ssl_session_parameters *params) {
+  _begin();
+  Entry e;
+  for (uint8_t i = 0; i < _entries; i++) {
+    ESP.rtcUserMemoryRead(_entryOffset(i), (uint32_t *)&e, sizeof(e));
+    if (e.stamp && !memcmp(e.params.session_id, params->session_id, sizeof(e.params.session_id))) {
+      _seal(&e.params);
+      if (e.crc != crc32(&e.params, sizeof(e.params))) {
+        // Saved under another key
+        continue;
+      }
+      memcpy(params, &e.params, sizeof(*params));
+      e.stamp = ++_stamp;
+      ESP.rtcUserMemoryWrite(_entryOffset(i), &e.stamp, sizeof(e.stamp));
+      memset(&e, 0, sizeof(e));
+      return true;
+    }
+  }
+  memset(&e, 0, sizeof(e));
+  return false;
+}
+
+ServerSessionsFlash::ServerSessionsFlash(uint32_t start, uint32_t sectors, uint8_t entries) :
+  _start(start), _sectors(sectors), _head(0), _seq(0), _init(false) {
+  _entries = entries ? new (std::nothrow) Entry[entries]() : nullptr;
+  _size = _entries ? entries : 0;
+}
+
+ServerSessionsFlash::~ServerSessionsFlash() {
+  if (_entries) {
+    memset(_entries, 0, _size * sizeof(Entry));
+  }
+  delete[] _entries;
+}
+
+bool ServerSessionsFlash::_read(uint32_t slot, Record *rec) const {
+  if (flash_hal_read(_start + slot * RECORD_SIZE, sizeof(*rec), (uint8_t *)rec) != FLASH_HAL_OK) {
+    return false;
+  }
+  _seal(&rec->params);
+  return (rec->magic == SERVER_SESSIONS_FLASH_MAGIC) &&
+         (rec->crc == crc32(rec, offsetof(Record, crc)));
+}
+
+ServerSessionsFlash::Entry *ServerSessionsFlash::_find(const uint8_t *sessionId) {
+  for (uint8_t i = 0; i < _size; i++) {
+    if (_entries[i].used && !memcmp(_entries[i].params.session_id, sessionId, sizeof(_entries[i].params.session_id))) {
+      return &_entries[i];
+    }
+  }
+  return nullptr;
+}
+
+ServerSessionsFlash::Entry *ServerSessionsFlash::_oldest() {
+  // An empty entry, else the one with the lowest sequence number
+  Entry *oldest = _size ? &_entries[0] : nullptr;
+  for (uint8_t i = 0; i < _size && oldest->used; i++) {
+    if (!_entries[i].used || ((int32_t)(_entries[i].seq - oldest->seq) < 0)) {
+      oldest = &_entries[i];
+    }
+  }
+  return oldest;
+}
+
+bool ServerSessionsFlash::begin() {
+  if (_init) {
+    return true;
+  }
+  static_assert(sizeof(Record) <= RECORD_SIZE, "Session record too large");
+  if ((_sectors < 2) || (_start % SECTOR_SIZE)) {
+    return false;
+  }
+  _init = true;
+
+  // Resume after the newest valid record
+  Record rec;
+  bool any = false;
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < _slots(); i++) {
+    if (_read(i, &rec) && (!any || (int32_t)(rec.seq - next) >= 0)) {
+      any = true;
+      next = rec.seq;
+      _head = i;
+    }
+  }
+  if (any) {
+    next++;
+    _head = (_head + 1) % _slots();
+  }
+
+  // Sessions saved before, numbered from 0, come after the stored ones
+  for (uint8_t i = 0; i < _size; i++) {
+    _entries[i].seq += next;
+  }
+  _seq += next;
+
+  // Fill up with the newest stored sessions
+  for (uint32_t i = 0; any && i < _slots(); i++) {
+    if (!_read(i, &rec)) {
+      continue;
+    }
+    Entry *entry = _find(rec.params.session_id);
+    if (!entry) {
+      entry = _oldest();
+      if (!entry || (entry->used && (int32_t)(rec.seq - entry->seq) < 0)) {
+        continue;
+      }
+    } else if ((int32_t)(rec.seq - entry->seq) < 0) {
+      continue;
+    }
+    entry->seq = rec.seq;
+    entry->used = true;
+    memcpy(&entry->params, &rec.params, sizeof(entry->params));
+  }
+  memset(&rec, 0, sizeof(rec));
+  return true;
+}
+
+void ServerSessionsFlash::_write(const Entry &entry) {
+  if ((_head % RECORDS_PER_SECTOR) == 0) {
+    // Entering a sector, erase it.  What it held is older than what RAM keeps.
+    if (flash_hal_erase(_start + _head * RECORD_SIZE, SECTOR_SIZE) != FLASH_HAL_OK) {
+      return;
+    }
+  }
+
+  Record rec;
+  rec.magic = SERVER_SESSIONS_FLASH_MAGIC;
+  rec.seq = entry.seq;
+  memcpy(&rec.params, &entry.params, sizeof(rec.params));
+  rec.crc = crc32(&rec, offsetof(Record, crc));
+  _seal(&rec.params);
+  flash_hal_write(_start + _head * RECORD_SIZE, sizeof(rec), (const uint8_t *)&rec);
+  memset(&rec, 0, sizeof(rec));
+  _head = (_head + 1) % _slots();
+}
+
+void ServerSessionsFlash::_schedule() {
+  // A single flush writes whatever is dirty by the time it runs
+  if (_flushPending) {
+    return;
+  }
+  _flushPending = std::make_shared<bool>(true);
+  std::weak_ptr<bool> token = _flushPending;
+  if (!schedule_function([this, token]() {
+        if (!token.expired()) {
+          _flush();
+        }
+      })) {
+    _flushPending.reset();
+  }
+}
+
+void ServerSessionsFlash::_flush() {
+  _flushPending.reset();
+  bool stored = begin();
+  // Oldest first.  Writing may yield, and a handshake then may save or
+  // evict entries, so each one is copied before it is written.
+  for (;;) {
+    Entry *next = nullptr;
+    for (uint8_t i = 0; i < _size; i++) {
+      if (_entries[i].used && _entries[i].dirty && (!next || (int32_t)(_entries[i].seq - next->seq) < 0)) {
+        next = &_entries[i];
+      }
+    }
+    if (!next) {
+      break;
+    }
+    next->dirty = false;
+    if (stored) {
+      Entry copy = *next;
+      _write(copy);
+      memset(&copy, 0, sizeof(copy));
+    }
+  }
+}
+
+uint32_t ServerSessionsFlash::save(const br_ssl_session_parameters *params) {
+  // Called by BearSSL during the handshake, RAM only
+  Entry *entry = _find(params->session_id);
+  uint32_t evicted = 0;
+  if (!entry) {
+    entry = _oldest();
+    if (!entry) {
+      return 0;
+    }
+    evicted = entry->used ? 1 : 0;
+  }
+  entry->seq = _seq++;
+  entry->used = true;
+  entry->dirty = true;
+  memcpy(&entry->params, params, sizeof(entry->params));
+  _schedule();
+  return evicted;
+}
+
+bool ServerSessionsFlash::load(br_ssl_session_parameters *params) {
+  // Called by BearSSL during the handshake, RAM only
+  if (!_init) {
+    _schedule();
+  }
+  Entry *entry = _find(params->session_id);
+  if (!entry) {
+    return false;
+  }
+  memcpy(params, &entry->params, sizeof(*params));
+  return true;
+}
+
+namespace {
+  // Persisted layout: header, a record and its host name for each entry in
+  // use, then HMAC-SHA256 (keyed) or CRC32
+  struct SessionCacheHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint8_t encrypted;
+    uint8_t reserved;
+    uint32_t length; // Of the records and host names
+    uint8_t nonce[12];
+  };
+  struct __attribute__((packed)) SessionCacheRecord {
+    uint32_t stamp;
+    uint64_t trust;
+    uint16_t port;
+    uint8_t hostLen;
+    br_ssl_session_parameters params;
+  };
+  constexpr uint32_t SESSION_CACHE_MAGIC = 0x43535342; // "BSSC"
+  constexpr uint8_t SESSION_CACHE_VERSION = 2;
+  constexpr size_t SESSION_CACHE_TAG = 32;
+  constexpr size_t SESSION_CACHE_HOST = 255; // Longer names are not persisted
+
+  // Bytes to read for a header that fits a cache of this size, 0 if invalid
+  size_t sessionCacheLength(const SessionCacheHeader *hdr, uint8_t entries, bool encrypted) {
+    if ((hdr->magic != SESSION_CACHE_MAGIC) || (hdr->version != SESSION_CACHE_VERSION) ||
+        (hdr->count > entries) || ((bool)hdr->encrypted != encrypted) ||
+        (hdr->length > hdr->count * (sizeof(SessionCacheRecord) + SESSION_CACHE_HOST))) {
+      return 0;
+    }
+    return (sizeof(SessionCacheHeader) + hdr->length + SESSION_CACHE_TAG + 3) & ~3;
+  }
+};
+
+void SessionCache::setKey(const uint8_t *key, size_t len) {
+  _hasKey = key && len;
+  // Normalize any key length to 32 bytes
+  br_sha256_context sha;
+  br_sha256_init(&sha);
+  if (_hasKey) {
+    br_sha256_update(&sha, key, len);
+  }
+  br_sha256_out(&sha, _key);
+}
+
+size_t SessionCache::serializedSize() const {
+  size_t len = sizeof(SessionCacheHeader) + SESSION_CACHE_TAG;
+  for (uint8_t i = 0; i < _size; i++) {
+    size_t hostLen = _entries[i].hash ? strlen(_entries[i].host) : SIZE_MAX;
+    if (hostLen <= SESSION_CACHE_HOST) {
+      len += sizeof(SessionCacheRecord) + hostLen;
+    }
+  }
+  return (len + 3) & ~3; // RTC memory is written in 4-byte blocks
+}
+
+void SessionCache::_subkey(const char *label, uint8_t *out) const {
+  // Separate ChaCha20 and HMAC keys derived from the application key
+  br_hmac_key_context kc;
+  br_hmac_context hc;
+  br_hmac_key_init(&kc, &br_sha256_vtable, _key, sizeof(_key));
+  br_hmac_init(&hc, &kc, 0);
+  br_hmac_update(&hc, label, strlen(label));
+  br_hmac_out(&hc, out);
+}
+
+void SessionCache::_cipher(uint8_t *data, size_t len, const uint8_t *nonce) const {
+  uint8_t subkey[32];
+  _subkey("enc", subkey);
+  br_chacha20_ct_run(subkey, nonce, 0, data, len);
+  memset(subkey, 0, sizeof(subkey));
+}
+
+void SessionCache::_mac(const uint8_t *data, size_t len, const uint8_t *nonce, uint8_t *mac) const {
+  uint8_t subkey[32];
+  br_hmac_key_context kc;
+  br_hmac_context hc;
+  _subkey("mac", subkey);
+  br_hmac_key_init(&kc, &br_sha256_vtable, subkey, sizeof(subkey));
+  br_hmac_init(&hc, &kc, 0);
+  br_hmac_update(&hc, nonce, 12);
+  br_hmac_update(&hc, data, len);
+  br_hmac_out(&hc, mac);
+  memset(subkey, 0, sizeof(subkey));
+}
+
+bool SessionCache::_serialize(uint8_t *buf) const {
+  if (!_size) {
+    return false;
+  }
+  memset(buf, 0, serializedSize());
+  SessionCacheHeader *hdr = (SessionCacheHeader *)buf;
+  uint8_t *body = buf + sizeof(SessionCacheHeader);
+  size_t bodyLen = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _size; i++) {
+    const Entry &entry = _entries[i];
+    size_t hostLen = entry.hash ? strlen(entry.host) : SIZE_MAX;
+    if (hostLen > SESSION_CACHE_HOST) {
+      continue;
+    }
+    SessionCacheRecord rec;
+    rec.stamp = entry.stamp;
+    rec.trust = entry.trust;
+    rec.port = entry.port;
+    rec.hostLen = hostLen;
+    memcpy(&rec.params, &entry.params, sizeof(rec.params));
+    memcpy(body + bodyLen, &rec, sizeof(rec));
+    memcpy(body + bodyLen + sizeof(rec), entry.host, hostLen);
+    memset(&rec, 0, sizeof(rec));
+    bodyLen += sizeof(rec) + hostLen;
+    count++;
+  }
+  uint8_t *tag = body + bodyLen;
+
+  hdr->magic = SESSION_CACHE_MAGIC;
+  hdr->version = SESSION_CACHE_VERSION;
+  hdr->count = count;
+  hdr->encrypted = _hasKey;
+  hdr->length = bodyLen;
+  if (_hasKey) {
+    ESP.random(hdr->nonce, sizeof(hdr->nonce));
+    // Encrypt, then MAC over nonce and ciphertext
+    _cipher(body, bodyLen, hdr->nonce);
+    _mac(body, bodyLen, hdr->nonce, tag);
+  } else {
+    uint32_t crc = crc32(buf, sizeof(SessionCacheHeader) + bodyLen);
+    memcpy(tag, &crc, sizeof(crc));
+  }
+  return true;
+}
+
+bool SessionCache::_deserialize(uint8_t *buf) {
+  SessionCacheHeader *hdr = (SessionCacheHeader *)buf;
+  uint8_t *body = buf + sizeof(SessionCacheHeader);
+  size_t bodyLen = hdr->length;
+  uint8_t *tag = body + bodyLen;
+
+  if (!_size || !sessionCacheLength(hdr, _size, _hasKey)) {
+    return false;
+  }
+  if (_hasKey) {
+    uint8_t mac[SESSION_CACHE_TAG];
+    _mac(body, bodyLen, hdr->nonce, mac);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof(mac); i++) {
+      diff |= mac[i] ^ tag[i];
+    }
+    if (diff) {
+      return false;
+    }
+    _cipher(body, bodyLen, hdr->nonce);
+  } else {
+    uint32_t crc;
+    memcpy(&crc, tag, sizeof(crc));
+    if (crc != crc32(buf, sizeof(SessionCacheHeader) + bodyLen)) {
+      return false;
+    }
+  }
+  clear();
+  size_t pos = 0;
+  for (uint8_t i = 0; i < hdr->count; i++) {
+    SessionCacheRecord rec;
+    if (pos + sizeof(rec) > bodyLen) {
+      return false;
+    }
+    memcpy(&rec, body + pos, sizeof(rec));
+    pos += sizeof(rec);
+    if (pos + rec.hostLen > bodyLen) {
+      return false;
+    }
+    Entry &entry = _entries[i];
+    entry.host = (char *)malloc(rec.hostLen + 1);
+    if (!entry.host) {
+      return false;
+    }
+    memcpy(entry.host, body + pos, rec.hostLen);
+    entry.host[rec.hostLen] = 0;
+    pos += rec.hostLen;
+    entry.stamp = rec.stamp;
+    entry.trust = rec.trust;
+    entry.port = rec.port;
+    memcpy(&entry.params, &rec.params, sizeof(entry.params));
+    memset(&rec, 0, sizeof(rec));
+    // The hash isn't stored, it comes from the fields it covers
+    entry.hash = _hash(entry.host, entry.port, entry.trust);
+    // Continue LRU ordering from the restored stamps
+    _stamp = std::max(_stamp, entry.stamp);
+  }
+  return true;
+}
+
+bool SessionCache::saveToRTC(uint32_t offset) const {
+  size_t len = serializedSize();
+  std::unique_ptr<uint32_t[]> buf(new (std::nothrow) uint32_t[len / 4]);
+  if (!buf || !_serialize((uint8_t *)buf.get())) {
+    return false;
+  }
+  return ESP.rtcUserMemoryWrite(offset, buf.get(), len);
+}
+
+bool SessionCache::restoreFromRTC(uint32_t offset) {
+  static_assert((sizeof(SessionCacheHeader) % 4) == 0, "RTC header must be whole blocks");
+  SessionCacheHeader hdr;
+  if (!ESP.rtcUserMemoryRead(offset, (uint32_t *)&hdr, sizeof(hdr))) {
+    return false;
+  }
+  size_t len = sessionCacheLength(&hdr, _size, _hasKey);
+  std::unique_ptr<uint32_t[]> buf(len ? new (std::nothrow) uint32_t[len / 4] : nullptr);
+  if (!buf || !ESP.rtcUserMemoryRead(offset, buf.get(), len)) {
+    return false;
+  }
+  return _deserialize((uint8_t *)buf.get());
+}
+
+bool SessionCache::save(Print &out) const {
+  size_t len = serializedSize();
+  std::unique_ptr<uint8_t[]> buf(new (std::nothrow) uint8_t[len]);
+  if (!buf || !_serialize(buf.get())) {
+    return false;
+  }
+  return out.write(buf.get(), len) == len;
+}
+
+bool SessionCache::restore(Stream &in) {
+  SessionCacheHeader hdr;
+  if (in.readBytes((uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr)) {
+    return false;
+  }
+  size_t len = sessionCacheLength(&hdr, _size, _hasKey);
+  std::unique_ptr<uint8_t[]> buf(len ? new (std::nothrow) uint8_t[len] : nullptr);
+  if (!buf) {
+    return false;
+  }
+  memcpy(buf.get(), &hdr, sizeof(hdr));
+  size_t rest = len - sizeof(hdr);
+  if (in.readBytes(buf.get() + sizeof(hdr), rest) != rest) {
+    return false;
+  }
+  return _deserialize(buf.get());
+}
+
+IOBufferPool::Stats IOBufferPool::_stats = { 0, 0, 0, 0, 0, 0 };
+
+namespace {
+  struct IdleBuffer {
+    unsigned char *buf;
+    size_t size;
+  };
+  std::vector<IdleBuffer> _poolIdle;
+  size_t _poolIdleLimit = 0;
+  size_t _poolBudget = 0;
+};
+
+unsigned char *IOBufferPool::_alloc(size_t size) {
+  // Allocate buffer with preference to IRAM
+  unsigned char *buf;
+  {
+    HeapSelectIram primary;
+    buf = new (std::nothrow) unsigned char[size];
+  }
+  if (!buf) {
+    HeapSelectDram alternate;
+    buf = new (std::nothrow) unsigned char[size];
+  }
+  return buf;
+}
+
+std::shared_ptr<unsigned char> IOBufferPool::get(size_t size) {
+  unsigned char *buf = nullptr;
+
+  for (auto it = _poolIdle.begin(); it != _poolIdle.end(); ++it) {
+    if (it->size == size) {
+      buf = it->buf;
+      _poolIdle.erase(it);
+      _stats.idle -= size;
+      _stats.hits++;
+      break;
+    }
+  }
+
+  if (!buf) {
+    if (_poolBudget && (_stats.inUse + size > _poolBudget)) {
+      _stats.failures++;
+      return nullptr;
+    }
+    buf = _alloc(size);
+    if (!buf && !_poolIdle.empty()) {
+      // Idle buffers of other sizes are in the way, give them back and retry
+      trim();
+      buf = _alloc(size);
+    }
+    if (!buf) {
+      _stats.failures++;
+      return nullptr;
+    }
+    _stats.misses++;
+  }
+
+  _stats.inUse += size;
+  _stats.peakInUse = std::max(_stats.peakInUse, _stats.inUse);
+  return std::shared_ptr<unsigned char>(buf, [size](unsigned char *p) { _release(p, size); });
+}
+
+void IOBufferPool::_release(unsigned char *buf, size_t size) {
+  _stats.inUse -= size;
+  if (_stats.idle + size <= _poolIdleLimit) {
+    _poolIdle.push_back({ buf, size });
+    _stats.idle += size;
+  } else {
+    delete[] buf;
+  }
+}
+
+void IOBufferPool::setIdleLimit(size_t bytes) {
+  _poolIdleLimit = bytes;
+  while (_stats.idle > _poolIdleLimit) {
+    // Oldest idle buffers go first
+    delete[] _poolIdle.front().buf;
+    _stats.idle -= _poolIdle.front().size;
+    _poolIdle.erase(_poolIdle.begin());
+  }
+}
+
+void IOBufferPool::setBudget(size_t bytes) {
+  _poolBudget = bytes;
+}
+
+void IOBufferPool::trim() {
+  for (auto &idle : _poolIdle) {
+    delete[] idle.buf;
+  }
+  _poolIdle.clear();
+  _stats.idle = 0;
+}
+
+void IOBufferPool::resetStats() {
+  _stats.peakInUse = _stats.inUse;
+  _stats.hits = 0;
+  _stats.misses = 0;
+  _stats.failures = 0;
 }
 
 // SHA256 hash for updater
@@ -24,6 +24,8 @@
 #define _BEARSSLHELPERS_H
 
 #include <bearssl/bearssl.h>
+#include <memory>
+#include <Stream.h>
 #include <StackThunk.h>
 #include <Updater.h>
 
@@ -150,16 +152,231 @@ class Session {
     br_ssl_session_parameters _session;
 };
 
+// Cache of client sessions for several servers, keyed by host and port with
+// LRU eviction.  Attach to clients with WiFiClientSecure::setSessionCache (or
+// make it the default for all clients) and it is consulted and updated on
+// every connect().  The contents can be saved to RTC memory to survive deep
+// sleep, or to any Stream (i.e. a file) to survive a reset, optionally
+// encrypted and authenticated with an application key.
+class SessionCache {
+  friend class WiFiClientSecureCtx;
+
+  public:
+    struct Stats {
+      uint32_t hits;      // Sessions offered and resumed by the server
+      uint32_t misses;    // Full handshakes
+      uint32_t evictions; // Entries dropped to make room
+    };
+
+    SessionCache(uint8_t entries = 4);
+    ~SessionCache();
+
+    // Number of entries the cache can hold, 0 if allocation failed
+    uint8_t size() const { return _size; }
+    void clear();
+
+    // Key used to encrypt and authenticate persisted sessions (copied, up to 32 bytes)
+    void setKey(const uint8_t *key, size_t len);
+
+    // Bytes used when persisted, grows with the host names cached
+    size_t serializedSize() const;
+    // Save to / restore from RTC user memory, offset is in 4-byte blocks
+    bool saveToRTC(uint32_t offset) const;
+    bool restoreFromRTC(uint32_t offset);
+    // Save to / restore from a Stream, e.g. a File
+    bool save(Print &out) const;
+    bool restore(Stream &in);
+
+    const Stats &stats() const { return _stats; }
+    void resetStats() { memset(&_stats, 0, sizeof(_stats)); }
+
+    // Cache used by clients which have none set, nullptr by default
+    static void setDefault(SessionCache *cache) { _default = cache; }
+    static SessionCache *getDefault() { return _default; }
+
+    // How a client authenticates the server and itself.  It is part of the
+    // key, so a session is only offered again by clients with the same
+    // settings: one made by an insecure client never skips the validation
+    // of a client with trust anchors.  Pointers may be null.
+    struct Trust {
+      bool insecure;
+      bool selfSigned;
+      const uint8_t *fingerprint;           // Pinned SHA1, 20 bytes
+      const br_rsa_public_key *rsaKey;      // Known server key
+      const br_ec_public_key *ecKey;
+      const br_x509_trust_anchor *anchors;  // Hashed by contents
+      size_t anchorCount;
+      const void *certStore;                // Hashed by identity
+      const br_x509_certificate *chain;     // Client certificate
+      size_t chainCount;
+    };
+
+    // Server and trust settings a session belongs to.  Host, port and
+    // trust digest must all match, the hash only saves comparing them.
+    struct Key {
+      String host;
+      uint16_t port = 0;
+      uint64_t trust = 0; // Digest of the Trust settings
+      uint32_t hash = 0;  // Of all of the above, never 0 once made
+    };
+
+    // For internal use by WiFiClientSecure, not needed by apps
+    static Key makeKey(const char *host, uint16_t port, const Trust &trust);
+    bool lookup(const Key &key, br_ssl_session_parameters *params);
+    void store(const Key &key, const br_ssl_session_parameters *params);
+
+  private:
+    struct Entry {
+      uint32_t hash;  // Key::hash, 0 == empty
+      uint32_t stamp; // LRU ordering
+      uint64_t trust;
+      uint16_t port;
+      char *host;
+      br_ssl_session_parameters params;
+    };
+
+    static uint32_t _hash(const char *host, uint16_t port, uint64_t trust);
+    static bool _matches(const Entry &entry, const Key &key);
+    void _release(Entry &entry);
+    bool _serialize(uint8_t *buf) const;
+    bool _deserialize(uint8_t *buf);
+    void _subkey(const char *label, uint8_t *out) const;
+    void _cipher(uint8_t *data, size_t len, const uint8_t *nonce) const;
+    void _mac(const uint8_t *data, size_t len, const uint8_t *nonce, uint8_t *mac) const;
+
+    Entry *_entries;
+    uint8_t _size;
+    uint32_t _stamp;
+    uint8_t _key[32];
+    bool _hasKey;
+    Stats _stats;
+
+    static SessionCache *_default;
+};
+
 // Represents a single server session.
 // Use with BearSSL::ServerSessions.
 typedef uint8_t ServerSession[100];
 
+// Storage for server sessions, replaces the built-in RAM LRU of ServerSessions.
+// Session IDs are always 32 random bytes.  Called from the BearSSL stack
+// during handshakes, so implementations must not block for long.
+class ServerSessionsBackend {
+  public:
+    ServerSessionsBackend() : _hasKey(false) { memset(_key, 0, sizeof(_key)); }
+    virtual ~ServerSessionsBackend() { memset(_key, 0, sizeof(_key)); }
+
+    // Stores the parameters keyed by params->session_id.
+    // Returns the number of older sessions dropped to make room.
+    virtual uint32_t save(const br_ssl_session_parameters *params) = 0;
+
+    // Fills in the parameters for params->session_id, false if unknown.
+    virtual bool load(br_ssl_session_parameters *params) = 0;
+
+    // Key used to encrypt the stored master secrets (copied, up to 32 bytes).
+    // Without one they are stored in plaintext.  Sessions saved under another
+    // key are not found.
+    void setKey(const uint8_t *key, size_t len);
+
+  protected:
+    // Encrypts or decrypts params->master_secret in place when a key is set
+    void _seal(br_ssl_session_parameters *params) const;
+
+    uint8_t _key[32];
+    bool _hasKey;
+};
+
+// Sessions kept in RTC user memory, which survives deep sleep.
+// Each entry takes 96 bytes plus a 4-byte header for the whole store,
+// offset is in 4-byte blocks as for ESP.rtcUserMemoryRead/Write.
+class ServerSessionsRTC : public ServerSessionsBackend {
+  public:
+    ServerSessionsRTC(uint32_t offset, uint8_t entries) : _offset(offset), _entries(entries), _stamp(0), _init(false) {}
+
+    uint32_t save(const br_ssl_session_parameters *params) override;
+    bool load(br_ssl_session_parameters *params) override;
+
+  private:
+    struct Entry {
+      uint32_t stamp; // 0 == empty
+      uint32_t crc;   // Of the unsealed params
+      br_ssl_session_parameters params;
+    };
+    void _begin();
+    uint32_t _entryOffset(uint8_t i) const;
+
+    uint32_t _offset;
+    uint8_t _entries;
+    uint32_t _stamp;
+    bool _init;
+};
+
+// Sessions appended to a ring of raw flash sectors, which survives reboots.
+// Writes go round the ring sequentially and a sector is only erased when the
+// ring wraps onto it, spreading wear evenly.  The region (sector aligned,
+// at least 2 sectors) must not be used by anything else.
+// BearSSL only sees the newest sessions kept in RAM: flash access may yield,
+// which must not happen inside a handshake, so new sessions are written out
+// later from a scheduled function.  Call begin() from setup() to load them.
+class ServerSessionsFlash : public ServerSessionsBackend {
+  public:
+    ServerSessionsFlash(uint32_t start, uint32_t sectors, uint8_t entries = 8);
+    ~ServerSessionsFlash() override;
+
+    // Loads the newest stored sessions, from loop context only.  Otherwise
+    // done after the first handshake, which can't resume a stored session.
+    bool begin();
+
+    uint32_t save(const br_ssl_session_parameters *params) override;
+    bool load(br_ssl_session_parameters *params) override;
+
+  private:
+    struct Record {
+      uint32_t magic;
+      uint32_t seq;
+      br_ssl_session_parameters params;
+      uint32_t crc; // Of the record with unsealed params
+    };
+    struct Entry {
+      uint32_t seq;
+      bool used;
+      bool dirty; // Not written to flash yet
+      br_ssl_session_parameters params;
+    };
+    static constexpr uint32_t RECORD_SIZE = 128;
+    static constexpr uint32_t SECTOR_SIZE = 4096;
+    static constexpr uint32_t RECORDS_PER_SECTOR = SECTOR_SIZE / RECORD_SIZE;
+    bool _read(uint32_t slot, Record *rec) const;
+    void _write(const Entry &entry);
+    void _schedule();
+    void _flush();
+    Entry *_find(const uint8_t *sessionId);
+    Entry *_oldest();
+    uint32_t _slots() const { return _sectors * RECORDS_PER_SECTOR; }
+
+    uint32_t _start;
+    uint32_t _sectors;
+    uint32_t _head; // Next slot to write
+    uint32_t _seq;  // Sequence number of the next record
+    bool _init;
+    Entry *_entries;
+    uint8_t _size;
+    std::shared_ptr<bool> _flushPending; // Expires when this object goes away
+};
+
 // Cache for the TLS sessions of multiple clients.
-// Use with BearSSL::WiFiServerSecure::setCache
+// Use with BearSSL::WiFiServerSecure::setCache, may be shared by several servers
 class ServerSessions {
   friend class WiFiClientSecureCtx;
 
   public:
+    struct Stats {
+      uint32_t hits;      // Sessions resumed
+      uint32_t misses;    // Resumptions asked for but not found
+      uint32_t saves;     // New sessions stored
+      uint32_t evictions; // Sessions dropped to make room
+    };
+
     // Uses the given buffer to cache the given number of sessions and initializes it.
     ServerSessions(ServerSession *sessions, uint32_t size) : ServerSessions(sessions, size, false) {}
 
@@ -168,17 +385,28 @@ class ServerSessions {
     // returned by size() will be 0.
     ServerSessions(uint32_t size) : ServerSessions(size > 0 ? new ServerSession[size] : nullptr, size, true) {}
 
+    // Stores sessions in the given backend (RTC memory, flash, ...), which must outlive this object.
+    ServerSessions(ServerSessionsBackend *backend);
+
     ~ServerSessions();
 
-    // Returns the number of sessions the cache can hold.
+    // Returns the number of sessions the RAM cache can hold (0 with a backend).
     uint32_t size() { return _size; }
 
+    const Stats &stats() const { return _stats; }
+    void resetStats() { memset(&_stats, 0, sizeof(_stats)); }
+
   private:
     ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic);
 
     // Returns the cache's vtable or null if the cache has no capacity.
     const br_ssl_session_cache_class **getCache();
 
+    static void _save(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx,
+                      const br_ssl_session_parameters *params);
+    static int _load(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx,
+                     br_ssl_session_parameters *params);
+
     // Size of the store in sessions.
     uint32_t _size;
     // Store where the information for the sessions are stored.
@@ -186,9 +414,55 @@ class ServerSessions {
     // Whether the store is dynamically allocated.
     // If this is true, the store needs to be freed in the destructor.
     bool _isDynamic;
+    // Optional external store, replaces _cache
+    ServerSessionsBackend *_backend;
 
     // Cache of the server using the _store.
     br_ssl_session_cache_lru _cache;
+
+    // Handed to BearSSL, forwards to _cache or _backend and keeps statistics
+    struct {
+      const br_ssl_session_cache_class *vtable;
+      ServerSessions *self;
+    } _dispatch;
+    Stats _stats;
+};
+
+// Pool of TLS record buffers shared by every WiFiClientSecure connection.
+// Buffers of closed connections are kept (up to the idle limit) and handed
+// to the next connection asking for the same size, which avoids heap churn
+// and fragmentation when several sessions come and go.  An optional budget
+// refuses new buffers before the heap is exhausted.
+class IOBufferPool {
+  public:
+    struct Stats {
+      uint32_t inUse;     // Bytes lent to live connections
+      uint32_t peakInUse; // High water mark of inUse
+      uint32_t idle;      // Bytes kept for reuse
+      uint32_t hits;      // Buffers served from the idle list
+      uint32_t misses;    // Buffers allocated from the heap
+      uint32_t failures;  // Requests refused (budget exceeded or OOM)
+    };
+
+    // Returns a buffer of exactly size bytes, or nullptr.  Released back to the
+    // pool when the last reference goes away.
+    static std::shared_ptr<unsigned char> get(size_t size);
+
+    // Maximum number of bytes of idle buffers to keep, 0 (default) frees on release
+    static void setIdleLimit(size_t bytes);
+    // Maximum number of bytes lent at once, 0 (default) is unlimited
+    static void setBudget(size_t bytes);
+    // Returns all idle buffers to the heap
+    static void trim();
+
+    static const Stats &stats() { return _stats; }
+    static void resetStats();
+
+  private:
+    static void _release(unsigned char *buf, size_t size);
+    static unsigned char *_alloc(size_t size);
+
+    static Stats _stats;
 };
 
 // Updater SHA256 hash and signature verification
@@ -0,0 +1,189 @@
+/*
+  BearSSLSessionCache.cpp - client session cache lookup, kept apart from
+  BearSSLHelpers.cpp so it builds without BearSSL (i.e. for the host tests)
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "BearSSLHelpers.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+  // FNV-1a, 64 bits so that two trust settings used with the same server
+  // don't collide in practice
+  uint64_t fnv(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+      hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  uint64_t fnv(uint64_t hash, uint32_t value) {
+    return fnv(hash, &value, sizeof(value));
+  }
+
+  constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+};
+
+namespace BearSSL {
+
+SessionCache *SessionCache::_default = nullptr;
+
+SessionCache::SessionCache(uint8_t entries) : _stamp(0), _hasKey(false) {
+  _entries = entries ? new (std::nothrow) Entry[entries]() : nullptr;
+  _size = _entries ? entries : 0;
+  memset(_key, 0, sizeof(_key));
+  resetStats();
+  clear();
+}
+
+SessionCache::~SessionCache() {
+  if (_default == this) {
+    _default = nullptr;
+  }
+  clear();
+  delete[] _entries;
+  memset(_key, 0, sizeof(_key));
+}
+
+void SessionCache::clear() {
+  for (uint8_t i = 0; i < _size; i++) {
+    _release(_entries[i]);
+  }
+  _stamp = 0;
+}
+
+void SessionCache::_release(Entry &entry) {
+  free(entry.host);
+  memset(&entry, 0, sizeof(entry));
+}
+
+uint32_t SessionCache::_hash(const char *host, uint16_t port, uint64_t trust) {
+  uint64_t hash = fnv(FNV_OFFSET, host, strlen(host) + 1);
+  hash = fnv(hash, port);
+  hash = fnv(hash, &trust, sizeof(trust));
+  uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+  return folded ? folded : 1;
+}
+
+bool SessionCache::_matches(const Entry &entry, const Key &key) {
+  return (entry.hash == key.hash) && (entry.port == key.port) && (entry.trust == key.trust) &&
+         entry.host && !strcmp(entry.host, key.host.c_str());
+}
+
+SessionCache::Key SessionCache::makeKey(const char *host, uint16_t port, const Trust &trust) {
+  uint64_t hash = FNV_OFFSET;
+  hash = fnv(hash, (trust.insecure ? 1 : 0) | (trust.selfSigned ? 2 : 0) | (trust.fingerprint ? 4 : 0));
+  if (trust.fingerprint) {
+    hash = fnv(hash, trust.fingerprint, 20);
+  }
+  // Lengths go in first so that adjacent fields can't be shifted into each other
+  if (trust.rsaKey) {
+    hash = fnv(hash, trust.rsaKey->nlen);
+    hash = fnv(hash, trust.rsaKey->n, trust.rsaKey->nlen);
+    hash = fnv(hash, trust.rsaKey->elen);
+    hash = fnv(hash, trust.rsaKey->e, trust.rsaKey->elen);
+  }
+  if (trust.ecKey) {
+    hash = fnv(hash, trust.ecKey->curve);
+    hash = fnv(hash, trust.ecKey->qlen);
+    hash = fnv(hash, trust.ecKey->q, trust.ecKey->qlen);
+  }
+  hash = fnv(hash, trust.anchorCount);
+  for (size_t i = 0; trust.anchors && i < trust.anchorCount; i++) {
+    const br_x509_trust_anchor *ta = &trust.anchors[i];
+    hash = fnv(hash, ta->dn.len);
+    hash = fnv(hash, ta->dn.data, ta->dn.len);
+    hash = fnv(hash, ta->flags);
+    hash = fnv(hash, ta->pkey.key_type);
+    if (ta->pkey.key_type == BR_KEYTYPE_RSA) {
+      hash = fnv(hash, ta->pkey.key.rsa.nlen);
+      hash = fnv(hash, ta->pkey.key.rsa.n, ta->pkey.key.rsa.nlen);
+      hash = fnv(hash, ta->pkey.key.rsa.elen);
+      hash = fnv(hash, ta->pkey.key.rsa.e, ta->pkey.key.rsa.elen);
+    } else if (ta->pkey.key_type == BR_KEYTYPE_EC) {
+      hash = fnv(hash, ta->pkey.key.ec.curve);
+      hash = fnv(hash, ta->pkey.key.ec.qlen);
+      hash = fnv(hash, ta->pkey.key.ec.q, ta->pkey.key.ec.qlen);
+    }
+  }
+  hash = fnv(hash, &trust.certStore, sizeof(trust.certStore));
+  hash = fnv(hash, trust.chainCount);
+  for (size_t i = 0; trust.chain && i < trust.chainCount; i++) {
+    hash = fnv(hash, trust.chain[i].data_len);
+    hash = fnv(hash, trust.chain[i].data, trust.chain[i].data_len);
+  }
+
+  Key key;
+  key.host = host ? host : "";
+  key.port = port;
+  key.trust = hash;
+  key.hash = _hash(key.host.c_str(), port, hash);
+  return key;
+}
+
+bool SessionCache::lookup(const Key &key, br_ssl_session_parameters *params) {
+  for (uint8_t i = 0; i < _size; i++) {
+    if (_matches(_entries[i], key)) {
+      _entries[i].stamp = ++_stamp;
+      memcpy(params, &_entries[i].params, sizeof(*params));
+      return true;
+    }
+  }
+  return false;
+}
+
+void SessionCache::store(const Key &key, const br_ssl_session_parameters *params) {
+  if (!_size) {
+    return;
+  }
+  // Same key, else an empty entry, else the least recently used one
+  Entry *slot = nullptr;
+  for (uint8_t i = 0; i < _size && !slot; i++) {
+    if (_matches(_entries[i], key)) {
+      slot = &_entries[i];
+    }
+  }
+  if (!slot) {
+    for (uint8_t i = 0; i < _size && !slot; i++) {
+      if (!_entries[i].hash) {
+        slot = &_entries[i];
+      }
+    }
+    if (!slot) {
+      slot = &_entries[0];
+      for (uint8_t i = 1; i < _size; i++) {
+        if (_entries[i].stamp < slot->stamp) {
+          slot = &_entries[i];
+        }
+      }
+      _stats.evictions++;
+    }
+    _release(*slot);
+    slot->host = strdup(key.host.c_str());
+    if (!slot->host) {
+      return;
+    }
+    slot->hash = key.hash;
+    slot->port = key.port;
+    slot->trust = key.trust;
+  }
+  slot->stamp = ++_stamp;
+  memcpy(&slot->params, params, sizeof(*params));
+}
+
+}
@@ -26,6 +26,8 @@
 #include "PolledTimeout.h"
 #include "ESP8266WiFiMulti.h"
 #include <coredecls.h>
+#include <Schedule.h>
+#include <algorithm>
 #include <limits.h>
 #include <string.h>
 
@@ -74,45 +76,28 @@ static void printWiFiStatus(wl_status_t status)
 #endif
 }
 
-/**
- * @brief Wait for WiFi connect status change, protected with timeout
- * @param connectTimeoutMs
- *      WiFi connection timeout in ms
- * @return
- *      WiFi connection status
- */
-static wl_status_t waitWiFiConnect(uint32_t connectTimeoutMs)
-{
-    wl_status_t status = WL_CONNECT_FAILED;
-    // Wait for WiFi to connect
-    // stop waiting upon status checked every 100ms or when timeout is reached
-    esp_delay(connectTimeoutMs,
-        [&status]() {
-            status = WiFi.status();
-            return status != WL_CONNECTED && status != WL_CONNECT_FAILED;
-        }, 100);
-
-    // Check status
-    if (status == WL_CONNECTED) {
-        // Connected, print WiFi status
-        printWiFiStatus(status);
-
-        // Return WiFi status
-        return status;
-    } else if (status == WL_CONNECT_FAILED) {
-        DEBUG_WIFI_MULTI("[WIFIM] Connect failed\n");
-    } else {
-        DEBUG_WIFI_MULTI("[WIFIM] Connect timeout\n");
-    }
-
-    // Return WiFi connect failed
-    return WL_CONNECT_FAILED;
-}
-
 /**
  * @brief Constructor
  */
-ESP8266WiFiMulti::ESP8266WiFiMulti() : _firstRun(true)
+ESP8266WiFiMulti::ESP8266WiFiMulti() :
+    _firstRun(true),
+    _polling(false),
+    _fastAttempt(false),
+    _eventPending(false),
+    _state(WifiMultiState::Idle),
+    _hysteresis(0),
+    _currentAP(-1),
+    _nextCandidate(0),
+    _nextHidden(0),
+    _scanTTL(0),
+    _scanTime(0),
+    _stepStart(0),
+    _stepTimeout(0),
+    _cycleStart(0),
+    _gotIPTime(0),
+    _asyncTimeoutMs(WIFI_CONNECT_TIMEOUT_MS),
+    _fast(),
+    _stats()
 {
 }
 
@@ -121,6 +106,9 @@ ESP8266WiFiMulti::ESP8266WiFiMulti() : _firstRun(true)
  */
 ESP8266WiFiMulti::~ESP8266WiFiMulti()
 {
+    // Cancel scheduled steps
+    stopAsync();
+
     // Cleanup memory
     APlistClean();
 }
@@ -167,6 +155,9 @@ bool ESP8266WiFiMulti::existsAP(const char *ssid, const char *passphrase)
 
 /**
  * @brief Keep WiFi connected to Access Point with strongest WiFi signal (RSSI)
+ * @details
+ *      Blocks until connected or until every candidate failed. Use poll() or
+ *      runAsync() to keep loop() running while connecting.
  * @param connectTimeoutMs
  *      Timeout in ms per WiFi connection (excluding fixed 5 seconds scan timeout)
  * @return
@@ -174,8 +165,243 @@ bool ESP8266WiFiMulti::existsAP(const char *ssid, const char *passphrase)
  */
 wl_status_t ESP8266WiFiMulti::run(uint32_t connectTimeoutMs)
 {
-    int8_t scanResult;
-    wl_status_t status;
+    wl_status_t status = poll(connectTimeoutMs);
+
+    // Drive the state machine until the connection cycle is over
+    while (_state != WifiMultiState::Idle) {
+        esp_delay(10);
+        status = poll(connectTimeoutMs);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Advance the connection state machine by one step, never blocks
+ * @param connectTimeoutMs
+ *      Timeout in ms per WiFi connection
+ * @retval WL_CONNECTED
+ *      Connected
+ * @retval WL_DISCONNECTED
+ *      Scan or connection in progress, call again
+ * @retval WL_CONNECT_FAILED
+ *      None of the known networks could be joined
+ * @retval WL_NO_SSID_AVAIL
+ *      WiFi scan failed
+ */
+wl_status_t ESP8266WiFiMulti::poll(uint32_t connectTimeoutMs)
+{
+    // runAsync() steps are also run from yield() while run() waits
+    if (_polling) {
+        return WiFi.status();
+    }
+
+    registerEvents();
+
+    _polling = true;
+    _eventPending = false;
+    wl_status_t status = step(connectTimeoutMs);
+    _polling = false;
+
+    return status;
+}
+
+/**
+ * @brief Keep WiFi connected from the scheduler, loop() is never blocked
+ * @param connectTimeoutMs
+ *      Timeout in ms per WiFi connection
+ * @param intervalMs
+ *      Interval between steps, WiFi events trigger a step immediately
+ * @retval true
+ *      Success
+ * @retval false
+ *      Scheduler queue full
+ */
+bool ESP8266WiFiMulti::runAsync(uint32_t connectTimeoutMs, uint32_t intervalMs)
+{
+    _asyncTimeoutMs = connectTimeoutMs;
+
+    if (_asyncToken) {
+        // Already scheduled
+        return true;
+    }
+
+    _asyncToken = std::make_shared<bool>(true);
+    std::weak_ptr<bool> token = _asyncToken;
+
+    bool scheduled = schedule_recurrent_function_us([this, token]() {
+        if (token.expired()) {
+            return false;
+        }
+        poll(_asyncTimeoutMs);
+        return true;
+    }, intervalMs * 1000, [this, token]() {
+        return !token.expired() && _eventPending;
+    });
+
+    if (!scheduled) {
+        _asyncToken.reset();
+    }
+    return scheduled;
+}
+
+/**
+ * @brief Stop scheduled steps started by runAsync()
+ */
+void ESP8266WiFiMulti::stopAsync()
+{
+    _asyncToken.reset();
+}
+
+/**
+ * @brief Get BSSID and channel of the last successful connection
+ * @param info
+ *      Filled with the connection details
+ * @retval true
+ *      Success
+ * @retval false
+ *      No connection recorded yet
+ */
+bool ESP8266WiFiMulti::getFastConnect(WifiFastConnect &info) const
+{
+    info = _fast;
+    return _fast.channel != 0;
+}
+
+/**
+ * @brief Restore connection details, e.g. from RTC memory after deep sleep
+ * @details
+ *      The next connection cycle tries this BSSID and channel first and
+ *      skips the scan when it succeeds.
+ * @param info
+ *      Connection details as returned by getFastConnect()
+ */
+void ESP8266WiFiMulti::setFastConnect(const WifiFastConnect &info)
+{
+    _fast = info;
+    if (_fast.ap >= _APlist.size()) {
+        _fast.channel = 0;
+    }
+}
+
+/**
+ * @brief Register WiFi event handlers, once WiFi is up
+ */
+void ESP8266WiFiMulti::registerEvents()
+{
+    if (_onGotIP) {
+        return;
+    }
+
+    _onGotIP = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP&) {
+        _gotIPTime = millis();
+        _eventPending = true;
+    });
+    _onDisconnected = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected&) {
+        _eventPending = true;
+    });
+}
+
+/**
+ * @brief One step of the connection state machine
+ * @param connectTimeoutMs
+ *      WiFi connect timeout in ms
+ * @return
+ *      WiFi connection status
+ */
+wl_status_t ESP8266WiFiMulti::step(uint32_t connectTimeoutMs)
+{
+    wl_status_t status = WiFi.status();
+
+    switch (_state) {
+        case WifiMultiState::Idle:
+            if (status == WL_CONNECTED) {
+                // Already connected
+                return status;
+            }
+            return startCycle(connectTimeoutMs);
+
+        case WifiMultiState::Scanning: {
+            int8_t scanResult = WiFi.scanComplete();
+            if (scanResult < 0) {
+                if (!stepExpired()) {
+                    return WL_DISCONNECTED;
+                }
+                // Scan did not report completion
+                DEBUG_WIFI_MULTI("[WIFIM] Scan timeout\n");
+                _state = WifiMultiState::Idle;
+                _stats.failures++;
+                return WL_NO_SSID_AVAIL;
+            }
+
+            _stats.scanMs = millis() - _stepStart;
+
+            // Print WiFi scan result
+            printWiFiScan();
+
+            // Keep the ranked known networks, release the SDK copy
+            storeScan(scanResult);
+            WiFi.scanDelete();
+
+            return connectNext(connectTimeoutMs);
+        }
+
+        case WifiMultiState::Connecting:
+            if (status == WL_CONNECTED) {
+                connected();
+                return status;
+            }
+            if (status != WL_CONNECT_FAILED && status != WL_WRONG_PASSWORD && !stepExpired()) {
+                return WL_DISCONNECTED;
+            }
+
+            if (status == WL_CONNECT_FAILED || status == WL_WRONG_PASSWORD) {
+                DEBUG_WIFI_MULTI("[WIFIM] Connect failed\n");
+            } else {
+                DEBUG_WIFI_MULTI("[WIFIM] Connect timeout\n");
+            }
+
+            if (_fastAttempt) {
+                // Stored BSSID/channel is stale, fall back to scanning
+                _fastAttempt = false;
+                _fast.channel = 0;
+                return startCycle(connectTimeoutMs);
+            }
+
+            return connectNext(connectTimeoutMs);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Start a connection cycle
+ * @details
+ *      Tries the stored BSSID/channel (or the SDK saved config on first run)
+ *      without scanning, then cached or fresh scan results.
+ * @param connectTimeoutMs
+ *      WiFi connect timeout in ms
+ * @return
+ *      WiFi connection status
+ */
+wl_status_t ESP8266WiFiMulti::startCycle(uint32_t connectTimeoutMs)
+{
+    if (_state == WifiMultiState::Idle) {
+        _cycleStart = millis();
+        _gotIPTime = 0;
+    }
+
+    _nextCandidate = 0;
+    _nextHidden = 0;
+    _tried.assign(_APlist.size(), false);
+
+    // Fast reconnect, skipping the scan
+    if (_fast.channel && _fast.ap < _APlist.size()) {
+        DEBUG_WIFI_MULTI("[WIFIM] Fast connect %s ch %d\n", _APlist[_fast.ap].ssid, _fast.channel);
+        _fastAttempt = true;
+        _firstRun = false;
+        return beginConnect(_fast.ap, _fast.channel, _fast.bssid, connectTimeoutMs);
+    }
 
     // Fast connect to previous WiFi on startup
     if (_firstRun) {
@@ -188,42 +414,32 @@ wl_status_t ESP8266WiFiMulti::run(uint32_t connectTimeoutMs)
             // Connect to previous saved WiFi
             WiFi.begin();
 
-            // Wait for status change
-            status = waitWiFiConnect(connectTimeoutMs);
+            _fastAttempt = true;
+            _currentAP = -1;
+            _state = WifiMultiState::Connecting;
+            _stepStart = millis();
+            _stepTimeout = connectTimeoutMs;
+            return WL_DISCONNECTED;
         }
     }
 
-    // Check connection state
-    status = WiFi.status();
-    if (status == WL_CONNECTED) {
-        // Already connected
-        return status;
-    }
-
-    // Start WiFi scan
-    scanResult = startScan();
-    if (scanResult < 0) {
-        // No WiFi scan results
-        return WL_NO_SSID_AVAIL;
+    // Reuse recent scan results
+    if (_scanTTL && _scanTime && (millis() - _scanTime < _scanTTL)) {
+        DEBUG_WIFI_MULTI("[WIFIM] Using cached scan\n");
+        _stats.scanCacheHits++;
+        return connectNext(connectTimeoutMs);
     }
 
-    // Try to connect to multiple WiFi's with strongest signal (RSSI)
-    return connectWiFiMulti(connectTimeoutMs);
+    return startScan();
 }
 
 /**
- * @brief Start WiFi scan
- * @retval >0
- *      Number of detected WiFi SSID's
- * @retval 0
- *      No WiFi connections found
- * @retval -2
- *      WiFi scan failed
+ * @brief Start asynchronous WiFi scan
+ * @return
+ *      WL_DISCONNECTED while scanning
  */
-int8_t ESP8266WiFiMulti::startScan()
+wl_status_t ESP8266WiFiMulti::startScan()
 {
-    int8_t scanResult;
-
     DEBUG_WIFI_MULTI("[WIFIM] Start scan\n");
 
     // Clean previous scan
@@ -235,36 +451,23 @@ int8_t ESP8266WiFiMulti::startScan()
     // Start wifi scan in async mode
     WiFi.scanNetworks(true);
 
-    // Wait for WiFi scan change or timeout
-    // stop waiting upon status checked every 100ms or when timeout is reached
-    esp_delay(WIFI_SCAN_TIMEOUT_MS,
-        [&scanResult]() {
-            scanResult = WiFi.scanComplete();
-            return scanResult < 0;
-        }, 100);
-    // Check for scan timeout which may occur when scan does not report completion
-    if (scanResult < 0) {
-        DEBUG_WIFI_MULTI("[WIFIM] Scan timeout\n");
-        return WIFI_SCAN_FAILED;
-    }
-
-    // Print WiFi scan result
-    printWiFiScan();
-
-    // Return (positive) number of detected WiFi networks
-    return scanResult;
+    _stats.scans++;
+    _state = WifiMultiState::Scanning;
+    _stepStart = millis();
+    _stepTimeout = WIFI_SCAN_TIMEOUT_MS;
+    return WL_DISCONNECTED;
 }
 
 /**
- * @brief Connect to multiple WiFi's
- * @param connectTimeoutMs
- *      WiFi connect timeout in ms
- * @return
- *      WiFi connection status
+ * @brief Rank known networks from the scan results
+ * @details
+ *      The last connected BSSID gets the RSSI hysteresis as a bonus, so
+ *      the node only moves to another AP when it is clearly stronger.
+ * @param scanResult
+ *      Number of scan results
  */
-wl_status_t ESP8266WiFiMulti::connectWiFiMulti(uint32_t connectTimeoutMs)
+void ESP8266WiFiMulti::storeScan(int8_t scanResult)
 {
-    int8_t scanResult;
     String ssid;
     int32_t rssi;
     uint8_t encType;
@@ -272,98 +475,156 @@ wl_status_t ESP8266WiFiMulti::connectWiFiMulti(uint32_t connectTimeoutMs)
     int32_t channel;
     bool hidden;
 
-    // Get scan results
-    scanResult = WiFi.scanComplete();
+    _candidates.clear();
 
     // Find known WiFi networks
-    uint8_t known[_APlist.size()];
-    uint8_t numNetworks = 0;
     for (int8_t i = 0; i < scanResult; i++) {
         // Get network information
         WiFi.getNetworkInfo(i, ssid, encType, rssi, bssid, channel, hidden);
 
         // Check if the WiFi network contains an entry in AP list
-        for (auto entry : _APlist) {
+        for (uint8_t j = 0; j < _APlist.size(); j++) {
             // Check SSID
-            if (ssid == entry.ssid) {
+            if (ssid == _APlist[j].ssid) {
                 // Known network
-                known[numNetworks++] = i;
+                WifiAPCandidate candidate;
+                candidate.ap = j;
+                memcpy(candidate.bssid, bssid, sizeof(candidate.bssid));
+                candidate.channel = channel;
+                candidate.rssi = rssi;
+                _candidates.push_back(candidate);
             }
         }
     }
 
-    // Sort WiFi networks by RSSI
-    for (int i = 0; i < numNetworks; i++) {
-        for (int j = i + 1; j < numNetworks; j++) {
-            if (WiFi.RSSI(known[j]) > WiFi.RSSI(known[i])) {
-                int8_t tmp;
-
-                // Swap indices
-                tmp = known[i];
-                known[i] = known[j];
-                known[j] = tmp;
-            }
-        }
+    // Sort WiFi networks by RSSI, favouring the last connected BSSID
+    const uint8_t *last = _fast.bssid;
+    int32_t bonus = _hysteresis;
+    std::stable_sort(_candidates.begin(), _candidates.end(),
+        [last, bonus](const WifiAPCandidate &a, const WifiAPCandidate &b) {
+            int32_t ra = a.rssi + (memcmp(a.bssid, last, 6) ? 0 : bonus);
+            int32_t rb = b.rssi + (memcmp(b.bssid, last, 6) ? 0 : bonus);
+            return ra > rb;
+        });
+
+    _scanTime = millis();
+    if (!_scanTime) {
+        _scanTime = 1;
     }
+}
 
-    // Print sorted indices
-    DEBUG_WIFI_MULTI("[WIFIM] Sorted indices: ");
-    for (int8_t i = 0; i < numNetworks; i++) {
-        DEBUG_WIFI_MULTI("%d ", known[i]);
-    }
-    DEBUG_WIFI_MULTI("\n");
+/**
+ * @brief Connect to the next candidate
+ * @param connectTimeoutMs
+ *      WiFi connect timeout in ms
+ * @return
+ *      WiFi connection status
+ */
+wl_status_t ESP8266WiFiMulti::connectNext(uint32_t connectTimeoutMs)
+{
+    _fastAttempt = false;
 
-    // Create indices for AP connection failures
-    uint8_t connectSkipIndex[_APlist.size()];
-    memset(connectSkipIndex, 0, sizeof(connectSkipIndex));
+    // addAP() may have grown the list since the cycle started
+    _tried.resize(_APlist.size(), false);
 
     // Connect to known WiFi AP's sorted by RSSI
-    for (int8_t i = 0; i < numNetworks; i++) {
-        // Get network information
-        WiFi.getNetworkInfo(known[i], ssid, encType, rssi, bssid, channel, hidden);
-
-        for (uint8_t j = 0; j < _APlist.size(); j++) {
-            auto &entry = _APlist[j];
-
-            // Check SSID
-            if (ssid == entry.ssid) {
-                DEBUG_WIFI_MULTI("[WIFIM] Connecting %s\n", ssid.c_str());
+    while (_nextCandidate < _candidates.size()) {
+        const WifiAPCandidate &candidate = _candidates[_nextCandidate++];
+        if (candidate.ap >= _APlist.size()) {
+            // AP list changed since the scan
+            continue;
+        }
 
-                // Connect to WiFi
-                WiFi.begin(ssid, entry.passphrase, channel, bssid);
+        DEBUG_WIFI_MULTI("[WIFIM] Connecting %s\n", _APlist[candidate.ap].ssid);
 
-                // Wait for status change
-                if (waitWiFiConnect(connectTimeoutMs) == WL_CONNECTED) {
-                    return WL_CONNECTED;
-                }
+        // Failed connects are skipped for hidden SSID connects
+        _tried[candidate.ap] = true;
+        return beginConnect(candidate.ap, candidate.channel, candidate.bssid, connectTimeoutMs);
+    }
 
-                // Failed to connect, skip for hidden SSID connects
-                connectSkipIndex[j] = true;
-            }
+    // Try to connect to hidden AP's which are not reported by WiFi scan
+    while (_nextHidden < _APlist.size()) {
+        uint8_t ap = _nextHidden++;
+        if (!_tried[ap]) {
+            DEBUG_WIFI_MULTI("[WIFIM] Try hidden connect %s\n", _APlist[ap].ssid);
+            return beginConnect(ap, 0, nullptr, connectTimeoutMs);
         }
     }
 
-    // Try to connect to hidden AP's which are not reported by WiFi scan
-    for (uint8_t i = 0; i < _APlist.size(); i++) {
-        auto &entry = _APlist[i];
+    DEBUG_WIFI_MULTI("[WIFIM] Could not connect\n");
 
-        if (!connectSkipIndex[i]) {
-            DEBUG_WIFI_MULTI("[WIFIM] Try hidden connect %s\n", entry.ssid);
+    // Rescan next time
+    _scanTime = 0;
+    _state = WifiMultiState::Idle;
+    _stats.failures++;
 
-            // Connect to WiFi
-            WiFi.begin(entry.ssid, entry.passphrase);
+    // Could not connect to any WiFi network
+    return WL_CONNECT_FAILED;
+}
+
+/**
+ * @brief Start connecting to an AP list entry
+ * @param ap
+ *      Index in the AP list
+ * @param channel
+ *      WiFi channel, 0 when unknown
+ * @param bssid
+ *      AP BSSID, nullptr when unknown
+ * @param connectTimeoutMs
+ *      WiFi connect timeout in ms
+ * @return
+ *      WL_DISCONNECTED while connecting
+ */
+wl_status_t ESP8266WiFiMulti::beginConnect(uint8_t ap, int32_t channel, const uint8_t *bssid, uint32_t connectTimeoutMs)
+{
+    auto &entry = _APlist[ap];
+
+    // Connect to WiFi
+    WiFi.begin(entry.ssid, entry.passphrase, channel, bssid);
+
+    _currentAP = ap;
+    _state = WifiMultiState::Connecting;
+    _stepStart = millis();
+    _stepTimeout = connectTimeoutMs;
+    return WL_DISCONNECTED;
+}
+
+/**
+ * @brief Record a successful connection
+ */
+void ESP8266WiFiMulti::connected()
+{
+    // GOT_IP timestamp is exact, polling may run a little later
+    uint32_t now = _gotIPTime ? _gotIPTime : millis();
+    _stats.connectMs = now - _cycleStart;
+    _stats.connects++;
+    if (_fastAttempt) {
+        _stats.fastConnects++;
+    }
 
-            // Wait for status change
-            if (waitWiFiConnect(connectTimeoutMs) == WL_CONNECTED) {
-                return WL_CONNECTED;
+    // SDK saved config does not tell which entry was used
+    if (_currentAP < 0) {
+        for (uint8_t i = 0; i < _APlist.size(); i++) {
+            if (WiFi.SSID() == _APlist[i].ssid) {
+                _currentAP = i;
+                break;
             }
         }
     }
 
-    DEBUG_WIFI_MULTI("[WIFIM] Could not connect\n");
+    // Remember BSSID/channel for the next fast connect
+    if (_currentAP >= 0) {
+        memcpy(_fast.bssid, WiFi.BSSID(), sizeof(_fast.bssid));
+        _fast.channel = WiFi.channel();
+        _fast.ap = _currentAP;
+    }
 
-    // Could not connect to any WiFi network
-    return WL_CONNECT_FAILED;
+    _fastAttempt = false;
+    _state = WifiMultiState::Idle;
+
+    // Connected, print WiFi status
+    printWiFiStatus(WL_CONNECTED);
+    DEBUG_WIFI_MULTI("[WIFIM]   Time: %u ms\n", _stats.connectMs);
 }
 
 // ##################################################################################
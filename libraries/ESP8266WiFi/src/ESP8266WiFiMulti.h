@@ -28,6 +28,7 @@
 #define WIFI_CLIENT_MULTI_H_
 
 #include "ESP8266WiFi.h"
+#include <memory>
 #include <vector>
 
 #ifdef DEBUG_ESP_WIFI
@@ -50,6 +51,11 @@
 #define WIFI_SCAN_TIMEOUT_MS        5000
 #endif
 
+//! Default interval in ms between runAsync() steps
+#ifndef WIFI_MULTI_ASYNC_INTERVAL_MS
+#define WIFI_MULTI_ASYNC_INTERVAL_MS 50
+#endif
+
 struct WifiAPEntry {
     char *ssid;
     char *passphrase;
@@ -57,6 +63,38 @@ struct WifiAPEntry {
 
 typedef std::vector<WifiAPEntry> WifiAPlist;
 
+//! Known network seen by the last scan, ranked by RSSI
+struct WifiAPCandidate {
+    uint8_t ap;         // index in the AP list
+    uint8_t bssid[6];
+    int32_t channel;
+    int32_t rssi;
+};
+
+//! Last successful connection, can be kept in RTC memory across deep sleep
+struct WifiFastConnect {
+    uint8_t bssid[6];
+    uint8_t channel;    // 0 when invalid
+    uint8_t ap;         // index in the AP list
+};
+
+//! Connection metrics, all times in ms
+struct WifiMultiStats {
+    uint32_t connectMs;     // time-to-connect of the last connection
+    uint32_t scanMs;        // duration of the last scan
+    uint32_t connects;
+    uint32_t fastConnects;  // connections made without scanning
+    uint32_t scans;
+    uint32_t scanCacheHits;
+    uint32_t failures;      // passes over all candidates without a connection
+};
+
+enum class WifiMultiState : uint8_t {
+    Idle,
+    Scanning,
+    Connecting
+};
+
 class ESP8266WiFiMulti
 {
 public:
@@ -67,19 +105,60 @@ public:
     bool existsAP(const char *ssid, const char *passphrase = NULL);
 
     wl_status_t run(uint32_t connectTimeoutMs=WIFI_CONNECT_TIMEOUT_MS);
+    wl_status_t poll(uint32_t connectTimeoutMs=WIFI_CONNECT_TIMEOUT_MS);
+    bool runAsync(uint32_t connectTimeoutMs=WIFI_CONNECT_TIMEOUT_MS, uint32_t intervalMs=WIFI_MULTI_ASYNC_INTERVAL_MS);
+    void stopAsync();
 
     void cleanAPlist();
 
+    void setScanCacheTTL(uint32_t ttlMs) { _scanTTL = ttlMs; }
+    void setRSSIHysteresis(uint8_t dB) { _hysteresis = dB; }
+    bool getFastConnect(WifiFastConnect &info) const;
+    void setFastConnect(const WifiFastConnect &info);
+
+    WifiMultiState state() const { return _state; }
+    const WifiMultiStats &stats() const { return _stats; }
+    void resetStats() { _stats = WifiMultiStats(); }
+
 private:
     WifiAPlist _APlist;
     bool _firstRun;
+    bool _polling;
+    bool _fastAttempt;
+    volatile bool _eventPending;
+    WifiMultiState _state;
+    uint8_t _hysteresis;
+    int16_t _currentAP;
+    size_t _nextCandidate;
+    size_t _nextHidden;
+    uint32_t _scanTTL;
+    uint32_t _scanTime;
+    uint32_t _stepStart;
+    uint32_t _stepTimeout;
+    uint32_t _cycleStart;
+    uint32_t _gotIPTime;
+    uint32_t _asyncTimeoutMs;
+    std::vector<WifiAPCandidate> _candidates;
+    std::vector<bool> _tried;
+    WifiFastConnect _fast;
+    WifiMultiStats _stats;
+    std::shared_ptr<bool> _asyncToken;
+    WiFiEventHandler _onGotIP;
+    WiFiEventHandler _onDisconnected;
 
     bool APlistAdd(const char *ssid, const char *passphrase = NULL);
     bool APlistExists(const char *ssid, const char *passphrase = NULL);
     void APlistClean();
 
-    wl_status_t connectWiFiMulti(uint32_t connectTimeoutMs);
-    int8_t startScan();
+    wl_status_t step(uint32_t connectTimeoutMs);
+    wl_status_t startCycle(uint32_t connectTimeoutMs);
+    wl_status_t startScan();
+    wl_status_t connectNext(uint32_t connectTimeoutMs);
+    wl_status_t beginConnect(uint8_t ap, int32_t channel, const uint8_t *bssid, uint32_t connectTimeoutMs);
+    void storeScan(int8_t scanResult);
+    void connected();
+    void registerEvents();
+    bool stepExpired() const { return millis() - _stepStart >= _stepTimeout; }
     void printWiFiScan();
 };
 
@@ -73,16 +73,18 @@ bool WiFiClient::getDefaultSync ()
 template<>
 WiFiClient* SList<WiFiClient>::_s_first = 0;
 
+uint32_t WiFiClient::_s_instances = 0;
+
 
 WiFiClient::WiFiClient()
-: _client(0), _owned(0)
+: _client(0), _owned(0), _instanceId(++_s_instances)
 {
     _timeout = 5000;
     WiFiClient::_add(this);
 }
 
 WiFiClient::WiFiClient(ClientContext* client)
-: _client(client), _owned(0)
+: _client(client), _owned(0), _instanceId(++_s_instances)
 {
     _timeout = 5000;
     _client->ref();
@@ -103,12 +105,19 @@ std::unique_ptr<WiFiClient> WiFiClient::clone() const {
     return std::make_unique<WiFiClient>(*this);
 }
 
+std::unique_ptr<WiFiClient> WiFiClient::cloneSettings() const {
+    auto copy = std::make_unique<WiFiClient>();
+    copy->_timeout = _timeout;
+    return copy;
+}
+
 WiFiClient::WiFiClient(const WiFiClient& other)
 {
     _client = other._client;
     _timeout = other._timeout;
     _localPort = other._localPort;
     _owned = other._owned;
+    _instanceId = other._instanceId;
     if (_client)
         _client->ref();
     WiFiClient::_add(this);
@@ -122,6 +131,7 @@ WiFiClient& WiFiClient::operator=(const WiFiClient& other)
     _timeout = other._timeout;
     _localPort = other._localPort;
     _owned = other._owned;
+    _instanceId = other._instanceId;
     if (_client)
         _client->ref();
     return *this;
@@ -143,6 +153,16 @@ int WiFiClient::connect(const String& host, uint16_t port)
 }
 
 int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    return _connect(ip, port, true);
+}
+
+bool WiFiClient::connectNoWait(IPAddress ip, uint16_t port)
+{
+    return _connect(ip, port, false);
+}
+
+int WiFiClient::_connect(IPAddress ip, uint16_t port, bool wait)
 {
     if (_client) {
         stop();
@@ -161,7 +181,7 @@ int WiFiClient::connect(IPAddress ip, uint16_t port)
     _client = new ClientContext(pcb, nullptr, nullptr);
     _client->ref();
     _client->setTimeout(_timeout);
-    int res = _client->connect(ip, port);
+    int res = _client->connect(ip, port, wait);
     if (res == 0) {
         _client->unref();
         _client = nullptr;
@@ -174,6 +194,13 @@ int WiFiClient::connect(IPAddress ip, uint16_t port)
     return 1;
 }
 
+void WiFiClient::setNotify(void (*cb)(void*), void* arg)
+{
+    if (!_client)
+        return;
+    _client->setNotify(cb, arg);
+}
+
 void WiFiClient::setNoDelay(bool nodelay) {
     if (!_client)
         return;
@@ -64,10 +64,24 @@ public:
   // - https://isocpp.github.io/CppCoreGuidelines/CppCoreGuidelines#Rh-copy
   virtual std::unique_ptr<WiFiClient> clone() const;
 
+  // A new, unconnected client with the same settings.  Unlike the copies
+  // made by clone(), it shares no connection (or TLS context) with this one.
+  virtual std::unique_ptr<WiFiClient> cloneSettings() const;
+
+  // Tells this client and its copies apart from any other one.  Unlike the
+  // address, it is not reused by clients created after this one is gone.
+  uint32_t instanceId() const { return _instanceId; }
+
   virtual uint8_t status();
   virtual int connect(IPAddress ip, uint16_t port) override;
   virtual int connect(const char *host, uint16_t port) override;
   virtual int connect(const String& host, uint16_t port);
+  // Starts connecting and returns true without waiting for the connection,
+  // status() is ESTABLISHED once connected. See Coroutine.h.
+  bool connectNoWait(IPAddress ip, uint16_t port);
+  // cb(arg) is called from the network stack on connection, received data,
+  // acknowledged data, close and error. nullptr removes it.
+  void setNotify(void (*cb)(void*), void* arg);
   virtual size_t write(uint8_t) override;
   virtual size_t write(const uint8_t *buf, size_t size) override;
   virtual size_t write_P(PGM_P buf, size_t size);
@@ -154,6 +168,8 @@ public:
 
 protected:
 
+  int _connect(IPAddress ip, uint16_t port, bool wait);
+
   static int8_t _s_connected(void* arg, void* tpcb, int8_t err);
   static void _s_err(void* arg, int8_t err);
 
@@ -162,7 +178,9 @@ protected:
 
   ClientContext* _client;
   WiFiClient* _owned;
+  uint32_t _instanceId;
   static uint16_t _localPort;
+  static uint32_t _s_instances;
 };
 
 #endif
@@ -83,11 +83,13 @@ void WiFiClientSecureCtx::_clear() {
   _now = 0; // You can override or ensure time() is correct w/configTime
   _ta = nullptr;
   setBufferSizes(16384, 512); // Minimum safe
+  _iobuf_auto = true; // Until the application picks its own sizes
   _handshake_done = false;
   _recvapp_buf = nullptr;
   _recvapp_len = 0;
   _oom_err = false;
   _session = nullptr;
+  _sessionCache = nullptr;
   _cipher_list = nullptr;
   _cipher_cnt = 0;
   _tls_min = BR_TLS10;
@@ -103,11 +105,48 @@ void WiFiClientSecureCtx::_clearAuthenticationSettings() {
 }
 
 
+// Everything set up through the public setters, none of the connection state
+void WiFiClientSecureCtx::_copySettings(const WiFiClientSecureCtx &from) {
+  _timeout = from._timeout;
+  _now = from._now;
+  _ta = from._ta;
+  _certStore = from._certStore;
+  _iobuf_in_size = from._iobuf_in_size;
+  _iobuf_out_size = from._iobuf_out_size;
+  _iobuf_auto = from._iobuf_auto;
+  _session = from._session;
+  _sessionCache = from._sessionCache;
+  _use_insecure = from._use_insecure;
+  _use_fingerprint = from._use_fingerprint;
+  memcpy(_fingerprint, from._fingerprint, sizeof(_fingerprint));
+  _use_self_signed = from._use_self_signed;
+  _knownkey = from._knownkey;
+  _knownkey_usages = from._knownkey_usages;
+  _cipher_list = from._cipher_list;
+  _cipher_cnt = from._cipher_cnt;
+  _tls_min = from._tls_min;
+  _tls_max = from._tls_max;
+  _chain = from._chain;
+  _sk = from._sk;
+  _allowed_usages = from._allowed_usages;
+  _cert_issuer_key_type = from._cert_issuer_key_type;
+}
+
+std::unique_ptr<WiFiClient> WiFiClientSecure::cloneSettings() const {
+  std::unique_ptr<WiFiClientSecure> copy(new WiFiClientSecure());
+  copy->_ctx->_copySettings(*_ctx);
+  return copy;
+}
+
 WiFiClientSecureCtx::WiFiClientSecureCtx() : WiFiClient() {
   _clear();
   _clearAuthenticationSettings();
   _certStore = nullptr; // Don't want to remove cert store on a clear, should be long lived
   _sk = nullptr;
+  _chain = nullptr;
+  _allowed_usages = 0;
+  _cert_issuer_key_type = 0;
+  _knownkey_usages = 0;
   stack_thunk_add_ref();
 }
 
@@ -176,6 +215,11 @@ void WiFiClientSecureCtx::setClientECCert(const X509List *chain,
 }
 
 void WiFiClientSecureCtx::setBufferSizes(int recv, int xmit) {
+  _iobuf_auto = false;
+  _setBufferSizes(recv, xmit);
+}
+
+void WiFiClientSecureCtx::_setBufferSizes(int recv, int xmit) {
   // Following constants taken from bearssl/src/ssl/ssl_engine.c (not exported unfortunately)
   const int MAX_OUT_OVERHEAD = 85;
   const int MAX_IN_OVERHEAD = 325;
@@ -1107,14 +1151,70 @@ bool WiFiClientSecureCtx::_installClientX509Validator() {
 }
 
 std::shared_ptr<unsigned char> WiFiClientSecureCtx::_alloc_iobuf(size_t sz)
-{ // Allocate buffer with preference to IRAM
-  HeapSelectIram primary;
-  auto sptr = std::shared_ptr<unsigned char>(new (std::nothrow) unsigned char[sz], std::default_delete<unsigned char[]>());
-  if (!sptr) {
-    HeapSelectDram alternate;
-    sptr = std::shared_ptr<unsigned char>(new (std::nothrow) unsigned char[sz], std::default_delete<unsigned char[]>());
-  }
-  return sptr;
+{ // Shared pool, allocates with preference to IRAM
+  return IOBufferPool::get(sz);
+}
+
+// Fragment lengths learnt per peer, from probeMaxFragmentLength() and from
+// the MFLN outcome of connections sized with them.  Small and round-robin,
+// a gateway only talks to a handful of servers.
+namespace {
+  struct MFLNPeer {
+    IPAddress ip;
+    uint16_t port;
+    uint16_t len; // 0 == MFLN not supported
+  };
+  MFLNPeer _mflnPeers[8];
+  uint8_t _mflnCount = 0;
+  uint8_t _mflnNext = 0;
+};
+
+void WiFiClientSecureCtx::_storeMFLN(IPAddress ip, uint16_t port, uint16_t len) {
+  for (uint8_t i = 0; i < _mflnCount; i++) {
+    if ((_mflnPeers[i].port == port) && (_mflnPeers[i].ip == ip)) {
+      _mflnPeers[i].len = len;
+      return;
+    }
+  }
+  const uint8_t slots = sizeof(_mflnPeers) / sizeof(_mflnPeers[0]);
+  _mflnPeers[_mflnNext] = { ip, port, len };
+  _mflnNext = (_mflnNext + 1) % slots;
+  if (_mflnCount < slots) {
+    _mflnCount++;
+  }
+}
+
+int WiFiClientSecureCtx::_lookupMFLN(IPAddress ip, uint16_t port) {
+  for (uint8_t i = 0; i < _mflnCount; i++) {
+    if ((_mflnPeers[i].port == port) && (_mflnPeers[i].ip == ip)) {
+      return _mflnPeers[i].len;
+    }
+  }
+  return -1;
+}
+
+// Everything deciding which servers are accepted, or who we are to them,
+// so cached sessions are only resumed under the same settings
+SessionCache::Trust WiFiClientSecureCtx::_sessionTrust() const {
+  SessionCache::Trust trust = {};
+  trust.insecure = _use_insecure;
+  trust.selfSigned = _use_self_signed;
+  trust.fingerprint = _use_fingerprint ? _fingerprint : nullptr;
+  if (_knownkey && _knownkey->isRSA()) {
+    trust.rsaKey = _knownkey->getRSA();
+  } else if (_knownkey && _knownkey->isEC()) {
+    trust.ecKey = _knownkey->getEC();
+  }
+  if (_ta) {
+    trust.anchors = _ta->getTrustAnchors();
+    trust.anchorCount = _ta->getCount();
+  }
+  trust.certStore = _certStore;
+  if (_chain) {
+    trust.chain = _chain->getX509Certs();
+    trust.chainCount = _chain->getCount();
+  }
+  return trust;
 }
 
 // Called by connect() to do the actual SSL setup and handshake.
@@ -1131,6 +1231,14 @@ bool WiFiClientSecureCtx::_connectSSL(const char* hostName) {
   }
 #endif
 
+  // Size the receive buffer from what this peer is known to negotiate
+  int mfln = -1;
+  if (_iobuf_auto) {
+    mfln = _lookupMFLN(remoteIP(), remotePort());
+    _setBufferSizes(mfln > 0 ? mfln : 16384, 512);
+    DEBUG_BSSL("_connectSSL: auto buffer size %d (mfln %d)\n", _iobuf_in_size, mfln);
+  }
+
   _sc = std::make_shared<br_ssl_client_context>();
   _eng = &_sc->eng; // Allocation/deallocation taken care of by the _sc shared_ptr
   _iobuf_in = _alloc_iobuf(_iobuf_in_size);
@@ -1184,13 +1292,44 @@ bool WiFiClientSecureCtx::_connectSSL(const char* hostName) {
     br_ssl_engine_set_session_parameters(_eng, _session->getSession());
   }
 
-  if (!br_ssl_client_reset(_sc.get(), hostName, _session?1:0)) {
+  // Otherwise look the peer up in the multi-host cache
+  SessionCache *cache = _session ? nullptr : (_sessionCache ? _sessionCache : SessionCache::getDefault());
+  SessionCache::Key cacheKey;
+  br_ssl_session_parameters offered;
+  bool resume = _session != nullptr;
+  if (cache) {
+    cacheKey = SessionCache::makeKey(hostName ? hostName : remoteIP().toString().c_str(), remotePort(), _sessionTrust());
+    if (cache->lookup(cacheKey, &offered)) {
+      br_ssl_engine_set_session_parameters(_eng, &offered);
+      resume = true;
+    } else {
+      offered.session_id_len = 0;
+    }
+  }
+
+  if (!br_ssl_client_reset(_sc.get(), hostName, resume?1:0)) {
     _freeSSL();
     DEBUG_BSSL("_connectSSL: Can't reset client\n");
     return false;
   }
 
   auto ret = _wait_for_handshake();
+  if (ret && cache) {
+    // Server echoes the offered session ID when it resumes
+    br_ssl_session_parameters params;
+    br_ssl_engine_get_session_parameters(_eng, &params);
+    if (offered.session_id_len && (params.session_id_len == offered.session_id_len) &&
+        !memcmp(params.session_id, offered.session_id, offered.session_id_len)) {
+      cache->_stats.hits++;
+    } else {
+      cache->_stats.misses++;
+    }
+    cache->store(cacheKey, &params);
+  }
+  if ((mfln > 0) && (!ret || !br_ssl_engine_get_mfln_negotiated(_eng))) {
+    // Server did not honor the probed length, use full buffers next time
+    _storeMFLN(remoteIP(), remotePort(), 0);
+  }
 #ifdef DEBUG_ESP_SSL
   if (!ret) {
     char err[256];
@@ -1480,6 +1619,13 @@ static bool _SendAbort(WiFiClient& probe, bool supportsLen) {
 //      same one we sent.  Not critical as only horribly broken servers would
 //      return changed or add their own extensions.
 bool WiFiClientSecure::probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len) {
+  bool supported = _probeMaxFragmentLength(ip, port, len);
+  // Remembered so connections to this peer size their buffers automatically
+  WiFiClientSecureCtx::_storeMFLN(ip, port, supported ? len : 0);
+  return supported;
+}
+
+bool WiFiClientSecure::_probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len) {
   // Hardcoded TLS 1.2 packets used throughout
   static const uint8_t clientHelloHead_P[] PROGMEM = {
     0x16, 0x03, 0x03, 0x00, 0, // TLS header, change last 2 bytes to len
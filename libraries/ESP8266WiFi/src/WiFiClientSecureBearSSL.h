@@ -45,6 +45,9 @@ class WiFiClientSecureCtx : public WiFiClient {
     std::unique_ptr<WiFiClient> clone() const override {
         return nullptr;
     }
+    std::unique_ptr<WiFiClient> cloneSettings() const override {
+        return nullptr;
+    }
 
     int connect(IPAddress ip, uint16_t port) override;
     int connect(const String& host, uint16_t port) override;
@@ -69,6 +72,8 @@ class WiFiClientSecureCtx : public WiFiClient {
 
     // Allow sessions to be saved/restored automatically to a memory area
     void setSession(Session *session) { _session = session; }
+    // Multi-host cache consulted when no Session is set, overrides SessionCache::getDefault()
+    void setSessionCache(SessionCache *cache) { _sessionCache = cache; }
 
     // Don't validate the chain, just accept whatever is given.  VERY INSECURE!
     void setInsecure() {
@@ -109,6 +114,8 @@ class WiFiClientSecureCtx : public WiFiClient {
                          unsigned allowed_usages, unsigned cert_issuer_key_type);
 
     // Sets the requested buffer size for transmit and receive
+    // Unless called, the receive buffer is sized from probeMaxFragmentLength()
+    // results for the peer, falling back to 16KB
     void setBufferSizes(int recv, int xmit);
 
     // Returns whether MFLN negotiation for the above buffer sizes succeeded (after connection)
@@ -153,6 +160,7 @@ class WiFiClientSecureCtx : public WiFiClient {
   private:
     void _clear();
     void _clearAuthenticationSettings();
+    void _copySettings(const WiFiClientSecureCtx &from);
     // Only one of the following two should ever be != nullptr!
     std::shared_ptr<br_ssl_client_context> _sc;
     std::shared_ptr<br_ssl_server_context> _sc_svr;
@@ -170,12 +178,15 @@ class WiFiClientSecureCtx : public WiFiClient {
     CertStoreBase *_certStore;
     int _iobuf_in_size;
     int _iobuf_out_size;
+    bool _iobuf_auto; // Buffer sizes picked per peer from known MFLN support
     bool _handshake_done;
     bool _oom_err;
 
     // Optional storage space pointer for session parameters
     // Will be used on connect and updated on close
     Session *_session;
+    // Optional multi-host session cache, used when _session is not set
+    SessionCache *_sessionCache;
 
     bool _use_insecure;
     bool _use_fingerprint;
@@ -203,6 +214,10 @@ class WiFiClientSecureCtx : public WiFiClient {
     bool _engineConnected(); // Are both socket and the bearssl engine alive?
 
     std::shared_ptr<unsigned char> _alloc_iobuf(size_t sz);
+    void _setBufferSizes(int recv, int xmit);
+    static void _storeMFLN(IPAddress ip, uint16_t port, uint16_t len);
+    static int _lookupMFLN(IPAddress ip, uint16_t port);
+    SessionCache::Trust _sessionTrust() const;
     void _freeSSL();
     int _run_until(unsigned target, bool blocking = true);
     size_t _write(const uint8_t *buf, size_t size, bool pmem);
@@ -255,12 +270,13 @@ class WiFiClientSecure : public WiFiClient {
   public:
 
     WiFiClientSecure():_ctx(new WiFiClientSecureCtx()) { _owned = _ctx.get(); }
-    WiFiClientSecure(const WiFiClientSecure &rhs): WiFiClient(), _ctx(rhs._ctx) { if (_ctx) _owned = _ctx.get(); }
+    WiFiClientSecure(const WiFiClientSecure &rhs): WiFiClient(), _ctx(rhs._ctx) { if (_ctx) _owned = _ctx.get(); _instanceId = rhs._instanceId; }
     ~WiFiClientSecure() override { _ctx = nullptr; }
 
     WiFiClientSecure& operator=(const WiFiClientSecure&) = default;
 
     std::unique_ptr<WiFiClient> clone() const override { return std::unique_ptr<WiFiClient>(new WiFiClientSecure(*this)); }
+    std::unique_ptr<WiFiClient> cloneSettings() const override;
 
     uint8_t status() override { return _ctx->status(); }
     int connect(IPAddress ip, uint16_t port) override { return _ctx->connect(ip, port); }
@@ -291,6 +307,7 @@ class WiFiClientSecure : public WiFiClient {
 
     // Allow sessions to be saved/restored automatically to a memory area
     void setSession(Session *session) { _ctx->setSession(session); }
+    void setSessionCache(SessionCache *cache) { _ctx->setSessionCache(cache); }
 
     // Don't validate the chain, just accept whatever is given.  VERY INSECURE!
     void setInsecure() { _ctx->setInsecure(); }
@@ -319,6 +336,8 @@ class WiFiClientSecure : public WiFiClient {
     }
 
     // Sets the requested buffer size for transmit and receive
+    // Unless called, the receive buffer is sized from probeMaxFragmentLength()
+    // results for the peer, falling back to 16KB
     void setBufferSizes(int recv, int xmit) { _ctx->setBufferSizes(recv, xmit); }
 
     // Returns whether MFLN negotiation for the above buffer sizes succeeded (after connection)
@@ -361,6 +380,8 @@ class WiFiClientSecure : public WiFiClient {
   private:
     std::shared_ptr<WiFiClientSecureCtx> _ctx;
 
+    static bool _probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len);
+
     // Methods for handling server.available() call which returns a client connection.
     friend class WiFiServerSecure; // Server needs to access these constructors
     WiFiClientSecure(ClientContext *client, const X509List *chain, unsigned cert_issuer_key_type,
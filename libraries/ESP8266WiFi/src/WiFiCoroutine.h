@@ -0,0 +1,193 @@
+/*
+ WiFiCoroutine.h - awaitable WiFiClient and WiFiUDP operations
+ Copyright (c) 2020 esp8266/Arduino
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef WIFICOROUTINE_H
+#define WIFICOROUTINE_H
+
+#include <Coroutine.h>
+
+#if defined(__cpp_impl_coroutine)
+
+#include <wl_definitions.h>
+#include "WiFiClient.h"
+#include "WiFiUdp.h"
+
+// Each awaiter suspends the coroutine until lwIP reports progress or the
+// timeout expires, then the coroutine resumes from a scheduled function.
+// Timeouts of 0 use the client's getTimeout().
+//
+//   coro::task<> exchange(IPAddress ip) {
+//       WiFiClient client;
+//       if (!co_await coro::connect(client, ip, 502)) co_return;
+//       client.write(request, sizeof(request));
+//       int len = co_await coro::read(client, reply, sizeof(reply));
+//   }
+//   ...
+//   exchange(ip).start();
+
+namespace esp8266
+{
+namespace coro
+{
+
+// co_await connect(client, ip, port) is true once connected
+class connect : public resumable
+{
+public:
+    connect(WiFiClient& client, IPAddress ip, uint16_t port, uint32_t timeout_ms = 0)
+        : _client(client), _ip(ip), _port(port), _timeout_ms(timeout_ms ? timeout_ms : client.getTimeout()) { }
+    // destroyed with the frame of a suspended coroutine, lwIP must not call back into it
+    ~connect()
+    {
+        if (_handle)
+        {
+            _client.setNotify(nullptr, nullptr);
+        }
+    }
+
+    bool await_ready()
+    {
+        return !_client.connectNoWait(_ip, _port) || _client.status() != SYN_SENT;
+    }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        suspend(handle);
+        _client.setNotify(&connect::_notify, this);
+        arm_timeout(_timeout_ms);
+    }
+    bool await_resume()
+    {
+        disarm_timeout();
+        _client.setNotify(nullptr, nullptr);
+        if (_client.status() != ESTABLISHED)
+        {
+            _client.abort();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static void _notify(void* arg)
+    {
+        connect* self = static_cast<connect*>(arg);
+        if (self->_client.status() != SYN_SENT)
+        {
+            self->resume_later();
+        }
+    }
+
+    WiFiClient& _client;
+    IPAddress _ip;
+    uint16_t _port;
+    uint32_t _timeout_ms;
+};
+
+// co_await read(client, buf, size) waits for data and reads what is there, up to size bytes.
+// 0 means the timeout expired or the connection is closed.
+class read : public resumable
+{
+public:
+    read(WiFiClient& client, uint8_t* buf, size_t size, uint32_t timeout_ms = 0)
+        : _client(client), _buf(buf), _size(size), _timeout_ms(timeout_ms ? timeout_ms : client.getTimeout()) { }
+    ~read()
+    {
+        if (_handle)
+        {
+            _client.setNotify(nullptr, nullptr);
+        }
+    }
+
+    bool await_ready() { return _client.peekAvailable() || !_client.connected(); }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        suspend(handle);
+        _client.setNotify(&read::_notify, this);
+        arm_timeout(_timeout_ms);
+    }
+    int await_resume()
+    {
+        disarm_timeout();
+        _client.setNotify(nullptr, nullptr);
+        return _client.peekAvailable() ? _client.read(_buf, _size) : 0;
+    }
+
+private:
+    static void _notify(void* arg)
+    {
+        read* self = static_cast<read*>(arg);
+        if (self->_client.peekAvailable() || !self->_client.connected())
+        {
+            self->resume_later();
+        }
+    }
+
+    WiFiClient& _client;
+    uint8_t* _buf;
+    size_t _size;
+    uint32_t _timeout_ms;
+};
+
+// co_await recv(udp, timeout_ms) waits for the next packet, same result as parsePacket()
+class recv : public resumable
+{
+public:
+    explicit recv(WiFiUDP& udp, uint32_t timeout_ms = 1000) : _udp(udp), _timeout_ms(timeout_ms) { }
+    ~recv()
+    {
+        if (_handle)
+        {
+            _udp.onReceive(nullptr);
+        }
+    }
+
+    bool await_ready()
+    {
+        _size = _udp.parsePacket();
+        return _size > 0 || !_udp;
+    }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        suspend(handle);
+        _udp.onReceive([this]() { resume_later(); });
+        arm_timeout(_timeout_ms);
+    }
+    int await_resume()
+    {
+        disarm_timeout();
+        if (_size <= 0 && _udp)
+        {
+            _udp.onReceive(nullptr);
+            _size = _udp.parsePacket();
+        }
+        return _size;
+    }
+
+private:
+    WiFiUDP& _udp;
+    uint32_t _timeout_ms;
+    int _size = 0;
+};
+
+} // namespace coro
+} // namespace esp8266
+
+#endif // __cpp_impl_coroutine
+
+#endif // WIFICOROUTINE_H
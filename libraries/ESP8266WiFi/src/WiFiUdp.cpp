@@ -123,6 +123,15 @@ int WiFiUDP::available() {
     return result;
 }
 
+bool WiFiUDP::onReceive(std::function<void(void)> handler)
+{
+    if (!_ctx)
+        return false;
+
+    _ctx->onRx(handler);
+    return true;
+}
+
 /* Release any resources being used by this WiFiUDP instance */
 void WiFiUDP::stop()
 {
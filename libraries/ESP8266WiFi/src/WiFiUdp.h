@@ -22,6 +22,7 @@
 #ifndef WIFIUDP_H
 #define WIFIUDP_H
 
+#include <functional>
 #include <Udp.h>
 #include <include/slist.h>
 
@@ -48,6 +49,9 @@ public:
   void stop() override;
   // join a multicast group and listen on the given port
   uint8_t beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port);
+  // handler is called from the network stack whenever a packet arrives, after begin().
+  // Returns false when not listening. See Coroutine.h.
+  bool onReceive(std::function<void(void)> handler);
 
   // Sending UDP packets
   
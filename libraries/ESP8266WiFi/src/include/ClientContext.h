@@ -25,6 +25,7 @@ class ClientContext;
 class WiFiClient;
 
 typedef void (*discard_cb_t)(void*, ClientContext*);
+typedef void (*notify_cb_t)(void*);
 
 #include <assert.h>
 #include <esp_priv.h>
@@ -126,7 +127,7 @@ public:
         }
     }
 
-    int connect(ip_addr_t* addr, uint16_t port)
+    int connect(ip_addr_t* addr, uint16_t port, bool wait = true)
     {
         // note: not using `const ip_addr_t* addr` because
         // - `ip6_addr_assign_zone()` below modifies `*addr`
@@ -141,6 +142,10 @@ public:
         if (err != ERR_OK) {
             return 0;
         }
+        if (!wait) {
+            // state() tells when done, along with the notify callback
+            return 1;
+        }
         _connect_pending = true;
         _op_start_time = millis();
         // will resume on timeout or when _connected or _notify_error fires
@@ -183,6 +188,13 @@ public:
         return tcp_nagle_disabled(_pcb);
     }
 
+    // cb(arg) is called from lwIP on connection, received data, acked data, close and error
+    void setNotify(notify_cb_t cb, void* arg)
+    {
+        _notify_cb = cb;
+        _notify_arg = arg;
+    }
+
     void setTimeout(int timeout_ms)
     {
         _timeout_ms = timeout_ms;
@@ -458,6 +470,14 @@ protected:
             _connect_pending = false;
             esp_schedule();
         }
+        _notify();
+    }
+
+    void _notify()
+    {
+        if (_notify_cb) {
+            _notify_cb(_notify_arg);
+        }
     }
 
     size_t _write_from_source(const char* ds, const size_t dl)
@@ -566,6 +586,7 @@ protected:
         (void) len;
         DEBUGV(":ack %d\r\n", len);
         _write_some_from_cb();
+        _notify();
         return ERR_OK;
     }
 
@@ -622,6 +643,7 @@ protected:
             _rx_buf = pb;
             _rx_buf_offset = 0;
         }
+        _notify();
         return ERR_OK;
     }
 
@@ -647,6 +669,7 @@ protected:
             _connect_pending = false;
             esp_schedule();
         }
+        _notify();
         return ERR_OK;
     }
 
@@ -698,6 +721,9 @@ private:
     bool _send_waiting = false;
     bool _connect_pending = false;
 
+    notify_cb_t _notify_cb = nullptr;
+    void* _notify_arg = nullptr;
+
     int8_t _refcnt;
     ClientContext* _next;
 
@@ -34,6 +34,11 @@ namespace
   uint32_t _criticalHeapLevel = 6000; // In bytes
   uint32_t _criticalHeapLevelBuffer = 6000; // In bytes
 
+  // Each log keeps at most this many entries, which also bounds the heap they use independently of traffic.
+  // Storage for a log is allocated when its first entry is stored.
+  uint16_t _logEntryCapacity = 32;
+  uint16_t _scheduledResponseCapacity = 40; // See _logEntryLifetimeMs
+
   using EspnowProtocolInterpreter::macAndType_td;
   using EspnowProtocolInterpreter::messageID_td;
   using EspnowProtocolInterpreter::peerMac_td;
@@ -41,9 +46,9 @@ namespace
   std::list<ResponseData> _responsesToSend = {};
   std::list<PeerRequestLog> _peerRequestConfirmationsToSend = {};
 
-  std::map<std::pair<macAndType_td, messageID_td>, MessageData> _receivedEspnowTransmissions = {};
-  std::map<std::pair<peerMac_td, messageID_td>, RequestData> _sentRequests = {};
-  std::map<std::pair<peerMac_td, messageID_td>, TimeTracker> _receivedRequests = {};
+  EspnowDatabase::receivedTransmissionLog_td _receivedEspnowTransmissions(_logEntryCapacity);
+  EspnowDatabase::sentRequestLog_td _sentRequests(_logEntryCapacity);
+  EspnowDatabase::receivedRequestLog_td _receivedRequests(_logEntryCapacity);
 
   std::shared_ptr<bool> _espnowConnectionQueueMutex = std::make_shared<bool>(false);
   std::shared_ptr<bool> _responsesToSendMutex = std::make_shared<bool>(false);
@@ -92,57 +97,45 @@ uint32_t EspnowDatabase::criticalHeapLevel()
   return _criticalHeapLevel;
 }
 
-template <typename T, typename U>
-void EspnowDatabase::deleteExpiredLogEntries(std::map<std::pair<U, uint64_t>, T> &logEntries, const uint32_t maxEntryLifetimeMs)
+template <typename U, typename T, typename V>
+void EspnowDatabase::deleteExpiredLogEntries(EspnowLogTable<U, T, V> &logEntries, const uint32_t maxEntryLifetimeMs)
 {
-  for(typename std::map<std::pair<U, uint64_t>, T>::iterator entryIterator = logEntries.begin(); 
-      entryIterator != logEntries.end(); )
-  {
-    if(entryIterator->second.getTimeTracker().timeSinceCreation() > maxEntryLifetimeMs)
-    {
-      entryIterator = logEntries.erase(entryIterator);
-    }
-    else
-      ++entryIterator;
-  }
+  // Entries are stored in creation order, so the first entry that has not expired ends the search.
+  logEntries.eraseExpired([maxEntryLifetimeMs](const std::pair<U, uint64_t> &, const T &entry)
+                          { return entry.getTimeTracker().timeSinceCreation() > maxEntryLifetimeMs ? LogEntryStatus::EXPIRED : LogEntryStatus::ALL_REMAINING_ACTIVE; });
 }
 
-template <typename U>
-void EspnowDatabase::deleteExpiredLogEntries(std::map<std::pair<U, uint64_t>, TimeTracker> &logEntries, const uint32_t maxEntryLifetimeMs)
+template <typename U, typename V>
+void EspnowDatabase::deleteExpiredLogEntries(EspnowLogTable<U, TimeTracker, V> &logEntries, const uint32_t maxEntryLifetimeMs)
 {
-  for(typename std::map<std::pair<U, uint64_t>, TimeTracker>::iterator entryIterator = logEntries.begin(); 
-      entryIterator != logEntries.end(); )
-  {
-    if(entryIterator->second.timeSinceCreation() > maxEntryLifetimeMs)
-    {
-      entryIterator = logEntries.erase(entryIterator);
-    }
-    else
-      ++entryIterator;
-  }
+  logEntries.eraseExpired([maxEntryLifetimeMs](const std::pair<U, uint64_t> &, const TimeTracker &entry)
+                          { return entry.timeSinceCreation() > maxEntryLifetimeMs ? LogEntryStatus::EXPIRED : LogEntryStatus::ALL_REMAINING_ACTIVE; });
 }
 
-void EspnowDatabase::deleteExpiredLogEntries(std::map<std::pair<peerMac_td, messageID_td>, RequestData> &logEntries, const uint32_t requestLifetimeMs, const uint32_t broadcastLifetimeMs)
+void EspnowDatabase::deleteExpiredLogEntries(sentRequestLog_td &logEntries, const uint32_t requestLifetimeMs, const uint32_t broadcastLifetimeMs)
 {
-  for(typename std::map<std::pair<peerMac_td, messageID_td>, RequestData>::iterator entryIterator = logEntries.begin(); 
-      entryIterator != logEntries.end(); )
+  // Entries younger than both lifetimes cannot have expired, so the search can end at the first such entry.
+  uint32_t shortestLifetimeMs = std::min(requestLifetimeMs, broadcastLifetimeMs);
+
+  logEntries.eraseExpired([=](const std::pair<peerMac_td, messageID_td> &key, const RequestData &entry)
   {
-    bool broadcast = entryIterator->first.first == EspnowProtocolInterpreter::uint64BroadcastMac;
-    uint32_t timeSinceCreation = entryIterator->second.getTimeTracker().timeSinceCreation();
+    bool broadcast = key.first == EspnowProtocolInterpreter::uint64BroadcastMac;
+    uint32_t timeSinceCreation = entry.getTimeTracker().timeSinceCreation();
     
     if((!broadcast && timeSinceCreation > requestLifetimeMs) 
         || (broadcast && timeSinceCreation > broadcastLifetimeMs))
-    {
-      entryIterator = logEntries.erase(entryIterator);
-    }
+      return LogEntryStatus::EXPIRED;
+    else if(timeSinceCreation <= shortestLifetimeMs)
+      return LogEntryStatus::ALL_REMAINING_ACTIVE;
     else
-      ++entryIterator;
-  }
+      return LogEntryStatus::ACTIVE;
+  });
 }
 
 template <typename T>
 void EspnowDatabase::deleteExpiredLogEntries(std::list<T> &logEntries, const uint32_t maxEntryLifetimeMs)
 {
+  // Entries are appended in creation order, so the first entry that has not expired ends the search.
   for(typename std::list<T>::iterator entryIterator = logEntries.begin(); 
       entryIterator != logEntries.end(); )
   {
@@ -151,7 +144,7 @@ void EspnowDatabase::deleteExpiredLogEntries(std::list<T> &logEntries, const uin
       entryIterator = logEntries.erase(entryIterator);
     }
     else
-      ++entryIterator;
+      break;
   }
 }
 
@@ -232,6 +225,35 @@ void EspnowDatabase::setEncryptionRequestTimeout(const uint32_t timeoutMs)
 }
 uint32_t EspnowDatabase::getEncryptionRequestTimeout() {return _encryptionRequestTimeoutMs;}
 
+void EspnowDatabase::setLogEntryCapacity(const uint16_t capacity)
+{
+  assert(capacity >= 1);
+  
+  _logEntryCapacity = capacity;
+  receivedEspnowTransmissions().setCapacity(capacity);
+  sentRequests().setCapacity(capacity);
+  receivedRequests().setCapacity(capacity);
+}
+uint16_t EspnowDatabase::logEntryCapacity() {return _logEntryCapacity;}
+
+void EspnowDatabase::setScheduledResponseCapacity(const uint16_t capacity)
+{
+  assert(capacity >= 1);
+  
+  _scheduledResponseCapacity = capacity;
+}
+uint16_t EspnowDatabase::scheduledResponseCapacity() {return _scheduledResponseCapacity;}
+
+bool EspnowDatabase::scheduleResponse(const String &message, const uint8_t recipientMac[6], const uint64_t requestID)
+{
+  if(responsesToSend().size() >= scheduledResponseCapacity())
+    return false;
+  
+  // Appending keeps responsesToSend in creation order, which deleteExpiredLogEntries relies on.
+  responsesToSend().emplace_back(message, recipientMac, requestID);
+  return true;
+}
+
 void EspnowDatabase::setAutoEncryptionDuration(const uint32_t duration)
 {
   _autoEncryptionDuration = duration;
@@ -315,7 +337,7 @@ uint8 EspnowDatabase::getWiFiChannel() const
 
 bool EspnowDatabase::requestReceived(const uint64_t requestMac, const uint64_t requestID)
 {
-  return receivedRequests().count(std::make_pair(requestMac, requestID));
+  return receivedRequests().find(std::make_pair(requestMac, requestID)) != nullptr;
 }
 
 MutexTracker EspnowDatabase::captureEspnowConnectionQueueMutex() 
@@ -332,21 +354,21 @@ MutexTracker EspnowDatabase::captureResponsesToSendMutex(const std::function<voi
 
 void EspnowDatabase::storeSentRequest(const uint64_t targetBSSID, const uint64_t messageID, const RequestData &requestData)
 {
-  sentRequests().insert(std::make_pair(std::make_pair(targetBSSID, messageID), requestData));
+  sentRequests().insert(std::make_pair(targetBSSID, messageID), requestData);
 }
 
 void EspnowDatabase::storeReceivedRequest(const uint64_t senderBSSID, const uint64_t messageID, const TimeTracker &timeTracker)
 {
-  receivedRequests().insert(std::make_pair(std::make_pair(senderBSSID, messageID), timeTracker));
+  receivedRequests().insert(std::make_pair(senderBSSID, messageID), timeTracker);
 }
 
 EspnowMeshBackend *EspnowDatabase::getOwnerOfSentRequest(const uint64_t requestMac, const uint64_t requestID)
 {
-  std::map<std::pair<peerMac_td, messageID_td>, RequestData>::iterator sentRequest = sentRequests().find(std::make_pair(requestMac, requestID));
+  RequestData *sentRequest = sentRequests().find(std::make_pair(requestMac, requestID));
   
-  if(sentRequest != sentRequests().end())
+  if(sentRequest)
   {
-    return &sentRequest->second.getMeshInstance();
+    return &sentRequest->getMeshInstance();
   }
   
   return nullptr;
@@ -359,25 +381,12 @@ size_t EspnowDatabase::deleteSentRequest(const uint64_t requestMac, const uint64
 
 size_t EspnowDatabase::deleteSentRequestsByOwner(const EspnowMeshBackend *instancePointer)
 {
-  size_t numberDeleted = 0;
-  
-  for(std::map<std::pair<peerMac_td, messageID_td>, RequestData>::iterator requestIterator = sentRequests().begin(); 
-      requestIterator != sentRequests().end(); )
-  {
-    if(&requestIterator->second.getMeshInstance() == instancePointer) // If instance at instancePointer made the request
-    {
-      requestIterator = sentRequests().erase(requestIterator);
-      numberDeleted++;
-    }
-    else
-      ++requestIterator;
-  }
-
-  return numberDeleted;
+  return sentRequests().eraseIf([instancePointer](const std::pair<peerMac_td, messageID_td> &, const RequestData &requestData)
+                                { return &requestData.getMeshInstance() == instancePointer; }); // If instance at instancePointer made the request
 }
 
 std::list<ResponseData> & EspnowDatabase::responsesToSend() { return _responsesToSend; }
 std::list<PeerRequestLog> & EspnowDatabase::peerRequestConfirmationsToSend() { return _peerRequestConfirmationsToSend; }
-std::map<std::pair<macAndType_td, messageID_td>, MessageData> & EspnowDatabase::receivedEspnowTransmissions() { return _receivedEspnowTransmissions; }
-std::map<std::pair<peerMac_td, messageID_td>, RequestData> & EspnowDatabase::sentRequests() { return _sentRequests; }
-std::map<std::pair<peerMac_td, messageID_td>, TimeTracker> & EspnowDatabase::receivedRequests() { return _receivedRequests; }
+EspnowDatabase::receivedTransmissionLog_td & EspnowDatabase::receivedEspnowTransmissions() { return _receivedEspnowTransmissions; }
+EspnowDatabase::sentRequestLog_td & EspnowDatabase::sentRequests() { return _sentRequests; }
+EspnowDatabase::receivedRequestLog_td & EspnowDatabase::receivedRequests() { return _receivedRequests; }
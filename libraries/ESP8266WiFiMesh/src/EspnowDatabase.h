@@ -24,8 +24,8 @@
 #include "RequestData.h"
 #include "EspnowProtocolInterpreter.h"
 #include <list>
-#include <map>
 #include "MessageData.h"
+#include "EspnowLogTable.h"
 #include "MutexTracker.h"
 #include "PeerRequestLog.h"
 #include "ConditionalPrinter.h"
@@ -57,6 +57,10 @@ public:
   static void deleteScheduledResponsesByRecipient(const uint8_t *recipientMac, const bool encryptedOnly);
   static void setEncryptionRequestTimeout(const uint32_t timeoutMs);
   static uint32_t getEncryptionRequestTimeout();
+  static void setLogEntryCapacity(const uint16_t capacity);
+  static uint16_t logEntryCapacity();
+  static void setScheduledResponseCapacity(const uint16_t capacity);
+  static uint16_t scheduledResponseCapacity();
   
   void setAutoEncryptionDuration(const uint32_t duration);
   uint32_t getAutoEncryptionDuration() const;
@@ -69,12 +73,28 @@ public:
   using messageID_td = EspnowProtocolInterpreter::messageID_td;
   using peerMac_td = EspnowProtocolInterpreter::peerMac_td;
 
+  struct MacAndTypePeerMac
+  {
+    uint64_t operator()(const macAndType_td &macAndType) const { return EspnowProtocolInterpreter::macAndTypeToUint64Mac(macAndType); }
+  };
+
+  using receivedTransmissionLog_td = EspnowLogTable<macAndType_td, MessageData, MacAndTypePeerMac>;
+  using sentRequestLog_td = EspnowLogTable<peerMac_td, RequestData>;
+  using receivedRequestLog_td = EspnowLogTable<peerMac_td, TimeTracker>;
+
   static size_t deleteSentRequestsByOwner(const EspnowMeshBackend *instancePointer);
   static std::list<ResponseData> & responsesToSend();
   static std::list<PeerRequestLog> & peerRequestConfirmationsToSend();
-  static std::map<std::pair<macAndType_td, messageID_td>, MessageData> & receivedEspnowTransmissions();
-  static std::map<std::pair<peerMac_td, messageID_td>, RequestData> & sentRequests();
-  static std::map<std::pair<peerMac_td, messageID_td>, TimeTracker> & receivedRequests();
+  static receivedTransmissionLog_td & receivedEspnowTransmissions();
+  static sentRequestLog_td & sentRequests();
+  static receivedRequestLog_td & receivedRequests();
+
+  /**
+   * Schedule a response for sending, unless scheduledResponseCapacity() responses are already waiting.
+   *
+   * @return True if the response was scheduled.
+   */
+  static bool scheduleResponse(const String &message, const uint8_t recipientMac[6], const uint64_t requestID);
   
   static bool requestReceived(const uint64_t requestMac, const uint64_t requestID);
 
@@ -127,67 +147,18 @@ public:
   uint8 getWiFiChannel() const;
   
   /**
-   * Remove all entries which target peerMac in the logEntries map.
+   * Remove all entries which target peerMac in the logEntries log.
    * Optionally deletes only entries sent/received by encrypted transmissions.
    * 
-   * @param logEntries The map to process.
+   * @param logEntries The log to process.
    * @param peerMac The MAC address of the peer node.
    * @param encryptedOnly If true, only entries sent/received by encrypted transmissions will be deleted.
    */
-  template <typename T>
-  static void deleteEntriesByMac(std::map<std::pair<macAndType_td, uint64_t>, T> &logEntries, const uint8_t *peerMac, const bool encryptedOnly)
+  template <typename U, typename T, typename V>
+  static void deleteEntriesByMac(EspnowLogTable<U, T, V> &logEntries, const uint8_t *peerMac, const bool encryptedOnly)
   {    
-    bool macFound = false;
-    
-    for(typename std::map<std::pair<macAndType_td, uint64_t>, T>::iterator entryIterator = logEntries.begin(); 
-        entryIterator != logEntries.end(); )
-    {
-      if(macAndTypeToUint64Mac(entryIterator->first.first) == MeshTypeConversionFunctions::macToUint64(peerMac))
-      {
-        macFound = true;
-           
-        if(!encryptedOnly || EspnowProtocolInterpreter::usesEncryption(entryIterator->first.second))
-        {
-          entryIterator = logEntries.erase(entryIterator);
-          continue;
-        }
-      }
-      else if(macFound)
-      {
-        // Since the map is sorted by MAC, we know here that no more matching MAC will be found.
-        return;
-      }
-  
-      ++entryIterator;
-    }
-  }
-  
-  template <typename T>
-  static void deleteEntriesByMac(std::map<std::pair<uint64_t, uint64_t>, T> &logEntries, const uint8_t *peerMac, const bool encryptedOnly)
-  {    
-    bool macFound = false;
-    
-    for(typename std::map<std::pair<uint64_t, uint64_t>, T>::iterator entryIterator = logEntries.begin(); 
-        entryIterator != logEntries.end(); )
-    {
-      if(entryIterator->first.first == MeshTypeConversionFunctions::macToUint64(peerMac))
-      {
-        macFound = true;
-           
-        if(!encryptedOnly || EspnowProtocolInterpreter::usesEncryption(entryIterator->first.second))
-        {
-          entryIterator = logEntries.erase(entryIterator);
-          continue;
-        }
-      }
-      else if(macFound)
-      {
-        // Since the map is sorted by MAC, we know here that no more matching MAC will be found.
-        return;
-      }
-  
-      ++entryIterator;
-    }
+    logEntries.eraseByPeerMac(MeshTypeConversionFunctions::macToUint64(peerMac), [encryptedOnly](const std::pair<U, uint64_t> &key, const T &)
+                              { return !encryptedOnly || EspnowProtocolInterpreter::usesEncryption(key.second); });
   }
 
 protected:
@@ -203,13 +174,13 @@ private:
 
   uint32_t _autoEncryptionDuration = 50;
   
-  template <typename T, typename U>
-  static void deleteExpiredLogEntries(std::map<std::pair<U, uint64_t>, T> &logEntries, const uint32_t maxEntryLifetimeMs);
+  template <typename U, typename T, typename V>
+  static void deleteExpiredLogEntries(EspnowLogTable<U, T, V> &logEntries, const uint32_t maxEntryLifetimeMs);
 
-  template <typename U>
-  static void deleteExpiredLogEntries(std::map<std::pair<U, uint64_t>, TimeTracker> &logEntries, const uint32_t maxEntryLifetimeMs);
+  template <typename U, typename V>
+  static void deleteExpiredLogEntries(EspnowLogTable<U, TimeTracker, V> &logEntries, const uint32_t maxEntryLifetimeMs);
 
-  static void deleteExpiredLogEntries(std::map<std::pair<peerMac_td, messageID_td>, RequestData> &logEntries, const uint32_t requestLifetimeMs, const uint32_t broadcastLifetimeMs);
+  static void deleteExpiredLogEntries(sentRequestLog_td &logEntries, const uint32_t requestLifetimeMs, const uint32_t broadcastLifetimeMs);
 
   template <typename T>
   static void deleteExpiredLogEntries(std::list<T> &logEntries, const uint32_t maxEntryLifetimeMs);
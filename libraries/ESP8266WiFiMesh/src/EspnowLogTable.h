@@ -0,0 +1,374 @@
+/*
+  Copyright (C) 2020 Anders Löfgren
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __ESPNOWLOGTABLE_H__
+#define __ESPNOWLOGTABLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <new>
+#include <utility>
+
+enum class LogEntryStatus
+{
+  EXPIRED = 0, // Erase the entry and keep looking.
+  ACTIVE = 1, // Keep the entry and keep looking.
+  ALL_REMAINING_ACTIVE = 2 // Keep the entry and all newer ones.
+};
+
+/**
+ * Converts the first key component of an EspnowLogTable to the MAC of the peer the entry belongs to.
+ */
+struct LogTablePeerMac
+{
+  template <typename U>
+  uint64_t operator()(const U &keyFirst) const { return static_cast<uint64_t>(keyFirst); }
+};
+
+/**
+ * Fixed capacity log of ESP-NOW transmission entries, keyed by (peer MAC based value, message ID).
+ *
+ * Each entry is linked into three indexes: a hash index by full key, a hash index by peer MAC and an age list
+ * ordered by insertion. Since all log entries are created when they are inserted, the age list is also the
+ * expiry order, so expiry checks can stop at the first entry that is still active and deletion by peer only
+ * visits entries that share a hash bucket with that peer.
+ *
+ * Storage for capacity() entries is allocated on the first insertion and reused until the capacity is changed.
+ * When the log is full, the oldest entry is replaced.
+ */
+template <typename KeyFirst, typename T, typename PeerMacOf = LogTablePeerMac>
+class EspnowLogTable {
+
+public:
+
+  using key_type = std::pair<KeyFirst, uint64_t>;
+
+  explicit EspnowLogTable(const uint16_t capacity) : _capacity(capacity) { }
+  ~EspnowLogTable() { clear(); }
+
+  EspnowLogTable(const EspnowLogTable &) = delete;
+  EspnowLogTable & operator=(const EspnowLogTable &) = delete;
+
+  /**
+   * Set the maximum number of entries. All entries are erased and the current storage is released.
+   *
+   * @param capacity The new maximum number of entries. Valid values are 1 to 65534.
+   */
+  void setCapacity(const uint16_t capacity)
+  {
+    release();
+    _capacity = capacity < NO_NODE ? capacity : NO_NODE - 1;
+  }
+  uint16_t capacity() const { return _capacity; }
+  uint16_t size() const { return _count; }
+  bool empty() const { return _count == 0; }
+
+  /**
+   * @return A pointer to the value stored for key, or nullptr if there is none.
+   */
+  T *find(const key_type &key)
+  {
+    uint16_t node = findNode(key);
+    return node == NO_NODE ? nullptr : &_nodes[node].value();
+  }
+
+  /**
+   * Store value for key unless key is already present. Replaces the oldest entry if the log is full.
+   *
+   * @return A pointer to the value stored for key. nullptr if storage could not be allocated.
+   */
+  T *insert(const key_type &key, const T &value) { return emplace(key, value); }
+  T *insert(const key_type &key, T &&value) { return emplace(key, std::move(value)); }
+
+  /**
+   * @return True if an entry was erased.
+   */
+  bool erase(const key_type &key)
+  {
+    uint16_t node = findNode(key);
+    if(node == NO_NODE)
+      return false;
+
+    eraseNode(node);
+    return true;
+  }
+
+  /**
+   * Erase the entries of peerMac for which shouldErase(key, value) returns true.
+   *
+   * @return The number of entries erased.
+   */
+  template <typename Predicate>
+  size_t eraseByPeerMac(const uint64_t peerMac, Predicate shouldErase)
+  {
+    if(!_nodes)
+      return 0;
+
+    size_t erased = 0;
+    uint16_t node = _macBuckets[macHash(peerMac)];
+
+    while(node != NO_NODE)
+    {
+      Node &entry = _nodes[node];
+      uint16_t next = entry.macNext;
+
+      if(PeerMacOf()(entry.key.first) == peerMac && shouldErase(entry.key, entry.value()))
+      {
+        eraseNode(node);
+        ++erased;
+      }
+
+      node = next;
+    }
+
+    return erased;
+  }
+
+  /**
+   * Visit entries from oldest to newest and erase those for which checkEntry(key, value) returns LogEntryStatus::EXPIRED.
+   * The walk ends at the first entry for which LogEntryStatus::ALL_REMAINING_ACTIVE is returned.
+   *
+   * @return The number of entries erased.
+   */
+  template <typename EntryCheck>
+  size_t eraseExpired(EntryCheck checkEntry)
+  {
+    size_t erased = 0;
+    uint16_t node = _oldest;
+
+    while(node != NO_NODE)
+    {
+      Node &entry = _nodes[node];
+      uint16_t newer = entry.newer;
+
+      LogEntryStatus status = checkEntry(entry.key, entry.value());
+      if(status == LogEntryStatus::ALL_REMAINING_ACTIVE)
+        break;
+
+      if(status == LogEntryStatus::EXPIRED)
+      {
+        eraseNode(node);
+        ++erased;
+      }
+
+      node = newer;
+    }
+
+    return erased;
+  }
+
+  /**
+   * Visit all entries from oldest to newest and erase those for which shouldErase(key, value) returns true.
+   *
+   * @return The number of entries erased.
+   */
+  template <typename Predicate>
+  size_t eraseIf(Predicate shouldErase)
+  {
+    return eraseExpired([&shouldErase](const key_type &key, const T &value)
+                        { return shouldErase(key, value) ? LogEntryStatus::EXPIRED : LogEntryStatus::ACTIVE; });
+  }
+
+  /**
+   * Erase all entries. Storage is kept for reuse.
+   */
+  void clear()
+  {
+    while(_oldest != NO_NODE)
+      eraseNode(_oldest);
+  }
+
+private:
+
+  static constexpr uint16_t NO_NODE = 0xFFFF;
+
+  struct Node
+  {
+    key_type key;
+    uint16_t keyNext;
+    uint16_t keyPrevious;
+    uint16_t macNext;
+    uint16_t macPrevious;
+    uint16_t newer; // Also links the free list.
+    uint16_t older;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T &value() { return *reinterpret_cast<T *>(storage); }
+  };
+
+  template <typename V>
+  T *emplace(const key_type &key, V &&value)
+  {
+    if(!allocate())
+      return nullptr;
+
+    uint16_t node = findNode(key);
+    if(node != NO_NODE)
+      return &_nodes[node].value();
+
+    if(_freeNodes == NO_NODE)
+      eraseNode(_oldest);
+
+    node = _freeNodes;
+    _freeNodes = _nodes[node].newer;
+
+    Node &entry = _nodes[node];
+    entry.key = key;
+    new (entry.storage) T(std::forward<V>(value));
+
+    link(_keyBuckets[keyBucket(key)], node, &Node::keyNext, &Node::keyPrevious);
+    link(_macBuckets[macBucket(key.first)], node, &Node::macNext, &Node::macPrevious);
+
+    entry.older = _newest;
+    entry.newer = NO_NODE;
+    if(_newest != NO_NODE)
+      _nodes[_newest].newer = node;
+    else
+      _oldest = node;
+    _newest = node;
+
+    ++_count;
+    return &entry.value();
+  }
+
+  bool allocate()
+  {
+    if(_nodes)
+      return true;
+
+    if(!_capacity)
+      return false;
+
+    uint8_t bucketBits = 0;
+    while((1UL << bucketBits) < _capacity)
+      ++bucketBits;
+
+    _nodes.reset(new (std::nothrow) Node[_capacity]);
+    _keyBuckets.reset(new (std::nothrow) uint16_t[1UL << bucketBits]);
+    _macBuckets.reset(new (std::nothrow) uint16_t[1UL << bucketBits]);
+
+    if(!_nodes || !_keyBuckets || !_macBuckets)
+    {
+      release();
+      return false;
+    }
+
+    _bucketBits = bucketBits;
+
+    for(size_t bucket = 0; bucket < (1UL << bucketBits); ++bucket)
+    {
+      _keyBuckets[bucket] = NO_NODE;
+      _macBuckets[bucket] = NO_NODE;
+    }
+
+    for(uint16_t node = 0; node < _capacity; ++node)
+      _nodes[node].newer = node + 1 < _capacity ? node + 1 : NO_NODE;
+    _freeNodes = 0;
+
+    return true;
+  }
+
+  void release()
+  {
+    clear();
+    _nodes.reset();
+    _keyBuckets.reset();
+    _macBuckets.reset();
+    _freeNodes = NO_NODE;
+  }
+
+  // Fibonacci hashing, the top bits of the product are the best mixed.
+  size_t hashToBucket(const uint64_t value) const
+  {
+    uint32_t folded = (uint32_t)value ^ (uint32_t)(value >> 32);
+    return _bucketBits ? (uint32_t)(folded * 2654435769UL) >> (32 - _bucketBits) : 0;
+  }
+
+  size_t macHash(const uint64_t peerMac) const { return hashToBucket(peerMac); }
+  size_t macBucket(const KeyFirst &keyFirst) const { return macHash(PeerMacOf()(keyFirst)); }
+  size_t keyBucket(const key_type &key) const { return hashToBucket(static_cast<uint64_t>(key.first) * 31 + key.second); }
+
+  uint16_t findNode(const key_type &key) const
+  {
+    if(!_nodes)
+      return NO_NODE;
+
+    uint16_t node = _keyBuckets[keyBucket(key)];
+    while(node != NO_NODE && _nodes[node].key != key)
+      node = _nodes[node].keyNext;
+
+    return node;
+  }
+
+  void link(uint16_t &bucketHead, const uint16_t node, uint16_t Node::*next, uint16_t Node::*previous)
+  {
+    _nodes[node].*next = bucketHead;
+    _nodes[node].*previous = NO_NODE;
+    if(bucketHead != NO_NODE)
+      _nodes[bucketHead].*previous = node;
+    bucketHead = node;
+  }
+
+  void unlink(uint16_t &bucketHead, const uint16_t node, uint16_t Node::*next, uint16_t Node::*previous)
+  {
+    Node &entry = _nodes[node];
+    if(entry.*previous != NO_NODE)
+      _nodes[entry.*previous].*next = entry.*next;
+    else
+      bucketHead = entry.*next;
+
+    if(entry.*next != NO_NODE)
+      _nodes[entry.*next].*previous = entry.*previous;
+  }
+
+  void eraseNode(const uint16_t node)
+  {
+    Node &entry = _nodes[node];
+
+    unlink(_keyBuckets[keyBucket(entry.key)], node, &Node::keyNext, &Node::keyPrevious);
+    unlink(_macBuckets[macBucket(entry.key.first)], node, &Node::macNext, &Node::macPrevious);
+
+    if(entry.older != NO_NODE)
+      _nodes[entry.older].newer = entry.newer;
+    else
+      _oldest = entry.newer;
+
+    if(entry.newer != NO_NODE)
+      _nodes[entry.newer].older = entry.older;
+    else
+      _newest = entry.older;
+
+    entry.value().~T();
+
+    entry.newer = _freeNodes;
+    _freeNodes = node;
+    --_count;
+  }
+
+  std::unique_ptr<Node[]> _nodes;
+  std::unique_ptr<uint16_t[]> _keyBuckets;
+  std::unique_ptr<uint16_t[]> _macBuckets;
+
+  uint16_t _capacity;
+  uint16_t _count = 0;
+  uint16_t _oldest = NO_NODE;
+  uint16_t _newest = NO_NODE;
+  uint16_t _freeNodes = NO_NODE;
+  uint8_t _bucketBits = 0;
+};
+
+#endif
@@ -356,17 +356,20 @@ void EspnowMeshBackend::espnowReceiveCallback(const uint8_t *macaddr, uint8_t *d
   /*
   if(messageStart)
   {
-    storeTransmission
+    if(messageFound)
+      return
+    else
+      storeTransmission
   }
   else
   {
     if(messageFound)
-      storeTransmission or (erase and return)
+      storeTransmission or return
     else
       return
   }
   
-  if(transmissionsRemaining != 0)
+  if(!messageComplete)
     return
     
   processMessage
@@ -374,7 +377,6 @@ void EspnowMeshBackend::espnowReceiveCallback(const uint8_t *macaddr, uint8_t *d
   ////// </Method overview> //////
 
   char messageType = getMessageType(dataArray);
-  uint8_t transmissionsRemaining = getTransmissionsRemaining(dataArray);
   uint64_t uint64Mac = TypeCast::macToUint64(macaddr);
   
   // The MAC is 6 bytes so two bytes of uint64Mac are free. We must include the messageType there since it is possible that we will
@@ -382,77 +384,65 @@ void EspnowMeshBackend::espnowReceiveCallback(const uint8_t *macaddr, uint8_t *d
   // This would otherwise potentially cause the request and response to be mixed into one message when they are multi-part transmissions sent roughly at the same time.
   macAndType_td macAndType = createMacAndTypeValue(uint64Mac, messageType); 
   uint64_t messageID = getMessageID(dataArray);
+  auto key = std::make_pair(macAndType, messageID);
   
   //uint32_t methodStart = millis();
 
+  MessageData *storedMessage = nullptr;
+
   if(isMessageStart(dataArray))
   {
+    if(EspnowDatabase::receivedEspnowTransmissions().find(key))
+      return; // The sender did not get our ack for the first transmission. Also, BroadcastFilter should not be called more than once for an accepted message.
+
+    if(!MessageData::acceptsMessage(dataArray))
+      return; // Longer than setMaxReceivedTransmissionsPerMessage() allows.
+    
     if(messageType == 'B')
     {
-      auto key = std::make_pair(macAndType, messageID);
-      if(EspnowDatabase::receivedEspnowTransmissions().find(key) != EspnowDatabase::receivedEspnowTransmissions().end())
-        return; // Should not call BroadcastFilter more than once for an accepted message
-      
       String message = getHashKeyLength(dataArray, len);
       _database.setSenderMac(macaddr);
       uint8_t senderAPMac[6] {0};
       _database.setSenderAPMac(getTransmissionMac(dataArray, senderAPMac));
       _encryptionBroker.setReceivedEncryptedTransmission(usesEncryption(messageID));
       bool acceptBroadcast = getBroadcastFilter()(message, *this);
-      if(acceptBroadcast)
-      {
-        // Does nothing if key already in receivedEspnowTransmissions
-        EspnowDatabase::receivedEspnowTransmissions().insert(std::make_pair(key, MessageData(message, getTransmissionsRemaining(dataArray))));
-      }
-      else
+      if(!acceptBroadcast)
       {
         return;
       }
     }
-    else
-    {  
-      // Does nothing if key already in receivedEspnowTransmissions
-      EspnowDatabase::receivedEspnowTransmissions().insert(std::make_pair(std::make_pair(macAndType, messageID), MessageData(dataArray, len)));
-    }
+
+    storedMessage = EspnowDatabase::receivedEspnowTransmissions().insert(key, MessageData(dataArray, len));
   }
   else
   {
-    std::map<std::pair<macAndType_td, messageID_td>, MessageData>::iterator storedMessageIterator = EspnowDatabase::receivedEspnowTransmissions().find(std::make_pair(macAndType, messageID));
+    storedMessage = EspnowDatabase::receivedEspnowTransmissions().find(key);
 
-    if(storedMessageIterator == EspnowDatabase::receivedEspnowTransmissions().end()) // If we have not stored the key already, we missed the first message part.
+    if(!storedMessage) // If we have not stored the key already, we missed the first message part.
     {
       return;
     }
     
-    if(!storedMessageIterator->second.addToMessage(dataArray, len))
+    // The remaining parts may arrive in any order, since the sender only retransmits the parts it did not get an ack for.
+    // Parts that have already been stored are ignored.
+    if(!storedMessage->addToMessage(dataArray, len))
     {
-      // If we received the wrong message part, remove the whole message if we have missed a part.
-      // Otherwise just ignore the received part since it has already been stored.
-      
-      uint8_t transmissionsRemainingExpected = storedMessageIterator->second.getTransmissionsRemaining() - 1;
-      
-      if(transmissionsRemaining < transmissionsRemainingExpected)
-      {
-        EspnowDatabase::receivedEspnowTransmissions().erase(storedMessageIterator);
-        return;
-      }
+      return;
     }
   }
   
   //Serial.println("methodStart storage done " + String(millis() - methodStart));
   
-  if(transmissionsRemaining != 0)
+  if(!storedMessage || !storedMessage->isComplete())
   {
     return;
   }
 
-  std::map<std::pair<macAndType_td, messageID_td>, MessageData>::iterator storedMessageIterator = EspnowDatabase::receivedEspnowTransmissions().find(std::make_pair(macAndType, messageID));
-  assert(storedMessageIterator != EspnowDatabase::receivedEspnowTransmissions().end());
-
   // Copy totalMessage in case user callbacks (request/responseHandler) do something odd with receivedEspnowTransmissions list.
-  String totalMessage = storedMessageIterator->second.getTotalMessage(); // https://stackoverflow.com/questions/134731/returning-a-const-reference-to-an-object-instead-of-a-copy It is likely that most compilers will perform Named Value Return Value Optimisation in this case
+  // This is the only copy of the message made after reception, since each transmission is stored directly in place.
+  String totalMessage = storedMessage->getTotalMessage();
 
-  EspnowDatabase::receivedEspnowTransmissions().erase(storedMessageIterator); // Erase the extra copy of the totalMessage, to save RAM. 
+  EspnowDatabase::receivedEspnowTransmissions().erase(key); // Return the reassembly buffer to the pool, to save RAM.
    
   //Serial.println("methodStart erase done " + String(millis() - methodStart));
   
@@ -470,7 +460,8 @@ void EspnowMeshBackend::espnowReceiveCallback(const uint8_t *macaddr, uint8_t *d
      
     if(response.length() > 0)
     {
-      EspnowDatabase::responsesToSend().emplace_back(response, macaddr, messageID);
+      if(!EspnowDatabase::scheduleResponse(response, macaddr, messageID))
+        warningPrint(String(F("WARNING! Too many scheduled responses, response dropped.")));
       
       //Serial.println("methodStart Q done " + String(millis() - methodStart));
     }
@@ -528,6 +519,18 @@ void EspnowMeshBackend::setBroadcastResponseTimeoutMs(const uint32_t broadcastRe
 }
 uint32_t EspnowMeshBackend::broadcastResponseTimeoutMs() { return EspnowDatabase::broadcastResponseTimeoutMs(); }
 
+void EspnowMeshBackend::setLogEntryCapacity(const uint16_t capacity)
+{
+  EspnowDatabase::setLogEntryCapacity(capacity);
+}
+uint16_t EspnowMeshBackend::logEntryCapacity() { return EspnowDatabase::logEntryCapacity(); }
+
+void EspnowMeshBackend::setScheduledResponseCapacity(const uint16_t capacity)
+{
+  EspnowDatabase::setScheduledResponseCapacity(capacity);
+}
+uint16_t EspnowMeshBackend::scheduledResponseCapacity() { return EspnowDatabase::scheduledResponseCapacity(); }
+
 void EspnowMeshBackend::setCriticalHeapLevelBuffer(const uint32_t bufferInBytes)
 {
   EspnowDatabase::setCriticalHeapLevelBuffer(bufferInBytes);
@@ -555,6 +558,30 @@ void EspnowMeshBackend::setEspnowRetransmissionInterval(const uint32_t intervalM
 }
 uint32_t EspnowMeshBackend::getEspnowRetransmissionInterval() {return EspnowTransmitter::getEspnowRetransmissionInterval();}
 
+void EspnowMeshBackend::setFragmentRetransmissionRounds(const uint8_t rounds)
+{
+  EspnowTransmitter::setFragmentRetransmissionRounds(rounds);
+}
+uint8_t EspnowMeshBackend::getFragmentRetransmissionRounds() {return EspnowTransmitter::getFragmentRetransmissionRounds();}
+
+void EspnowMeshBackend::setUseSelectiveRetransmission(const bool useSelectiveRetransmission)
+{
+  EspnowTransmitter::setUseSelectiveRetransmission(useSelectiveRetransmission);
+}
+bool EspnowMeshBackend::useSelectiveRetransmission() {return EspnowTransmitter::useSelectiveRetransmission();}
+
+void EspnowMeshBackend::setReassemblyBufferPoolSize(const uint8_t poolSize)
+{
+  MessageData::setBufferPoolSize(poolSize);
+}
+uint8_t EspnowMeshBackend::reassemblyBufferPoolSize() {return MessageData::bufferPoolSize();}
+
+void EspnowMeshBackend::setMaxReceivedTransmissionsPerMessage(const uint8_t maxTransmissionsPerMessage)
+{
+  MessageData::setMaxTransmissionsPerMessage(maxTransmissionsPerMessage);
+}
+uint8_t EspnowMeshBackend::getMaxReceivedTransmissionsPerMessage() {return MessageData::getMaxTransmissionsPerMessage();}
+
 void EspnowMeshBackend::setEncryptionRequestTimeout(const uint32_t timeoutMs)
 {
   EspnowDatabase::setEncryptionRequestTimeout(timeoutMs);
@@ -848,6 +875,38 @@ TransmissionStatusType EspnowMeshBackend::attemptTransmission(const String &mess
   return initiateTransmission(message, recipientInfo);
 }
 
+TransmissionStatusType EspnowMeshBackend::attemptTransmission(const uint8_t *payload, const uint32_t payloadLength, const EspnowNetworkInfo &recipientInfo)
+{
+  MutexTracker mutexTracker(EspnowTransmitter::captureEspnowTransmissionMutex(EspnowConnectionManager::handlePostponedRemovals));
+  if(!mutexTracker.mutexCaptured())
+  {
+    assert(false && String(F("ERROR! Transmission in progress. Don't call attemptTransmission from callbacks as this may corrupt program state! Aborting."))); 
+    return TransmissionStatusType::CONNECTION_FAILED;
+  }
+
+  uint8_t targetBSSID[6] {0};
+  assert(recipientInfo.BSSID() != nullptr); // We need at least the BSSID to connect
+  recipientInfo.getBSSID(targetBSSID);
+
+  return _transmitter.sendRequest(payload, payloadLength, targetBSSID, this);
+}
+
+TransmissionStatusType EspnowMeshBackend::attemptTransmission(Stream &payload, const uint32_t payloadLength, const EspnowNetworkInfo &recipientInfo)
+{
+  MutexTracker mutexTracker(EspnowTransmitter::captureEspnowTransmissionMutex(EspnowConnectionManager::handlePostponedRemovals));
+  if(!mutexTracker.mutexCaptured())
+  {
+    assert(false && String(F("ERROR! Transmission in progress. Don't call attemptTransmission from callbacks as this may corrupt program state! Aborting."))); 
+    return TransmissionStatusType::CONNECTION_FAILED;
+  }
+
+  uint8_t targetBSSID[6] {0};
+  assert(recipientInfo.BSSID() != nullptr); // We need at least the BSSID to connect
+  recipientInfo.getBSSID(targetBSSID);
+
+  return _transmitter.sendRequest(payload, payloadLength, targetBSSID, this);
+}
+
 TransmissionStatusType EspnowMeshBackend::initiateAutoEncryptingTransmission(const String &message, uint8_t *targetBSSID, EncryptedConnectionStatus connectionStatus)
 {
   TransmissionStatusType transmissionResult = TransmissionStatusType::CONNECTION_FAILED;
@@ -941,6 +1000,30 @@ void EspnowMeshBackend::broadcast(const String &message)
   EspnowTransmitter::espnowSendToNode(message, EspnowProtocolInterpreter::broadcastMac, 'B', this);
 }
 
+void EspnowMeshBackend::broadcast(const uint8_t *payload, const uint32_t payloadLength)
+{  
+  MutexTracker mutexTracker(EspnowTransmitter::captureEspnowTransmissionMutex(EspnowConnectionManager::handlePostponedRemovals));
+  if(!mutexTracker.mutexCaptured())
+  {
+    assert(false && String(F("ERROR! Transmission in progress. Don't call broadcast from callbacks as this may corrupt program state! Aborting."))); 
+    return;
+  }
+
+  EspnowTransmitter::espnowSendToNode(payload, payloadLength, EspnowProtocolInterpreter::broadcastMac, 'B', this);
+}
+
+void EspnowMeshBackend::broadcast(Stream &payload, const uint32_t payloadLength)
+{  
+  MutexTracker mutexTracker(EspnowTransmitter::captureEspnowTransmissionMutex(EspnowConnectionManager::handlePostponedRemovals));
+  if(!mutexTracker.mutexCaptured())
+  {
+    assert(false && String(F("ERROR! Transmission in progress. Don't call broadcast from callbacks as this may corrupt program state! Aborting."))); 
+    return;
+  }
+
+  EspnowTransmitter::espnowSendToNode(payload, payloadLength, EspnowProtocolInterpreter::broadcastMac, 'B', this);
+}
+
 void EspnowMeshBackend::setBroadcastTransmissionRedundancy(const uint8_t redundancy) { _transmitter.setBroadcastTransmissionRedundancy(redundancy); }
 uint8_t EspnowMeshBackend::getBroadcastTransmissionRedundancy() const { return _transmitter.getBroadcastTransmissionRedundancy(); }
 
@@ -257,6 +257,23 @@ public:
    * @param recipientInfo The recipient information.
    */
   TransmissionStatusType attemptTransmission(const String &message, const EspnowNetworkInfo &recipientInfo);
+
+  /**
+   * Transmit a binary payload to a single recipient without changing the local transmission state.
+   * Each ESP-NOW transmission is filled directly from the payload, so no copy of the full payload is made. 
+   * The payload will arrive as a String of length payloadLength, which may contain null bytes.
+   * 
+   * @param payload The payload. Must not be modified until the method returns.
+   * @param payloadLength The payload length in bytes. At most getMaxMessageLength().
+   * @param recipientInfo The recipient information.
+   */
+  TransmissionStatusType attemptTransmission(const uint8_t *payload, const uint32_t payloadLength, const EspnowNetworkInfo &recipientInfo);
+
+  /**
+   * Same as above, but reads payloadLength bytes from a Stream as they are transmitted. 
+   * Since the Stream cannot be read again, each part of the payload is retried immediately instead of in later rounds (see setFragmentRetransmissionRounds).
+   */
+  TransmissionStatusType attemptTransmission(Stream &payload, const uint32_t payloadLength, const EspnowNetworkInfo &recipientInfo);
   
   /* 
    * Will ensure that an encrypted connection exists to each target node before sending the message, 
@@ -303,6 +320,12 @@ public:
    */
   void broadcast(const String &message);
 
+  /**
+   * Broadcast a binary payload, or payloadLength bytes read from a Stream. See the binary attemptTransmission methods.
+   */
+  void broadcast(const uint8_t *payload, const uint32_t payloadLength);
+  void broadcast(Stream &payload, const uint32_t payloadLength);
+
   /**
    * Set the number of redundant transmissions that will be made for every broadcast. 
    * A greater number increases the likelihood that the broadcast is received, but also means it takes longer time to send.
@@ -355,6 +378,29 @@ public:
   static void setBroadcastResponseTimeoutMs(const uint32_t broadcastResponseTimeoutMs);
   static uint32_t broadcastResponseTimeoutMs();
 
+  /**
+   * Set the maximum number of entries in each of the ESP-NOW logs of received transmissions, sent requests and received requests.
+   * Storage for a log is allocated when its first entry is stored, and when a log is full its oldest entry is replaced.
+   * Setting the capacity too low for the transmission activity may cause responses or multi-part transmissions to be lost,
+   * or make the node receive the same transmission multiple times. Changing the capacity clears the logs.
+   * 
+   * Set to 32 by default.
+   * 
+   * @param capacity The maximum number of entries in each log.
+   */
+  static void setLogEntryCapacity(const uint16_t capacity);
+  static uint16_t logEntryCapacity();
+
+  /**
+   * Set the maximum number of responses that can wait to be sent. Responses created while this many are waiting are dropped.
+   * 
+   * Set to 40 by default.
+   * 
+   * @param capacity The maximum number of scheduled responses.
+   */
+  static void setScheduledResponseCapacity(const uint16_t capacity);
+  static uint16_t scheduledResponseCapacity();
+
   /** 
    * Change the key used by this EspnowMeshBackend instance for creating encrypted ESP-NOW connections.
    * Will apply to any new received requests for encrypted connection if this EspnowMeshBackend instance is the current request manager. 
@@ -515,7 +561,7 @@ public:
 
   /**
    * Set the maximum acceptable message length, in terms of transmissions, when sending a message from this node.
-   * This has no effect when receiving messages, the limit for receiving is always 256 transmissions per message. 
+   * This has no effect when receiving messages, the limit for receiving is set by setMaxReceivedTransmissionsPerMessage(). 
    * Note that although values up to 128 are possible, this would in practice fill almost all the RAM available on the ESP8266 with just one message.
    * Thus, if this value is set higher than the default, make sure there is enough heap available to store the messages 
    * and don't send messages more frequently than they can be processed. 
@@ -628,6 +674,46 @@ public:
   static void setEspnowRetransmissionInterval(const uint32_t intervalMs);
   static uint32_t getEspnowRetransmissionInterval();
 
+  /**
+   * Set the number of extra rounds made to send the parts of a multi-part message that did not get an ack.
+   * A round ends at the first part that does not get an ack, and the next round continues from that part, so parts already acked are never resent.
+   * The first part of a message must always get an ack before the other parts are sent, since the receiver needs it to store the other parts.
+   * 
+   * @param rounds The number of retransmission rounds. Each round gives every missing part one more transmission timeout. Defaults to 2.
+   */
+  static void setFragmentRetransmissionRounds(const uint8_t rounds);
+  static uint8_t getFragmentRetransmissionRounds();
+
+  /**
+   * Set whether the parts of a multi-part message that did not get an ack are skipped instead of ending the round, so that all parts are sent once 
+   * before any part is sent again (see setFragmentRetransmissionRounds). The parts will then arrive out of order when a transmission is lost.
+   * 
+   * Only enable this when all nodes in the mesh run a version of this library that reassembles out-of-order parts. 
+   * Older nodes drop a message when a part is skipped, while the sender still gets an ack for every part.
+   * 
+   * @param useSelectiveRetransmission True to send the parts of a message out of order when a transmission is lost. Defaults to false.
+   */
+  static void setUseSelectiveRetransmission(const bool useSelectiveRetransmission);
+  static bool useSelectiveRetransmission();
+
+  /**
+   * Set the number of message reassembly buffers to keep for reuse once the messages they were used for have been handled.
+   * Reusing buffers avoids heap fragmentation when many multi-part messages are received.
+   * 
+   * @param poolSize The number of buffers to keep. Defaults to 2.
+   */
+  static void setReassemblyBufferPoolSize(const uint8_t poolSize);
+  static uint8_t reassemblyBufferPoolSize();
+
+  /**
+   * Set the maximum acceptable message length, in terms of transmissions, when receiving a message. Longer messages are ignored.
+   * Reassembly buffers grow as the transmissions of a message arrive, so this bounds the heap one message can take.
+   * 
+   * @param maxTransmissionsPerMessage The maximum acceptable length of a received message. Valid values are 1 to 128. Defaults to 128.
+   */
+  static void setMaxReceivedTransmissionsPerMessage(const uint8_t maxTransmissionsPerMessage);
+  static uint8_t getMaxReceivedTransmissionsPerMessage();
+
   // The maximum amount of time each of the two stages in an encrypted connection request may take.
   static void setEncryptionRequestTimeout(const uint32_t timeoutMs);
   static uint32_t getEncryptionRequestTimeout();
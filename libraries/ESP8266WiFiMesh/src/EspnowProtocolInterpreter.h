@@ -36,6 +36,8 @@
 //            This distinction based on encryption is required since the ESP-NOW API does not provide information about whether a received transmission is encrypted or not.
 // Byte 16-249: The message.
 // Each message can be split in up to EspnowMeshBackend::getMaxTransmissionsPerMessage() transmissions, based on message size. (max three transmissions per message is the default)
+// All transmissions of a message except the last carry the maximum number of message bytes, so the position of each part is given by its transmissions remaining value.
+// The message start transmission is always sent first, but the other transmissions may arrive in any order since only the ones that were not acked are retransmitted.
 
 namespace EspnowProtocolInterpreter
 { 
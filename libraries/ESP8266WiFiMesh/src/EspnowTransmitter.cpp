@@ -25,6 +25,7 @@ extern "C" {
 #include "UtilityFunctions.h"
 #include "MeshCryptoInterface.h"
 #include "JsonTranslator.h"
+#include "TransmissionBitmap.h"
 
 namespace
 {
@@ -47,6 +48,8 @@ namespace
   bool _espnowSendConfirmed = false;
 
   uint8_t _maxTransmissionsPerMessage = 3;
+  uint8_t _fragmentRetransmissionRounds = 2;
+  bool _useSelectiveRetransmission = false;
 }
 
 EspnowTransmitter::EspnowTransmitter(ConditionalPrinter &conditionalPrinterInstance, EspnowDatabase &databaseInstance, EspnowConnectionManager &connectionManagerInstance) 
@@ -126,6 +129,18 @@ void EspnowTransmitter::setEspnowRetransmissionInterval(const uint32_t intervalM
 }
 uint32_t EspnowTransmitter::getEspnowRetransmissionInterval() {return _espnowRetransmissionIntervalMs;}
 
+void EspnowTransmitter::setFragmentRetransmissionRounds(const uint8_t rounds)
+{
+  _fragmentRetransmissionRounds = rounds;
+}
+uint8_t EspnowTransmitter::getFragmentRetransmissionRounds() {return _fragmentRetransmissionRounds;}
+
+void EspnowTransmitter::setUseSelectiveRetransmission(const bool useSelectiveRetransmission)
+{
+  _useSelectiveRetransmission = useSelectiveRetransmission;
+}
+bool EspnowTransmitter::useSelectiveRetransmission() {return _useSelectiveRetransmission;}
+
 double EspnowTransmitter::getTransmissionFailRate()
 {
   if(_transmissionsTotal == 0)
@@ -206,6 +221,21 @@ MutexTracker EspnowTransmitter::captureEspnowTransmissionMutex(const std::functi
 bool EspnowTransmitter::transmissionInProgress(){return *_espnowTransmissionMutex;}
 
 TransmissionStatusType EspnowTransmitter::espnowSendToNode(const String &message, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance)
+{
+  return sendToNodeKernel(PayloadSource{(const uint8_t *)message.c_str(), nullptr, message.length()}, targetBSSID, messageType, espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::espnowSendToNode(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance)
+{
+  return sendToNodeKernel(PayloadSource{payload, nullptr, payloadLength}, targetBSSID, messageType, espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::espnowSendToNode(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance)
+{
+  return sendToNodeKernel(PayloadSource{nullptr, &payload, payloadLength}, targetBSSID, messageType, espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::sendToNodeKernel(const PayloadSource &payload, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance)
 {
   using EspnowProtocolInterpreter::synchronizationRequestHeader;
   
@@ -228,13 +258,52 @@ TransmissionStatusType EspnowTransmitter::espnowSendToNode(const String &message
       }
     }
 
-    return espnowSendToNodeUnsynchronized(message, encryptedMac, messageType, EspnowConnectionManager::generateMessageID(encryptedConnection), espnowInstance);
+    return sendToNodeUnsynchronizedKernel(payload, encryptedMac, messageType, EspnowConnectionManager::generateMessageID(encryptedConnection), espnowInstance);
   }
   
-  return espnowSendToNodeUnsynchronized(message, targetBSSID, messageType, EspnowConnectionManager::generateMessageID(encryptedConnection), espnowInstance);
+  return sendToNodeUnsynchronizedKernel(payload, targetBSSID, messageType, EspnowConnectionManager::generateMessageID(encryptedConnection), espnowInstance);
 }
 
 TransmissionStatusType EspnowTransmitter::espnowSendToNodeUnsynchronized(const String message, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance)
+{
+  // The message String is copied by the argument to make sure it is not modified by a callback during the delay(1) calls of the transmission.
+  return sendToNodeUnsynchronizedKernel(PayloadSource{(const uint8_t *)message.c_str(), nullptr, message.length()}, targetBSSID, messageType, messageID, espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::espnowSendToNodeUnsynchronized(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance)
+{
+  return sendToNodeUnsynchronizedKernel(PayloadSource{payload, nullptr, payloadLength}, targetBSSID, messageType, messageID, espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::espnowSendToNodeUnsynchronized(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance)
+{
+  return sendToNodeUnsynchronizedKernel(PayloadSource{nullptr, &payload, payloadLength}, targetBSSID, messageType, messageID, espnowInstance);
+}
+
+bool EspnowTransmitter::transmitFragment(const uint8_t *transmission, const uint8_t transmissionSize, const uint32_t retransmissions, const uint8_t timeoutPeriods)
+{
+  for(uint32_t i = 0; i <= retransmissions; ++i)
+  {
+    _espnowSendConfirmed = false;
+    ExpiringTimeTracker transmissionTimeout([timeoutPeriods](){ return timeoutPeriods * getEspnowTransmissionTimeout(); });
+    
+    while(!_espnowSendConfirmed && !transmissionTimeout)
+    {
+      if(esp_now_send(_transmissionTargetBSSID, const_cast<uint8_t *>(transmission), transmissionSize) == 0) // == 0 => Success
+      {
+        ExpiringTimeTracker retransmissionTime([](){ return getEspnowRetransmissionInterval(); });
+        while(!_espnowSendConfirmed && !retransmissionTime && !transmissionTimeout)
+        {        
+          delay(1); // Note that callbacks can be called during delay time, so it is possible to receive a transmission during this delay.
+        }
+      }
+    }
+  }
+
+  return _espnowSendConfirmed;
+}
+
+TransmissionStatusType EspnowTransmitter::sendToNodeUnsynchronizedKernel(const PayloadSource &payload, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance)
 {
   using namespace EspnowProtocolInterpreter;
 
@@ -245,15 +314,15 @@ TransmissionStatusType EspnowTransmitter::espnowSendToNodeUnsynchronized(const S
     return TransmissionStatusType::TRANSMISSION_FAILED;
   }
 
-  // We copy the message String and bssid array from the arguments in this method to make sure they are
+  // We copy the bssid array from the arguments in this method to make sure it is
   // not modified by a callback during the delay(1) calls further down. 
   // This also makes it possible to get the current _transmissionTargetBSSID outside of the method.
   std::copy_n(targetBSSID, 6, _transmissionTargetBSSID);
   
   EncryptedConnectionLog *encryptedConnection = EspnowConnectionManager::getEncryptedConnection(_transmissionTargetBSSID);
   
-  int32_t transmissionsRequired = ceil((double)message.length() / getMaxMessageBytesPerTransmission());
-  int32_t transmissionsRemaining = transmissionsRequired > 1 ? transmissionsRequired - 1 : 0;
+  uint32_t maxMessageBytes = getMaxMessageBytesPerTransmission();
+  int32_t transmissionsRequired = payload.length > 0 ? (payload.length + maxMessageBytes - 1) / maxMessageBytes : 1;
 
   _transmissionsTotal++;
 
@@ -261,139 +330,159 @@ TransmissionStatusType EspnowTransmitter::espnowSendToNodeUnsynchronized(const S
   // Messages composed of up to 128 transmissions can be handled without modification, but RAM limitations on the ESP8266 would make this hard in practice. 
   // We thus prefer to keep the code simple and performant instead.
   // Very large messages can always be split by the user as required. 
-  assert(transmissionsRequired <= getMaxTransmissionsPerMessage());
+  if(transmissionsRequired > getMaxTransmissionsPerMessage())
+  {
+    ++_transmissionsFailed;
+    ConditionalPrinter::staticVerboseModePrint(String(F("espnowSendToNode failed! Message requires ")) + String(transmissionsRequired) 
+                                               + String(F(" transmissions, the maximum is ")) + String(getMaxTransmissionsPerMessage()) + String('.'));
+    return TransmissionStatusType::TRANSMISSION_FAILED;
+  }
   assert(messageType == 'Q' || messageType == 'A' || messageType == 'B' || messageType == 'S' || messageType == 'P' || messageType == 'C');
   if(messageType == 'P' || messageType == 'C')
   {
     assert(transmissionsRequired == 1); // These messages are assumed to be contained in one message by the receive callbacks.
   }
   
-  uint8_t transmissionSize = 0;
-  bool messageStart = true;
   uint8_t espnowMetadataSize = metadataSize();
+  
+  uint32_t retransmissions = 0;
+  if(messageType == 'B')
+    retransmissions = espnowInstance->getBroadcastTransmissionRedundancy();
+
+  // A Stream cannot be read again, so its transmissions get all their retransmission time at once.
+  uint8_t timeoutPeriods = payload.stream ? 1 + getFragmentRetransmissionRounds() : 1;
+
+  TransmissionBitmap missingTransmissions;
+  bool transmissionAborted = false;
 
-  do
+  // The first round sends every transmission in order. Later rounds only resend the transmissions that were not acked. 
+  // Receivers without out-of-order reassembly drop a message when a transmission is skipped, so unless selective retransmission is enabled 
+  // a round ends at the first transmission that is not acked and the next round continues from there, keeping the transmissions in order.
+  bool selectiveRetransmission = useSelectiveRetransmission();
+  for(uint16_t round = 0; round <= getFragmentRetransmissionRounds() && (round == 0 || missingTransmissions.count() > 0) && !transmissionAborted; ++round)
   {
-    ////// Manage logs //////
-    
-    if(transmissionsRemaining == 0 && (messageType == 'Q' || messageType == 'B'))
+    for(int32_t transmissionIndex = 0; transmissionIndex < transmissionsRequired; ++transmissionIndex)
     {
-      assert(espnowInstance); // espnowInstance required when transmitting 'Q' and 'B' type messages.
-      // If we are sending the last transmission of a request we should store the sent request in the log no matter if we receive an ack for the final transmission or not.
-      // That way we will always be ready to receive the response to the request when there is a chance the request message was transmitted successfully, 
-      // even if the final ack for the request message was lost.
-      EspnowDatabase::storeSentRequest(TypeCast::macToUint64(_transmissionTargetBSSID), messageID, RequestData(*espnowInstance));
-    }
-    
-    ////// Create transmission array //////
-    
-    if(transmissionsRemaining > 0)
-    {
-      transmissionSize = getMaxBytesPerTransmission();
-    }
-    else
-    {
-      transmissionSize = espnowMetadataSize;
+      if(round > 0 && !missingTransmissions.test(transmissionIndex))
+        continue;
+      
+      int32_t transmissionsRemaining = transmissionsRequired - transmissionIndex - 1;
+      
+      ////// Manage logs //////
       
-      if(message.length() > 0)
+      if(round == 0 && transmissionsRemaining == 0 && (messageType == 'Q' || messageType == 'B'))
       {
-        uint32_t remainingLength = message.length() % getMaxMessageBytesPerTransmission();
-        transmissionSize += (remainingLength == 0 ? getMaxMessageBytesPerTransmission() : remainingLength);
+        assert(espnowInstance); // espnowInstance required when transmitting 'Q' and 'B' type messages.
+        // If we are sending the last transmission of a request we should store the sent request in the log no matter if we receive an ack for the final transmission or not.
+        // That way we will always be ready to receive the response to the request when there is a chance the request message was transmitted successfully, 
+        // even if the final ack for the request message was lost.
+        EspnowDatabase::storeSentRequest(TypeCast::macToUint64(_transmissionTargetBSSID), messageID, RequestData(*espnowInstance));
       }
-    }
-    
-    uint8_t transmission[transmissionSize];
+      
+      ////// Create transmission array //////
 
-    ////// Fill protocol bytes //////
-    
-    transmission[messageTypeIndex] = messageType;
-    
-    if(messageStart)
-    {
-      transmission[transmissionsRemainingIndex] = (char)(transmissionsRemaining | 0x80);
-    }
-    else
-    {
-      transmission[transmissionsRemainingIndex] = (char)transmissionsRemaining;
-    }
+      uint32_t transmissionStartIndex = transmissionIndex * maxMessageBytes;
+      uint32_t messageBytes = transmissionsRemaining > 0 ? maxMessageBytes : payload.length - transmissionStartIndex;
+      uint8_t transmissionSize = espnowMetadataSize + messageBytes;
+      
+      uint8_t transmission[getMaxBytesPerTransmission()];
 
-    // Fills indices in range [transmissionMacIndex, transmissionMacIndex + 5] (6 bytes) with the MAC address of the WiFi AP interface.
-    // We always transmit from the station interface (due to using ESP_NOW_ROLE_CONTROLLER), so this makes it possible to always know both interface MAC addresses of a node that sends a transmission.
-    WiFi.softAPmacAddress(transmission + transmissionMacIndex);
+      ////// Fill protocol bytes //////
+      
+      transmission[messageTypeIndex] = messageType;
 
-    setMessageID(transmission, messageID);
+      // The receiver learns the number of transmissions from the message start, so it is always sent first and must be acked before the rest.
+      if(transmissionIndex == 0)
+      {
+        transmission[transmissionsRemainingIndex] = (char)(transmissionsRemaining | 0x80);
+      }
+      else
+      {
+        transmission[transmissionsRemainingIndex] = (char)transmissionsRemaining;
+      }
 
-    ////// Fill message bytes //////
-    
-    int32_t transmissionStartIndex = (transmissionsRequired - transmissionsRemaining - 1) * getMaxMessageBytesPerTransmission();
-    
-    std::copy_n(message.begin() + transmissionStartIndex, transmissionSize - espnowMetadataSize, transmission + espnowMetadataSize);
-
-    if(useEncryptedMessages())
-    {      
-      // chacha20Poly1305Encrypt encrypts transmission in place.
-      // We are using the protocol bytes as a key salt.
-      experimental::crypto::ChaCha20Poly1305::encrypt(transmission + espnowMetadataSize, transmissionSize - espnowMetadataSize, getEspnowMessageEncryptionKey(), transmission, 
-                                               protocolBytesSize, transmission + protocolBytesSize, transmission + protocolBytesSize + 12);
-    }
-    
-    ////// Transmit //////
+      // Fills indices in range [transmissionMacIndex, transmissionMacIndex + 5] (6 bytes) with the MAC address of the WiFi AP interface.
+      // We always transmit from the station interface (due to using ESP_NOW_ROLE_CONTROLLER), so this makes it possible to always know both interface MAC addresses of a node that sends a transmission.
+      WiFi.softAPmacAddress(transmission + transmissionMacIndex);
+
+      setMessageID(transmission, messageID);
 
-    uint32_t retransmissions = 0;
-    if(messageType == 'B')
-      retransmissions = espnowInstance->getBroadcastTransmissionRedundancy();
+      ////// Fill message bytes //////
       
-    for(uint32_t i = 0; i <= retransmissions; ++i)
-    {
-      _espnowSendConfirmed = false;
-      ExpiringTimeTracker transmissionTimeout([](){ return getEspnowTransmissionTimeout(); });
+      if(payload.stream)
+      {
+        if(payload.stream->readBytes(transmission + espnowMetadataSize, messageBytes) != messageBytes)
+        {
+          ++_transmissionsFailed;
+          ConditionalPrinter::staticVerboseModePrint(String(F("espnowSendToNode failed! Payload stream ended early.")));
+          return TransmissionStatusType::TRANSMISSION_FAILED;
+        }
+      }
+      else
+      {
+        std::copy_n(payload.array + transmissionStartIndex, messageBytes, transmission + espnowMetadataSize);
+      }
+
+      if(useEncryptedMessages())
+      {      
+        // chacha20Poly1305Encrypt encrypts transmission in place.
+        // We are using the protocol bytes as a key salt.
+        experimental::crypto::ChaCha20Poly1305::encrypt(transmission + espnowMetadataSize, transmissionSize - espnowMetadataSize, getEspnowMessageEncryptionKey(), transmission, 
+                                                 protocolBytesSize, transmission + protocolBytesSize, transmission + protocolBytesSize + 12);
+      }
       
-      while(!_espnowSendConfirmed && !transmissionTimeout)
+      ////// Transmit //////
+
+      bool transmissionConfirmed = transmitFragment(transmission, transmissionSize, retransmissions, timeoutPeriods);
+
+      if(transmissionIndex == 0 && encryptedConnection && !usesConstantSessionKey(messageType) && encryptedConnection->getOwnSessionKey() == messageID)
       {
-        if(esp_now_send(_transmissionTargetBSSID, transmission, transmissionSize) == 0) // == 0 => Success
+        if(transmissionConfirmed)
         {
-          ExpiringTimeTracker retransmissionTime([](){ return getEspnowRetransmissionInterval(); });
-          while(!_espnowSendConfirmed && !retransmissionTime && !transmissionTimeout)
-          {        
-            delay(1); // Note that callbacks can be called during delay time, so it is possible to receive a transmission during this delay.
-          }
+          encryptedConnection->setDesync(false);
+          encryptedConnection->incrementOwnSessionKey();
         }
-  
-        if(_espnowSendConfirmed)
+        else
         {
-          if(messageStart)
-          {        
-            if(encryptedConnection && !usesConstantSessionKey(messageType) && encryptedConnection->getOwnSessionKey() == messageID)
-            {
-              encryptedConnection->setDesync(false);
-              encryptedConnection->incrementOwnSessionKey();
-            }
-            
-            messageStart = false;
-          }  
-          
-          break;
+          encryptedConnection->setDesync(true);
         }
       }
-    }
-    
-    if(!_espnowSendConfirmed)
-    {
-      ++_transmissionsFailed;
-
-      ConditionalPrinter::staticVerboseModePrint(String(F("espnowSendToNode failed!")));
-      ConditionalPrinter::staticVerboseModePrint(String(F("Transmission #: ")) + String(transmissionsRequired - transmissionsRemaining) + String('/') + String(transmissionsRequired));
-      ConditionalPrinter::staticVerboseModePrint(String(F("Transmission fail rate (up) ")) + String(getTransmissionFailRate()));
 
-      if(messageStart && encryptedConnection && !usesConstantSessionKey(messageType) && encryptedConnection->getOwnSessionKey() == messageID)
-        encryptedConnection->setDesync(true);
-      
-      return TransmissionStatusType::TRANSMISSION_FAILED;
+      if(transmissionConfirmed)
+      {
+        missingTransmissions.clear(transmissionIndex);
+      }
+      else if(transmissionIndex == 0 || payload.stream)
+      {
+        // Without the message start the receiver cannot store the other transmissions, and a Stream cannot be read again.
+        for(int32_t missingIndex = transmissionIndex; missingIndex < transmissionsRequired; ++missingIndex)
+          missingTransmissions.set(missingIndex);
+        transmissionAborted = true;
+        break;
+      }
+      else if(!selectiveRetransmission)
+      {
+        for(int32_t missingIndex = transmissionIndex; missingIndex < transmissionsRequired; ++missingIndex)
+          missingTransmissions.set(missingIndex);
+        break;
+      }
+      else
+      {
+        missingTransmissions.set(transmissionIndex);
+      }
     }
+  }
+  
+  if(missingTransmissions.count() > 0)
+  {
+    ++_transmissionsFailed;
 
-    --transmissionsRemaining; // This is used when transferring multi-transmission messages.
+    ConditionalPrinter::staticVerboseModePrint(String(F("espnowSendToNode failed!")));
+    ConditionalPrinter::staticVerboseModePrint(String(F("Transmissions missing: ")) + String(missingTransmissions.count()) + String('/') + String(transmissionsRequired));
+    ConditionalPrinter::staticVerboseModePrint(String(F("Transmission fail rate (up) ")) + String(getTransmissionFailRate()));
     
-  } while(transmissionsRemaining >= 0);
+    return TransmissionStatusType::TRANSMISSION_FAILED;
+  }
 
   // Useful when debugging the protocol
   //_conditionalPrinter.staticVerboseModePrint("Sent to Mac: " + TypeCast::macToString(_transmissionTargetBSSID) + " ID: " + TypeCast::uint64ToString(messageID)); 
@@ -413,6 +502,16 @@ TransmissionStatusType EspnowTransmitter::sendRequest(const String &message, con
   return transmissionStatus;
 }
 
+TransmissionStatusType EspnowTransmitter::sendRequest(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance)
+{
+  return espnowSendToNode(payload, payloadLength, targetBSSID, 'Q', espnowInstance);
+}
+
+TransmissionStatusType EspnowTransmitter::sendRequest(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance)
+{
+  return espnowSendToNode(payload, payloadLength, targetBSSID, 'Q', espnowInstance);
+}
+
 TransmissionStatusType EspnowTransmitter::sendResponse(const String &message, const uint64_t requestID, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance)
 {
   EncryptedConnectionLog *encryptedConnection = EspnowConnectionManager::getEncryptedConnection(targetBSSID);
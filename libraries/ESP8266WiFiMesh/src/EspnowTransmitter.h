@@ -49,10 +49,25 @@ public:
   // Send a message using exactly the arguments given, without consideration for any encrypted connections.
   static TransmissionStatusType espnowSendToNodeUnsynchronized(const String message, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance = nullptr);
 
+  /**
+   * Binary versions of the methods above. Each transmission is filled directly from the payload, so no copy of the full message is made.
+   * The payload array must not be modified until the method returns. Note that callbacks can be called during the transmission.
+   * 
+   * A Stream payload is read one transmission at a time, so it must provide payloadLength bytes without a long wait.
+   * Since a Stream cannot be read again, each part of a Stream payload is retried for the combined duration of all retransmission rounds 
+   * instead of in later rounds (see setFragmentRetransmissionRounds).
+   */
+  static TransmissionStatusType espnowSendToNode(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance = nullptr);
+  static TransmissionStatusType espnowSendToNode(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance = nullptr);
+  static TransmissionStatusType espnowSendToNodeUnsynchronized(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance = nullptr);
+  static TransmissionStatusType espnowSendToNodeUnsynchronized(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance = nullptr);
+
   // Send a PeerRequestConfirmation using exactly the arguments given, without consideration for any encrypted connections.
   static TransmissionStatusType espnowSendPeerRequestConfirmationsUnsynchronized(const String message, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance = nullptr);
   
   TransmissionStatusType sendRequest(const String &message, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance);
+  TransmissionStatusType sendRequest(const uint8_t *payload, const uint32_t payloadLength, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance);
+  TransmissionStatusType sendRequest(Stream &payload, const uint32_t payloadLength, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance);
   TransmissionStatusType sendResponse(const String &message, const uint64_t requestID, const uint8_t *targetBSSID, EspnowMeshBackend *espnowInstance);
   
   static void setUseEncryptedMessages(const bool useEncryptedMessages);
@@ -72,6 +87,10 @@ public:
   static uint32_t getEspnowTransmissionTimeout();
   static void setEspnowRetransmissionInterval(const uint32_t intervalMs);
   static uint32_t getEspnowRetransmissionInterval();
+  static void setFragmentRetransmissionRounds(const uint8_t rounds);
+  static uint8_t getFragmentRetransmissionRounds();
+  static void setUseSelectiveRetransmission(const bool useSelectiveRetransmission);
+  static bool useSelectiveRetransmission();
   static double getTransmissionFailRate();
   static void resetTransmissionFailRate();
 
@@ -97,6 +116,18 @@ public:
 
 private:
 
+  // The payload of a transmission, read one part at a time.
+  struct PayloadSource
+  {
+    const uint8_t *array;
+    Stream *stream;
+    uint32_t length;
+  };
+
+  static TransmissionStatusType sendToNodeKernel(const PayloadSource &payload, const uint8_t *targetBSSID, const char messageType, EspnowMeshBackend *espnowInstance);
+  static TransmissionStatusType sendToNodeUnsynchronizedKernel(const PayloadSource &payload, const uint8_t *targetBSSID, const char messageType, const uint64_t messageID, EspnowMeshBackend *espnowInstance);
+  static bool transmitFragment(const uint8_t *transmission, const uint8_t transmissionSize, const uint32_t retransmissions, const uint8_t timeoutPeriods);
+
   ConditionalPrinter & _conditionalPrinter;
   EspnowDatabase & _database;
   EspnowConnectionManager & _connectionManager;
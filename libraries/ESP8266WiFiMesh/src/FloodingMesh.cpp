@@ -132,21 +132,24 @@ void FloodingMesh::performMeshInstanceMaintenance()
 {
   EspnowMeshBackend::performEspnowMaintenance(); 
   
-  for(std::list<std::pair<String, bool>>::iterator backlogIterator = getForwardingBacklog().begin();  backlogIterator != getForwardingBacklog().end(); )
+  ForwardingBacklog &backlog = getForwardingBacklog();
+
+  // Messages received while forwarding are appended to the backlog and forwarded in this loop as well.
+  while(!backlog.empty())
   {
-    std::pair<String, bool> &messageData = *backlogIterator;
-    if(messageData.second) // message encrypted
+    String &message = backlog.frontMessage();
+    if(backlog.frontEncrypted())
     {
-      getMacIgnoreList() = messageData.first.substring(0, 12) + ','; // The message should contain the messageID first
-      encryptedBroadcastKernel(messageData.first); 
+      getMacIgnoreList() = message.substring(0, 12) + ','; // The message should contain the messageID first
+      encryptedBroadcastKernel(message); 
       getMacIgnoreList() = emptyString;
     }
     else
     {
-      broadcastKernel(messageData.first);
+      broadcastKernel(message);
     }
 
-    backlogIterator = getForwardingBacklog().erase(backlogIterator);
+    backlog.pop();
     
     EspnowMeshBackend::performEspnowMaintenance(); // It is best to performEspnowMaintenance frequently to keep the Espnow backend responsive. Especially if each encryptedBroadcast takes a lot of time.
   }
@@ -224,7 +227,6 @@ void FloodingMesh::encryptedBroadcastKernel(const String &message)
 void FloodingMesh::clearMessageLogs()
 {
   _messageIDs.clear();
-  std::queue<messageQueueElementType>().swap(_messageIdOrder);
 }
 
 void FloodingMesh::clearForwardingBacklog()
@@ -247,7 +249,7 @@ uint8_t *FloodingMesh::getOriginMac(uint8_t *macArray) const
   return macArray;
 }
 
-std::list<std::pair<String, bool>> &  FloodingMesh::getForwardingBacklog() { return _forwardingBacklog; }
+ForwardingBacklog & FloodingMesh::getForwardingBacklog() { return _forwardingBacklog; }
 
 String & FloodingMesh::getMacIgnoreList() { return _macIgnoreList; }
 
@@ -265,9 +267,18 @@ uint32_t FloodingMesh::maxEncryptedMessageLength() const
 void FloodingMesh::setMessageLogSize(const uint16_t messageLogSize) 
 { 
   assert(messageLogSize >= 1);
-  _messageLogSize = messageLogSize; 
+  if(!_messageIDs.setCapacity(messageLogSize))
+    getEspnowMeshBackend().warningPrint(String(F("WARNING! Not enough memory for the message log.")));
+}
+uint16_t FloodingMesh::messageLogSize() const { return _messageIDs.capacity(); }
+
+void FloodingMesh::setForwardingBacklogSize(const uint8_t backlogSize)
+{
+  assert(backlogSize >= 1);
+  if(!getForwardingBacklog().setCapacity(backlogSize))
+    getEspnowMeshBackend().warningPrint(String(F("WARNING! Not enough memory for the forwarding backlog.")));
 }
-uint16_t FloodingMesh::messageLogSize() const { return _messageLogSize; }
+uint8_t FloodingMesh::forwardingBacklogSize() const { return _forwardingBacklog.capacity(); }
 
 void FloodingMesh::setMetadataDelimiter(const char metadataDelimiter) 
 { 
@@ -300,12 +311,15 @@ bool FloodingMesh::insertPreliminaryMessageID(const uint64_t messageID)
   if(messageID >> 16 == TypeCast::macToUint64(WiFi.softAPmacAddress(apMacArray)))
     return false; // The node should not receive its own messages.
   
-  auto insertionResult = _messageIDs.emplace(messageID, 0); // Returns std::pair<iterator,bool>
+  bool inserted = false;
+  uint8_t *receptions = _messageIDs.insert(messageID, 0, inserted);
 
-  if(insertionResult.second) // Insertion succeeded.
-    updateMessageQueue(insertionResult.first);
-  else if(insertionResult.first->second < getBroadcastReceptionRedundancy()) // messageID exists but not with desired redundancy
-    insertionResult.first->second++;
+  if(!receptions)
+    return false; // No message log memory
+  else if(inserted)
+    return true;
+  else if(*receptions < getBroadcastReceptionRedundancy()) // messageID exists but not with desired redundancy
+    ++*receptions;
   else
     return false; // messageID already existed in _messageIDs with desired redundancy
 
@@ -318,31 +332,21 @@ bool FloodingMesh::insertCompletedMessageID(const uint64_t messageID)
   if(messageID >> 16 == TypeCast::macToUint64(WiFi.softAPmacAddress(apMacArray)))
     return false; // The node should not receive its own messages.
   
-  auto insertionResult = _messageIDs.emplace(messageID, MESSAGE_COMPLETE); // Returns std::pair<iterator,bool>
+  bool inserted = false;
+  uint8_t *receptions = _messageIDs.insert(messageID, MESSAGE_COMPLETE, inserted);
 
-  if(insertionResult.second) // Insertion succeeded.
-    updateMessageQueue(insertionResult.first);
-  else if(insertionResult.first->second < MESSAGE_COMPLETE) // messageID exists but is not complete
-    insertionResult.first->second = MESSAGE_COMPLETE;
+  if(!receptions)
+    return false; // No message log memory
+  else if(inserted)
+    return true;
+  else if(*receptions < MESSAGE_COMPLETE) // messageID exists but is not complete
+    *receptions = MESSAGE_COMPLETE;
   else
     return false; // messageID already existed in _messageIDs and is complete
 
   return true;
 }
 
-void FloodingMesh::updateMessageQueue(const messageQueueElementType messageIterator)
-{
-  _messageIdOrder.emplace(messageIterator);
-  
-  if(_messageIDs.size() > messageLogSize())
-  {
-    _messageIDs.erase(_messageIdOrder.front());
-    _messageIdOrder.pop();
-    assert(_messageIDs.size() == messageLogSize()); // If this is false we either have too many elements in messageIDs or we deleted too many elements.
-    assert(_messageIDs.size() == _messageIdOrder.size()); // The containers should always be in sync
-  }
-}
-
 void FloodingMesh::restoreDefaultRequestHandler()
 {
   getEspnowMeshBackend().setRequestHandler([this](const String &request, MeshBackendBase &meshInstance){ return _defaultRequestHandler(request, meshInstance); });
@@ -425,7 +429,8 @@ String FloodingMesh::_defaultRequestHandler(const String &request, MeshBackendBa
     {
       message = broadcastTarget + remainingRequest.substring(0, messageIDEndIndex + 1) + message;
       assert(message.length() <= _espnowBackend.getMaxMessageLength());
-      getForwardingBacklog().emplace_back(message, getEspnowMeshBackend().receivedEncryptedTransmission());
+      if(!getForwardingBacklog().push(message, getEspnowMeshBackend().receivedEncryptedTransmission()))
+        getEspnowMeshBackend().warningPrint(String(F("WARNING! Forwarding backlog full, message will not be forwarded.")));
     }
   }
   
@@ -26,8 +26,9 @@
 #define __FLOODINGMESH_H__
 
 #include "EspnowMeshBackend.h"
+#include "MessageIdLog.h"
+#include "ForwardingBacklog.h"
 #include <set>
-#include <queue>
 
 /**
  * An alternative to standard delay(). Will continuously call performMeshMaintenance() during the waiting time, so that the FloodingMesh node remains responsive.
@@ -241,6 +242,18 @@ public:
   void setMessageLogSize(const uint16_t messageLogSize);
   uint16_t messageLogSize() const;
 
+  /**
+   * The number of received messages that can wait to be forwarded by the node. Messages are forwarded during performMeshMaintenance(),
+   * and those received while the backlog is full are still handled by the node but not forwarded.
+   * Each slot keeps the buffer of the largest message it has held until clearForwardingBacklog() is called.
+   *
+   * Defaults to 16.
+   *
+   * @param backlogSize The number of slots in the forwarding backlog. Valid values are 1 to 255. Any waiting messages are discarded.
+   */
+  void setForwardingBacklogSize(const uint8_t backlogSize);
+  uint8_t forwardingBacklogSize() const;
+
   /**
    * Hint: Use String.length() to get the ASCII length of a String.
    * 
@@ -286,8 +299,6 @@ public:
 
 protected:
 
-  using messageQueueElementType = std::map<uint64_t, uint8_t>::iterator;
-
   static std::set<FloodingMesh *> availableFloodingMeshes;
   
   String generateMessageID();
@@ -298,7 +309,6 @@ protected:
 
   bool insertPreliminaryMessageID(const uint64_t messageID);
   bool insertCompletedMessageID(const uint64_t messageID);
-  void updateMessageQueue(const messageQueueElementType messageIterator);
   
   void loadMeshState(const String &serializedMeshState);
 
@@ -309,7 +319,7 @@ protected:
    */
   void setOriginMac(const uint8_t *macArray);
 
-  std::list<std::pair<String, bool>> & getForwardingBacklog();
+  ForwardingBacklog & getForwardingBacklog();
   
   String & getMacIgnoreList(); // Experimental, may break in the future.
   
@@ -319,9 +329,8 @@ private:
 
   messageHandlerType _messageHandler;
 
-  std::map<uint64_t, uint8_t> _messageIDs = {};
-  std::queue<messageQueueElementType> _messageIdOrder = {};
-  std::list<std::pair<String, bool>> _forwardingBacklog = {};
+  MessageIdLog _messageIDs;
+  ForwardingBacklog _forwardingBacklog;
 
   String _macIgnoreList;
   
@@ -335,7 +344,6 @@ private:
   uint8_t _originMac[6] = {0};
   
   uint16_t _messageCount = 0;
-  uint16_t _messageLogSize = 100;
 
   uint8_t _broadcastReceptionRedundancy = 2;
 };
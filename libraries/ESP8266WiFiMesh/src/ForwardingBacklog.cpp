@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ForwardingBacklog.h"
+#include <new>
+
+ForwardingBacklog::ForwardingBacklog(const uint8_t capacity)
+{
+  setCapacity(capacity);
+}
+
+bool ForwardingBacklog::setCapacity(const uint8_t capacity)
+{
+  _messages.reset(new (std::nothrow) String[capacity]);
+  _encrypted.reset(new (std::nothrow) bool[capacity]);
+
+  if(!_messages || !_encrypted)
+  {
+    _messages.reset();
+    _encrypted.reset();
+  }
+
+  _capacity = _messages ? capacity : 0;
+  _count = 0;
+  _oldest = 0;
+
+  return _capacity == capacity;
+}
+
+uint8_t ForwardingBacklog::capacity() const { return _capacity; }
+uint8_t ForwardingBacklog::size() const { return _count; }
+bool ForwardingBacklog::empty() const { return _count == 0; }
+uint32_t ForwardingBacklog::droppedCount() const { return _dropped; }
+
+bool ForwardingBacklog::push(const String &message, const bool encrypted)
+{
+  if(_count == _capacity)
+  {
+    ++_dropped;
+    return false;
+  }
+
+  uint8_t position = (_oldest + _count) % _capacity;
+  _messages[position] = message; // Reuses the buffer of the slot when it is large enough.
+  _encrypted[position] = encrypted;
+  ++_count;
+
+  return true;
+}
+
+String &ForwardingBacklog::frontMessage()
+{
+  assert(_count > 0);
+  return _messages[_oldest];
+}
+
+bool ForwardingBacklog::frontEncrypted() const
+{
+  assert(_count > 0);
+  return _encrypted[_oldest];
+}
+
+void ForwardingBacklog::pop()
+{
+  assert(_count > 0);
+  _oldest = (_oldest + 1) % _capacity;
+  --_count;
+}
+
+void ForwardingBacklog::clear()
+{
+  for(uint8_t i = 0; i < _capacity; ++i)
+  {
+    // Copying an empty String would keep the buffer, moving one in releases it.
+    _messages[i] = String();
+  }
+
+  _count = 0;
+  _oldest = 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __FORWARDINGBACKLOG_H__
+#define __FORWARDINGBACKLOG_H__
+
+#include <Arduino.h>
+#include <memory>
+
+/**
+ * Bounded FIFO of messages waiting to be forwarded by a FloodingMesh node.
+ *
+ * The slots are allocated once by setCapacity() and reused, so each String keeps its buffer between messages
+ * and a steady stream of forwarded messages of similar size causes no heap churn.
+ */
+class ForwardingBacklog {
+
+public:
+
+  explicit ForwardingBacklog(const uint8_t capacity = 16);
+
+  /**
+   * Change the number of slots. Any stored messages are discarded.
+   *
+   * @return True on success. False if memory could not be allocated, in which case the capacity becomes 0.
+   */
+  bool setCapacity(const uint8_t capacity);
+  uint8_t capacity() const;
+  uint8_t size() const;
+  bool empty() const;
+
+  /**
+   * Queue a message for forwarding.
+   *
+   * @return True if the message was queued. False if the backlog was full, in which case the message is dropped.
+   */
+  bool push(const String &message, const bool encrypted);
+
+  /**
+   * The oldest message and whether it was received encrypted. Must not be called when empty().
+   * The reference stays valid while other messages are pushed, until pop() is called.
+   */
+  String &frontMessage();
+  bool frontEncrypted() const;
+  void pop();
+
+  /**
+   * Discard all stored messages and release their buffers.
+   */
+  void clear();
+
+  /**
+   * @return The number of messages dropped by push() because the backlog was full.
+   */
+  uint32_t droppedCount() const;
+
+private:
+
+  std::unique_ptr<String[]> _messages;
+  std::unique_ptr<bool[]> _encrypted;
+  uint8_t _capacity = 0;
+  uint8_t _count = 0;
+  uint8_t _oldest = 0;
+  uint32_t _dropped = 0;
+};
+
+#endif
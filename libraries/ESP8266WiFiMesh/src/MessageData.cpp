@@ -26,39 +26,130 @@
 #include "EspnowProtocolInterpreter.h"
 #include "EspnowMeshBackend.h"
 #include <assert.h>
+#include <vector>
 
-MessageData::MessageData(const String &message, const uint8_t transmissionsRemaining, const uint32_t creationTimeMs) :
-  _timeTracker(creationTimeMs)
+namespace
 {
-  _transmissionsExpected = transmissionsRemaining + 1;
-  _totalMessage += message;
-  ++_transmissionsReceived;
+  using EspnowProtocolInterpreter::getMaxMessageBytesPerTransmission;
+
+  struct PooledBuffer
+  {
+    std::unique_ptr<uint8_t[]> buffer;
+    uint32_t size;
+  };
+  
+  std::vector<PooledBuffer> _bufferPool = {};
+  uint8_t _bufferPoolSize = 2;
+  uint8_t _maxTransmissionsPerMessage = 128;
+
+  // Room for this many transmissions is allocated when a message starts, which covers a message of the default send length.
+  // Longer messages grow their buffer as transmissions arrive, so a message start alone never claims more heap than this.
+  constexpr uint8_t preallocatedTransmissions = 3;
+
+  uint32_t pooledBufferSize()
+  {
+    return preallocatedTransmissions * getMaxMessageBytesPerTransmission();
+  }
+
+  std::unique_ptr<uint8_t[]> acquireBuffer(const uint32_t requiredSize, uint32_t &bufferSize)
+  {
+    for(auto bufferIterator = _bufferPool.begin(); bufferIterator != _bufferPool.end(); ++bufferIterator)
+    {
+      if(bufferIterator->size >= requiredSize)
+      {
+        std::unique_ptr<uint8_t[]> buffer = std::move(bufferIterator->buffer);
+        bufferSize = bufferIterator->size;
+        _bufferPool.erase(bufferIterator);
+        return buffer;
+      }
+    }
+
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[requiredSize]);
+    bufferSize = buffer ? requiredSize : 0;
+    return buffer;
+  }
+
+  void releaseBuffer(std::unique_ptr<uint8_t[]> buffer, const uint32_t bufferSize)
+  {
+    // Buffers grown for long messages are freed, the pool only keeps the size every message starts with.
+    if(bufferSize <= pooledBufferSize() && _bufferPool.size() < _bufferPoolSize)
+    {
+      if(_bufferPool.capacity() < _bufferPoolSize)
+        _bufferPool.reserve(_bufferPoolSize);
+      _bufferPool.push_back(PooledBuffer{std::move(buffer), bufferSize});
+    }
+  }
 }
 
 MessageData::MessageData(uint8_t *initialTransmission, const uint8_t transmissionLength, const uint32_t creationTimeMs) :
   _timeTracker(creationTimeMs)
 {
+  if(!acceptsMessage(initialTransmission))
+    return; // Without a buffer no transmission is added and the message never completes.
+
   _transmissionsExpected = EspnowProtocolInterpreter::getTransmissionsRemaining(initialTransmission) + 1;
+  _buffer = acquireBuffer(std::min(_transmissionsExpected, preallocatedTransmissions) * getMaxMessageBytesPerTransmission(), _bufferSize);
   addToMessage(initialTransmission, transmissionLength);
 }
 
+MessageData::~MessageData()
+{
+  if(_buffer)
+    releaseBuffer(std::move(_buffer), _bufferSize);
+}
+
 bool MessageData::addToMessage(uint8_t *transmission, const uint8_t transmissionLength)
 {
-  if(EspnowProtocolInterpreter::getTransmissionsRemaining(transmission) == getTransmissionsRemaining() - 1)
-  {
-    String message = EspnowProtocolInterpreter::getHashKeyLength(transmission, transmissionLength);
-    assert(message.length() <= EspnowMeshBackend::getMaxMessageBytesPerTransmission()); // Should catch some cases where transmission is not null terminated.
-    _totalMessage += message;
-    ++_transmissionsReceived;
-    return true;
-  }
+  using namespace EspnowProtocolInterpreter;
+
+  uint8_t transmissionsRemaining = EspnowProtocolInterpreter::getTransmissionsRemaining(transmission);
+  
+  if(!_buffer || transmissionsRemaining >= getTransmissionsExpected() || transmissionLength < metadataSize())
+    return false;
+
+  uint8_t transmissionIndex = getTransmissionsExpected() - 1 - transmissionsRemaining;
+  
+  if(_transmissionsReceived.test(transmissionIndex))
+    return false; // Already received, the sender did not get our ack.
+
+  uint32_t messageBytes = transmissionLength - metadataSize();
+  // Every transmission but the last is full, so the position of each transmission is given by its index.
+  if(messageBytes > getMaxMessageBytesPerTransmission() || (transmissionsRemaining > 0 && messageBytes != getMaxMessageBytesPerTransmission()))
+    return false;
+
+  uint32_t messageOffset = transmissionIndex * getMaxMessageBytesPerTransmission();
+  if(messageOffset + messageBytes > _bufferSize && !growBuffer(messageOffset + messageBytes))
+    return false;
+  
+  std::copy_n(transmission + metadataSize(), messageBytes, _buffer.get() + messageOffset);
 
-  return false;
+  if(transmissionsRemaining == 0)
+    _totalMessageLength = messageOffset + messageBytes;
+
+  _transmissionsReceived.set(transmissionIndex);
+  return true;
+}
+
+bool MessageData::growBuffer(const uint32_t requiredSize)
+{
+  // Doubling keeps the number of copies low when a long message arrives in order.
+  uint32_t messageSize = getTransmissionsExpected() * getMaxMessageBytesPerTransmission();
+  uint32_t newSize = std::min(std::max(requiredSize, 2 * _bufferSize), messageSize);
+
+  std::unique_ptr<uint8_t[]> newBuffer(new (std::nothrow) uint8_t[newSize]);
+  if(!newBuffer)
+    return false;
+
+  std::copy_n(_buffer.get(), _bufferSize, newBuffer.get());
+  releaseBuffer(std::move(_buffer), _bufferSize);
+  _buffer = std::move(newBuffer);
+  _bufferSize = newSize;
+  return true;
 }
 
 uint8_t MessageData::getTransmissionsReceived() const
 {
-  return _transmissionsReceived;
+  return _transmissionsReceived.count();
 }
 
 uint8_t MessageData::getTransmissionsExpected() const
@@ -71,9 +162,46 @@ uint8_t MessageData::getTransmissionsRemaining() const
   return getTransmissionsExpected() - getTransmissionsReceived();
 }
 
+bool MessageData::isComplete() const
+{
+  return _buffer && getTransmissionsRemaining() == 0;
+}
+
 String MessageData::getTotalMessage() const
 {
-  return _totalMessage;
+  String totalMessage;
+  
+  if(isComplete())
+    totalMessage.concat((const char *)getTotalMessageBytes(), getTotalMessageLength()); // concat keeps any null bytes of binary messages.
+
+  return totalMessage;
 }
 
+const uint8_t *MessageData::getTotalMessageBytes() const { return _buffer.get(); }
+uint32_t MessageData::getTotalMessageLength() const { return isComplete() ? _totalMessageLength : 0; }
+
 const TimeTracker &MessageData::getTimeTracker() const { return _timeTracker; }
+
+void MessageData::setBufferPoolSize(const uint8_t poolSize)
+{
+  _bufferPoolSize = poolSize;
+
+  while(_bufferPool.size() > poolSize)
+    _bufferPool.pop_back();
+}
+
+uint8_t MessageData::bufferPoolSize() { return _bufferPoolSize; }
+
+bool MessageData::acceptsMessage(const uint8_t *initialTransmission)
+{
+  return EspnowProtocolInterpreter::getTransmissionsRemaining(initialTransmission) < _maxTransmissionsPerMessage;
+}
+
+void MessageData::setMaxTransmissionsPerMessage(const uint8_t maxTransmissionsPerMessage)
+{
+  assert(1 <= maxTransmissionsPerMessage && maxTransmissionsPerMessage <= 128);
+
+  _maxTransmissionsPerMessage = maxTransmissionsPerMessage;
+}
+
+uint8_t MessageData::getMaxTransmissionsPerMessage() { return _maxTransmissionsPerMessage; }
@@ -26,31 +26,80 @@
 #define __ESPNOWMESSAGEDATA_H__
 
 #include "TimeTracker.h"
+#include "TransmissionBitmap.h"
 #include <Arduino.h>
+#include <memory>
 
+/**
+ * Reassembles a message sent as one or more ESP-NOW transmissions.
+ * 
+ * The first transmission of a message (the one with the message start flag) must arrive first, since it holds the number of transmissions in the message. 
+ * The remaining transmissions may then arrive in any order, which allows the sender to retransmit only the transmissions it did not get an ack for.
+ * Each transmission is copied directly to its place in a reassembly buffer, and the buffers are recycled via a small pool to avoid heap churn.
+ * The buffer starts out large enough for a message of the default length and grows as transmissions further into a longer message arrive,
+ * so the transmission count claimed by an unauthenticated message start does not decide how much heap is taken.
+ */
 class MessageData {
 
 public:
 
-  MessageData(const String &message, const uint8_t transmissionsRemaining, const uint32_t creationTimeMs = millis());
+  /**
+   * @initialTransmission A string of characters, including initial protocol bytes. Not const since that would increase heap consumption during processing.
+   * @transmissionLength Length of initialTransmission.
+   */
   MessageData(uint8_t *initialTransmission, const uint8_t transmissionLength, const uint32_t creationTimeMs = millis());
+  MessageData(MessageData &&other) = default;
+  MessageData(const MessageData &other) = delete;
+  MessageData & operator=(const MessageData &other) = delete;
+  ~MessageData();
+  
   /**
    * @transmission A string of characters, including initial protocol bytes. Not const since that would increase heap consumption during processing.
    * @transmissionLength Length of transmission.
+   * @return True if the transmission was added. False if it was already received or does not belong to the message.
    */
   bool addToMessage(uint8_t *transmission, const uint8_t transmissionLength);
   uint8_t getTransmissionsReceived() const;
   uint8_t getTransmissionsExpected() const;
   uint8_t getTransmissionsRemaining() const;
+  bool isComplete() const;
   String getTotalMessage() const;
+  const uint8_t *getTotalMessageBytes() const;
+  uint32_t getTotalMessageLength() const;
   const TimeTracker &getTimeTracker() const;
 
+  /**
+   * Set the maximum number of unused reassembly buffers kept for reuse. Buffers are only allocated when messages are received.
+   * 
+   * @param poolSize The number of buffers to keep. 0 frees every buffer as soon as its message has been handled. Defaults to 2.
+   */
+  static void setBufferPoolSize(const uint8_t poolSize);
+  static uint8_t bufferPoolSize();
+
+  /**
+   * Set the maximum number of transmissions a received message may consist of. Messages claiming more are ignored.
+   * 
+   * @param maxTransmissionsPerMessage Valid values are 1 to 128. Defaults to 128.
+   */
+  static void setMaxTransmissionsPerMessage(const uint8_t maxTransmissionsPerMessage);
+  static uint8_t getMaxTransmissionsPerMessage();
+
+  /**
+   * @initialTransmission The first transmission of a message, including initial protocol bytes.
+   * @return True if the message is not longer than getMaxTransmissionsPerMessage() allows.
+   */
+  static bool acceptsMessage(const uint8_t *initialTransmission);
+
 private:
 
+  bool growBuffer(const uint32_t requiredSize);
+
   TimeTracker _timeTracker;
-  String _totalMessage;
-  uint8_t _transmissionsReceived = 0;
-  uint8_t _transmissionsExpected;
+  std::unique_ptr<uint8_t[]> _buffer;
+  uint32_t _bufferSize = 0;
+  uint32_t _totalMessageLength = 0;
+  TransmissionBitmap _transmissionsReceived;
+  uint8_t _transmissionsExpected = 0;
 };
 
 #endif
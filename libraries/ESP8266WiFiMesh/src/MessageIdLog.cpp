@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "MessageIdLog.h"
+#include <new>
+#include <assert.h>
+
+MessageIdLog::MessageIdLog(const uint16_t capacity)
+{
+  setCapacity(capacity);
+}
+
+bool MessageIdLog::setCapacity(const uint16_t capacity)
+{
+  assert(capacity >= 1);
+
+  // Keep the table at most half full so probe sequences stay short.
+  uint8_t tableBits = 1;
+  while((1UL << tableBits) < 2UL * capacity)
+    ++tableBits;
+
+  std::unique_ptr<uint64_t[]> ids(new (std::nothrow) uint64_t[capacity]);
+  std::unique_ptr<uint8_t[]> values(new (std::nothrow) uint8_t[capacity]);
+  std::unique_ptr<uint16_t[]> table(new (std::nothrow) uint16_t[1UL << tableBits]);
+
+  // Collect the newest IDs before the old storage goes away.
+  uint16_t kept = _count < capacity ? _count : capacity;
+  if(ids && values && table)
+  {
+    for(uint16_t i = 0; i < kept; ++i)
+    {
+      uint16_t position = (_oldest + _count - kept + i) % _capacity;
+      ids[i] = _ids[position];
+      values[i] = _values[position];
+    }
+  }
+  else
+  {
+    ids.reset();
+    values.reset();
+    table.reset();
+    kept = 0;
+  }
+
+  _ids = std::move(ids);
+  _values = std::move(values);
+  _table = std::move(table);
+  _capacity = _ids ? capacity : 0;
+  _tableBits = _table ? tableBits : 0;
+  _tableMask = _table ? (1UL << tableBits) - 1 : 0;
+  _count = 0;
+  _oldest = 0;
+
+  if(!_table)
+    return false;
+
+  for(size_t slot = 0; slot <= _tableMask; ++slot)
+    _table[slot] = EMPTY_SLOT;
+
+  for(uint16_t i = 0; i < kept; ++i)
+  {
+    size_t slot = homeSlot(_ids[i]);
+    while(_table[slot] != EMPTY_SLOT)
+      slot = (slot + 1) & _tableMask;
+    _table[slot] = i;
+  }
+  _count = kept;
+
+  return true;
+}
+
+uint16_t MessageIdLog::capacity() const { return _capacity; }
+uint16_t MessageIdLog::size() const { return _count; }
+
+void MessageIdLog::clear()
+{
+  for(size_t slot = 0; _table && slot <= _tableMask; ++slot)
+    _table[slot] = EMPTY_SLOT;
+
+  _count = 0;
+  _oldest = 0;
+}
+
+size_t MessageIdLog::homeSlot(const uint64_t messageID) const
+{
+  // Fibonacci hashing of the folded ID, the top bits are the best mixed.
+  uint32_t folded = (uint32_t)messageID ^ (uint32_t)(messageID >> 32);
+  return (uint32_t)(folded * 2654435769UL) >> (32 - _tableBits);
+}
+
+size_t MessageIdLog::slotOf(const uint64_t messageID) const
+{
+  size_t slot = homeSlot(messageID);
+
+  while(_table[slot] != EMPTY_SLOT)
+  {
+    if(_ids[_table[slot]] == messageID)
+      return slot;
+
+    slot = (slot + 1) & _tableMask;
+  }
+
+  return slot;
+}
+
+uint8_t *MessageIdLog::find(const uint64_t messageID)
+{
+  if(!_count)
+    return nullptr;
+
+  uint16_t position = _table[slotOf(messageID)];
+  return position == EMPTY_SLOT ? nullptr : &_values[position];
+}
+
+uint8_t *MessageIdLog::insert(const uint64_t messageID, const uint8_t value, bool &inserted)
+{
+  inserted = false;
+
+  if(!_capacity)
+    return nullptr;
+
+  size_t slot = slotOf(messageID);
+  if(_table[slot] != EMPTY_SLOT)
+    return &_values[_table[slot]];
+
+  if(_count == _capacity)
+  {
+    evictOldest();
+    slot = slotOf(messageID); // The eviction may have shifted the probe sequence.
+  }
+
+  uint16_t position = (_oldest + _count) % _capacity;
+  _ids[position] = messageID;
+  _values[position] = value;
+  _table[slot] = position;
+  ++_count;
+
+  inserted = true;
+  return &_values[position];
+}
+
+void MessageIdLog::evictOldest()
+{
+  size_t slot = homeSlot(_ids[_oldest]);
+  while(_table[slot] != _oldest)
+    slot = (slot + 1) & _tableMask;
+
+  eraseSlot(slot);
+  _oldest = (_oldest + 1) % _capacity;
+  --_count;
+}
+
+void MessageIdLog::eraseSlot(size_t slot)
+{
+  // Backward shift deletion, so no tombstones are needed: move up every following entry of the probe run
+  // that would otherwise become unreachable from its home slot.
+  size_t next = slot;
+
+  while(true)
+  {
+    next = (next + 1) & _tableMask;
+
+    if(_table[next] == EMPTY_SLOT)
+      break;
+
+    size_t home = homeSlot(_ids[_table[next]]);
+
+    // The entry may move to slot unless its home lies cyclically within (slot, next].
+    bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+    if(!stays)
+    {
+      _table[slot] = _table[next];
+      slot = next;
+    }
+  }
+
+  _table[slot] = EMPTY_SLOT;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __MESSAGEIDLOG_H__
+#define __MESSAGEIDLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+/**
+ * Fixed capacity set of 64 bit message IDs, each with a one byte value, that forgets the oldest ID when full.
+ *
+ * IDs and values live in a FIFO ring sized to the capacity, and an open addressing (linear probing) table of
+ * ring positions, at most half full, finds them. All memory is allocated by setCapacity(), so insertions, lookups
+ * and evictions never touch the heap. Memory use is 9 bytes per ID for the ring plus 4 to 8 bytes per ID for the table.
+ */
+class MessageIdLog {
+
+public:
+
+  explicit MessageIdLog(const uint16_t capacity = 100);
+
+  /**
+   * Change how many IDs are remembered. The newest IDs are kept.
+   *
+   * @return True on success. False if memory could not be allocated, in which case the log is left empty.
+   */
+  bool setCapacity(const uint16_t capacity);
+  uint16_t capacity() const;
+  uint16_t size() const;
+
+  /**
+   * @return A pointer to the value stored for messageID, or nullptr if messageID is not in the log.
+   *         The pointer is valid until the next insertion or capacity change.
+   */
+  uint8_t *find(const uint64_t messageID);
+
+  /**
+   * Add messageID with value unless it is already present. The oldest ID is forgotten if the log is full.
+   *
+   * @param inserted Set to true if messageID was added, false if it was already present.
+   * @return A pointer to the value stored for messageID, as for find().
+   */
+  uint8_t *insert(const uint64_t messageID, const uint8_t value, bool &inserted);
+
+  void clear();
+
+private:
+
+  static constexpr uint16_t EMPTY_SLOT = 0xFFFF;
+
+  size_t homeSlot(const uint64_t messageID) const;
+  size_t slotOf(const uint64_t messageID) const;
+  void eraseSlot(size_t slot);
+  void evictOldest();
+
+  std::unique_ptr<uint64_t[]> _ids;
+  std::unique_ptr<uint8_t[]> _values;
+  std::unique_ptr<uint16_t[]> _table; // Ring positions, EMPTY_SLOT when unused.
+
+  uint16_t _capacity = 0;
+  uint16_t _count = 0;
+  uint16_t _oldest = 0;
+  uint32_t _tableMask = 0;
+  uint8_t _tableBits = 0;
+};
+
+#endif
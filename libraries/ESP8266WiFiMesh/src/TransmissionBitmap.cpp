@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "TransmissionBitmap.h"
+#include <assert.h>
+
+bool TransmissionBitmap::set(const uint8_t transmissionIndex)
+{
+  if(test(transmissionIndex))
+    return false;
+
+  _bits[transmissionIndex / 8] |= 1 << (transmissionIndex % 8);
+  ++_count;
+  return true;
+}
+
+bool TransmissionBitmap::clear(const uint8_t transmissionIndex)
+{
+  if(!test(transmissionIndex))
+    return false;
+
+  _bits[transmissionIndex / 8] &= ~(1 << (transmissionIndex % 8));
+  --_count;
+  return true;
+}
+
+bool TransmissionBitmap::test(const uint8_t transmissionIndex) const
+{
+  assert(transmissionIndex < 128);
+
+  return _bits[transmissionIndex / 8] & (1 << (transmissionIndex % 8));
+}
+
+uint8_t TransmissionBitmap::count() const { return _count; }
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019 Anders Löfgren
+ *
+ * License (MIT license):
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __ESPNOWTRANSMISSIONBITMAP_H__
+#define __ESPNOWTRANSMISSIONBITMAP_H__
+
+#include <stdint.h>
+
+/**
+ * One bit per transmission of an ESP-NOW message, 128 transmissions max.
+ * Used by receivers to tell which transmissions have been stored and by senders to tell which transmissions still need to be retransmitted.
+ */
+class TransmissionBitmap {
+
+public:
+
+  /**
+   * @return True if the bit of transmissionIndex was clear and has been set.
+   */
+  bool set(const uint8_t transmissionIndex);
+
+  /**
+   * @return True if the bit of transmissionIndex was set and has been cleared.
+   */
+  bool clear(const uint8_t transmissionIndex);
+  
+  bool test(const uint8_t transmissionIndex) const;
+
+  // The number of bits set.
+  uint8_t count() const;
+
+private:
+
+  uint8_t _bits[16] = {0};
+  uint8_t _count = 0;
+};
+
+#endif
@@ -168,7 +168,44 @@ int LittleFSImpl::lfs_flash_read(const struct lfs_config *c,
     lfs_block_t block, lfs_off_t off, void *dst, lfs_size_t size) {
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
     uint32_t addr = me->_start + (block * me->_blockSize) + off;
-    return flash_hal_read(addr, size, static_cast<uint8_t*>(dst)) == FLASH_HAL_OK ? 0 : -1;
+    uint8_t *out = static_cast<uint8_t*>(dst);
+    if (!me->_blockCache || (size >= me->_cfg._blockCacheLines * _blockCacheLineSize)) {
+        me->_cacheStats.bypasses++;
+        return flash_hal_read(addr, size, out) == FLASH_HAL_OK ? 0 : -1;
+    }
+    while (size) {
+        uint32_t lineAddr = addr & ~(_blockCacheLineSize - 1);
+        uint32_t lineOff = addr - lineAddr;
+        uint32_t n = std::min(size, _blockCacheLineSize - lineOff);
+        uint32_t victim = 0;
+        uint32_t i;
+        for (i = 0; i < me->_cfg._blockCacheLines; i++) {
+            if (me->_blockCacheTags[i].addr == lineAddr) {
+                break;
+            }
+            if (me->_blockCacheTags[i].used < me->_blockCacheTags[victim].used) {
+                victim = i;
+            }
+        }
+        if (i == me->_cfg._blockCacheLines) {
+            // Miss, replace the least recently used line
+            i = victim;
+            me->_cacheStats.readMisses++;
+            me->_blockCacheTags[i].addr = UINT32_MAX;
+            if (flash_hal_read(lineAddr, _blockCacheLineSize, me->_blockCache + i * _blockCacheLineSize) != FLASH_HAL_OK) {
+                return -1;
+            }
+            me->_blockCacheTags[i].addr = lineAddr;
+        } else {
+            me->_cacheStats.readHits++;
+        }
+        me->_blockCacheTags[i].used = ++me->_blockCacheStamp;
+        memcpy(out, me->_blockCache + i * _blockCacheLineSize + lineOff, n);
+        out += n;
+        addr += n;
+        size -= n;
+    }
+    return 0;
 }
 
 int LittleFSImpl::lfs_flash_prog(const struct lfs_config *c,
@@ -176,6 +213,7 @@ int LittleFSImpl::lfs_flash_prog(const struct lfs_config *c,
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
     uint32_t addr = me->_start + (block * me->_blockSize) + off;
     const uint8_t *src = reinterpret_cast<const uint8_t *>(buffer);
+    me->_invalidateBlockCache(addr, size);
     return flash_hal_write(addr, size, static_cast<const uint8_t*>(src)) == FLASH_HAL_OK ? 0 : -1;
 }
 
@@ -183,6 +221,7 @@ int LittleFSImpl::lfs_flash_erase(const struct lfs_config *c, lfs_block_t block)
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
     uint32_t addr = me->_start + (block * me->_blockSize);
     uint32_t size = me->_blockSize;
+    me->_invalidateBlockCache(addr, size);
     return flash_hal_erase(addr, size) == FLASH_HAL_OK ? 0 : -1;
 }
 
@@ -192,6 +231,43 @@ int LittleFSImpl::lfs_flash_sync(const struct lfs_config *c) {
     return 0;
 }
 
+bool LittleFSImpl::_allocBlockCache() {
+    if (!_cfg._blockCacheLines || _blockCache) {
+        return true;
+    }
+    _blockCache = new (std::nothrow) uint8_t[_cfg._blockCacheLines * _blockCacheLineSize];
+    _blockCacheTags = new (std::nothrow) BlockCacheTag[_cfg._blockCacheLines];
+    if (!_blockCache || !_blockCacheTags) {
+        DEBUGV("LittleFS: unable to allocate %d line block cache\n", _cfg._blockCacheLines);
+        _freeBlockCache();
+        return false;
+    }
+    for (uint32_t i = 0; i < _cfg._blockCacheLines; i++) {
+        _blockCacheTags[i].addr = UINT32_MAX;
+        _blockCacheTags[i].used = 0;
+    }
+    return true;
+}
+
+void LittleFSImpl::_freeBlockCache() {
+    delete[] _blockCache;
+    delete[] _blockCacheTags;
+    _blockCache = nullptr;
+    _blockCacheTags = nullptr;
+}
+
+void LittleFSImpl::_invalidateBlockCache(uint32_t addr, uint32_t size) {
+    if (!_blockCache) {
+        return;
+    }
+    for (uint32_t i = 0; i < _cfg._blockCacheLines; i++) {
+        uint32_t line = _blockCacheTags[i].addr;
+        if ((line != UINT32_MAX) && (line < addr + size) && (addr < line + _blockCacheLineSize)) {
+            _blockCacheTags[i].addr = UINT32_MAX;
+            _blockCacheTags[i].used = 0;
+        }
+    }
+}
 
 }; // namespace
 
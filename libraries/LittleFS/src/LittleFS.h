@@ -28,6 +28,7 @@
 #define __LITTLEFS_H
 
 #include <limits>
+#include <algorithm>
 #include <FS.h>
 #include <FSImpl.h>
 #include <debug.h>
@@ -48,7 +49,76 @@ class LittleFSConfig : public FSConfig
 {
 public:
     static constexpr uint32_t FSId = 0x4c495454;
-    LittleFSConfig(bool autoFormat = true) : FSConfig(FSId, autoFormat) { }
+
+    // RAM vs. throughput presets for the lfs buffers
+    enum Profile {
+        LowRAM,     // Smallest lookahead, 64 byte caches (~150 bytes + 64/file)
+        Balanced,   // Historical defaults, 64 bytes everywhere
+        Throughput  // 1KB caches, 256 byte lookahead, 4KB shared block cache
+    };
+
+    LittleFSConfig(bool autoFormat = true) : FSConfig(FSId, autoFormat) {
+        setProfile(Balanced);
+    }
+
+    LittleFSConfig setAutoFormat(bool val = true) {
+        _autoFormat = val;
+        return *this;
+    }
+    LittleFSConfig setProfile(Profile profile) {
+        _readSize = 64;
+        _progSize = 64;
+        switch (profile) {
+        case LowRAM:
+            _cacheSize = 64;
+            _lookaheadSize = 16;
+            _blockCacheLines = 0;
+            break;
+        case Throughput:
+            _cacheSize = 1024;
+            _lookaheadSize = 256;
+            _blockCacheLines = 16;
+            break;
+        default:
+            _cacheSize = 64;
+            _lookaheadSize = 64;
+            _blockCacheLines = 0;
+            break;
+        }
+        return *this;
+    }
+    // Minimum flash read, in bytes.  Must divide the cache size
+    LittleFSConfig setReadSize(uint16_t size) {
+        _readSize = size;
+        return *this;
+    }
+    // Minimum flash program, in bytes.  Must divide the cache size
+    LittleFSConfig setProgSize(uint16_t size) {
+        _progSize = size;
+        return *this;
+    }
+    // Size of the FS read and program caches and of every open file's buffer
+    LittleFSConfig setCacheSize(uint16_t size) {
+        _cacheSize = size;
+        return *this;
+    }
+    // Bytes of block allocation bitmap (1 bit per block), multiple of 8
+    LittleFSConfig setLookaheadSize(uint16_t size) {
+        _lookaheadSize = size;
+        return *this;
+    }
+    // Number of 256 byte flash lines cached below lfs and shared by all open files (0 = disabled)
+    LittleFSConfig setBlockCacheLines(uint16_t lines) {
+        _blockCacheLines = lines;
+        return *this;
+    }
+
+    // Inherit _type and _autoFormat
+    uint16_t _readSize;
+    uint16_t _progSize;
+    uint16_t _cacheSize;
+    uint16_t _lookaheadSize;
+    uint16_t _blockCacheLines;
 };
 
 class LittleFSImpl : public FSImpl
@@ -56,8 +126,9 @@ class LittleFSImpl : public FSImpl
 public:
     LittleFSImpl(uint32_t start, uint32_t size, uint32_t pageSize, uint32_t blockSize, uint32_t maxOpenFds)
         : _start(start) , _size(size) , _pageSize(pageSize) , _blockSize(blockSize) , _maxOpenFds(maxOpenFds),
-          _mounted(false) {
+          _mounted(false), _mappable(false), _blockCache(nullptr), _blockCacheTags(nullptr), _blockCacheStamp(0) {
         memset(&_lfs, 0, sizeof(_lfs));
+        memset(&_cacheStats, 0, sizeof(_cacheStats));
         memset(&_lfs_cfg, 0, sizeof(_lfs_cfg));
         if (_size && _blockSize) {
             _lfs_cfg.context = (void*) this;
@@ -65,13 +136,12 @@ public:
             _lfs_cfg.prog = lfs_flash_prog;
             _lfs_cfg.erase = lfs_flash_erase;
             _lfs_cfg.sync = lfs_flash_sync;
-            _lfs_cfg.read_size = 64;
-            _lfs_cfg.prog_size = 64;
             _lfs_cfg.block_size =  _blockSize;
             _lfs_cfg.block_count = _size / _blockSize;
             _lfs_cfg.block_cycles = 16; // TODO - need better explanation
-            _lfs_cfg.cache_size = 64;
-            _lfs_cfg.lookahead_size = 64;
+            _applyConfig();
+            // Files can only be read through the flash cache when the whole FS is in the mapped window
+            _mappable = flash_hal_map(_start, _size) != nullptr;
             _lfs_cfg.read_buffer = nullptr;
             _lfs_cfg.prog_buffer = nullptr;
             _lfs_cfg.lookahead_buffer = nullptr;
@@ -85,6 +155,7 @@ public:
         if (_mounted) {
             lfs_unmount(&_lfs);
         }
+        _freeBlockCache();
     }
 
     FileImplPtr open(const char* path, OpenMode openMode, AccessMode accessMode) override;
@@ -178,10 +249,30 @@ public:
         if ((cfg._type != LittleFSConfig::FSId) || _mounted) {
             return false;
         }
-        _cfg = *static_cast<const LittleFSConfig *>(&cfg);
+        const LittleFSConfig *lcfg = static_cast<const LittleFSConfig *>(&cfg);
+        if (!lcfg->_readSize || !lcfg->_progSize || !lcfg->_cacheSize ||
+            (lcfg->_cacheSize % lcfg->_readSize) || (lcfg->_cacheSize % lcfg->_progSize) ||
+            (_blockSize && (_blockSize % lcfg->_cacheSize)) ||
+            !lcfg->_lookaheadSize || (lcfg->_lookaheadSize % 8)) {
+            DEBUGV("LittleFS::setConfig: invalid buffer geometry\n");
+            return false;
+        }
+        _cfg = *lcfg;
+        if (_size && _blockSize) {
+            _applyConfig();
+        }
        return true;
     }
 
+    // Flash reads seen by the shared block cache.  Without one every read is a bypass
+    bool cacheStats(FSCacheStats& stats, bool reset) override {
+        stats = _cacheStats;
+        if (reset) {
+            memset(&_cacheStats, 0, sizeof(_cacheStats));
+        }
+        return _cfg._blockCacheLines != 0;
+    }
+
     bool begin() override {
         if (_mounted) {
             return true;
@@ -205,6 +296,7 @@ public:
         }
         lfs_unmount(&_lfs);
         _mounted = false;
+        _freeBlockCache();
     }
 
     bool format() override {
@@ -275,11 +367,26 @@ protected:
         return &_lfs;
     }
 
+    void _applyConfig() {
+        _lfs_cfg.read_size = _cfg._readSize;
+        _lfs_cfg.prog_size = _cfg._progSize;
+        _lfs_cfg.cache_size = _cfg._cacheSize;
+        // No point looking ahead further than the number of blocks we have
+        _lfs_cfg.lookahead_size = std::min((uint32_t)_cfg._lookaheadSize, ((_lfs_cfg.block_count + 63) / 64) * 8);
+    }
+
+    bool _allocBlockCache();
+    void _freeBlockCache();
+    void _invalidateBlockCache(uint32_t addr, uint32_t size);
+
     bool _tryMount() {
         if (_mounted) {
             lfs_unmount(&_lfs);
             _mounted = false;
         }
+        if (!_allocBlockCache()) {
+            return false;
+        }
         memset(&_lfs, 0, sizeof(_lfs));
         int rc = lfs_mount(&_lfs, &_lfs_cfg);
         if (rc==0) {
@@ -355,13 +462,25 @@ protected:
     uint32_t _maxOpenFds;
 
     bool     _mounted;
+    bool     _mappable;
+
+    // Optional flash line cache shared by all open files, see LittleFSConfig::setBlockCacheLines()
+    static constexpr uint32_t _blockCacheLineSize = 256;
+    struct BlockCacheTag {
+        uint32_t addr;  // Flash address of the line, or UINT32_MAX if empty
+        uint32_t used;  // LRU stamp
+    };
+    uint8_t            *_blockCache;
+    BlockCacheTag      *_blockCacheTags;
+    uint32_t            _blockCacheStamp;
+    FSCacheStats        _cacheStats;
 };
 
 
 class LittleFSFileImpl : public FileImpl
 {
 public:
-    LittleFSFileImpl(LittleFSImpl* fs, const char *name, std::shared_ptr<lfs_file_t> fd, int flags, time_t creation) : _fs(fs), _fd(fd), _opened(true), _flags(flags), _creation(creation) {
+    LittleFSFileImpl(LittleFSImpl* fs, const char *name, std::shared_ptr<lfs_file_t> fd, int flags, time_t creation) : _fs(fs), _fd(fd), _opened(true), _flags(flags), _creation(creation), _extentAddr(nullptr), _extentPos(0), _extentLen(0) {
         _name = std::shared_ptr<char>(new char[strlen(name) + 1], std::default_delete<char[]>());
         strcpy(_name.get(), name);
     }
@@ -400,6 +519,8 @@ public:
         if (!_opened || !_fd || !buf) {
             return 0;
         }
+        // Copy-on-write moves the data, a mapped run may point to a block about to be reused
+        _extentLen = 0;
         int result = lfs_file_write(_fs->getFS(), _getFD(), (void*) buf, size);
         if (result < 0) {
             DEBUGV("lfs_write rc=%d\n", result);
@@ -412,19 +533,32 @@ public:
         if (!_opened || !_fd | !buf) {
             return 0;
         }
-        int result = lfs_file_read(_fs->getFS(), _getFD(), (void*) buf, size);
+        size_t done = 0;
+        FileExtent extent;
+        // Straight from the flash cache, no lfs block walk or SPI command, one block run at a time
+        while ((done < size) && _fs->_mappable && mapExtent(extent)) {
+            size_t n = std::min(size - done, extent.len);
+            memcpy_P(buf + done, extent.addr, n);
+            lfs_file_seek(_fs->getFS(), _getFD(), n, LFS_SEEK_CUR);
+            done += n;
+        }
+        if (done == size) {
+            return done;
+        }
+        int result = lfs_file_read(_fs->getFS(), _getFD(), (void*) (buf + done), size - done);
         if (result < 0) {
             DEBUGV("lfs_read rc=%d\n", result);
-            return 0;
+            return done;
         }
 
-        return result;
+        return done + result;
     }
 
     void flush() override {
         if (!_opened || !_fd) {
             return;
         }
+        _extentLen = 0;
         int rc = lfs_file_sync(_fs->getFS(), _getFD());
         if (rc < 0) {
             DEBUGV("lfs_file_sync rc=%d\n", rc);
@@ -473,6 +607,7 @@ public:
         if (!_opened || !_fd) {
             return false;
         }
+        _extentLen = 0;
         int rc = lfs_file_truncate(_fs->getFS(), _getFD(), size);
         if (rc < 0) {
             DEBUGV("lfs_file_truncate rc=%d\n", rc);
@@ -558,17 +693,65 @@ public:
         return (rc == 0) && (info.type == LFS_TYPE_DIR);
     }
 
+    bool mapExtent(FileExtent& extent) override {
+        // Only read-only files, whose data cannot be sitting in RAM buffers
+        if (!_opened || !_fd || !_fs->_mappable || ((_flags & LFS_O_RDWR) != LFS_O_RDONLY)) {
+            return false;
+        }
+        size_t pos = position();
+        if ((pos < _extentPos) || (pos >= _extentPos + _extentLen)) {
+            if (!_loadExtent(pos)) {
+                return false;
+            }
+        }
+        extent.addr = _extentAddr + (pos - _extentPos);
+        extent.len = _extentLen - (pos - _extentPos);
+        return true;
+    }
+
 protected:
     lfs_file_t *_getFD() const {
         return _fd.get();
     }
 
+    // Locate the flash block holding file offset pos, and the data run following it
+    bool _loadExtent(size_t pos) {
+        const auto f = _getFD();
+        const auto fs = _fs->getFS();
+        _extentLen = 0;
+        if ((f->flags & LFS_F_INLINE) || (pos >= size())) {
+            // Inline files live in the metadata pair, not in their own block
+            return false;
+        }
+        // Let lfs walk its CTZ list: after reading the byte at pos, f->block/f->off point just past it
+        uint8_t dummy;
+        if (lfs_file_read(fs, f, &dummy, 1) != 1) {
+            return false;
+        }
+        lfs_off_t off = f->off - 1;
+        size_t len = std::min((size_t)(fs->cfg->block_size - off), size() - pos);
+        const uint8_t *addr = flash_hal_map(_fs->_start + f->block * fs->cfg->block_size + off, len);
+        lfs_file_seek(fs, f, pos, LFS_SEEK_SET);
+        if (!addr) {
+            return false;
+        }
+        _extentAddr = addr;
+        _extentPos = pos;
+        _extentLen = len;
+        return true;
+    }
+
     LittleFSImpl                *_fs;
     std::shared_ptr<lfs_file_t>  _fd;
     std::shared_ptr<char>        _name;
     bool                         _opened;
     int                          _flags;
     time_t                       _creation;
+
+    // Last mapped run of file data, see mapExtent()
+    const uint8_t               *_extentAddr;
+    size_t                       _extentPos;
+    size_t                       _extentLen;
 };
 
 class LittleFSDirImpl : public DirImpl
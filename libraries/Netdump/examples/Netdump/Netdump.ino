@@ -55,7 +55,11 @@ void startSerial(SerialOption option) {
 
 void startTracefile() {
   // To file all traffic, format pcap file
+  // Frames are queued by the capture hook and written from loop(),
+  // keep only the first 128 bytes of each one (headers)
   tracefile = filesystem->open("/tr.pcap", "w");
+  nd.setSnapLength(128);
+  // nd.setFilterExpression("tcp port 80 or arp");  // compiled, checked on raw frames
   nd.fileDump(tracefile);
 }
 
@@ -95,6 +99,13 @@ void setup(void) {
     webServer.send(200, "text/html", a);
   });
 
+  webServer.on("/stats", []() {
+    // pcap writer counters, for the tracefile and tcpdump options
+    const Netdump::Stats& st = nd.stats();
+    String a = "<h1>captured " + String(st.captured) + ", dropped " + String(st.dropped) + ", truncated " + String(st.truncated) + ", written " + String(st.written) + " bytes, peak " + String(st.peak) + " bytes</h1>";
+    webServer.send(200, "text/html", a);
+  });
+
   webServer.on("/reset", []() {
     nd.reset();
     tracefile.close();
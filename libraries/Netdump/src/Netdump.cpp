@@ -28,7 +28,7 @@ namespace NetCapture
 
 CallBackList<Netdump::LwipCallback> Netdump::lwipCallback;
 
-Netdump::Netdump()
+Netdump::Netdump() : alive(std::make_shared<bool>(true))
 {
     using namespace std::placeholders;
     phy_capture = capture;
@@ -38,9 +38,9 @@ Netdump::Netdump()
 Netdump::~Netdump()
 {
     reset();
-    if (packetBuffer)
+    if (ringBuffer)
     {
-        delete[] packetBuffer;
+        delete[] ringBuffer;
     }
 };
 
@@ -60,9 +60,64 @@ void Netdump::setFilter(const Filter nf)
     netDumpFilter = nf;
 }
 
+bool Netdump::setFilterExpression(const char* expr)
+{
+    FilterProgram program;
+    if (!program.compile(expr))
+    {
+        return false;
+    }
+    setFilter(program);
+    return true;
+}
+
+void Netdump::setFilter(const FilterProgram& program)
+{
+    rawFilter = program;
+}
+
 void Netdump::reset()
 {
+    if (ringOut)
+    {
+        // write out what was captured so far, the file can be closed right after
+        ringDrain(true);
+        ringOut = nullptr;
+    }
     setCallback(nullptr, nullptr);
+    rawFilter.clear();
+}
+
+bool Netdump::setBufferSize(size_t size)
+{
+    if (ringOut)
+    {
+        return false;
+    }
+    // anything smaller would drop every full-sized frame
+    size = std::max(size, snapLength + recordHeaderLen);
+    size_t rounded = 256;
+    while (rounded < size)
+    {
+        rounded <<= 1;
+    }
+    if (rounded != ringSize && ringBuffer)
+    {
+        delete[] ringBuffer;
+        ringBuffer = nullptr;
+    }
+    ringSize = rounded;
+    return true;
+}
+
+void Netdump::setSnapLength(uint16_t len)
+{
+    snapLength = std::min(std::max<uint16_t>(len, ETH_HDR_LEN), maxSnapLength);
+    if (ringSize < snapLength + recordHeaderLen && !setBufferSize(snapLength + recordHeaderLen))
+    {
+        // a dump is running on a smaller ring
+        snapLength = ringSize - recordHeaderLen;
+    }
 }
 
 void Netdump::printDump(Print& out, Packet::PacketDetail ndd, const Filter nf)
@@ -76,33 +131,47 @@ void Netdump::printDump(Print& out, Packet::PacketDetail ndd, const Filter nf)
         nf);
 }
 
-void Netdump::fileDump(File& outfile, const Filter nf)
+bool Netdump::fileDump(File& outfile, const Filter nf)
 {
+    if (!ringAlloc())
+    {
+        return false;
+    }
     writePcapHeader(outfile);
-    setCallback(
-        [&outfile, this](const Packet& ndp)
+    ringStart(&outfile, false, nf);
+
+    if (fileDraining)
+    {
+        // the running loop drains the new file as well
+        return true;
+    }
+    std::weak_ptr<bool> token = alive;
+    fileDraining = schedule_function(
+        [this, token]()
         {
-            fileDumpProcess(outfile, ndp);
-        },
-        nf);
+            if (!token.expired())
+            {
+                fileDumpLoop();
+            }
+        });
+    return true;
 }
+
 bool Netdump::tcpDump(WiFiServer& tcpDumpServer, const Filter nf)
 {
-    if (!packetBuffer)
+    if (!ringAlloc())
     {
-        packetBuffer = new (std::nothrow) char[tcpBufferSize];
-
-        if (!packetBuffer)
-        {
-            return false;
-        }
+        return false;
     }
-    bufferIndex = 0;
 
+    std::weak_ptr<bool> token = alive;
     schedule_function(
-        [&tcpDumpServer, this, nf]()
+        [&tcpDumpServer, this, nf, token]()
         {
-            tcpDumpLoop(tcpDumpServer, nf);
+            if (!token.expired())
+            {
+                tcpDumpLoop(tcpDumpServer, nf);
+            }
         });
     return true;
 }
@@ -118,6 +187,33 @@ void Netdump::capture(int netif_idx, const char* data, size_t len, int out, int
 
 void Netdump::netdumpCapture(int netif_idx, const char* data, size_t len, int out, int success)
 {
+    if (!rawFilter.match(reinterpret_cast<const uint8_t*>(data), len))
+    {
+        return;
+    }
+    if (ringOut)
+    {
+        // Stay cheap in here: no Packet unless a filter needs one, just a copy
+        if (ringToClient && len >= ETH_HDR_LEN + 24 && data[12] == 0x08 && data[13] == 0x00
+            && data[ETH_HDR_LEN + 9] == 6)
+        {
+            // skip the tcpdump connection itself
+            const char* tcp  = data + ETH_HDR_LEN + ((data[ETH_HDR_LEN] & 0x0f) << 2);
+            uint16_t    self = tcpDumpClient.localPort();
+            if (tcp + 4 <= data + len
+                && (((uint8_t)tcp[0] << 8 | (uint8_t)tcp[1]) == self
+                    || ((uint8_t)tcp[2] << 8 | (uint8_t)tcp[3]) == self))
+            {
+                return;
+            }
+        }
+        if (netDumpFilter && !netDumpFilter(Packet(millis(), netif_idx, data, len, out, success)))
+        {
+            return;
+        }
+        ringPush(data, len);
+        return;
+    }
     if (netDumpCallback)
     {
         Packet np(millis(), netif_idx, data, len, out, success);
@@ -132,12 +228,12 @@ void Netdump::netdumpCapture(int netif_idx, const char* data, size_t len, int ou
 void Netdump::writePcapHeader(Stream& s) const
 {
     uint32_t pcapHeader[6];
-    pcapHeader[0] = 0xa1b2c3d4;     // pcap magic number
-    pcapHeader[1] = 0x00040002;     // pcap major/minor version
-    pcapHeader[2] = 0;              // pcap UTC correction in seconds
-    pcapHeader[3] = 0;              // pcap time stamp accuracy
-    pcapHeader[4] = maxPcapLength;  // pcap max packet length per record
-    pcapHeader[5] = 1;              // pacp data linkt type = ethernet
+    pcapHeader[0] = pcapMagic;   // pcap magic number
+    pcapHeader[1] = 0x00040002;  // pcap major/minor version
+    pcapHeader[2] = 0;           // pcap UTC correction in seconds
+    pcapHeader[3] = 0;           // pcap time stamp accuracy
+    pcapHeader[4] = snapLength;  // pcap max packet length per record
+    pcapHeader[5] = 1;           // pacp data linkt type = ethernet
     s.write(reinterpret_cast<char*>(pcapHeader), 24);
 }
 
@@ -146,85 +242,156 @@ void Netdump::printDumpProcess(Print& out, Packet::PacketDetail ndd, const Packe
     out.printf_P(PSTR("%8lld %s"), np.getTime(), np.toString(ndd).c_str());
 }
 
-void Netdump::fileDumpProcess(File& outfile, const Packet& np) const
+bool Netdump::ringAlloc()
 {
-    size_t   incl_len = np.getPacketSize() > maxPcapLength ? maxPcapLength : np.getPacketSize();
-    uint32_t pcapHeader[4];
+    if (!ringBuffer)
+    {
+        ringBuffer = new (std::nothrow) char[ringSize];
+    }
+    return ringBuffer != nullptr;
+}
+
+void Netdump::ringStart(Print* out, bool toClient, const Filter nf)
+{
+    ringOut = nullptr;
+    setCallback(nullptr, nf);
+    ringHead     = 0;
+    ringTail     = 0;
+    ringFlushed  = millis();
+    ringToClient = toClient;
+    ringOut      = out;
+}
+
+void Netdump::ringCopy(uint32_t pos, const void* src, size_t len)
+{
+    size_t off   = pos & (ringSize - 1);
+    size_t first = std::min(len, ringSize - off);
+    memcpy(ringBuffer + off, src, first);
+    memcpy(ringBuffer, static_cast<const char*>(src) + first, len - first);
+}
+
+// Called from the capture hook: never blocks, a record that does not fit is dropped
+void Netdump::ringPush(const char* data, size_t len)
+{
+    size_t   incl_len = len > snapLength ? snapLength : len;
+    uint32_t head     = ringHead;
+    uint32_t used     = head - ringTail;
+    if (ringSize - used < recordHeaderLen + incl_len)
+    {
+        captureStats.dropped++;
+        return;
+    }
 
     struct timeval tv;
     gettimeofday(&tv, nullptr);
-    pcapHeader[0] = tv.tv_sec;
+    uint32_t pcapHeader[4];
+    pcapHeader[0] = tv.tv_sec;  // pcap record header
     pcapHeader[1] = tv.tv_usec;
     pcapHeader[2] = incl_len;
-    pcapHeader[3] = np.getPacketSize();
-    outfile.write(reinterpret_cast<char*>(pcapHeader), 16);  // pcap record header
-
-    outfile.write(np.rawData(), incl_len);
+    pcapHeader[3] = len;
+    ringCopy(head, pcapHeader, recordHeaderLen);
+    ringCopy(head + recordHeaderLen, data, incl_len);
+    ringHead = head + recordHeaderLen + incl_len;  // publish only once the record is complete
+
+    captureStats.captured++;
+    captureStats.truncated += (incl_len < len);
+    captureStats.peak = std::max<uint32_t>(captureStats.peak, used + recordHeaderLen + incl_len);
 }
 
-void Netdump::tcpDumpProcess(const Packet& np)
+// Writes queued records out, in batches unless forced.  Returns true when
+// everything was written.
+bool Netdump::ringDrain(bool force)
 {
-    if (np.isTCP() && np.hasPort(tcpDumpClient.localPort()))
+    uint32_t used = ringHead - ringTail;
+    if (!ringOut || !used)
     {
-        // skip myself
-        return;
+        ringFlushed = millis();
+        return true;
+    }
+    if (!force && used < drainBatch && millis() - ringFlushed < drainIntervalMs)
+    {
+        return false;
     }
-    size_t incl_len = np.getPacketSize() > maxPcapLength ? maxPcapLength : np.getPacketSize();
+    ringFlushed = millis();
 
-    if (bufferIndex + 16 + incl_len < tcpBufferSize)  // only add if enough space available
+    while (used)
     {
-        struct timeval tv;
-        gettimeofday(&tv, nullptr);
-        uint32_t* pcapHeader = reinterpret_cast<uint32_t*>(&packetBuffer[bufferIndex]);
-        pcapHeader[0]        = tv.tv_sec;  // add pcap record header
-        pcapHeader[1]        = tv.tv_usec;
-        pcapHeader[2]        = incl_len;
-        pcapHeader[3]        = np.getPacketSize();
-        bufferIndex += 16;  // pcap header size
-        memcpy(&packetBuffer[bufferIndex], np.rawData(), incl_len);
-        bufferIndex += incl_len;
+        size_t off  = ringTail & (ringSize - 1);
+        size_t span = std::min<size_t>(used, ringSize - off);
+        if (ringToClient)
+        {
+            // never wait for the peer, the rest goes out on a later pass
+            span = std::min<size_t>(span, std::max(ringOut->availableForWrite(), 0));
+            if (!span)
+            {
+                return false;
+            }
+        }
+        size_t written = ringOut->write(ringBuffer + off, span);
+        ringTail += written;
+        used -= written;
+        captureStats.written += written;
+        if (written != span)
+        {
+            return false;
+        }
     }
+    return true;
+}
 
-    if (bufferIndex && tcpDumpClient && tcpDumpClient.availableForWrite() >= (int)bufferIndex)
+void Netdump::fileDumpLoop()
+{
+    if (!ringOut || ringToClient)
     {
-        tcpDumpClient.write(packetBuffer, bufferIndex);
-        bufferIndex = 0;
+        fileDraining = false;
+        return;
     }
+    ringDrain(false);
+
+    std::weak_ptr<bool> token = alive;
+    fileDraining = schedule_function(
+        [this, token]()
+        {
+            if (!token.expired())
+            {
+                fileDumpLoop();
+            }
+        });
 }
 
 void Netdump::tcpDumpLoop(WiFiServer& tcpDumpServer, const Filter nf)
 {
     if (tcpDumpServer.hasClient())
     {
+        ringOut       = nullptr;
         tcpDumpClient = tcpDumpServer.accept();
         tcpDumpClient.setNoDelay(true);
 
-        bufferIndex = 0;
         writePcapHeader(tcpDumpClient);
-
-        setCallback(
-            [this](const Packet& ndp)
-            {
-                tcpDumpProcess(ndp);
-            },
-            nf);
+        ringStart(&tcpDumpClient, true, nf);
     }
-    if (!tcpDumpClient || !tcpDumpClient.connected())
+    // a fileDump() started since owns the ring, leave it alone
+    const bool owner = ringOut == &tcpDumpClient;
+    if (owner && (!tcpDumpClient || !tcpDumpClient.connected()))
     {
+        ringOut = nullptr;
         setCallback(nullptr);
     }
-    if (bufferIndex && tcpDumpClient && tcpDumpClient.availableForWrite() >= (int)bufferIndex)
+    else if (owner)
     {
-        tcpDumpClient.write(packetBuffer, bufferIndex);
-        bufferIndex = 0;
+        ringDrain(false);
     }
 
     if (tcpDumpServer.status() != CLOSED)
     {
+        std::weak_ptr<bool> token = alive;
         schedule_function(
-            [&tcpDumpServer, this, nf]()
+            [&tcpDumpServer, this, nf, token]()
             {
-                tcpDumpLoop(tcpDumpServer, nf);
+                if (!token.expired())
+                {
+                    tcpDumpLoop(tcpDumpServer, nf);
+                }
             });
     }
 }
@@ -24,9 +24,11 @@
 
 #include <Print.h>
 #include <functional>
+#include <memory>
 #include <lwipopts.h>
 #include <FS.h>
 #include "NetdumpPacket.h"
+#include "NetdumpFilter.h"
 #include <ESP8266WiFi.h>
 #include "CallBackList.h"
 
@@ -42,22 +44,57 @@ public:
     using Callback     = std::function<void(const Packet&)>;
     using LwipCallback = std::function<void(int, const char*, int, int, int)>;
 
+    // pcap writer counters, updated from the capture hook and the drainer
+    struct Stats
+    {
+        uint32_t captured;   // records queued for the file / client
+        uint32_t dropped;    // records lost because the ring was full
+        uint32_t truncated;  // records cut down to the snap length
+        uint32_t written;    // bytes handed to the file / client
+        uint32_t peak;       // highest ring occupancy in bytes
+    };
+
     Netdump();
     ~Netdump();
 
     void setCallback(const Callback nc);
     void setCallback(const Callback nc, const Filter nf);
     void setFilter(const Filter nf);
+    // tcpdump-like expression checked on the raw frame ahead of everything
+    // else (see NetdumpFilter.h), kept until reset().  A syntax error leaves
+    // the current expression in place, compile a FilterProgram to see why.
+    bool setFilterExpression(const char* expr);
+    void setFilter(const FilterProgram& program);
     void reset();
 
     void printDump(Print& out, Packet::PacketDetail ndd, const Filter nf = nullptr);
-    void fileDump(File& outfile, const Filter nf = nullptr);
+    bool fileDump(File& outfile, const Filter nf = nullptr);
     bool tcpDump(WiFiServer& tcpDumpServer, const Filter nf = nullptr);
 
+    // fileDump() / tcpDump() copy frames into a ring from the capture hook,
+    // the ring is written out later from loop().  Size is rounded up to a
+    // power of two, at least one full record, and can only be changed while
+    // no pcap dump is running.
+    bool setBufferSize(size_t size);
+    // bytes of each frame kept in the pcap records, the ring grows to hold
+    // one such record unless a dump is running
+    void setSnapLength(uint16_t len);
+
+    const Stats& stats() const
+    {
+        return captureStats;
+    }
+    void resetStats()
+    {
+        captureStats = Stats();
+    }
+
 private:
     Callback netDumpCallback = nullptr;
     Filter   netDumpFilter   = nullptr;
 
+    FilterProgram rawFilter;
+
     static void capture(int netif_idx, const char* data, size_t len, int out, int success);
     static CallBackList<LwipCallback>           lwipCallback;
     CallBackList<LwipCallback>::CallBackHandler lwipHandler;
@@ -65,19 +102,42 @@ private:
     void netdumpCapture(int netif_idx, const char* data, size_t len, int out, int success);
 
     void printDumpProcess(Print& out, Packet::PacketDetail ndd, const Packet& np) const;
-    void fileDumpProcess(File& outfile, const Packet& np) const;
-    void tcpDumpProcess(const Packet& np);
     void tcpDumpLoop(WiFiServer& tcpDumpServer, const Filter nf);
+    void fileDumpLoop();
+
+    bool ringAlloc();
+    void ringStart(Print* out, bool toClient, const Filter nf);
+    void ringPush(const char* data, size_t len);
+    void ringCopy(uint32_t pos, const void* src, size_t len);
+    bool ringDrain(bool force);
 
     void writePcapHeader(Stream& s) const;
 
     WiFiClient tcpDumpClient;
-    char*      packetBuffer = nullptr;
-    int        bufferIndex  = 0;
 
-    static constexpr int      tcpBufferSize = 2048;
-    static constexpr int      maxPcapLength = 1024;
-    static constexpr uint32_t pcapMagic     = 0xa1b2c3d4;
+    // single producer (capture hook) / single consumer (ringDrain) ring of
+    // pcap records, head and tail are free running and masked on access
+    char*             ringBuffer   = nullptr;
+    size_t            ringSize     = defaultRingSize;
+    volatile uint32_t ringHead     = 0;
+    volatile uint32_t ringTail     = 0;
+    Print*            ringOut      = nullptr;
+    bool              ringToClient = false;
+    bool              fileDraining = false;  // a fileDumpLoop() is scheduled
+    uint32_t          ringFlushed  = 0;
+    uint16_t          snapLength   = maxPcapLength;
+    Stats             captureStats = {};
+
+    // expires with the object, scheduled loops check it before touching this
+    std::shared_ptr<bool> alive;
+
+    static constexpr int      maxPcapLength   = 1024;
+    static constexpr uint16_t maxSnapLength   = 1536;
+    static constexpr size_t   defaultRingSize = 4096;
+    static constexpr size_t   recordHeaderLen = 16;
+    static constexpr size_t   drainBatch      = 512;
+    static constexpr uint32_t drainIntervalMs = 100;
+    static constexpr uint32_t pcapMagic       = 0xa1b2c3d4;
 };
 
 }  // namespace NetCapture
@@ -0,0 +1,777 @@
+/*
+    NetdumpFilter.cpp - tcpdump-like filter expressions compiled for Netdump
+    Copyright (c) 2020 esp8266/Arduino
+
+    This file is part of the esp8266 core for Arduino environment.
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "NetdumpFilter.h"
+#include <string.h>
+
+namespace NetCapture
+{
+
+namespace
+{
+
+inline uint16_t rd16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+inline uint32_t rd32(const uint8_t* p)
+{
+    return ((uint32_t)rd16(p) << 16) | rd16(p + 2);
+}
+
+inline uint32_t word(FilterProgram::Op op, uint8_t dir = 0, uint16_t arg = 0)
+{
+    return (uint32_t)op | ((uint32_t)dir << 8) | ((uint32_t)arg << 16);
+}
+
+constexpr uint8_t IP_PROTO_ICMP  = 1;
+constexpr uint8_t IP_PROTO_TCP   = 6;
+constexpr uint8_t IP_PROTO_UDP   = 17;
+constexpr uint8_t IP_PROTO_ICMP6 = 58;
+
+// Header offsets of one frame, worked out once per match()
+struct Frame
+{
+    enum Kind : uint8_t
+    {
+        Other,
+        Arp,
+        Ip4,
+        Ip6
+    };
+
+    const uint8_t* p;
+    size_t         len;
+    size_t         l3    = 0;
+    size_t         l4    = 0;  // 0: no TCP/UDP ports available
+    uint8_t        proto = 0;
+    Kind           kind  = Other;
+
+    Frame(const uint8_t* frame, size_t length) : p(frame), len(length)
+    {
+        if (len < 14)
+        {
+            return;
+        }
+        uint16_t type = rd16(p + 12);
+        l3            = 14;
+        if (type == 0x8100 && len >= 18)
+        {
+            // 802.1Q tag
+            type = rd16(p + 16);
+            l3   = 18;
+        }
+        if (type == 0x0800 && len >= l3 + 20 && (p[l3] >> 4) == 4)
+        {
+            kind          = Ip4;
+            proto         = p[l3 + 9];
+            size_t ihl    = (p[l3] & 0x0f) << 2;
+            bool   gotL4  = (rd16(p + l3 + 6) & 0x1fff) == 0;  // first fragment only
+            if (gotL4 && ihl >= 20 && len >= l3 + ihl + 4)
+            {
+                l4 = l3 + ihl;
+            }
+        }
+        else if (type == 0x86dd && len >= l3 + 40)
+        {
+            kind  = Ip6;
+            proto = p[l3 + 6];
+            if (len >= l3 + 44)
+            {
+                l4 = l3 + 40;
+            }
+        }
+        else if (type == 0x0806 && len >= l3 + 28)
+        {
+            kind = Arp;
+        }
+    }
+
+    // IPv4 source / destination, or ARP sender / target protocol address
+    bool addresses(uint32_t& src, uint32_t& dst) const
+    {
+        if (kind == Ip4)
+        {
+            src = rd32(p + l3 + 12);
+            dst = rd32(p + l3 + 16);
+            return true;
+        }
+        if (kind == Arp)
+        {
+            src = rd32(p + l3 + 14);
+            dst = rd32(p + l3 + 24);
+            return true;
+        }
+        return false;
+    }
+};
+
+inline bool directed(uint8_t dir, bool src, bool dst)
+{
+    switch (dir)
+    {
+    case FilterProgram::Src:
+        return src;
+    case FilterProgram::Dst:
+        return dst;
+    case FilterProgram::SrcAndDst:
+        return src && dst;
+    default:
+        return src || dst;
+    }
+}
+
+bool protoMatch(const Frame& f, FilterProgram::Proto proto)
+{
+    switch (proto)
+    {
+    case FilterProgram::Proto::Arp:
+        return f.kind == Frame::Arp;
+    case FilterProgram::Proto::Ip:
+        return f.kind == Frame::Ip4;
+    case FilterProgram::Proto::Ip6:
+        return f.kind == Frame::Ip6;
+    case FilterProgram::Proto::Tcp:
+        return f.proto == IP_PROTO_TCP;
+    case FilterProgram::Proto::Udp:
+        return f.proto == IP_PROTO_UDP;
+    case FilterProgram::Proto::Icmp:
+        return f.kind == Frame::Ip4 && f.proto == IP_PROTO_ICMP;
+    case FilterProgram::Proto::Icmp6:
+        return f.kind == Frame::Ip6 && f.proto == IP_PROTO_ICMP6;
+    }
+    return false;
+}
+
+}  // namespace
+
+bool FilterProgram::match(const uint8_t* frame, size_t len) const
+{
+    if (code.empty())
+    {
+        return true;
+    }
+
+    Frame           f(frame, len);
+    uint32_t        stack = 0;  // one bit per pending result, top is bit 0
+    const uint32_t* pc    = code.data();
+    const uint32_t* end   = pc + code.size();
+
+    while (pc < end)
+    {
+        uint32_t w   = *pc++;
+        uint8_t  dir = (w >> 8) & 0xff;
+        uint16_t arg = w >> 16;
+        bool     r   = false;
+
+        switch (static_cast<Op>(w & 0xff))
+        {
+        case Op::And:
+            r = stack & 1;
+            stack >>= 1;
+            stack &= ~1u | r;
+            continue;
+        case Op::Or:
+            r = stack & 1;
+            stack >>= 1;
+            stack |= r;
+            continue;
+        case Op::Not:
+            stack ^= 1;
+            continue;
+
+        case Op::Proto:
+            r = protoMatch(f, static_cast<Proto>(arg));
+            break;
+
+        case Op::Host:
+        case Op::Net:
+        {
+            uint32_t addr = *pc++;
+            uint32_t mask = (static_cast<Op>(w & 0xff) == Op::Net) ? *pc++ : 0xffffffff;
+            uint32_t src, dst;
+            r = f.addresses(src, dst)
+                && directed(dir, (src & mask) == addr, (dst & mask) == addr);
+            break;
+        }
+
+        case Op::Port:
+        {
+            uint32_t range = *pc++;
+            if (f.l4 && (arg ? f.proto == arg : (f.proto == IP_PROTO_TCP || f.proto == IP_PROTO_UDP)))
+            {
+                uint16_t lo = range & 0xffff;
+                uint16_t hi = range >> 16;
+                uint16_t sp = rd16(f.p + f.l4);
+                uint16_t dp = rd16(f.p + f.l4 + 2);
+                r = directed(dir, sp >= lo && sp <= hi, dp >= lo && dp <= hi);
+            }
+            break;
+        }
+
+        case Op::Ether:
+        {
+            uint32_t hi = *pc++;
+            uint32_t lo = *pc++;
+            if (len >= 14)
+            {
+                bool dst = rd32(frame) == hi && rd16(frame + 4) == lo;
+                bool src = rd32(frame + 6) == hi && rd16(frame + 10) == lo;
+                r        = directed(dir, src, dst);
+            }
+            break;
+        }
+
+        case Op::Len:
+        {
+            uint32_t n = *pc++;
+            switch (dir)
+            {
+            case Less:
+                r = len < n;
+                break;
+            case LessEq:
+                r = len <= n;
+                break;
+            case Greater:
+                r = len > n;
+                break;
+            case GreaterEq:
+                r = len >= n;
+                break;
+            case Equal:
+                r = len == n;
+                break;
+            default:
+                r = len != n;
+                break;
+            }
+            break;
+        }
+        }
+        stack = (stack << 1) | r;
+    }
+    return stack & 1;
+}
+
+// Recursive descent over the token list, emitting postfix code:
+//   expr    := and { (or | ||) and }
+//   and     := unary { (and | &&) unary }
+//   unary   := (not | !) unary | '(' expr ')' | primitive
+class FilterCompiler
+{
+public:
+    FilterCompiler(FilterProgram& program, const char* expr) : prog(program), src(expr) { }
+
+    bool run()
+    {
+        if (!tokenize())
+        {
+            return false;
+        }
+        if (tokens.empty())
+        {
+            return true;
+        }
+        if (!parseOr())
+        {
+            return false;
+        }
+        if (cur < tokens.size())
+        {
+            return fail("unexpected token");
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> code;
+
+protected:
+    struct Token
+    {
+        const char* s;
+        size_t      len;
+    };
+
+    bool fail(const char* msg)
+    {
+        prog.errorMsg = msg;
+        prog.errorPos = cur < tokens.size() ? tokens[cur].s - src : strlen(src);
+        return false;
+    }
+
+    static bool wordChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+               || c == '.' || c == ':' || c == '/' || c == '-' || c == '_';
+    }
+
+    bool tokenize()
+    {
+        static const char* const ops[] = { "&&", "||", "!=", "<=", ">=", "==", "(", ")", "!", "<", ">", "=" };
+        const char*              p     = src;
+        while (*p)
+        {
+            if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            {
+                p++;
+                continue;
+            }
+            if (wordChar(*p))
+            {
+                const char* s = p;
+                while (wordChar(*p))
+                {
+                    p++;
+                }
+                tokens.push_back({ s, (size_t)(p - s) });
+                continue;
+            }
+            size_t n = 0;
+            for (const char* op : ops)
+            {
+                size_t l = strlen(op);
+                if (!strncmp(p, op, l))
+                {
+                    n = l;
+                    break;
+                }
+            }
+            if (!n)
+            {
+                prog.errorMsg = "unexpected character";
+                prog.errorPos = p - src;
+                return false;
+            }
+            tokens.push_back({ p, n });
+            p += n;
+        }
+        return true;
+    }
+
+    bool is(const char* word, size_t ahead = 0) const
+    {
+        if (cur + ahead >= tokens.size())
+        {
+            return false;
+        }
+        const Token& t = tokens[cur + ahead];
+        return t.len == strlen(word) && !strncmp(t.s, word, t.len);
+    }
+
+    bool accept(const char* word)
+    {
+        if (is(word))
+        {
+            cur++;
+            return true;
+        }
+        return false;
+    }
+
+    bool more() const
+    {
+        return cur < tokens.size();
+    }
+
+    void emit(uint32_t w)
+    {
+        code.push_back(w);
+    }
+
+    // leaves push one result, And / Or pop one
+    bool push()
+    {
+        if (++depth > FilterProgram::maxDepth)
+        {
+            return fail("expression too deep");
+        }
+        return true;
+    }
+
+    void combine(FilterProgram::Op op)
+    {
+        emit(word(op));
+        depth--;
+    }
+
+    bool parseOr()
+    {
+        if (!parseAnd())
+        {
+            return false;
+        }
+        while (accept("or") || accept("||"))
+        {
+            if (!parseAnd())
+            {
+                return false;
+            }
+            combine(FilterProgram::Op::Or);
+        }
+        return true;
+    }
+
+    bool parseAnd()
+    {
+        if (!parseUnary())
+        {
+            return false;
+        }
+        while (accept("and") || accept("&&"))
+        {
+            if (!parseUnary())
+            {
+                return false;
+            }
+            combine(FilterProgram::Op::And);
+        }
+        return true;
+    }
+
+    bool parseUnary()
+    {
+        if (!more())
+        {
+            return fail("unexpected end of expression");
+        }
+        if (accept("not") || accept("!"))
+        {
+            if (!parseUnary())
+            {
+                return false;
+            }
+            emit(word(FilterProgram::Op::Not));
+            return true;
+        }
+        if (accept("("))
+        {
+            if (!parseOr())
+            {
+                return false;
+            }
+            if (!accept(")"))
+            {
+                return fail("expected ')'");
+            }
+            return true;
+        }
+        return parsePrimitive();
+    }
+
+    bool number(uint32_t& out, const char* s, size_t len, uint32_t max)
+    {
+        if (!len)
+        {
+            return false;
+        }
+        uint32_t v = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            if (s[i] < '0' || s[i] > '9')
+            {
+                return false;
+            }
+            v = v * 10 + (s[i] - '0');
+            if (v > max)
+            {
+                return false;
+            }
+        }
+        out = v;
+        return true;
+    }
+
+    bool ipv4(const char* s, size_t len, uint32_t& addr)
+    {
+        const char* end = s + len;
+        addr            = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            const char* dot = s;
+            while (dot < end && *dot != '.')
+            {
+                dot++;
+            }
+            uint32_t octet;
+            if ((i < 3) != (dot < end) || !number(octet, s, dot - s, 255))
+            {
+                return false;
+            }
+            addr = (addr << 8) | octet;
+            s    = dot + 1;
+        }
+        return true;
+    }
+
+    static int hex(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        c |= 0x20;
+        return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+    }
+
+    bool mac(const Token& t, uint32_t& hi, uint32_t& lo)
+    {
+        uint8_t b[6];
+        size_t  i = 0;
+        for (int n = 0; n < 6; n++)
+        {
+            int h = i < t.len ? hex(t.s[i]) : -1;
+            int l = i + 1 < t.len ? hex(t.s[i + 1]) : -1;
+            if (h < 0 || l < 0 || (n < 5 && (i + 2 >= t.len || t.s[i + 2] != ':')))
+            {
+                return false;
+            }
+            b[n] = (h << 4) | l;
+            i += 3;
+        }
+        if (i - 1 != t.len)
+        {
+            return false;
+        }
+        hi = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+        lo = (b[4] << 8) | b[5];
+        return true;
+    }
+
+    bool parseLen(FilterProgram::Cmp cmp, bool explicitCmp)
+    {
+        if (explicitCmp)
+        {
+            static const char* const names[] = { "<", "<=", ">", ">=", "==", "!=" };
+            bool                     found   = false;
+            for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            {
+                if (accept(names[i]))
+                {
+                    cmp   = static_cast<FilterProgram::Cmp>(i);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found && accept("="))
+            {
+                cmp   = FilterProgram::Equal;
+                found = true;
+            }
+            if (!found)
+            {
+                return fail("expected a comparison");
+            }
+        }
+        uint32_t n;
+        if (!more() || !number(n, tokens[cur].s, tokens[cur].len, 0xffff))
+        {
+            return fail("bad length");
+        }
+        cur++;
+        emit(word(FilterProgram::Op::Len, cmp));
+        emit(n);
+        return push();
+    }
+
+    //   [proto] [dir] (host | net | port | portrange) value
+    //   ether [dir] [host] mac,  proto,  len cmp n,  less n,  greater n
+    bool parsePrimitive()
+    {
+        static const char* const protoNames[] = { "arp", "ip", "ip6", "tcp", "udp", "icmp", "icmp6" };
+
+        if (accept("len"))
+        {
+            return parseLen(FilterProgram::Equal, true);
+        }
+        if (accept("less"))
+        {
+            return parseLen(FilterProgram::LessEq, false);
+        }
+        if (accept("greater"))
+        {
+            return parseLen(FilterProgram::GreaterEq, false);
+        }
+
+        int  proto = -1;
+        bool ether = accept("ether");
+        for (size_t i = 0; !ether && i < sizeof(protoNames) / sizeof(protoNames[0]); i++)
+        {
+            if (accept(protoNames[i]))
+            {
+                proto = i;
+                break;
+            }
+        }
+
+        uint8_t dir    = FilterProgram::SrcOrDst;
+        bool    hasDir = false;
+        if (is("src") || is("dst"))
+        {
+            bool srcFirst = is("src");
+            hasDir        = true;
+            dir           = srcFirst ? FilterProgram::Src : FilterProgram::Dst;
+            cur++;
+            if ((is("or") || is("and")) && is(srcFirst ? "dst" : "src", 1))
+            {
+                dir = is("or") ? FilterProgram::SrcOrDst : FilterProgram::SrcAndDst;
+                cur += 2;
+            }
+        }
+
+        if (ether)
+        {
+            accept("host");
+            uint32_t hi, lo;
+            if (!more() || !mac(tokens[cur], hi, lo))
+            {
+                return fail("bad MAC address");
+            }
+            cur++;
+            emit(word(FilterProgram::Op::Ether, dir));
+            emit(hi);
+            emit(lo);
+            return push();
+        }
+
+        if (accept("port") || is("portrange"))
+        {
+            bool range = accept("portrange");
+            if (proto >= 0 && proto != (int)FilterProgram::Proto::Tcp
+                && proto != (int)FilterProgram::Proto::Udp)
+            {
+                return fail("ports need tcp or udp");
+            }
+            if (!more())
+            {
+                return fail("bad port");
+            }
+            const Token& t     = tokens[cur];
+            const char*  dash  = range ? (const char*)memchr(t.s, '-', t.len) : nullptr;
+            size_t       loLen = dash ? (size_t)(dash - t.s) : t.len;
+            uint32_t     lo, hi;
+            if ((range && !dash) || !number(lo, t.s, loLen, 0xffff))
+            {
+                return fail("bad port");
+            }
+            hi = lo;
+            if (dash && (!number(hi, dash + 1, t.len - loLen - 1, 0xffff) || hi < lo))
+            {
+                return fail("bad port range");
+            }
+            cur++;
+            uint8_t ipProto = proto == (int)FilterProgram::Proto::Tcp   ? IP_PROTO_TCP
+                              : proto == (int)FilterProgram::Proto::Udp ? IP_PROTO_UDP
+                                                                        : 0;
+            emit(word(FilterProgram::Op::Port, dir, ipProto));
+            emit(lo | (hi << 16));
+            return push();
+        }
+
+        bool net  = accept("net");
+        bool host = !net && accept("host");
+        if (!net && !host)
+        {
+            // a bare address is a host, a bare protocol stands for itself
+            bool address = more() && tokens[cur].s[0] >= '0' && tokens[cur].s[0] <= '9';
+            if (!address)
+            {
+                if (proto >= 0 && !hasDir)
+                {
+                    emit(word(FilterProgram::Op::Proto, 0, proto));
+                    return push();
+                }
+                return fail(more() ? "unknown keyword" : "unexpected end of expression");
+            }
+        }
+        if (proto == (int)FilterProgram::Proto::Ip6 || proto == (int)FilterProgram::Proto::Icmp6)
+        {
+            return fail("IPv6 addresses are not supported");
+        }
+        if (!more())
+        {
+            return fail("bad IPv4 address");
+        }
+
+        const Token& t     = tokens[cur];
+        const char*  slash = net ? (const char*)memchr(t.s, '/', t.len) : nullptr;
+        size_t       aLen  = slash ? (size_t)(slash - t.s) : t.len;
+        uint32_t     addr, bits = 32;
+        if (!ipv4(t.s, aLen, addr))
+        {
+            return fail("bad IPv4 address");
+        }
+        if (slash && !number(bits, slash + 1, t.len - aLen - 1, 32))
+        {
+            return fail("bad prefix length");
+        }
+        cur++;
+        uint32_t mask = bits ? 0xffffffff << (32 - bits) : 0;
+        if (net)
+        {
+            emit(word(FilterProgram::Op::Net, dir));
+            emit(addr & mask);
+            emit(mask);
+        }
+        else
+        {
+            emit(word(FilterProgram::Op::Host, dir));
+            emit(addr);
+        }
+        if (!push())
+        {
+            return false;
+        }
+        if (proto >= 0)
+        {
+            emit(word(FilterProgram::Op::Proto, 0, proto));
+            if (!push())
+            {
+                return false;
+            }
+            combine(FilterProgram::Op::And);
+        }
+        return true;
+    }
+
+    FilterProgram&     prog;
+    const char*        src;
+    std::vector<Token> tokens;
+    size_t             cur   = 0;
+    int                depth = 0;
+};
+
+bool FilterProgram::compile(const char* expr)
+{
+    clear();
+    errorMsg = nullptr;
+    errorPos = 0;
+
+    FilterCompiler compiler(*this, expr ? expr : "");
+    if (!compiler.run())
+    {
+        return false;
+    }
+    code.swap(compiler.code);
+    code.shrink_to_fit();
+    compiled = true;
+    return true;
+}
+
+}  // namespace NetCapture
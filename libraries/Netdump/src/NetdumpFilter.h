@@ -0,0 +1,143 @@
+/*
+    NetdumpFilter.h - tcpdump-like filter expressions compiled for Netdump
+    Copyright (c) 2020 esp8266/Arduino
+
+    This file is part of the esp8266 core for Arduino environment.
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __NETDUMP_FILTER_H
+#define __NETDUMP_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace NetCapture
+{
+
+/*
+    Packet filter compiled from a tcpdump-like expression, evaluated on the
+    raw ethernet frame before any Packet is built.
+
+    primitives  [proto] [src|dst|src or dst|src and dst] host A.B.C.D
+                [proto] [dir] net A.B.C.D/len
+                [tcp|udp] [dir] port N
+                [tcp|udp] [dir] portrange N-M
+                ether [dir] [host] aa:bb:cc:dd:ee:ff
+                arp | ip | ip6 | tcp | udp | icmp | icmp6
+                len (<|<=|>|>=|==|!=) N,  less N,  greater N
+                A.B.C.D (same as host A.B.C.D)
+    operators   not / !,  and / &&,  or / ||,  ( )
+
+    "host" also matches the sender / target address of ARP frames.  Ports
+    are those of unfragmented IPv4 or plain IPv6 (no extension header)
+    TCP and UDP segments.  Nesting is limited to 32 pending results.
+*/
+class FilterProgram
+{
+public:
+    FilterProgram() = default;
+    explicit FilterProgram(const char* expr)
+    {
+        compile(expr);
+    }
+
+    // false on syntax error, see error() / errorOffset(); an empty
+    // expression compiles to a program that accepts every frame
+    bool compile(const char* expr);
+    bool match(const uint8_t* frame, size_t len) const;
+
+    void clear()
+    {
+        code.clear();
+        compiled = false;
+    }
+    bool valid() const
+    {
+        return compiled;
+    }
+    bool empty() const
+    {
+        return code.empty();
+    }
+    // program size in 32-bit words
+    size_t size() const
+    {
+        return code.size();
+    }
+    const char* error() const
+    {
+        return errorMsg;
+    }
+    size_t errorOffset() const
+    {
+        return errorPos;
+    }
+
+    enum class Op : uint8_t
+    {
+        Proto,  // arg: Proto
+        Host,   // dir, +1 word IPv4 address
+        Net,    // dir, +2 words address, mask
+        Port,   // dir, arg: IP protocol or 0 for TCP/UDP, +1 word lo | hi << 16
+        Ether,  // dir, +2 words MAC
+        Len,    // dir: Cmp, +1 word length
+        And,
+        Or,
+        Not
+    };
+
+    enum class Proto : uint8_t
+    {
+        Arp,
+        Ip,
+        Ip6,
+        Tcp,
+        Udp,
+        Icmp,
+        Icmp6
+    };
+
+    enum Dir : uint8_t
+    {
+        SrcOrDst,
+        Src,
+        Dst,
+        SrcAndDst
+    };
+
+    enum Cmp : uint8_t
+    {
+        Less,
+        LessEq,
+        Greater,
+        GreaterEq,
+        Equal,
+        NotEqual
+    };
+
+protected:
+    friend class FilterCompiler;
+
+    std::vector<uint32_t> code;
+    bool                  compiled = false;
+    const char*           errorMsg = nullptr;
+    size_t                errorPos = 0;
+
+    static constexpr int maxDepth = 32;
+};
+
+}  // namespace NetCapture
+
+#endif /* __NETDUMP_FILTER_H */
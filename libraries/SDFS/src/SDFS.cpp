@@ -158,5 +158,144 @@ bool SDFSImpl::format() {
 }
 
 
+int SDFSFileImpl::read(uint8_t* buf, size_t size)
+{
+    if (!_opened) {
+        return -1;
+    }
+    if (!_cache) {
+        return _fd->read(buf, size);
+    }
+    if (!_flushCache()) {
+        return -1;
+    }
+    size_t done = 0;
+    bool hit = true;
+    while (done < size) {
+        if ((_pos >= _cacheStart) && (_pos < _cacheStart + _cacheLen)) {
+            size_t n = std::min((size_t)(_cacheStart + _cacheLen - _pos), size - done);
+            memcpy(buf + done, _cache.get() + (_pos - _cacheStart), n);
+            _pos += n;
+            done += n;
+        } else if (size - done >= _cacheSize) {
+            // Big reads already become multi-sector transfers, no need to double-buffer
+            _fs->_cacheStats.bypasses++;
+            hit = false;
+            if (!_fd->seekSet(_pos)) {
+                break;
+            }
+            int n = _fd->read(buf + done, size - done);
+            if (n <= 0) {
+                break;
+            }
+            _pos += n;
+            done += n;
+        } else {
+            hit = false;
+            if (!_fillCache()) {
+                break;
+            }
+        }
+    }
+    if (hit && done) {
+        _fs->_cacheStats.readHits++;
+    }
+    return done;
+}
+
+size_t SDFSFileImpl::write(const uint8_t *buf, size_t size)
+{
+    if (!_opened) {
+        return -1;
+    }
+    if (!_cache) {
+        return _fd->write(buf, size);
+    }
+    if (!_cacheDirty) {
+        // Read-ahead data may go stale, drop it
+        _cacheLen = 0;
+    } else if (_pos != _cacheStart + _cacheLen) {
+        // Not contiguous with the pending data
+        if (!_flushCache()) {
+            return 0;
+        }
+    }
+    if (!_cacheDirty && (size >= _cacheSize)) {
+        _fs->_cacheStats.bypasses++;
+        if (!_fd->seekSet(_pos)) {
+            return 0;
+        }
+        size_t n = _fd->write(buf, size);
+        if (n != (size_t)-1) {
+            _pos += n;
+        }
+        return n;
+    }
+    size_t done = 0;
+    bool hit = true;
+    while (done < size) {
+        if (!_cacheDirty) {
+            _cacheStart = _pos;
+            _cacheLen = 0;
+            _cacheDirty = true;
+        }
+        // Stop the buffer on a sector boundary so later flushes are sector-aligned
+        size_t room = _cacheSize - (_cacheStart % 512) - _cacheLen;
+        size_t n = std::min(room, size - done);
+        memcpy(_cache.get() + _cacheLen, buf + done, n);
+        _cacheLen += n;
+        _pos += n;
+        done += n;
+        if (n == room) {
+            hit = false;
+            size_t pending = std::min((size_t)_cacheLen, done);
+            if (!_flushCache()) {
+                return done - pending;
+            }
+        }
+    }
+    if (hit) {
+        _fs->_cacheStats.writeHits++;
+    }
+    return done;
+}
+
+bool SDFSFileImpl::_fillCache()
+{
+    // Refill from a sector boundary so whole sectors are transferred from the card
+    uint32_t start = _pos & ~511;
+    _cacheLen = 0;
+    _fs->_cacheStats.readMisses++;
+    if (!_fd->seekSet(start)) {
+        return false;
+    }
+    int n = _fd->read(_cache.get(), _cacheSize);
+    if (n <= 0) {
+        return false;
+    }
+    _cacheStart = start;
+    _cacheLen = n;
+    return _pos < _cacheStart + _cacheLen;
+}
+
+bool SDFSFileImpl::_flushCache()
+{
+    if (!_cacheDirty) {
+        return true;
+    }
+    _cacheDirty = false;
+    if (!_cacheLen) {
+        return true;
+    }
+    _fs->_cacheStats.writeFlushes++;
+    if (!_fd->seekSet(_cacheStart) || (_fd->write(_cache.get(), _cacheLen) != _cacheLen)) {
+        DEBUGV("SDFSFileImpl::_flushCache: write of %u bytes failed\n", (unsigned)_cacheLen);
+        _cacheLen = 0;
+        return false;
+    }
+    // The buffer now mirrors the card, keep it around for reads
+    return true;
+}
+
 }; // namespace sdfs
 
@@ -27,7 +27,9 @@
  License along with this library; if not, write to the Free Software
  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
+#include <algorithm>
 #include <limits>
+#include <new>
 #include <assert.h>
 #include <FSImpl.h>
 #include "debug.h"
@@ -44,7 +46,7 @@ class SDFSConfig : public fs::FSConfig
 public:
     static constexpr uint32_t FSId = 0x53444653;
 
-    SDFSConfig(uint8_t csPin = 4, uint32_t spi = SD_SCK_MHZ(10)) : FSConfig(FSId, false), _csPin(csPin), _part(0), _spiSettings(spi)  { }
+    SDFSConfig(uint8_t csPin = 4, uint32_t spi = SD_SCK_MHZ(10)) : FSConfig(FSId, false), _csPin(csPin), _part(0), _spiSettings(spi), _cacheSectors(0)  { }
 
     SDFSConfig setAutoFormat(bool val = true) {
         _autoFormat = val;
@@ -62,11 +64,18 @@ public:
         _part = part;
         return *this;
     }
+    // Per-file read-ahead/write-behind buffer, in 512 byte sectors (0 = disabled).
+    // Sequential accesses are then sent to the card as multi-sector transfers.
+    SDFSConfig setCacheSectors(uint16_t sectors) {
+        _cacheSectors = sectors;
+        return *this;
+    }
 
     // Inherit _type and _autoFormat
     uint8_t   _csPin;
     uint8_t   _part;
     uint32_t  _spiSettings;
+    uint16_t  _cacheSectors;
 };
 
 class SDFSImpl : public fs::FSImpl
@@ -74,6 +83,7 @@ class SDFSImpl : public fs::FSImpl
 public:
     SDFSImpl() : _mounted(false)
     {
+        memset(&_cacheStats, 0, sizeof(_cacheStats));
     }
 
     fs::FileImplPtr open(const char* path, fs::OpenMode openMode, fs::AccessMode accessMode) override;
@@ -164,6 +174,15 @@ public:
 
     bool format() override;
 
+    // Counters for the per-file buffers set up by SDFSConfig::setCacheSectors()
+    bool cacheStats(fs::FSCacheStats& stats, bool reset) override {
+        stats = _cacheStats;
+        if (reset) {
+            memset(&_cacheStats, 0, sizeof(_cacheStats));
+        }
+        return _cfg._cacheSectors != 0;
+    }
+
     // The following are not common FS interfaces, but are needed only to
     // support the older SD.h exports
     uint8_t type() {
@@ -223,7 +242,7 @@ public:
     }
 
 protected:
-    friend class SDFileImpl;
+    friend class SDFSFileImpl;
     friend class SDFSDirImpl;
 
     SdFat* getFs() {
@@ -252,9 +271,10 @@ protected:
         return mode;
     }
 
-    SdFat        _fs;
-    SDFSConfig   _cfg;
-    bool         _mounted;
+    SdFat            _fs;
+    SDFSConfig       _cfg;
+    bool             _mounted;
+    fs::FSCacheStats _cacheStats;
 };
 
 
@@ -262,10 +282,19 @@ class SDFSFileImpl : public fs::FileImpl
 {
 public:
     SDFSFileImpl(SDFSImpl *fs, std::shared_ptr<File32> fd, const char *name)
-        : _fs(fs), _fd(fd), _opened(true)
+        : _fs(fs), _fd(fd), _opened(true), _cacheSize(0), _cacheStart(0), _cacheLen(0), _cacheDirty(false), _pos(0)
     {
         _name = std::shared_ptr<char>(new char[strlen(name) + 1], std::default_delete<char[]>());
         strcpy(_name.get(), name);
+        if (_fs->_cfg._cacheSectors && _fd->isFile()) {
+            _cacheSize = _fs->_cfg._cacheSectors * 512;
+            _cache.reset(new (std::nothrow) uint8_t[_cacheSize]);
+            if (!_cache) {
+                DEBUGV("SDFSFileImpl: unable to allocate %u byte cache\n", (unsigned)_cacheSize);
+                _cacheSize = 0;
+            }
+            _pos = _fd->curPosition();
+        }
     }
 
     ~SDFSFileImpl() override
@@ -279,19 +308,14 @@ public:
         return _opened ? _fd->availableSpaceForWrite() : 0;
     }
 
-    size_t write(const uint8_t *buf, size_t size) override
-    {
-        return _opened ? _fd->write(buf, size) : -1;
-    }
+    size_t write(const uint8_t *buf, size_t size) override;
 
-    int read(uint8_t* buf, size_t size) override
-    {
-        return _opened ? _fd->read(buf, size) : -1;
-    }
+    int read(uint8_t* buf, size_t size) override;
 
     void flush() override
     {
         if (_opened) {
+            _flushCache();
             _fd->sync();
         }
     }
@@ -301,6 +325,33 @@ public:
         if (!_opened) {
             return false;
         }
+        if (_cache) {
+            // Only the logical position moves, the card is touched on the next refill/flush
+            uint32_t newPos;
+            switch (mode) {
+                case fs::SeekSet:
+                    newPos = pos;
+                    break;
+                case fs::SeekEnd:
+                    if (pos > size()) {
+                        return false;
+                    }
+                    newPos = size() - pos;
+                    break;
+                case fs::SeekCur:
+                    newPos = _pos + pos;
+                    break;
+                default:
+                    DEBUGV("SDFSFileImpl::seek: invalid seek mode %d\n", mode);
+                    assert((mode==fs::SeekSet) || (mode==fs::SeekEnd) || (mode==fs::SeekCur)); // Will fail and give meaningful assert message
+                    return false;
+            }
+            if (newPos > size()) {
+                return false;
+            }
+            _pos = newPos;
+            return true;
+        }
         switch (mode) {
             case fs::SeekSet:
                 return _fd->seekSet(pos);
@@ -318,12 +369,23 @@ public:
 
     size_t position() const override
     {
-        return _opened ? _fd->curPosition() : 0;
+        if (!_opened) {
+            return 0;
+        }
+        return _cache ? _pos : _fd->curPosition();
     }
 
     size_t size() const override
     {
-        return _opened ? _fd->fileSize() : 0;
+        if (!_opened) {
+            return 0;
+        }
+        size_t sz = _fd->fileSize();
+        if (_cacheDirty && (_cacheStart + _cacheLen > sz)) {
+            // Pending write-behind data extends the file
+            sz = _cacheStart + _cacheLen;
+        }
+        return sz;
     }
 
     bool truncate(uint32_t size) override
@@ -332,12 +394,21 @@ public:
             DEBUGV("SDFSFileImpl::truncate: file not opened\n");
             return false;
         }
+        if (_cache) {
+            _flushCache();
+            _cacheLen = 0;
+            bool ret = _fd->truncate(size);
+            // The card position is past _pos after a read-ahead fill, only cut what is beyond the new end
+            _pos = std::min<uint32_t>(_pos, size);
+            return ret;
+        }
         return _fd->truncate(size);
     }
 
     void close() override
     {
         if (_opened) {
+            _flushCache();
             _fd->close();
             _opened = false;
         }
@@ -397,10 +468,21 @@ public:
     }
 
 protected:
+    bool _fillCache();
+    bool _flushCache();
+
     SDFSImpl*                _fs;
     std::shared_ptr<File32>  _fd;
     std::shared_ptr<char>    _name;
     bool                     _opened;
+
+    // Read-ahead/write-behind buffer, only allocated when SDFSConfig::setCacheSectors() != 0
+    std::unique_ptr<uint8_t[]> _cache;
+    uint32_t                 _cacheSize;  // Buffer capacity in bytes
+    uint32_t                 _cacheStart; // File offset of _cache[0]
+    uint32_t                 _cacheLen;   // Valid (or pending, if dirty) bytes in _cache
+    bool                     _cacheDirty; // Buffer holds data not yet written to the card
+    uint32_t                 _pos;        // Logical file position while caching
 };
 
 class SDFSDirImpl : public fs::DirImpl
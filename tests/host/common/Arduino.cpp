@@ -41,8 +41,43 @@ extern "C" unsigned long micros()
     return ((time.tv_sec - gtod0.tv_sec) * 1000000) + time.tv_usec - gtod0.tv_usec;
 }
 
+// Replaced by cores/esp8266/Tasks.cpp when a test builds it, as on the device
+extern "C" bool __task_suspend(uint32_t ms)
+{
+    (void)ms;
+    return false;
+}
+extern "C" bool task_suspend(uint32_t ms) __attribute__((weak, alias("__task_suspend")));
+
+extern "C" void __task_set_blocked(bool (*blocked)(void*), void* arg)
+{
+    (void)blocked;
+    (void)arg;
+}
+extern "C" void task_set_blocked(bool (*blocked)(void*), void* arg)
+    __attribute__((weak, alias("__task_set_blocked")));
+
+extern "C" void __run_tasks() { }
+extern "C" void run_tasks() __attribute__((weak, alias("__run_tasks")));
+
+extern "C" cont_t* __task_find_cont(uint32_t sp)
+{
+    (void)sp;
+    return nullptr;
+}
+extern "C" cont_t* task_find_cont(uint32_t sp) __attribute__((weak, alias("__task_find_cont")));
+
+static uint32_t s_schedule_count = 0;
+
+extern "C" uint32_t esp_schedule_count()
+{
+    return s_schedule_count;
+}
+
 extern "C" void yield()
 {
+    if (task_suspend(0))
+        return;
     run_scheduled_recurrent_functions();
 }
 
@@ -62,14 +97,25 @@ extern "C" void optimistic_yield(uint32_t interval_us)
     (void)interval_us;
 }
 
-extern "C" void esp_suspend() { }
+extern "C" void esp_suspend()
+{
+    task_suspend(TASK_SUSPEND_SCHEDULED);
+}
 
-extern "C" void esp_schedule() { }
+extern "C" void esp_schedule()
+{
+    ++s_schedule_count;
+}
 
-extern "C" void esp_yield() { }
+extern "C" void esp_yield()
+{
+    task_suspend(0);
+}
 
 extern "C" void esp_delay(unsigned long ms)
 {
+    if (task_suspend(ms))
+        return;
     usleep(ms * 1000);
 }
 
@@ -114,3 +160,7 @@ extern "C" int __mockverbose(const char* fmt, ...)
 
 int mockverbose(const char* fmt, ...)
     __attribute__((weak, alias("__mockverbose"), format(printf, 1, 2)));
+
+// command line options of the emulation, ArduinoMain.cpp overrides these
+const char* host_interface __attribute__((weak))    = nullptr;
+int         mock_port_shifter __attribute__((weak)) = 0;
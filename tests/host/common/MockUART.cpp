@@ -25,14 +25,17 @@
  original driver and was striped from all HW dependent interfaces.
 
  UART0 writes got to stdout, while UART1 writes got to stderr. The user
- is responsible for feeding the RX FIFO new data by calling uart_new_data().
+ is responsible for feeding the RX FIFO new data by calling uart_new_data(),
+ and for ending frames in frame mode by calling uart_rx_idle().
  */
 
+#include <algorithm>
 #include <unistd.h>    // write
 #include <sys/time.h>  // gettimeofday
 #include <time.h>      // localtime
 
 #include "Arduino.h"
+#include "Schedule.h"
 #include "uart.h"
 
 //#define UART_DISCARD_NEWEST
@@ -50,6 +53,7 @@ extern "C"
         size_t   size;
         size_t   rpos;
         size_t   wpos;
+        uint32_t in;  // bytes ever stored, frame ends are counted in it
         uint8_t* buffer;
     };
 
@@ -61,6 +65,14 @@ extern "C"
         bool                    tx_enabled;
         bool                    rx_overrun;
         struct uart_rx_buffer_* rx_buffer;
+        size_t                  tx_buffer_size;
+        uint8_t                 rx_frame_idle;  // 0 unless in frame mode
+        uint32_t                rx_frame_ends[UART_RX_FRAMES];
+        size_t                  rx_frame_first;
+        size_t                  rx_frame_count;
+        bool                    rx_frame_scheduled;
+        uart_rx_frame_cb_t      rx_frame_cb;
+        void*                   rx_frame_arg;
     };
 
     bool serial_timestamp = false;
@@ -115,6 +127,7 @@ extern "C"
         }
         rx_buffer->buffer[rx_buffer->wpos] = data;
         rx_buffer->wpos                    = nextPos;
+        ++rx_buffer->in;
     }
 
     // insert a new byte into the RX FIFO nuffer
@@ -140,6 +153,90 @@ extern "C"
         return ret;
     }
 
+    // bytes not yet read up to the frame end `end`, <= 0 once all are read
+    static int32_t uart_rx_frame_left(uart_t* uart, uint32_t end)
+    {
+        uint32_t out = uart->rx_buffer->in - uart_rx_available_unsafe(uart->rx_buffer);
+        return (int32_t)(end - out);
+    }
+
+    // size of the oldest frame, dropping those read through the byte API or lost in an overrun
+    static size_t uart_rx_frame_size(uart_t* uart)
+    {
+        while (uart->rx_frame_count)
+        {
+            int32_t left = uart_rx_frame_left(uart, uart->rx_frame_ends[uart->rx_frame_first]);
+            if (left > 0)
+                return left;
+            uart->rx_frame_first = (uart->rx_frame_first + 1) % UART_RX_FRAMES;
+            --uart->rx_frame_count;
+        }
+        return 0;
+    }
+
+    // after the rx buffer was resized, frame ends past what it kept are gone and
+    // a frame cut short ends with the buffer
+    static void uart_rx_frame_rebase(uart_t* uart)
+    {
+        const uint32_t in   = uart->rx_buffer->in;
+        size_t         kept = 0;
+        while (kept < uart->rx_frame_count)
+        {
+            uint32_t end = uart->rx_frame_ends[(uart->rx_frame_first + kept) % UART_RX_FRAMES];
+            if ((int32_t)(end - in) > 0)
+                break;
+            ++kept;
+        }
+        const size_t last = (uart->rx_frame_first + kept + UART_RX_FRAMES - 1) % UART_RX_FRAMES;
+        if (kept < uart->rx_frame_count
+            && (kept ? uart->rx_frame_ends[last] != in : uart_rx_frame_left(uart, in) > 0))
+            uart->rx_frame_ends[(uart->rx_frame_first + kept++) % UART_RX_FRAMES] = in;
+        uart->rx_frame_count = kept;
+    }
+
+    static void uart_rx_frame_notify(int uart_nr)
+    {
+        uart_t* uart = UART[uart_nr];
+        if (uart == NULL || !uart->rx_frame_idle)
+            return;
+
+        uart->rx_frame_scheduled = false;
+        if (uart->rx_frame_cb && uart_rx_frame_size(uart))
+            uart->rx_frame_cb(uart->rx_frame_arg);
+    }
+
+    // the line went idle, what was received since the last call makes up a frame (the rx-timeout interrupt)
+    void uart_rx_idle(const int uart_nr)
+    {
+        uart_t* uart = UART[uart_nr];
+
+        if (uart == NULL || !uart->rx_enabled || !uart->rx_frame_idle)
+            return;
+
+        const uint32_t in   = uart->rx_buffer->in;
+        const size_t   last = (uart->rx_frame_first + uart->rx_frame_count + UART_RX_FRAMES - 1)
+                            % UART_RX_FRAMES;
+        if (uart->rx_frame_count ? uart->rx_frame_ends[last] == in
+                                 : uart_rx_frame_left(uart, in) <= 0)
+            return;
+
+        if (uart->rx_frame_count == UART_RX_FRAMES)
+        {
+            uart->rx_frame_ends[last] = in;
+            uart->rx_overrun          = true;
+        }
+        else
+        {
+            uart->rx_frame_ends[(uart->rx_frame_first + uart->rx_frame_count) % UART_RX_FRAMES]
+                = in;
+            ++uart->rx_frame_count;
+        }
+
+        if (uart->rx_frame_cb && !uart->rx_frame_scheduled)
+            uart->rx_frame_scheduled
+                = schedule_function([uart_nr]() { uart_rx_frame_notify(uart_nr); });
+    }
+
     // taking data straight from fifo, only needed in uart_resize_rx_buffer()
     static int uart_read_char_unsafe(uart_t* uart)
     {
@@ -224,18 +321,22 @@ extern "C"
         if (!new_buf)
             return uart->rx_buffer->size;
 
-        size_t new_wpos = 0;
-        // if uart_rx_available_unsafe() returns non-0, uart_read_char_unsafe() can't return -1
-        while (uart_rx_available_unsafe(uart->rx_buffer) && new_wpos < new_size)
+        size_t         new_wpos = 0;
+        const uint32_t out = uart->rx_buffer->in - uart_rx_available_unsafe(uart->rx_buffer);
+        // if uart_rx_available_unsafe() returns non-0, uart_read_char_unsafe() can't return -1,
+        // a full ring holds one byte less than its size
+        while (uart_rx_available_unsafe(uart->rx_buffer) && new_wpos + 1 < new_size)
             new_buf[new_wpos++] = uart_read_char_unsafe(uart);
-        if (new_wpos == new_size)
-            new_wpos = 0;
 
         uint8_t* old_buf        = uart->rx_buffer->buffer;
         uart->rx_buffer->rpos   = 0;
         uart->rx_buffer->wpos   = new_wpos;
         uart->rx_buffer->size   = new_size;
         uart->rx_buffer->buffer = new_buf;
+        // only what was kept counts as stored
+        uart->rx_buffer->in = out + new_wpos;
+        if (uart->rx_frame_idle)
+            uart_rx_frame_rebase(uart);
         free(old_buf);
         return uart->rx_buffer->size;
     }
@@ -273,7 +374,7 @@ extern "C"
         if (uart == NULL || !uart->tx_enabled)
             return 0;
 
-        return UART_TX_FIFO_SIZE;
+        return UART_TX_FIFO_SIZE + (uart->tx_buffer_size ? uart->tx_buffer_size - 1 : 0);
     }
 
     void uart_wait_tx_empty(uart_t* uart)
@@ -281,6 +382,23 @@ extern "C"
         (void)uart;
     }
 
+    size_t uart_resize_tx_buffer(uart_t* uart, size_t new_size)
+    {
+        if (uart == NULL || !uart->tx_enabled)
+            return 0;
+
+        if (new_size == 1)
+            new_size = 2;
+
+        uart->tx_buffer_size = new_size;
+        return new_size;
+    }
+
+    size_t uart_get_tx_buffer_size(uart_t* uart)
+    {
+        return uart ? uart->tx_buffer_size : 0;
+    }
+
     void uart_flush(uart_t* uart)
     {
         if (uart == NULL)
@@ -290,7 +408,89 @@ extern "C"
         {
             uart->rx_buffer->rpos = 0;
             uart->rx_buffer->wpos = 0;
+            uart->rx_frame_count  = 0;
+        }
+    }
+
+    bool uart_rx_frame_mode(uart_t* uart, uint8_t idle_chars)
+    {
+        if (uart == NULL || !uart->rx_enabled || idle_chars > 0x7f)
+            return false;
+
+        if (!idle_chars || !uart->rx_frame_idle)
+        {
+            uart->rx_frame_first     = 0;
+            uart->rx_frame_count     = 0;
+            uart->rx_frame_scheduled = false;
+            uart->rx_frame_cb        = NULL;
+            uart->rx_frame_arg       = NULL;
         }
+        uart->rx_frame_idle = idle_chars;
+        return true;
+    }
+
+    void uart_rx_frame_set_callback(uart_t* uart, uart_rx_frame_cb_t cb, void* arg)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return;
+
+        uart->rx_frame_cb  = cb;
+        uart->rx_frame_arg = arg;
+    }
+
+    size_t uart_rx_frame_count(uart_t* uart)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return 0;
+
+        return uart_rx_frame_size(uart) ? uart->rx_frame_count : 0;
+    }
+
+    size_t uart_rx_frame_available(uart_t* uart)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return 0;
+
+        return uart_rx_frame_size(uart);
+    }
+
+    size_t uart_rx_frame_read(uart_t* uart, char* userbuffer, size_t usersize)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return 0;
+
+        struct uart_rx_buffer_* rx_buffer = uart->rx_buffer;
+        size_t                  size      = std::min(uart_rx_frame_size(uart), usersize);
+        size_t                  chunk     = std::min(rx_buffer->size - rx_buffer->rpos, size);
+        memcpy(userbuffer, rx_buffer->buffer + rx_buffer->rpos, chunk);
+        memcpy(userbuffer + chunk, rx_buffer->buffer, size - chunk);
+        rx_buffer->rpos = (rx_buffer->rpos + size) % rx_buffer->size;
+        return size;
+    }
+
+    size_t uart_rx_frame_peek_available(uart_t* uart)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return 0;
+
+        return std::min(uart_rx_frame_size(uart), uart->rx_buffer->size - uart->rx_buffer->rpos);
+    }
+
+    const char* uart_rx_frame_peek_buffer(uart_t* uart)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return NULL;
+
+        return (const char*)&uart->rx_buffer->buffer[uart->rx_buffer->rpos];
+    }
+
+    void uart_rx_frame_peek_consume(uart_t* uart, size_t consume)
+    {
+        if (uart == NULL || !uart->rx_frame_idle)
+            return;
+
+        consume               = std::min(uart_rx_frame_size(uart), consume);
+        uart->rx_buffer->rpos = (uart->rx_buffer->rpos + consume) % uart->rx_buffer->size;
     }
 
     void uart_set_baudrate(uart_t* uart, int baud_rate)
@@ -327,8 +527,11 @@ extern "C"
         if (uart == NULL)
             return NULL;
 
-        uart->uart_nr    = uart_nr;
-        uart->rx_overrun = false;
+        uart->uart_nr        = uart_nr;
+        uart->rx_overrun     = false;
+        uart->tx_buffer_size = 0;
+        uart->rx_frame_idle  = 0;
+        uart->rx_frame_count = 0;
 
         switch (uart->uart_nr)
         {
@@ -347,6 +550,7 @@ extern "C"
                 rx_buffer->size   = rx_size;  // var this
                 rx_buffer->rpos   = 0;
                 rx_buffer->wpos   = 0;
+                rx_buffer->in     = 0;
                 rx_buffer->buffer = (uint8_t*)malloc(rx_buffer->size);
                 if (rx_buffer->buffer == NULL)
                 {
@@ -388,6 +592,8 @@ extern "C"
             free(uart->rx_buffer->buffer);
             free(uart->rx_buffer);
         }
+        if (UART[uart->uart_nr] == uart)
+            UART[uart->uart_nr] = NULL;
         free(uart);
     }
 
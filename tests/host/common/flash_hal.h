@@ -20,6 +20,7 @@ extern "C"
     extern int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t* dst);
     extern int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t* src);
     extern int32_t flash_hal_erase(uint32_t addr, uint32_t size);
+    extern const uint8_t* flash_hal_map(uint32_t addr, uint32_t size);
 }
 
 #endif
@@ -20,6 +20,15 @@ int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t* dst)
     return 0;
 }
 
+const uint8_t* flash_hal_map(uint32_t addr, uint32_t size)
+{
+    if (!s_phys_data || addr > s_phys_size || size > s_phys_size - addr)
+    {
+        return nullptr;
+    }
+    return s_phys_data + addr;
+}
+
 int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t* src)
 {
     memcpy(s_phys_data + addr, src, size);
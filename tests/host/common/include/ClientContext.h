@@ -99,11 +99,20 @@ public:
         }
     }
 
-    int connect(const ip_addr_t* addr, uint16_t port)
+    int connect(const ip_addr_t* addr, uint16_t port, bool wait = true)
     {
+        // the mock always connects synchronously
+        (void)wait;
         return mockConnect(addr->addr, _sock, port);
     }
 
+    void setNotify(void (*cb)(void*), void* arg)
+    {
+        (void)cb;
+        (void)arg;
+        mockverbose("TODO setNotify()\n");
+    }
+
     size_t availableForWrite()
     {
         // XXXFIXME be smarter
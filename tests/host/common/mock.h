@@ -141,10 +141,23 @@ extern "C"
 {
 #endif
     void uart_new_data(const int uart_nr, uint8_t data);
+    void uart_rx_idle(const int uart_nr);
 #ifdef __cplusplus
 }
 #endif
 
+// os_timer, an armed timer (period in timer_period) only goes off when a test fires it
+struct _ETSTIMER_;
+bool               mock_timer_armed(const struct _ETSTIMER_* timer);
+struct _ETSTIMER_* mock_timer_last();  // the armed timer armed last
+void               mock_timer_fire(struct _ETSTIMER_* timer);
+
+// station, connected (STATION_GOT_IP) and without scan results until a test changes it
+struct bss_info;
+void mock_station_status(int status);  // a station_status_t
+void mock_station_scan(const struct bss_info* found, size_t count);  // what the next scans find, once
+                                                                     // scheduled functions run
+
 // tcp
 int     mockSockSetup(int sock);
 int     mockConnect(uint32_t addr, int& sock, int port);
@@ -37,9 +37,11 @@
 #include <ifaddrs.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <vector>
 #include <arpa/inet.h>
 
 #include "MocklwIP.h"
+#include <Schedule.h>
 
 extern "C"
 {
@@ -56,9 +58,18 @@ extern "C"
         return PHY_MODE_11N;
     }
 
+    // emulated station: connected until a test says otherwise, it keeps the config
+    // and channel it was last given, and its scans find what a test put on the air
+    static station_status_t      mock_station_state      = STATION_GOT_IP;
+    static uint8                 mock_station_channel    = 1;
+    static struct station_config mock_station_config     = {};
+    static bool                  mock_station_configured = false;
+    static std::vector<bss_info> mock_station_air;
+    static bool                  mock_station_air_set = false;
+
     uint8 wifi_get_channel(void)
     {
-        return 1;
+        return mock_station_channel;
     }
 
     uint8 wifi_station_get_current_ap_id(void)
@@ -68,7 +79,7 @@ extern "C"
 
     station_status_t wifi_station_get_connect_status(void)
     {
-        return STATION_GOT_IP;
+        return mock_station_state;
     }
 
     uint8 wifi_station_get_auto_connect(void)
@@ -78,6 +89,11 @@ extern "C"
 
     bool wifi_station_get_config(struct station_config* config)
     {
+        if (mock_station_configured)
+        {
+            *config = mock_station_config;
+            return true;
+        }
         strcpy((char*)config->ssid, "emulated-ssid");
         strcpy((char*)config->password, "emulated-ssid-password");
         config->bssid_set = 0;
@@ -231,7 +247,7 @@ extern "C"
 
     bool wifi_set_channel(uint8 channel)
     {
-        (void)channel;
+        mock_station_channel = channel;
         return true;
     }
 
@@ -337,14 +353,14 @@ extern "C"
 
     bool wifi_station_set_config(struct station_config* config)
     {
-        (void)config;
+        mock_station_config     = *config;
+        mock_station_configured = true;
         return true;
     }
 
     bool wifi_station_set_config_current(struct station_config* config)
     {
-        (void)config;
-        return true;
+        return wifi_station_set_config(config);
     }
 
     bool wifi_station_set_hostname(const char* name)
@@ -402,8 +418,24 @@ extern "C"
     bool wifi_station_scan(struct scan_config* config, scan_done_cb_t cb)
     {
         (void)config;
-        cb(nullptr, FAIL);
-        return false;
+        if (!mock_station_air_set)
+        {
+            cb(nullptr, FAIL);
+            return false;
+        }
+        // reported later from the SYS context, the results only live during the callback
+        std::vector<bss_info> air = mock_station_air;
+        return schedule_function(
+            [cb, air]()
+            {
+                std::vector<bss_info> found = air;
+                for (size_t i = 0; i < found.size(); i++)
+                {
+                    STAILQ_NEXT(&found[i], next)
+                        = (i + 1 < found.size()) ? &found[i + 1] : nullptr;
+                }
+                cb(found.empty() ? nullptr : &found[0], OK);
+            });
     }
 
     uint32_t core_version = 1;
@@ -439,4 +471,77 @@ extern "C"
         return NONE_SLEEP_T;
     }
 
+    // armed os_timers, linked through timer_next, go off in mock_timer_fire() only
+    static ETSTimer* mock_timers = nullptr;
+
+    static void mock_timer_unlink(ETSTimer* t)
+    {
+        for (ETSTimer** link = &mock_timers; *link; link = &(*link)->timer_next)
+        {
+            if (*link == t)
+            {
+                *link = t->timer_next;
+                return;
+            }
+        }
+    }
+
+    void ets_timer_setfn(ETSTimer* t, ETSTimerFunc* fn, void* parg)
+    {
+        t->timer_func = fn;
+        t->timer_arg  = parg;
+    }
+
+    void ets_timer_arm_new(ETSTimer* t, int time, int repeat, int isMstimer)
+    {
+        (void)isMstimer;
+        mock_timer_unlink(t);
+        t->timer_period = time;
+        t->timer_expire = repeat;
+        t->timer_next   = mock_timers;
+        mock_timers     = t;
+    }
+
+    void ets_timer_disarm(ETSTimer* t)
+    {
+        mock_timer_unlink(t);
+    }
+
 }  // extern "C"
+
+bool mock_timer_armed(const ETSTimer* timer)
+{
+    for (ETSTimer* t = mock_timers; t; t = t->timer_next)
+    {
+        if (t == timer)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+ETSTimer* mock_timer_last()
+{
+    return mock_timers;
+}
+
+void mock_timer_fire(ETSTimer* timer)
+{
+    if (!timer->timer_expire)
+    {
+        mock_timer_unlink(timer);
+    }
+    timer->timer_func(timer->timer_arg);
+}
+
+void mock_station_status(int status)
+{
+    mock_station_state = (station_status_t)status;
+}
+
+void mock_station_scan(const struct bss_info* found, size_t count)
+{
+    mock_station_air.assign(found, found + count);
+    mock_station_air_set = true;
+}
@@ -0,0 +1,203 @@
+/*
+ test_Coroutine.cpp - C++20 coroutine awaiter tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <Arduino.h>
+#include <Schedule.h>
+#include <coredecls.h>
+#include <WiFiCoroutine.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// built with -std=gnu++20 here, the rest of the host core is C++17
+#include "../../../cores/esp8266/Coroutine.cpp"
+
+using namespace esp8266;
+
+namespace
+{
+
+// what yield() and loop_end() run
+void runScheduled()
+{
+    run_scheduled_recurrent_functions();
+    run_scheduled_functions();
+}
+
+coro::task<> sleeper(uint32_t ms, int& step)
+{
+    step = 1;
+    co_await coro::sleep_ms(ms);
+    step = 2;
+}
+
+coro::task<int> twice(int value)
+{
+    co_await coro::sleep_ms(0);
+    co_return 2 * value;
+}
+
+coro::task<> sum(int& result)
+{
+    int first = co_await twice(1);
+    result    = first + co_await twice(2);
+}
+
+// runs a task that is not detached until its first suspension, as awaiting it would
+void begin(coro::task<>& task)
+{
+    task.await_suspend(std::noop_coroutine()).resume();
+}
+
+coro::task<> destroyer(coro::task<>& other, int& step)
+{
+    co_await coro::sleep_ms(0);
+    other = coro::task<>();
+    step  = 1;
+}
+
+coro::task<> connector(uint16_t port, int& connected)
+{
+    WiFiClient client;
+    connected = co_await coro::connect(client, IPAddress(127, 0, 0, 1), port, 1000);
+}
+
+// a listening socket on a free port of the loopback interface
+struct Listener
+{
+    Listener()
+    {
+        sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len        = sizeof(addr);
+        if (::bind(sock, (sockaddr*)&addr, len) == 0 && ::listen(sock, 1) == 0
+            && ::getsockname(sock, (sockaddr*)&addr, &len) == 0)
+        {
+            port = ntohs(addr.sin_port);
+        }
+    }
+    ~Listener()
+    {
+        ::close(sock);
+    }
+
+    int      sock;
+    uint16_t port = 0;
+};
+
+}  // namespace
+
+TEST_CASE("A coroutine awaiting a timer resumes once it went off", "[core][coroutine]")
+{
+    int step = 0;
+    CHECK(sleeper(50, step).start());
+    CHECK(step == 1);
+
+    ETSTimer* timer = mock_timer_last();
+    REQUIRE(timer != nullptr);
+    CHECK(timer->timer_period == 50);
+    runScheduled();
+    CHECK(step == 1);
+
+    // what the timer callback does is safe in an interrupt, it only wakes CONT up
+    const uint32_t scheduled = esp_schedule_count();
+    mock_timer_fire(timer);
+    CHECK(esp_schedule_count() != scheduled);
+    CHECK(step == 1);
+
+    runScheduled();
+    CHECK(step == 2);
+    CHECK(mock_timer_last() == nullptr);
+}
+
+TEST_CASE("Coroutines awaiting each other pass their results", "[core][coroutine]")
+{
+    int result = 0;
+    CHECK(sum(result).start());
+
+    // each sleep_ms(0) ends at the next run, not in the one that resumed its coroutine
+    for (int i = 0; i < 3 && !result; i++)
+    {
+        runScheduled();
+    }
+    CHECK(result == 6);
+    CHECK(mock_timer_last() == nullptr);
+}
+
+TEST_CASE("A task destroyed while suspended leaves no timer or resumption behind",
+          "[core][coroutine]")
+{
+    int step = 0;
+    {
+        coro::task<> task = sleeper(50, step);
+        begin(task);
+        CHECK(step == 1);
+        CHECK(mock_timer_last() != nullptr);
+    }
+    CHECK(mock_timer_last() == nullptr);
+
+    // queued to resume at the next run
+    step = 0;
+    {
+        coro::task<> task = sleeper(0, step);
+        begin(task);
+        CHECK(step == 1);
+    }
+    runScheduled();
+    CHECK(step == 1);
+
+    // by a coroutine resumed in the same run, before it
+    coro::task<> victim;
+    int          destroyed = 0;
+    CHECK(destroyer(victim, destroyed).start());
+    step   = 0;
+    victim = sleeper(0, step);
+    begin(victim);
+    runScheduled();
+    CHECK(destroyed == 1);
+    CHECK(step == 1);
+    CHECK_FALSE(victim);
+
+    // the queue still works
+    CHECK(sleeper(0, step).start());
+    runScheduled();
+    CHECK(step == 2);
+}
+
+TEST_CASE("WiFiClient connect awaiter", "[core][coroutine]")
+{
+    Listener listener;
+    REQUIRE(listener.port != 0);
+
+    // the mock connects right away, the coroutine does not have to suspend
+    int connected = -1;
+    CHECK(connector(listener.port, connected).start());
+    CHECK(connected == 1);
+    int accepted = ::accept(listener.sock, nullptr, nullptr);
+    CHECK(accepted >= 0);
+    ::close(accepted);
+    CHECK(mock_timer_last() == nullptr);
+
+    // refused, once nothing listens on the port anymore
+    const uint16_t port = listener.port;
+    ::close(listener.sock);
+    listener.sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    connected     = -1;
+    CHECK(connector(port, connected).start());
+    CHECK(connected == 0);
+}
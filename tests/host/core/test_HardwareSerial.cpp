@@ -0,0 +1,171 @@
+/*
+ test_HardwareSerial.cpp - HardwareSerial tx buffer size and rx frame tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ */
+
+#include <catch.hpp>
+#include <string.h>
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include <Schedule.h>
+
+TEST_CASE("HardwareSerial tx buffer size and free space", "[core][uart]")
+{
+    HardwareSerial port(UART1);
+    port.setTxBufferSize(2048);
+    port.begin(115200);
+    REQUIRE(port.getTxBufferSize() == 2048);
+    CHECK(port.availableForWrite() == UART_TX_FIFO_SIZE + 2047);
+
+    CHECK(port.setTxBufferSize(1) == 2);
+    CHECK(port.setTxBufferSize(0) == 0);
+    CHECK(port.availableForWrite() == UART_TX_FIFO_SIZE);
+    port.end();
+}
+
+namespace
+{
+
+void receive(const char* data)
+{
+    while (*data)
+        uart_new_data(UART0, *data++);
+}
+
+}  // namespace
+
+TEST_CASE("HardwareSerial frame mode splits rx data at an idle line", "[core][uart]")
+{
+    HardwareSerial port(UART0);
+    REQUIRE(port.setRxFrameMode(4));
+    port.begin(115200);
+
+    receive("abc");
+    CHECK(port.frameCount() == 0);
+    CHECK(port.frameAvailable() == 0);
+    CHECK(port.available() == 3);
+    uart_rx_idle(UART0);
+    receive("defgh");
+    uart_rx_idle(UART0);
+    // idle again without new data adds no frame
+    uart_rx_idle(UART0);
+    receive("i");
+    CHECK(port.frameCount() == 2);
+
+    char buf[16];
+    CHECK(port.frameAvailable() == 3);
+    REQUIRE(port.readFrame(buf, 2) == 2);
+    CHECK(memcmp(buf, "ab", 2) == 0);
+    CHECK(port.frameAvailable() == 1);
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 1);
+    CHECK(buf[0] == 'c');
+
+    CHECK(port.frameCount() == 1);
+    REQUIRE(port.peekFrameAvailable() == 5);
+    CHECK(memcmp(port.peekFrameBuffer(), "defgh", 5) == 0);
+    port.peekFrameConsume(5);
+    CHECK(port.frameCount() == 0);
+    CHECK(port.available() == 1);
+    port.end();
+}
+
+TEST_CASE("HardwareSerial frames wrap around the rx buffer end", "[core][uart]")
+{
+    HardwareSerial port(UART0);
+    port.setRxBufferSize(8);
+    port.setRxFrameMode(4);
+    port.begin(115200);
+
+    receive("12345");
+    uart_rx_idle(UART0);
+    char buf[8];
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 5);
+
+    receive("uvwxyz");
+    uart_rx_idle(UART0);
+    CHECK(port.frameAvailable() == 6);
+    CHECK(port.peekFrameAvailable() == 3);
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 6);
+    CHECK(memcmp(buf, "uvwxyz", 6) == 0);
+
+    // frames read through the byte API are dropped
+    receive("ab");
+    uart_rx_idle(UART0);
+    receive("cd");
+    uart_rx_idle(UART0);
+    CHECK(port.read() == 'a');
+    CHECK(port.read() == 'b');
+    CHECK(port.frameCount() == 1);
+    CHECK(port.frameAvailable() == 2);
+    port.end();
+}
+
+TEST_CASE("HardwareSerial frame callback runs once for pending frames", "[core][uart]")
+{
+    HardwareSerial port(UART0);
+    int            calls = 0;
+    port.onReceiveFrame([&calls]() { ++calls; });
+    port.setRxFrameMode(4);
+    port.begin(115200);
+
+    receive("one");
+    uart_rx_idle(UART0);
+    receive("two");
+    uart_rx_idle(UART0);
+    CHECK(calls == 0);
+    run_scheduled_functions();
+    CHECK(calls == 1);
+    CHECK(port.frameCount() == 2);
+
+    port.setRxFrameMode(0);
+    CHECK(port.frameCount() == 0);
+    receive("three");
+    uart_rx_idle(UART0);
+    run_scheduled_functions();
+    CHECK(calls == 1);
+    port.end();
+}
+
+TEST_CASE("HardwareSerial rx buffer resize keeps the frames it holds", "[core][uart]")
+{
+    HardwareSerial port(UART0);
+    // no uart yet, and then no frame mode
+    CHECK(port.peekFrameBuffer() == nullptr);
+    port.begin(115200);
+    CHECK(port.peekFrameBuffer() == nullptr);
+    REQUIRE(port.setRxFrameMode(4));
+
+    receive("abc");
+    uart_rx_idle(UART0);
+    receive("defghij");
+    uart_rx_idle(UART0);
+    receive("k");
+    REQUIRE(port.setRxBufferSize(256) == 256);
+    CHECK(port.frameCount() == 2);
+    CHECK(port.frameAvailable() == 3);
+
+    // too small for what is there, the frame cut short ends with the new buffer
+    REQUIRE(port.setRxBufferSize(8) == 8);
+    CHECK(port.frameCount() == 2);
+    char buf[16];
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 3);
+    CHECK(memcmp(buf, "abc", 3) == 0);
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 4);
+    CHECK(memcmp(buf, "defg", 4) == 0);
+
+    receive("xyz");
+    uart_rx_idle(UART0);
+    CHECK(port.frameCount() == 1);
+    REQUIRE(port.readFrame(buf, sizeof(buf)) == 3);
+    CHECK(memcmp(buf, "xyz", 3) == 0);
+    port.end();
+}
@@ -0,0 +1,413 @@
+/*
+ test_MovableHeap.cpp - umm_relocate(), MovableHeap compactor and heap placement tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ */
+
+#include <catch.hpp>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include <Schedule.h>
+
+// The host build allocates from libc, umm_malloc is built here on an arena
+// of its own.  MockTools.cpp has a umm_info() stub for the rest of the build.
+#define umm_info host_umm_info
+#define UMM_INTEGRITY_CHECK 1
+
+extern "C"
+{
+    void* ets_memcpy(void* dst, const void* src, size_t n)
+    {
+        return memcpy(dst, src, n);
+    }
+    void* ets_memmove(void* dst, const void* src, size_t n)
+    {
+        return memmove(dst, src, n);
+    }
+    void* ets_memset(void* dst, int c, size_t n)
+    {
+        return memset(dst, c, n);
+    }
+    int ets_uart_putc1(char c)
+    {
+        return putchar(c);
+    }
+    int ets_vprintf(int (*print)(char), const char* fmt, va_list ap)
+    {
+        (void)print;
+        return vprintf(fmt, ap);
+    }
+}
+
+#include "../../../cores/esp8266/umm_malloc/umm_malloc_cfg.h"
+
+namespace umm
+{
+alignas(8) uint8_t arena[8192];
+alignas(8) uint8_t external[MMU_EXTERNAL_HEAP * 1024];
+}
+
+#undef UMM_MALLOC_CFG_HEAP_ADDR
+#define UMM_MALLOC_CFG_HEAP_ADDR (umm::arena)
+#undef UMM_MALLOC_CFG_HEAP_SIZE
+#define UMM_MALLOC_CFG_HEAP_SIZE (sizeof(umm::arena))
+
+// no interrupts on the host, umm_malloc is never called from an ISR here
+#undef xt_rsil
+#define xt_rsil(level) 0
+
+// the device's 32-bit types in printf formats, UMM_CRITICAL_SUSPEND() expanding to nothing
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wunused-value"
+#include "../../../cores/esp8266/umm_malloc/umm_malloc.cpp"
+#pragma GCC diagnostic pop
+
+#undef memcpy
+#undef memmove
+#undef memset
+#undef xt_rsil
+#define xt_rsil(level) (level)
+
+namespace umm
+{
+
+// what MovableHeap.cpp asks EspClass about, for the heap built here
+struct Esp
+{
+    uint32_t getFreeHeap()
+    {
+        return umm_free_heap_size();
+    }
+    uint8_t getHeapFragmentation()
+    {
+        return umm_fragmentation_metric();
+    }
+} esp;
+
+// each call to micros() from the compactor is step microseconds later
+uint32_t now  = 0;
+uint32_t step = 0;
+
+uint32_t micros()
+{
+    return now += step;
+}
+
+}  // namespace umm
+
+#define malloc umm_malloc
+#define realloc umm_realloc
+#define free umm_free
+#define ESP umm::esp
+#define micros() umm::micros()
+
+#include "../../../cores/esp8266/MovableHeap.cpp"
+
+#undef malloc
+#undef realloc
+#undef free
+#undef ESP
+#undef micros
+
+namespace
+{
+
+// a heap and a handle table nothing was ever allocated from
+void reset()
+{
+    heap_context[0].heap = NULL;
+    umm_init();
+
+    // the table lived in the old heap
+    movable_stop_compactor();
+    sTable     = nullptr;
+    sTableSize = 0;
+    sHandles   = 0;
+    sCursor    = 0;
+    sIdle      = false;
+    sStats     = {};
+
+    umm::now  = 0;
+    umm::step = 0;
+}
+
+void fill(void* ptr, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        static_cast<uint8_t*>(ptr)[i] = (uint8_t)(seed + i * 13);
+    }
+}
+
+bool filled(const void* ptr, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (static_cast<const uint8_t*>(ptr)[i] != (uint8_t)(seed + i * 13))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool filled(movable_t handle, uint8_t seed)
+{
+    MovableLock lock(handle);
+    return lock && filled(lock.get(), movable_size(handle), seed);
+}
+
+bool inExternal(const void* ptr)
+{
+    return ptr >= umm::external && ptr < umm::external + sizeof(umm::external);
+}
+
+size_t oomCount(size_t id)
+{
+    return heap_context[id].UMM_OOM_COUNT;
+}
+
+}  // namespace
+
+TEST_CASE("umm_relocate slides a block into the free block below it", "[core][umm]")
+{
+    reset();
+    void* a = umm_malloc(40);
+    void* b = umm_malloc(100);
+    void* c = umm_malloc(16);
+    REQUIRE(a < b);
+    REQUIRE(b < c);
+    fill(b, 100, 1);
+
+    umm_free(a);
+    void* moved = umm_relocate(b);
+    CHECK(moved == a);
+    CHECK(filled(moved, 100, 1));
+    CHECK(umm_integrity_check());
+
+    // what the block no longer covers was freed, and is used again
+    void* below = umm_malloc(40);
+    CHECK(below > moved);
+    CHECK(below < c);
+    CHECK(umm_integrity_check());
+
+    // nothing free below any more
+    CHECK(umm_relocate(moved) == moved);
+    CHECK(umm_relocate(nullptr) == nullptr);
+}
+
+TEST_CASE("umm_relocate moves a block to the lowest hole that fits", "[core][umm]")
+{
+    reset();
+    void* small = umm_malloc(8);
+    void* gap   = umm_malloc(16);
+    void* large = umm_malloc(64);
+    void* used  = umm_malloc(16);
+    void* block = umm_malloc(48);
+    void* top   = umm_malloc(16);
+    fill(block, 48, 7);
+
+    // too small, then large enough, and the block right below is in use
+    umm_free(small);
+    umm_free(large);
+    void* moved = umm_relocate(block);
+    CHECK(moved == large);
+    CHECK(filled(moved, 48, 7));
+    CHECK(umm_integrity_check());
+
+    // the rest of the hole and the old place are free again
+    size_t freeHeap = umm_free_heap_size();
+    umm_free(gap);
+    umm_free(used);
+    umm_free(moved);
+    umm_free(top);
+    CHECK(umm_integrity_check());
+    CHECK(umm_free_heap_size() > freeHeap);
+    CHECK(umm_fragmentation_metric() == 0);
+}
+
+TEST_CASE("MovableHeap compacts unlocked blocks and keeps their contents", "[core][umm]")
+{
+    reset();
+    std::vector<movable_t> handles;
+    for (int i = 0; i < 24; i++)
+    {
+        movable_t handle = movable_malloc(40 + i * 8);
+        REQUIRE(handle != MOVABLE_NONE);
+        MovableLock lock(handle);
+        fill(lock.get(), movable_size(handle), i);
+        handles.push_back(handle);
+    }
+
+    // every other one gone leaves holes all over the heap
+    for (int i = 0; i < 24; i += 2)
+    {
+        movable_free(handles[i]);
+    }
+    const size_t maxBlock = umm_max_block_size();
+    const int    frag     = umm_fragmentation_metric();
+    REQUIRE(frag > 0);
+
+    // pinned blocks stay where they are
+    void* pinned = movable_lock(handles[13]);
+
+    CHECK(movable_compact(1000000) > 0);
+    CHECK(umm_integrity_check());
+    CHECK(movable_lock(handles[13]) == pinned);
+    movable_unlock(handles[13]);
+    movable_unlock(handles[13]);
+
+    for (int i = 1; i < 24; i += 2)
+    {
+        CAPTURE(i);
+        CHECK(filled(handles[i], i));
+    }
+    CHECK(umm_max_block_size() > maxBlock);
+    CHECK(umm_fragmentation_metric() < frag);
+
+    movable_stats_t stats;
+    movable_get_stats(&stats);
+    CHECK(stats.passes == 1);
+    CHECK(stats.handles == 12);
+    CHECK(stats.fragBefore == frag);
+    CHECK(stats.fragAfter == umm_fragmentation_metric());
+
+    // until a pass finds nothing to move, and then until the heap changes
+    while (movable_compact(1000000))
+    {
+    }
+    movable_get_stats(&stats);
+    const uint32_t passes = stats.passes;
+    CHECK(movable_compact(1000000) == 0);
+    movable_get_stats(&stats);
+    CHECK(stats.passes == passes);
+
+    for (int i = 1; i < 24; i += 2)
+    {
+        CHECK(filled(handles[i], i));
+        movable_free(handles[i]);
+    }
+    CHECK(umm_integrity_check());
+}
+
+TEST_CASE("MovableHeap compactor stops at its time budget and resumes", "[core][umm]")
+{
+    reset();
+    std::vector<movable_t> handles;
+    for (int i = 0; i < 16; i++)
+    {
+        handles.push_back(movable_malloc(64));
+        MovableLock lock(handles.back());
+        fill(lock.get(), 64, i);
+    }
+    movable_free(handles[0]);
+    handles.erase(handles.begin());
+
+    // 10us per check against a 35us budget, three handles per call
+    umm::step = 10;
+    void* last = MovableLock(handles.back()).get();
+    CHECK(movable_compact(35) > 0);
+    movable_stats_t stats;
+    movable_get_stats(&stats);
+    CHECK(stats.passes == 0);
+    CHECK(MovableLock(handles.back()).get() == last);
+
+    size_t moved = stats.moves;
+    int    calls = 1;
+    do
+    {
+        moved += movable_compact(35);
+        ++calls;
+        movable_get_stats(&stats);
+        CHECK(umm_integrity_check());
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            CAPTURE(i);
+            CHECK(filled(handles[i], i + 1));
+        }
+    } while (!stats.passes);
+
+    // the table is 16 entries, the first call also starts the pass
+    CHECK(calls == 6);
+    CHECK(MovableLock(handles.back()).get() < last);
+    CHECK(stats.moves == moved);
+    CHECK(stats.bytes == moved * 64);
+
+    for (movable_t handle : handles)
+    {
+        movable_free(handle);
+    }
+    CHECK(umm_integrity_check());
+}
+
+TEST_CASE("Placement rules route by size and fall back to the next heap", "[core][umm]")
+{
+    reset();
+    umm_init_vm(umm::external, sizeof(umm::external));
+    umm_placement_reset_stats();
+
+    // nothing changes without a placement tag
+    void* plain = umm_malloc(512);
+    CHECK_FALSE(inExternal(plain));
+    umm_placement_stats_t stats;
+    REQUIRE(umm_placement_get_stats(UMM_PLACEMENT_ALL, &stats));
+    CHECK(stats.allocs[UMM_HEAP_DRAM] == 0);
+
+    // small requests go to DRAM first, large ones to the other heap first
+    CHECK(umm_placement_set_current(UMM_PLACEMENT_BY_SIZE) == UMM_PLACEMENT_NONE);
+    void* small = umm_malloc(32);
+    void* large = umm_malloc(1024);
+    CHECK_FALSE(inExternal(small));
+    CHECK(inExternal(large));
+    REQUIRE(umm_placement_get_stats(UMM_PLACEMENT_BY_SIZE, &stats));
+    CHECK(stats.allocs[UMM_HEAP_DRAM] == 1);
+    CHECK(stats.allocs[UMM_HEAP_EXTERNAL] == 1);
+    CHECK(stats.bytes[UMM_HEAP_DRAM] == 32);
+    CHECK(stats.bytes[UMM_HEAP_EXTERNAL] == 1024);
+    CHECK(stats.fallbacks == 0);
+
+    // the other heap is full, DRAM serves the next one and neither heap counts an OOM
+    void* fallback = umm_malloc(1024);
+    REQUIRE(fallback != nullptr);
+    CHECK_FALSE(inExternal(fallback));
+    REQUIRE(umm_placement_get_stats(UMM_PLACEMENT_BY_SIZE, &stats));
+    CHECK(stats.allocs[UMM_HEAP_DRAM] == 2);
+    CHECK(stats.fallbacks == 1);
+    CHECK(stats.failures == 0);
+    CHECK(oomCount(UMM_HEAP_DRAM) == 0);
+    CHECK(oomCount(UMM_HEAP_EXTERNAL) == 0);
+
+    // too large for either, an OOM in every heap of the order
+    CHECK(umm_malloc(sizeof(umm::arena)) == nullptr);
+    REQUIRE(umm_placement_get_stats(UMM_PLACEMENT_BY_SIZE, &stats));
+    CHECK(stats.fallbacks == 1);
+    CHECK(stats.failures == 1);
+    CHECK(oomCount(UMM_HEAP_DRAM) == 1);
+    CHECK(oomCount(UMM_HEAP_EXTERNAL) == 1);
+
+    // a heap selected explicitly takes priority, and is not counted
+    umm_set_heap_by_id(UMM_HEAP_EXTERNAL);
+    CHECK(umm_malloc(1024) == nullptr);
+    umm_set_heap_by_id(UMM_HEAP_DRAM);
+    REQUIRE(umm_placement_get_stats(UMM_PLACEMENT_ALL, &stats));
+    CHECK(stats.failures == 1);
+    CHECK(oomCount(UMM_HEAP_EXTERNAL) == 2);
+
+    CHECK(umm_placement_set_current(UMM_PLACEMENT_NONE) == UMM_PLACEMENT_BY_SIZE);
+    umm_free(fallback);
+    umm_free(large);
+    umm_free(small);
+    umm_free(plain);
+    CHECK(umm_integrity_check());
+    umm_placement_reset_stats();
+}
@@ -0,0 +1,340 @@
+/*
+ test_Tasks.cpp - cooperative task tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <ucontext.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <Tasks.h>
+#include <coredecls.h>
+#include <ets_sys.h>
+
+// cont.S on ucontext: pc_ret is set while a cont runs, pc_suspend while it is suspended
+namespace hostcont
+{
+
+struct Context
+{
+    ucontext_t cont;
+    ucontext_t caller;
+    void (*pfn)(void);
+};
+
+std::map<cont_t*, Context> contexts;
+cont_t*                    starting = nullptr;
+
+void entry()
+{
+    cont_t* cont = starting;
+    contexts[cont].pfn();
+    cont->pc_suspend = nullptr;
+}
+
+void run(cont_t* cont, void (*pfn)(void))
+{
+    Context& context = contexts[cont];
+    cont->pc_ret     = pfn;
+    if (cont->pc_suspend)
+    {
+        cont->pc_suspend = nullptr;
+    }
+    else
+    {
+        getcontext(&context.cont);
+        context.cont.uc_stack.ss_sp   = cont->stack;
+        context.cont.uc_stack.ss_size = (char*)cont->stack_end - (char*)cont->stack;
+        context.cont.uc_link          = &context.caller;
+        context.pfn                   = pfn;
+        makecontext(&context.cont, &entry, 0);
+        starting = cont;
+    }
+    swapcontext(&context.caller, &context.cont);
+    cont->pc_ret = nullptr;
+}
+
+void suspend(cont_t* cont)
+{
+    Context& context = contexts[cont];
+    cont->pc_suspend = cont->pc_ret;
+    swapcontext(&context.cont, &context.caller);
+}
+
+}  // namespace hostcont
+
+// the stack pointer of cont_repaint_stack(), and no interrupts on the host
+#define register
+#define asm(reg) = (uint32_t*)__builtin_frame_address(0)
+#define ETS_INTR_WITHINISR() false
+#include "../../../cores/esp8266/cont_util.cpp"
+#undef register
+#undef asm
+
+// time only passes when a test says so
+namespace tasks
+{
+uint32_t now = 0;
+}  // namespace tasks
+
+#define cont_run hostcont::run
+#define cont_suspend hostcont::suspend
+#define millis() tasks::now
+
+#include "../../../cores/esp8266/Tasks.cpp"
+
+#undef cont_run
+#undef cont_suspend
+#undef millis
+
+namespace
+{
+
+constexpr size_t stackSize = 65536;
+
+// what the tasks did, in order
+using Steps = std::vector<std::string>;
+Steps steps;
+
+void reset()
+{
+    REQUIRE(task_count() == 0);
+    steps.clear();
+    tasks::now = 0;
+}
+
+// when the wake timer goes off, or -1
+int armedMs()
+{
+    return mock_timer_armed(&sWakeTimer) ? (int)sWakeTimer.timer_period : -1;
+}
+
+void expire()
+{
+    REQUIRE(armedMs() > 0);
+    tasks::now += armedMs();
+    mock_timer_fire(&sWakeTimer);
+}
+
+}  // namespace
+
+TEST_CASE("Tasks are created, run from run_tasks() and deleted when done", "[core][tasks]")
+{
+    reset();
+    task_t* inside    = nullptr;
+    int     freeStack = 0;
+    task_t* task      = task_create(
+        [&]()
+        {
+            inside    = task_current();
+            freeStack = task_get_free_stack();
+            steps.push_back("ran");
+        },
+        stackSize);
+    REQUIRE(task != nullptr);
+    CHECK(task_count() == 1);
+    CHECK(steps.empty());
+    CHECK(task_current() == nullptr);
+    // untouched, the guard word right behind the stack counts as well
+    CHECK(task_get_free_stack(task) >= (int)stackSize);
+
+    run_tasks();
+    CHECK(steps == Steps({ "ran" }));
+    CHECK(inside == task);
+    CHECK(freeStack > 0);
+    CHECK(freeStack < (int)stackSize);
+    CHECK(task_count() == 0);
+    CHECK(task_current() == nullptr);
+    CHECK(armedMs() == -1);
+
+    // nothing to do, and no task to suspend outside of one
+    run_tasks();
+    CHECK_FALSE(task_suspend(0));
+}
+
+TEST_CASE("Tasks switch at yield(), the highest priority ones first", "[core][tasks]")
+{
+    reset();
+    auto loop = [](const char* name, int times)
+    {
+        return [name, times]()
+        {
+            for (int i = 0; i < times; i++)
+            {
+                steps.push_back(name + std::to_string(i));
+                yield();
+            }
+        };
+    };
+    task_create(loop("a", 2), stackSize);
+    task_create(loop("b", 2), stackSize);
+    task_create(loop("h", 2), stackSize, 1);
+    CHECK(task_count() == 3);
+
+    // one step of each ready task of the top priority per round
+    const uint32_t scheduled = esp_schedule_count();
+    run_tasks();
+    CHECK(steps == Steps({ "h0" }));
+    CHECK(esp_schedule_count() != scheduled);
+    run_tasks();
+    run_tasks();
+    CHECK(steps == Steps({ "h0", "h1" }));
+    CHECK(task_count() == 2);
+
+    run_tasks();
+    run_tasks();
+    CHECK(steps == Steps({ "h0", "h1", "a0", "b0", "a1", "b1" }));
+    run_tasks();
+    CHECK(task_count() == 0);
+}
+
+TEST_CASE("Sleeping and delayed tasks wake on time", "[core][tasks]")
+{
+    reset();
+    task_create(
+        []()
+        {
+            task_sleep(100);
+            steps.push_back("slept");
+        },
+        stackSize);
+    task_create(
+        []()
+        {
+            delay(30);
+            steps.push_back("delayed");
+        },
+        stackSize);
+
+    run_tasks();
+    CHECK(steps.empty());
+    CHECK(armedMs() == 30);
+
+    // nothing is due before its time
+    tasks::now = 29;
+    run_tasks();
+    CHECK(steps.empty());
+    CHECK(armedMs() == 1);
+
+    expire();
+    run_tasks();
+    CHECK(steps == Steps({ "delayed" }));
+    CHECK(armedMs() == 70);
+
+    // an esp_schedule() does not end task_sleep()
+    esp_schedule();
+    run_tasks();
+    CHECK(steps.size() == 1);
+
+    expire();
+    run_tasks();
+    CHECK(steps == Steps({ "delayed", "slept" }));
+    CHECK(task_count() == 0);
+    CHECK(armedMs() == -1);
+}
+
+TEST_CASE("esp_schedule() only resumes delayed tasks that are no longer blocked", "[core][tasks]")
+{
+    reset();
+    bool ready = false;
+    task_create(
+        [&]()
+        {
+            esp_delay(1000, [&]() { return !ready; });
+            steps.push_back(ready ? "ready" : "timeout");
+        },
+        stackSize);
+    task_create(
+        []()
+        {
+            esp_suspend();
+            steps.push_back("resumed");
+        },
+        stackSize);
+    task_create(
+        []()
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                yield();
+            }
+            steps.push_back("yielded");
+        },
+        stackSize);
+
+    // the rounds the yielding task asks for wake neither of the others
+    for (int i = 0; i < 4; i++)
+    {
+        run_tasks();
+    }
+    CHECK(steps == Steps({ "yielded" }));
+
+    // an event elsewhere, the suspended task resumes and the blocked one waits on
+    esp_schedule();
+    run_tasks();
+    CHECK(steps == Steps({ "yielded", "resumed" }));
+    run_tasks();
+    CHECK(steps.size() == 2);
+
+    // until what it waits for is there, and the next esp_schedule() says so
+    ready = true;
+    run_tasks();
+    CHECK(steps.size() == 2);
+    esp_schedule();
+    run_tasks();
+    CHECK(steps == Steps({ "yielded", "resumed", "ready" }));
+    CHECK(task_count() == 0);
+}
+
+TEST_CASE("Events wake the task waiting for them", "[core][tasks]")
+{
+    reset();
+    task_event_t event;
+    task_create([&]() { steps.push_back(task_wait(&event, 500) ? "signaled" : "timeout"); },
+                stackSize);
+    task_create([&]() { steps.push_back(task_wait(&event, 50) ? "signaled" : "timeout"); },
+                stackSize);
+
+    run_tasks();
+    CHECK(steps.empty());
+    expire();
+    run_tasks();
+    CHECK(steps == Steps({ "timeout" }));
+
+    task_signal(&event);
+    run_tasks();
+    CHECK(steps == Steps({ "timeout", "signaled" }));
+    CHECK_FALSE(event.signaled);
+}
+
+TEST_CASE("task_find_cont() finds the task a stack address belongs to", "[core][tasks]")
+{
+    reset();
+    cont_t* found   = nullptr;
+    task_t* task    = task_create(
+        [&]()
+        {
+            int local = 0;
+            found     = task_find_cont((uint32_t)(uintptr_t)&local);
+            yield();
+        },
+        stackSize);
+    run_tasks();
+    CHECK(found == task->cont);
+
+    int local = 0;
+    CHECK(task_find_cont((uint32_t)(uintptr_t)&local) == nullptr);
+    run_tasks();
+    CHECK(task_count() == 0);
+}
@@ -0,0 +1,120 @@
+/*
+ test_mmu_iram.cpp - 32-bit access block function tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ */
+
+#include <catch.hpp>
+#include <string.h>
+#include <Arduino.h>
+#include <mmu_iram.h>
+
+namespace
+{
+
+// Word aligned and padded, the 32-bit variants read whole words around both ends
+constexpr size_t words = 16;
+
+struct Buffers
+{
+    uint32_t src[words];
+    uint32_t dst[words];
+    uint32_t expected[words];
+
+    Buffers()
+    {
+        auto* s = reinterpret_cast<uint8_t*>(src);
+        for (size_t i = 0; i < sizeof(src); ++i)
+        {
+            s[i] = static_cast<uint8_t>(i * 7 + 1);
+        }
+        memset(dst, 0xa5, sizeof(dst));
+        memset(expected, 0xa5, sizeof(expected));
+    }
+
+    uint8_t* s() { return reinterpret_cast<uint8_t*>(src); }
+    uint8_t* d() { return reinterpret_cast<uint8_t*>(dst); }
+    uint8_t* e() { return reinterpret_cast<uint8_t*>(expected); }
+};
+
+}  // namespace
+
+TEST_CASE("mmu_memcpy32 and mmu_memset32 match memcpy and memset", "[core][mmu]")
+{
+    for (size_t dofs = 4; dofs < 8; ++dofs)
+    {
+        for (size_t sofs = 4; sofs < 8; ++sofs)
+        {
+            for (size_t n = 0; n < 24; ++n)
+            {
+                Buffers b;
+                REQUIRE(mmu_memcpy32(b.d() + dofs, b.s() + sofs, n) == b.d() + dofs);
+                memcpy(b.e() + dofs, b.s() + sofs, n);
+                REQUIRE(memcmp(b.dst, b.expected, sizeof(b.dst)) == 0);
+
+                mmu_memset32(b.d() + sofs, 0x3c, n);
+                memset(b.e() + sofs, 0x3c, n);
+                REQUIRE(memcmp(b.dst, b.expected, sizeof(b.dst)) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("mmu_memmove32 handles overlap in both directions", "[core][mmu]")
+{
+    for (size_t dofs = 4; dofs < 12; ++dofs)
+    {
+        for (size_t sofs = 4; sofs < 12; ++sofs)
+        {
+            for (size_t n = 0; n < 24; ++n)
+            {
+                Buffers b;
+                memcpy(b.dst, b.src, sizeof(b.dst));
+                memcpy(b.expected, b.src, sizeof(b.expected));
+                mmu_memmove32(b.d() + dofs, b.d() + sofs, n);
+                memmove(b.e() + dofs, b.e() + sofs, n);
+                REQUIRE(memcmp(b.dst, b.expected, sizeof(b.dst)) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("mmu_memcmp32 orders like memcmp", "[core][mmu]")
+{
+    auto sign = [](int v) { return (v > 0) - (v < 0); };
+
+    for (size_t aofs = 4; aofs < 8; ++aofs)
+    {
+        for (size_t bofs = 4; bofs < 8; ++bofs)
+        {
+            for (size_t diff = 0; diff < 20; ++diff)
+            {
+                Buffers b;
+                memcpy(b.d() + bofs, b.s() + aofs, 20);
+                b.d()[bofs + diff] += 1;
+
+                CHECK(mmu_memcmp32(b.s() + aofs, b.d() + bofs, diff) == 0);
+                CHECK(sign(mmu_memcmp32(b.s() + aofs, b.d() + bofs, 20)) == sign(memcmp(b.s() + aofs, b.d() + bofs, 20)));
+                CHECK(sign(mmu_memcmp32(b.d() + bofs, b.s() + aofs, 20)) == sign(memcmp(b.d() + bofs, b.s() + aofs, 20)));
+            }
+        }
+    }
+}
+
+TEST_CASE("mmu_memcpy family falls back to the library for DRAM", "[core][mmu]")
+{
+    char dst[8] = "abcdefg";
+    CHECK_FALSE(mmu_is_32bit_only(dst));
+    CHECK(mmu_memcpy(dst, "xyz", 3) == dst);
+    CHECK(mmu_memmove(dst + 1, dst, 3) == dst + 1);
+    CHECK(mmu_memset(dst + 6, 'q', 1) == dst + 6);
+    CHECK(mmu_memcmp(dst, "xxyzefq", 8) == 0);
+}
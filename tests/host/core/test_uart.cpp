@@ -0,0 +1,494 @@
+/*
+ test_uart.cpp - cores/esp8266/uart.cpp against emulated UART registers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <deque>
+#include <map>
+#include <string>
+#include <Arduino.h>
+#include <Schedule.h>
+#include <user_interface.h>
+#include <gdb_hooks.h>
+
+// The rest of the host build uses MockUART.cpp, so the uart.cpp functions
+// built here are renamed to hw_*.  Tests call them by their usual names.
+#define uart_ hw_uart_
+#define uart_t hw_uart_t
+#define uart_init hw_uart_init
+#define uart_uninit hw_uart_uninit
+#define uart_swap hw_uart_swap
+#define uart_set_tx hw_uart_set_tx
+#define uart_set_pins hw_uart_set_pins
+#define uart_tx_enabled hw_uart_tx_enabled
+#define uart_rx_enabled hw_uart_rx_enabled
+#define uart_set_baudrate hw_uart_set_baudrate
+#define uart_get_baudrate hw_uart_get_baudrate
+#define uart_resize_rx_buffer hw_uart_resize_rx_buffer
+#define uart_get_rx_buffer_size hw_uart_get_rx_buffer_size
+#define uart_resize_tx_buffer hw_uart_resize_tx_buffer
+#define uart_get_tx_buffer_size hw_uart_get_tx_buffer_size
+#define uart_write_char hw_uart_write_char
+#define uart_write hw_uart_write
+#define uart_read_char hw_uart_read_char
+#define uart_peek_char hw_uart_peek_char
+#define uart_read hw_uart_read
+#define uart_rx_available hw_uart_rx_available
+#define uart_tx_free hw_uart_tx_free
+#define uart_wait_tx_empty hw_uart_wait_tx_empty
+#define uart_flush hw_uart_flush
+#define uart_has_overrun hw_uart_has_overrun
+#define uart_has_rx_error hw_uart_has_rx_error
+#define uart_set_debug hw_uart_set_debug
+#define uart_get_debug hw_uart_get_debug
+#define uart_start_detect_baudrate hw_uart_start_detect_baudrate
+#define uart_detect_baudrate hw_uart_detect_baudrate
+#define uart_peek_available hw_uart_peek_available
+#define uart_peek_buffer hw_uart_peek_buffer
+#define uart_peek_consume hw_uart_peek_consume
+#define uart_get_bit_length hw_uart_get_bit_length
+#define uart_rx_frame_mode hw_uart_rx_frame_mode
+#define uart_rx_frame_set_callback hw_uart_rx_frame_set_callback
+#define uart_rx_frame_count hw_uart_rx_frame_count
+#define uart_rx_frame_available hw_uart_rx_frame_available
+#define uart_rx_frame_read hw_uart_rx_frame_read
+#define uart_rx_frame_peek_available hw_uart_rx_frame_peek_available
+#define uart_rx_frame_peek_buffer hw_uart_rx_frame_peek_buffer
+#define uart_rx_frame_peek_consume hw_uart_rx_frame_peek_consume
+#define uart_rx_frame_notify hw_uart_rx_frame_notify
+#define uart_isr hw_uart_isr
+#undef ESP_UART_H
+#include <uart.h>
+
+// the register definitions the host build leaves out
+#undef CORE_MOCK
+#undef ESP8266_PERI_H_INCLUDED
+#undef RANDOM_REG32
+#include "../../../cores/esp8266/esp8266_peri.h"
+#define CORE_MOCK 1
+
+namespace emu
+{
+
+// One UART as seen through its registers.  Bytes only leave the tx fifo
+// when the code under test waits, one character time per wait.
+struct Uart
+{
+    std::deque<uint8_t> txFifo, rxFifo;
+    std::string         wire;  // everything sent so far
+    uint32_t            latched = 0;  // interrupts raised, until cleared through USIC
+    std::map<uint32_t, uint32_t> regs;
+};
+
+Uart     uarts[2];
+bool     intrEnabled = true;
+bool     inIsr       = false;
+void (*isr)(void*, void*) = nullptr;
+uint32_t other[0x1000];  // every register that is not a UART one
+
+uint32_t& stored(int nr, uint32_t offset)
+{
+    return uarts[nr].regs[offset];
+}
+
+uint32_t raw(int nr)
+{
+    Uart&    u     = uarts[nr];
+    uint32_t conf1 = stored(nr, 0x024);
+    uint32_t bits  = u.latched;
+    if (u.txFifo.size() < ((conf1 >> UCFET) & 0x7f))
+        bits |= 1 << UIFE;
+    if (!u.rxFifo.empty() && u.rxFifo.size() >= ((conf1 >> UCFFT) & 0x7f))
+        bits |= 1 << UIFF;
+    return bits;
+}
+
+void runIsr()
+{
+    if (!intrEnabled || inIsr || !isr)
+        return;
+    for (int nr = 0; nr < 2; nr++)
+    {
+        if (raw(nr) & stored(nr, 0x00c))
+        {
+            inIsr = true;
+            isr(nullptr, nullptr);
+            inIsr = false;
+            return;
+        }
+    }
+}
+
+// one character time passes on both wires
+void tick()
+{
+    for (Uart& u : uarts)
+    {
+        if (!u.txFifo.empty())
+        {
+            u.wire += (char)u.txFifo.front();
+            u.txFifo.pop_front();
+        }
+    }
+    runIsr();
+}
+
+bool txFull(int nr)
+{
+    return uarts[nr].txFifo.size() >= 0x7f;
+}
+
+struct Reg
+{
+    uint32_t addr;
+
+    int      nr() const { return (addr >= 0xF00 && addr < 0xF80) ? 1 : 0; }
+    uint32_t offset() const { return addr - nr() * 0xF00; }
+    bool     isUart() const { return addr < 0x80 || (addr >= 0xF00 && addr < 0xF80); }
+
+    operator uint32_t() const
+    {
+        if (!isUart())
+            return other[(addr / 4) % 0x1000];
+        Uart& u = uarts[nr()];
+        switch (offset())
+        {
+        case 0x000:  // USF
+        {
+            if (u.rxFifo.empty())
+                return 0;
+            uint8_t c = u.rxFifo.front();
+            u.rxFifo.pop_front();
+            return c;
+        }
+        case 0x004:  // USIR
+            return raw(nr());
+        case 0x008:  // USIS
+            return raw(nr()) & stored(nr(), 0x00c);
+        case 0x01C:  // USS, a busy wait on a full fifo lets a character go out
+            if (txFull(nr()) && intrEnabled && !inIsr)
+                tick();
+            return (std::min<size_t>(u.rxFifo.size(), 0xff) << USRXC)
+                   | (std::min<size_t>(u.txFifo.size(), 0xff) << USTXC);
+        default:
+            return stored(nr(), offset());
+        }
+    }
+
+    Reg& operator=(uint32_t value)
+    {
+        if (!isUart())
+        {
+            other[(addr / 4) % 0x1000] = value;
+            return *this;
+        }
+        Uart& u = uarts[nr()];
+        switch (offset())
+        {
+        case 0x000:  // USF
+            REQUIRE(u.txFifo.size() < UART_TX_FIFO_SIZE);
+            u.txFifo.push_back(value);
+            break;
+        case 0x010:  // USIC
+            u.latched &= ~value;
+            break;
+        default:
+            stored(nr(), offset()) = value;
+        }
+        return *this;
+    }
+
+    // some masks are built as unsigned long
+    template <typename T>
+    Reg& operator|=(T value)
+    {
+        return *this = (uint32_t)((uint32_t) * this | value);
+    }
+    template <typename T>
+    Reg& operator&=(T value)
+    {
+        return *this = (uint32_t)((uint32_t) * this & value);
+    }
+};
+
+void intrDisable()
+{
+    intrEnabled = false;
+}
+
+void intrEnable()
+{
+    intrEnabled = true;
+    runIsr();
+}
+
+void intrAttach(void (*handler)(void*, void*))
+{
+    isr = handler;
+}
+
+// the callers are waiting for the wire, or might be
+void yield()
+{
+    tick();
+}
+
+void optimisticYield()
+{
+    if (txFull(0) || txFull(1))
+        tick();
+}
+
+void receive(int nr, const char* data)
+{
+    while (*data)
+        uarts[nr].rxFifo.push_back(*data++);
+    runIsr();
+}
+
+// the line has been idle for the rx timeout
+void idle(int nr)
+{
+    if (!uarts[nr].rxFifo.empty())
+        uarts[nr].latched |= 1 << UITO;
+    runIsr();
+}
+
+void reset()
+{
+    for (Uart& u : uarts)
+        u = Uart();
+    intrEnabled = true;
+    isr         = nullptr;
+}
+
+}  // namespace emu
+
+#undef ESP8266_REG
+#define ESP8266_REG(addr) (emu::Reg { (uint32_t)(addr) })
+// IOSWAP, set up by uart_init() on UART0
+#undef ESP8266_DREG
+#define ESP8266_DREG(addr) (emu::Reg { 0x10000 + (uint32_t)(addr) })
+#undef ETS_UART_INTR_DISABLE
+#define ETS_UART_INTR_DISABLE() emu::intrDisable()
+#undef ETS_UART_INTR_ENABLE
+#define ETS_UART_INTR_ENABLE() emu::intrEnable()
+#undef ETS_UART_INTR_ATTACH
+#define ETS_UART_INTR_ATTACH(func, arg) emu::intrAttach(func)
+#define esp_yield() emu::yield()
+#define optimistic_yield(us) emu::optimisticYield()
+
+#include "../../../cores/esp8266/uart.cpp"
+
+#undef esp_yield
+#undef optimistic_yield
+#undef ESP8266_REG
+#undef ESP8266_DREG
+
+// no gdbstub and no ROM printing in the host build
+extern "C"
+{
+    bool gdbstub_has_putc1_control(void)
+    {
+        return false;
+    }
+    void gdbstub_set_putc1_callback(void (*)(char)) { }
+    bool gdbstub_has_uart_isr_control(void)
+    {
+        return false;
+    }
+    void gdbstub_set_uart_isr_callback(void (*)(void*, uint8_t), void*) { }
+    void gdbstub_write_char(char) { }
+    void gdbstub_write(const char*, size_t) { }
+    void ets_install_putc1(fp_putc_t) { }
+    void system_set_os_print(uint8) { }
+    void uart_buff_switch(uint8_t) { }
+    int  uart_baudrate_detect(int, int)
+    {
+        return 0;
+    }
+}
+
+namespace
+{
+
+// bytes sent on the wire while f ran
+template <typename F>
+size_t sentDuring(int nr, F f)
+{
+    size_t before = emu::uarts[nr].wire.size();
+    f();
+    return emu::uarts[nr].wire.size() - before;
+}
+
+constexpr size_t fifoRoom = 0x7f;  // uart_tx_fifo_full() leaves one fifo slot free
+
+}  // namespace
+
+TEST_CASE("uart without tx buffer blocks on a full fifo", "[core][uart]")
+{
+    emu::reset();
+    uart_t* uart = uart_init(UART1, 115200, UART_8N1, UART_TX_ONLY, 2, 0, false);
+    REQUIRE(uart);
+    CHECK(uart_get_tx_buffer_size(uart) == 0);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE);
+
+    // every byte past a full fifo waits for one to go out, and the
+    // optimistic_yield() after the last one lets one more go
+    std::string data(1000, 'x');
+    CHECK(sentDuring(UART1, [&]() { CHECK(uart_write(uart, data.data(), data.size()) == 1000); })
+          == 1000 - fifoRoom + 1);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE - fifoRoom + 1);
+
+    uart_wait_tx_empty(uart);
+    CHECK(emu::uarts[UART1].wire == data);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE);
+    uart_uninit(uart);
+}
+
+TEST_CASE("uart tx buffer is drained by the tx-fifo-empty interrupt", "[core][uart]")
+{
+    emu::reset();
+    uart_t* uart = uart_init(UART1, 115200, UART_8N1, UART_TX_ONLY, 2, 0, false);
+    REQUIRE(uart);
+    REQUIRE(uart_resize_tx_buffer(uart, 2048) == 2048);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE - 1 + 2047);
+
+    std::string data;
+    for (int i = 0; i < 4096; i++)
+        data += (char)('a' + i % 26);
+
+    // the fifo and the buffer take it all without waiting
+    CHECK(sentDuring(UART1, [&]() { CHECK(uart_write(uart, data.data(), 1000) == 1000); }) == 0);
+    CHECK(emu::uarts[UART1].txFifo.size() == fifoRoom);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE - 1 + 2047 - 1000);
+    CHECK((emu::stored(UART1, 0x00c) & (1 << UIFE)) != 0);
+
+    // the interrupt tops up the fifo once it runs low, and stops when the buffer is empty
+    for (int i = 0; i < 100; i++)
+        emu::tick();
+    CHECK(emu::uarts[UART1].txFifo.size() >= 32);
+    uart_wait_tx_empty(uart);
+    CHECK(emu::uarts[UART1].wire == data.substr(0, 1000));
+    CHECK((emu::stored(UART1, 0x00c) & (1 << UIFE)) == 0);
+
+    // more than fits only waits for the overflow, and keeps the order
+    CHECK(sentDuring(UART1, [&]() { CHECK(uart_write(uart, data.data() + 1000, 3096) == 3096); })
+          == 3096 - fifoRoom - 2047);
+    CHECK(uart_write_char(uart, '!') == 1);
+    uart_wait_tx_empty(uart);
+    CHECK(emu::uarts[UART1].wire == data + '!');
+
+    // back to direct writes
+    CHECK(uart_resize_tx_buffer(uart, 0) == 0);
+    CHECK(uart_tx_free(uart) == UART_TX_FIFO_SIZE);
+    uart_uninit(uart);
+}
+
+TEST_CASE("uart tx buffer resize sends what is pending first", "[core][uart]")
+{
+    emu::reset();
+    uart_t* uart = uart_init(UART1, 115200, UART_8N1, UART_TX_ONLY, 2, 0, false);
+    REQUIRE(uart);
+    REQUIRE(uart_resize_tx_buffer(uart, 256) == 256);
+
+    std::string data(300, 'y');
+    uart_write(uart, data.data(), data.size());
+    REQUIRE(uart_resize_tx_buffer(uart, 64) == 64);
+    size_t inFifo = emu::uarts[UART1].txFifo.size();
+    CHECK(emu::uarts[UART1].wire.size() == 300 - inFifo);
+    CHECK(uart_tx_free(uart) == (UART_TX_FIFO_SIZE - 1 - inFifo) + 63);
+
+    // a size of 1 could never hold a byte
+    CHECK(uart_resize_tx_buffer(uart, 1) == 2);
+    uart_uninit(uart);
+}
+
+TEST_CASE("uart frame mode ends a frame at each rx timeout", "[core][uart]")
+{
+    emu::reset();
+    uart_t* uart = uart_init(UART0, 115200, UART_8N1, UART_FULL, 1, 64, false);
+    REQUIRE(uart);
+
+    // no frames without frame mode
+    CHECK(uart_rx_frame_peek_buffer(nullptr) == nullptr);
+    CHECK(uart_rx_frame_peek_buffer(uart) == nullptr);
+    CHECK(uart_rx_frame_peek_available(uart) == 0);
+
+    REQUIRE(uart_rx_frame_mode(uart, 4));
+    const uint32_t conf1 = emu::stored(UART0, 0x024);
+    CHECK(((conf1 >> UCTOT) & 0x7f) == 4);
+    CHECK((conf1 & (1UL << UCTOE)) != 0);
+
+    emu::receive(UART0, "hello");
+    CHECK(uart_rx_frame_count(uart) == 0);
+    emu::idle(UART0);
+    emu::receive(UART0, "world!");
+    emu::idle(UART0);
+    CHECK(uart_rx_frame_count(uart) == 2);
+    CHECK(uart_rx_frame_available(uart) == 5);
+
+    REQUIRE(uart_rx_frame_peek_available(uart) == 5);
+    CHECK(memcmp(uart_rx_frame_peek_buffer(uart), "hello", 5) == 0);
+    uart_rx_frame_peek_consume(uart, 5);
+    char buf[16];
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 6);
+    CHECK(memcmp(buf, "world!", 6) == 0);
+    CHECK(uart_rx_frame_count(uart) == 0);
+    uart_uninit(uart);
+}
+
+TEST_CASE("uart rx buffer resize keeps the frames it holds", "[core][uart]")
+{
+    emu::reset();
+    uart_t* uart = uart_init(UART0, 115200, UART_8N1, UART_FULL, 1, 64, false);
+    REQUIRE(uart);
+    REQUIRE(uart_rx_frame_mode(uart, 4));
+    char buf[16];
+
+    // a frame in progress, partly still in the fifo, goes on in the new buffer
+    emu::receive(UART0, "abc");
+    emu::idle(UART0);
+    emu::receive(UART0, "defgh");
+    emu::idle(UART0);
+    emu::receive(UART0, "ij");
+    REQUIRE(uart_resize_rx_buffer(uart, 128) == 128);
+    CHECK(uart_rx_frame_count(uart) == 2);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 3);
+    CHECK(memcmp(buf, "abc", 3) == 0);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 5);
+    CHECK(memcmp(buf, "defgh", 5) == 0);
+    emu::idle(UART0);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 2);
+    CHECK(memcmp(buf, "ij", 2) == 0);
+
+    // too small for what is there, the frame cut short ends with the new buffer
+    emu::receive(UART0, "abc");
+    emu::idle(UART0);
+    emu::receive(UART0, "defghij");
+    emu::idle(UART0);
+    REQUIRE(uart_resize_rx_buffer(uart, 8) == 8);
+    CHECK(uart_rx_frame_count(uart) == 2);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 3);
+    CHECK(memcmp(buf, "abc", 3) == 0);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 4);
+    CHECK(memcmp(buf, "defg", 4) == 0);
+
+    // and the next frames are counted from there
+    emu::receive(UART0, "xyz");
+    emu::idle(UART0);
+    CHECK(uart_rx_frame_count(uart) == 1);
+    REQUIRE(uart_rx_frame_read(uart, buf, sizeof(buf)) == 3);
+    CHECK(memcmp(buf, "xyz", 3) == 0);
+    uart_uninit(uart);
+}
@@ -16,6 +16,7 @@
 #include <catch.hpp>
 #include <map>
 #include <FS.h>
+#include <StreamString.h>
 #include "../common/spiffs_mock.h"
 #include "../common/littlefs_mock.h"
 #include "../common/sdfs_mock.h"
@@ -94,6 +95,101 @@ TEST_CASE("LittleFS checks the config object passed in", "[fs]")
     REQUIRE(LittleFS.setConfig(l));
 }
 
+TEST_CASE("LittleFS maps read-only file data", "[fs]")
+{
+    LITTLEFS_MOCK_DECLARE(64, 8, 512, "");
+    REQUIRE(LittleFS.begin());
+    String big;
+    while (big.length() < 20000) {
+        big += String(big.length()) + ",";
+    }
+    File f = LittleFS.open("/big.txt", "w");
+    REQUIRE(f.print(big) == big.length());
+    FileExtent extent;
+    REQUIRE_FALSE(f.mapExtent(extent));  // Writable, data may still be in RAM
+    f.close();
+    createFile("/small.txt", "inline");
+
+    // Walk the extents, they must cover the whole file
+    f = LittleFS.open("/big.txt", "r");
+    String mapped;
+    int    extents = 0;
+    while (f.mapExtent(extent)) {
+        REQUIRE(extent.len > 0);
+        mapped.concat((const char*)extent.addr, extent.len);
+        REQUIRE(f.seek(extent.len, SeekCur));
+        extents++;
+    }
+    REQUIRE(mapped == big);
+    REQUIRE(extents >= 3);  // 8KB blocks
+
+    // read() and Stream::send() go through the mapping
+    REQUIRE(f.seek(100, SeekSet));
+    char buf[10];
+    REQUIRE(f.read((uint8_t*)buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(!memcmp(buf, big.c_str() + 100, sizeof(buf)));
+    // a single read() spans block boundaries and fills the whole request
+    REQUIRE(f.seek(0, SeekSet));
+    std::unique_ptr<char[]> all(new char[big.length()]);
+    REQUIRE(f.read((uint8_t*)all.get(), big.length()) == big.length());
+    REQUIRE(!memcmp(all.get(), big.c_str(), big.length()));
+    REQUIRE(f.read((uint8_t*)buf, sizeof(buf)) == 0);
+    REQUIRE(f.seek(0, SeekSet));
+    REQUIRE(f.hasPeekBufferAPI());
+    StreamString out;
+    REQUIRE(f.sendAll(out) == big.length());
+    REQUIRE(out == big);
+    f.close();
+
+    // Handles open for update read what they wrote, not the block it was copied from
+    f = LittleFS.open("/big.txt", "r+");
+    REQUIRE_FALSE(f.mapExtent(extent));
+    REQUIRE(f.seek(9000, SeekSet));
+    REQUIRE(f.write((const uint8_t*)"XXXXXXXX", 8) == 8);
+    REQUIRE(f.seek(8990, SeekSet));
+    REQUIRE(f.read((uint8_t*)buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(!memcmp(buf, big.c_str() + 8990, sizeof(buf)));
+    REQUIRE(f.read((uint8_t*)buf, 8) == 8);
+    REQUIRE(!memcmp(buf, "XXXXXXXX", 8));
+    f.close();
+
+    // Fallback for inline files
+    f = LittleFS.open("/small.txt", "r");
+    REQUIRE_FALSE(f.mapExtent(extent));
+    REQUIRE_FALSE(f.hasPeekBufferAPI());
+    REQUIRE(f.readString() == "inline");
+}
+
+TEST_CASE("LittleFS rejects bad buffer geometry and works with every profile", "[fs]")
+{
+    LITTLEFS_MOCK_DECLARE(64, 8, 512, "");
+    REQUIRE_FALSE(LittleFS.setConfig(LittleFSConfig().setCacheSize(100)));
+    REQUIRE_FALSE(LittleFS.setConfig(LittleFSConfig().setLookaheadSize(12)));
+    REQUIRE_FALSE(LittleFS.setConfig(LittleFSConfig().setReadSize(48)));
+
+    for (auto profile : { LittleFSConfig::LowRAM, LittleFSConfig::Balanced, LittleFSConfig::Throughput }) {
+        LittleFS.end();
+        REQUIRE(LittleFS.setConfig(LittleFSConfig().setProfile(profile)));
+        REQUIRE(LittleFS.format());
+        REQUIRE(LittleFS.begin());
+        String big;
+        for (int i = 0; i < 1000; i++) {
+            big += String(i) + ",";
+        }
+        File f = LittleFS.open("/big.txt", "w");
+        REQUIRE(f.print(big) == big.length());
+        f.close();
+        REQUIRE(LittleFS.open("/big.txt", "r").readString() == big);
+        // Remount to make sure nothing stale is served from the block cache
+        LittleFS.end();
+        REQUIRE(LittleFS.begin());
+        f = LittleFS.open("/big.txt", "a");
+        f.print("end");
+        f.close();
+        REQUIRE(LittleFS.open("/big.txt", "r").readString() == big + "end");
+    }
+}
+
 };  // namespace littlefs_test
 
 namespace sdfs_test
@@ -134,6 +230,70 @@ TEST_CASE("SDFS checks the config object passed in", "[fs]")
     REQUIRE_FALSE(SDFS.setConfig(l));
 }
 
+TEST_CASE("SDFS read-ahead/write-behind cache", "[fs]")
+{
+    SDFS_MOCK_DECLARE(64, 8, 512, "");
+    REQUIRE(SDFS.setConfig(SDFSConfig().setAutoFormat(true).setCacheSectors(4)));
+    REQUIRE(SDFS.begin());
+    FSCacheStats stats;
+    REQUIRE(SDFS.cacheStats(stats, true));
+
+    File f = SDFS.open("/log.txt", "w");
+    REQUIRE(f);
+    char line[32];
+    for (int i = 0; i < 500; i++) {
+        snprintf(line, sizeof(line), "record %05d\n", i);
+        REQUIRE(f.write(line, strlen(line)) == strlen(line));
+    }
+    // Pending data is visible before the flush
+    REQUIRE(f.size() == 500 * 13);
+    REQUIRE(f.position() == 500 * 13);
+    f.close();
+    REQUIRE(SDFS.cacheStats(stats, true));
+    REQUIRE(stats.writeHits > 400);
+    REQUIRE(stats.writeFlushes >= 3);
+
+    f = SDFS.open("/log.txt", "r");
+    REQUIRE(f.size() == 500 * 13);
+    for (int i = 0; i < 500; i++) {
+        snprintf(line, sizeof(line), "record %05d\n", i);
+        char buf[13];
+        REQUIRE(f.read((uint8_t*)buf, sizeof(buf)) == sizeof(buf));
+        REQUIRE(!memcmp(buf, line, sizeof(buf)));
+    }
+    REQUIRE(f.read() == -1);
+    REQUIRE(SDFS.cacheStats(stats));
+    REQUIRE(stats.readMisses >= 3);
+    REQUIRE(stats.readHits > 400);
+    REQUIRE(f.seek(13 * 250, SeekSet));
+    REQUIRE(f.readStringUntil('\n') == "record 00250");
+    REQUIRE_FALSE(f.seek(500 * 13 + 1, SeekSet));
+    f.close();
+
+    // Overwrite in the middle, then read it back through the same handle
+    f = SDFS.open("/log.txt", "r+");
+    REQUIRE(f.seek(13 * 100, SeekSet));
+    REQUIRE(f.write("RECORD", 6) == 6);
+    REQUIRE(f.seek(13 * 100, SeekSet));
+    REQUIRE(f.readStringUntil('\n') == "RECORD 00100");
+    f.close();
+    REQUIRE(readFile("/log.txt").length() == 500 * 13);
+
+    // Growing the file keeps the logical position, not the one the read-ahead left on the card
+    f = SDFS.open("/log.txt", "r+");
+    char buf[10];
+    REQUIRE(f.read((uint8_t*)buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(f.truncate(500 * 13 + 1000));
+    REQUIRE(f.position() == sizeof(buf));
+    REQUIRE(f.readStringUntil('\n') == "00");
+    // and shrinking it below the position moves it to the new end
+    REQUIRE(f.truncate(5));
+    REQUIRE(f.position() == 5);
+    REQUIRE(f.read() == -1);
+    f.close();
+    REQUIRE(readFile("/log.txt") == "recor");
+}
+
 // Also a SD specific test to check that FILE_OPEN is really an append operation:
 
 TEST_CASE("SD.h FILE_WRITE macro is append", "[fs]")
@@ -0,0 +1,86 @@
+/*
+ test_littlefs_perf.cpp - host side LittleFS buffer geometry benchmark
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+// Hidden by default, run with:  bin/host_tests "[benchmark]"
+
+#include <catch.hpp>
+#include <chrono>
+#include <FS.h>
+#include "../common/littlefs_mock.h"
+#include <LittleFS.h>
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+double elapsedMs(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+void runBench(const char* label, const LittleFSConfig& cfg)
+{
+    constexpr size_t fileSize  = 256 * 1024;
+    constexpr size_t chunkSize = 64;
+
+    LittleFS.end();
+    REQUIRE(LittleFS.setConfig(cfg));
+    REQUIRE(LittleFS.format());
+
+    FSCacheStats stats;
+    uint8_t       chunk[chunkSize];
+    for (size_t i = 0; i < chunkSize; i++)
+        chunk[i] = i;
+
+    auto start = clock_type::now();
+    REQUIRE(LittleFS.begin());
+    double mountMs = elapsedMs(start);
+
+    start  = clock_type::now();
+    File f = LittleFS.open("/bench.bin", "w");
+    for (size_t i = 0; i < fileSize; i += chunkSize)
+        REQUIRE(f.write(chunk, chunkSize) == chunkSize);
+    f.close();
+    double writeMs = elapsedMs(start);
+
+    LittleFS.end();
+    REQUIRE(LittleFS.begin());
+    LittleFS.cacheStats(stats, true);
+    start = clock_type::now();
+    f     = LittleFS.open("/bench.bin", "r");
+    for (size_t i = 0; i < fileSize; i += chunkSize)
+        REQUIRE(f.read(chunk, chunkSize) == chunkSize);
+    f.close();
+    double readMs = elapsedMs(start);
+
+    LittleFS.cacheStats(stats);
+    printf("%-12s mount %7.3f ms  write %7.2f MB/s  read %7.2f MB/s  flash reads %6u (line "
+           "hits %u)\n",
+           label, mountMs, fileSize / writeMs / 1000.0, fileSize / readMs / 1000.0,
+           stats.readMisses + stats.bypasses, stats.readHits);
+}
+
+}  // namespace
+
+TEST_CASE("LittleFS sequential throughput vs. buffer geometry", "[.][benchmark]")
+{
+    LITTLEFS_MOCK_DECLARE(1024, 8, 512, "");
+    runBench("LowRAM", LittleFSConfig().setProfile(LittleFSConfig::LowRAM));
+    runBench("Balanced", LittleFSConfig().setProfile(LittleFSConfig::Balanced));
+    runBench("cache=256", LittleFSConfig().setCacheSize(256));
+    runBench("cache=512", LittleFSConfig().setCacheSize(512).setLookaheadSize(128));
+    runBench("Throughput", LittleFSConfig().setProfile(LittleFSConfig::Throughput));
+    runBench("Thru,nolines", LittleFSConfig().setProfile(LittleFSConfig::Throughput).setBlockCacheLines(0));
+}
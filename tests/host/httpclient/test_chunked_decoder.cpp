@@ -0,0 +1,298 @@
+/*
+ test_chunked_decoder.cpp - HTTPClient chunked transfer and gzip decoding tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ESP8266HTTPClient.h>
+#include <StreamString.h>
+
+namespace
+{
+
+// A server reply handed out in the given pieces, each one being what a
+// single read from the network returns.  Requests are dropped.
+class ScriptedClient : public WiFiClient
+{
+public:
+    explicit ScriptedClient(std::vector<std::string> pieces) :
+        _reply(std::make_shared<std::deque<std::string>>(pieces.begin(), pieces.end()))
+    {
+        drop();
+    }
+
+    int connect(IPAddress, uint16_t) override
+    {
+        return 1;
+    }
+    int connect(const char*, uint16_t) override
+    {
+        return 1;
+    }
+    int connect(const String&, uint16_t) override
+    {
+        return 1;
+    }
+    uint8_t connected() override
+    {
+        return !_reply->empty();
+    }
+    int available() override
+    {
+        return _reply->empty() ? 0 : _reply->front().size();
+    }
+    int read() override
+    {
+        if (_reply->empty())
+        {
+            return -1;
+        }
+        int c = (uint8_t)_reply->front()[0];
+        peekConsume(1);
+        return c;
+    }
+    int read(uint8_t* buf, size_t size) override
+    {
+        size_t n = std::min(size, (size_t)available());
+        memcpy(buf, peekBuffer(), n);
+        peekConsume(n);
+        return n;
+    }
+    int peek() override
+    {
+        return _reply->empty() ? -1 : (uint8_t)_reply->front()[0];
+    }
+    bool hasPeekBufferAPI() const override
+    {
+        return true;
+    }
+    size_t peekAvailable() override
+    {
+        return available();
+    }
+    const char* peekBuffer() override
+    {
+        return _reply->empty() ? nullptr : _reply->front().data();
+    }
+    void peekConsume(size_t consume) override
+    {
+        _reply->front().erase(0, consume);
+        drop();
+    }
+    int availableForWrite() override
+    {
+        return 1460;
+    }
+    size_t write(uint8_t) override
+    {
+        return 1;
+    }
+    size_t write(const uint8_t*, size_t size) override
+    {
+        return size;
+    }
+    void stop() override
+    {
+        _reply->clear();
+    }
+    std::unique_ptr<WiFiClient> clone() const override
+    {
+        return std::unique_ptr<WiFiClient>(new ScriptedClient(*this));
+    }
+
+private:
+    void drop()
+    {
+        while (!_reply->empty() && _reply->front().empty())
+        {
+            _reply->pop_front();
+        }
+    }
+
+    std::shared_ptr<std::deque<std::string>> _reply;
+};
+
+const std::string chunkedHeader = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+
+// body of the reply cut into pieces of every size from 1 to the whole of it
+std::vector<std::vector<std::string>> splits(const std::string& header, const std::string& body)
+{
+    std::vector<std::vector<std::string>> all;
+    for (size_t size = 1; size <= body.size(); size++)
+    {
+        std::vector<std::string> pieces { header };
+        for (size_t i = 0; i < body.size(); i += size)
+        {
+            pieces.push_back(body.substr(i, size));
+        }
+        all.push_back(pieces);
+    }
+    return all;
+}
+
+struct Result
+{
+    int         code;
+    int         written;
+    std::string body;
+};
+
+Result get(const std::vector<std::string>& pieces, bool gzip = false)
+{
+    ScriptedClient client(pieces);
+    HTTPClient     http;
+    StreamString   out;
+    Result         result;
+    http.setTimeout(50);
+    http.setReuse(false);
+    http.setAcceptGzip(gzip);
+    REQUIRE(http.begin(client, "http://example.com/"));
+    result.code    = http.GET();
+    result.written = http.writeToStream(&out);
+    result.body    = out.c_str();
+    return result;
+}
+
+// "The quick brown fox jumps over the lazy dog. " * 20, gzip -9
+const uint8_t foxGzip[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x0b, 0xc9, 0x48, 0x55, 0x28,
+    0x2c, 0xcd, 0x4c, 0xce, 0x56, 0x48, 0x2a, 0xca, 0x2f, 0xcf, 0x53, 0x48, 0xcb, 0xaf, 0x50,
+    0xc8, 0x2a, 0xcd, 0x2d, 0x28, 0x56, 0xc8, 0x2f, 0x4b, 0x2d, 0x52, 0x28, 0x01, 0x4a, 0xe7,
+    0x24, 0x56, 0x55, 0x2a, 0xa4, 0xe4, 0xa7, 0xeb, 0x29, 0x84, 0x8c, 0x2a, 0x1e, 0x55, 0x3c,
+    0xaa, 0x98, 0xda, 0x8a, 0x01, 0xe6, 0x4a, 0x66, 0xb0, 0x84, 0x03, 0x00, 0x00,
+};
+
+std::string fox()
+{
+    std::string text;
+    for (int i = 0; i < 20; i++)
+    {
+        text += "The quick brown fox jumps over the lazy dog. ";
+    }
+    return text;
+}
+
+// data sent as chunks of at most size bytes
+std::string chunked(const std::string& data, size_t size)
+{
+    std::string body;
+    char        line[16];
+    for (size_t i = 0; i < data.size(); i += size)
+    {
+        std::string chunk = data.substr(i, size);
+        snprintf(line, sizeof(line), "%zx\r\n", chunk.size());
+        body += line + chunk + "\r\n";
+    }
+    return body + "0\r\n\r\n";
+}
+
+}  // namespace
+
+TEST_CASE("Chunked bodies are decoded however the reads split them", "[httpclient][chunked]")
+{
+    const std::string body = "4\r\nWiki\r\n5\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n"
+                             "00a\r\n0123456789\r\n0\r\n\r\n";
+    for (auto& pieces : splits(chunkedHeader, body))
+    {
+        CAPTURE(pieces.size());
+        Result r = get(pieces);
+        CHECK(r.code == 200);
+        CHECK(r.written == 33);
+        CHECK(r.body == "Wikipedia in\r\n\r\nchunks.0123456789");
+    }
+}
+
+TEST_CASE("Chunk extensions are skipped", "[httpclient][chunked]")
+{
+    const std::string body = "4;name=value\r\nWiki\r\n5 ; quoted=\"a;b\"\r\npedia\r\n"
+                             "3\t;x\r\n!!!\r\n0;last\r\n\r\n";
+    for (auto& pieces : splits(chunkedHeader, body))
+    {
+        CAPTURE(pieces.size());
+        Result r = get(pieces);
+        CHECK(r.written == 12);
+        CHECK(r.body == "Wikipedia!!!");
+    }
+}
+
+TEST_CASE("Trailers end the body", "[httpclient][chunked]")
+{
+    const std::string body = "5\r\nhello\r\n0\r\nExpires: never\r\nX-Checksum: 1234\r\n\r\n";
+    // a pipelined reply behind the trailers is not part of the body
+    const std::string next = "HTTP/1.1 204 No Content\r\n\r\n";
+    for (auto& pieces : splits(chunkedHeader, body + next))
+    {
+        CAPTURE(pieces.size());
+        Result r = get(pieces);
+        CHECK(r.written == 5);
+        CHECK(r.body == "hello");
+    }
+}
+
+TEST_CASE("Malformed chunk framing is an encoding error", "[httpclient][chunked]")
+{
+    const char* bodies[] = {
+        "zz\r\nabc\r\n0\r\n\r\n",          // not hex
+        "\r\nabc\r\n0\r\n\r\n",            // no size at all
+        ";ext\r\nabc\r\n0\r\n\r\n",        // extension without a size
+        "3\r\nabcd\r\n0\r\n\r\n",          // chunk longer than its size
+        "3\rxabc\r\n0\r\n\r\n",            // CR not followed by LF
+        "fffffffff\r\nabc\r\n0\r\n\r\n",   // size overflow
+    };
+    for (const char* body : bodies)
+    {
+        CAPTURE(body);
+        for (auto& pieces : splits(chunkedHeader, body))
+        {
+            CHECK(get(pieces).written == HTTPC_ERROR_ENCODING);
+        }
+    }
+}
+
+TEST_CASE("Truncated chunked bodies report the lost connection", "[httpclient][chunked]")
+{
+    Result r = get({ chunkedHeader, "a\r\n01234" });
+    CHECK(r.written == HTTPC_ERROR_CONNECTION_LOST);
+}
+
+TEST_CASE("Gzip content in chunked transfer is inflated", "[httpclient][chunked][gzip]")
+{
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+                               "Transfer-Encoding: chunked\r\n\r\n";
+    const std::string gz((const char*)foxGzip, sizeof(foxGzip));
+
+    // chunk boundaries and read boundaries falling anywhere in the gzip stream
+    for (size_t chunk : { 1, 7, 16, 73 })
+    {
+        for (auto& pieces : splits(header, chunked(gz, chunk)))
+        {
+            CAPTURE(chunk);
+            CAPTURE(pieces.size());
+            Result r = get(pieces, true);
+            CHECK(r.written == (int)fox().size());
+            CHECK(r.body == fox());
+        }
+    }
+
+    // the gzip stream cut short by the end of the chunks
+    std::string cut = chunked(gz.substr(0, 40), 16);
+    CHECK(get({ header, cut }, true).written == HTTPC_ERROR_DECOMPRESSION);
+
+    // bad framing reported as such, not as a decompression failure
+    std::string bad = chunked(gz.substr(0, 20), 20);
+    bad.replace(0, 2, "zz");
+    CHECK(get({ header, bad }, true).written == HTTPC_ERROR_ENCODING);
+}
@@ -0,0 +1,254 @@
+/*
+ test_connection_pool.cpp - HTTPClient keep-alive connection pool tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <ESP8266HTTPClient.h>
+
+namespace
+{
+
+// an established connection as far as the pool can tell
+class FakeClient : public WiFiClient
+{
+public:
+    explicit FakeClient(int id, int* stops = nullptr) : id(id), stops(stops) { }
+
+    uint8_t connected() override
+    {
+        return open;
+    }
+    int available() override
+    {
+        return pending;
+    }
+    void stop() override
+    {
+        open = false;
+        if (stops)
+        {
+            ++*stops;
+        }
+    }
+    std::unique_ptr<WiFiClient> clone() const override
+    {
+        return std::unique_ptr<WiFiClient>(new FakeClient(*this));
+    }
+    IPAddress remoteIP() override
+    {
+        return ip;
+    }
+    uint16_t remotePort() override
+    {
+        return peerPort;
+    }
+
+    int       id;
+    int*      stops;
+    bool      open     = true;
+    int       pending  = 0;
+    IPAddress ip       = IPAddress(192, 168, 4, 2);
+    uint16_t  peerPort = 80;
+};
+
+struct Pool : public HTTPConnectionPool
+{
+    using HTTPConnectionPool::makeKey;
+    using HTTPConnectionPool::park;
+    using HTTPConnectionPool::take;
+
+    static void park(const String& key, WiFiClient* client)
+    {
+        std::unique_ptr<WiFiClient> owned(client);
+        HTTPConnectionPool::park(key, owned);
+    }
+
+    static int takeId(const String& key)
+    {
+        std::unique_ptr<WiFiClient> client = take(key);
+        return client ? static_cast<FakeClient*>(client.get())->id : -1;
+    }
+};
+
+void reset(uint8_t maxPerHost, uint8_t maxTotal, uint32_t idleMs = 30000)
+{
+    Pool::setLimits(maxPerHost, maxTotal);
+    Pool::clear();
+    Pool::setIdleTimeout(idleMs);
+    Pool::resetStats();
+}
+
+}  // namespace
+
+TEST_CASE("Pool hands parked connections back for the same key only", "[httpclient][pool]")
+{
+    reset(2, 4);
+    WiFiClient owner, otherOwner;
+    String     key = Pool::makeKey("https", "example.com", 443, owner.instanceId());
+
+    Pool::park(key, new FakeClient(1));
+    CHECK(Pool::idle() == 1);
+    CHECK(Pool::stats().parked == 1);
+
+    // Other port, scheme, host, or a connection made by another WiFiClient
+    CHECK(Pool::takeId(Pool::makeKey("https", "example.com", 8443, owner.instanceId())) == -1);
+    CHECK(Pool::takeId(Pool::makeKey("http", "example.com", 443, owner.instanceId())) == -1);
+    CHECK(Pool::takeId(Pool::makeKey("https", "example.org", 443, owner.instanceId())) == -1);
+    CHECK(Pool::takeId(Pool::makeKey("https", "example.com", 443, otherOwner.instanceId())) == -1);
+    CHECK(Pool::stats().misses == 4);
+
+    CHECK(Pool::takeId(key) == 1);
+    CHECK(Pool::stats().hits == 1);
+    CHECK(Pool::idle() == 0);
+    CHECK(Pool::takeId(key) == -1);
+
+    Pool::setLimits(2, 0);
+}
+
+TEST_CASE("Pool takes the most recently parked healthy connection", "[httpclient][pool]")
+{
+    reset(3, 4);
+    WiFiClient owner;
+    String     key = Pool::makeKey("http", "h", 80, owner.instanceId());
+    int        stops = 0;
+
+    Pool::park(key, new FakeClient(1, &stops));
+    Pool::park(key, new FakeClient(2, &stops));
+    CHECK(Pool::takeId(key) == 2);
+
+    // Closed by the server or with unread data while parked
+    auto closed  = new FakeClient(3, &stops);
+    auto chatty  = new FakeClient(4, &stops);
+    Pool::park(key, closed);
+    Pool::park(key, chatty);
+    closed->open    = false;
+    chatty->pending = 5;
+    CHECK(Pool::takeId(key) == 1);
+    CHECK(Pool::stats().unhealthy == 2);
+    CHECK(stops == 2);
+
+    // Unhealthy connections are not parked at all
+    auto stale = new FakeClient(5, &stops);
+    stale->pending = 1;
+    Pool::park(key, stale);
+    CHECK(Pool::idle() == 0);
+
+    Pool::setLimits(2, 0);
+}
+
+TEST_CASE("Pool closes connections idle for longer than the timeout", "[httpclient][pool]")
+{
+    reset(2, 4, 20);
+    WiFiClient owner;
+    String     key   = Pool::makeKey("http", "h", 80, owner.instanceId());
+    int        stops = 0;
+
+    Pool::park(key, new FakeClient(1, &stops));
+    CHECK(Pool::idle() == 1);
+    delay(30);
+    CHECK(Pool::idle() == 0);
+    CHECK(Pool::stats().expired == 1);
+    CHECK(stops == 1);
+
+    Pool::park(key, new FakeClient(2, &stops));
+    delay(30);
+    CHECK(Pool::takeId(key) == -1);
+    CHECK(Pool::stats().expired == 2);
+
+    Pool::setLimits(2, 0);
+}
+
+TEST_CASE("Pool respects maxPerHost and maxTotal", "[httpclient][pool]")
+{
+    reset(2, 3);
+    WiFiClient owner;
+    String     a     = Pool::makeKey("http", "a", 80, owner.instanceId());
+    String     b     = Pool::makeKey("http", "b", 80, owner.instanceId());
+    int        stops = 0;
+
+    // A third connection to the same host replaces the oldest one
+    Pool::park(a, new FakeClient(1, &stops));
+    Pool::park(a, new FakeClient(2, &stops));
+    Pool::park(a, new FakeClient(3, &stops));
+    CHECK(Pool::idle() == 2);
+    CHECK(Pool::stats().evicted == 1);
+    CHECK(stops == 1);
+
+    // Over the total, the oldest connection overall goes
+    Pool::park(b, new FakeClient(4, &stops));
+    Pool::park(b, new FakeClient(5, &stops));
+    CHECK(Pool::idle() == 3);
+    CHECK(Pool::stats().evicted == 2);
+    CHECK(Pool::takeId(a) == 3);
+    CHECK(Pool::takeId(a) == -1);
+    CHECK(Pool::takeId(b) == 5);
+    CHECK(Pool::takeId(b) == 4);
+
+    // 0 disables the pool and closes what it holds
+    Pool::park(a, new FakeClient(6, &stops));
+    Pool::setLimits(2, 0);
+    CHECK(Pool::idle() == 0);
+    CHECK(stops == 3);
+}
+
+TEST_CASE("Pool keys on the identity of the client, not its address", "[httpclient][pool]")
+{
+    reset(2, 4);
+
+    // Copies are the same client, a copy of the settings is another one
+    WiFiClient owner;
+    WiFiClient copy(owner);
+    CHECK(copy.instanceId() == owner.instanceId());
+    CHECK(owner.clone()->instanceId() == owner.instanceId());
+    owner.setTimeout(1234);
+    auto settings = owner.cloneSettings();
+    CHECK(settings->instanceId() != owner.instanceId());
+    CHECK(settings->getTimeout() == 1234);
+    CHECK_FALSE(settings->connected());
+
+    // A client created where a destroyed one was does not get its connections
+    auto*  gone = new WiFiClient;
+    String key  = Pool::makeKey("http", "h", 80, gone->instanceId());
+    delete gone;
+    Pool::park(key, new FakeClient(1));
+    auto* next = new WiFiClient;
+    CHECK(Pool::takeId(Pool::makeKey("http", "h", 80, next->instanceId())) == -1);
+    delete next;
+    CHECK(Pool::takeId(key) == 1);
+
+    Pool::setLimits(2, 0);
+}
+
+TEST_CASE("Pool drops connections which talk to another peer than when parked", "[httpclient][pool]")
+{
+    reset(2, 4);
+    WiFiClient owner;
+    String     key   = Pool::makeKey("https", "a", 443, owner.instanceId());
+    int        stops = 0;
+
+    auto moved = new FakeClient(1, &stops);
+    moved->peerPort = 443;
+    Pool::park(key, moved);
+    auto other = new FakeClient(2, &stops);
+    other->peerPort = 443;
+    Pool::park(key, other);
+
+    // Reconnected to another host by whoever shares it, the pool leaves it open
+    other->ip = IPAddress(192, 168, 4, 3);
+    moved->peerPort = 8443;
+    CHECK(Pool::takeId(key) == -1);
+    CHECK(Pool::stats().unhealthy == 2);
+    CHECK(stops == 0);
+
+    Pool::setLimits(2, 0);
+}
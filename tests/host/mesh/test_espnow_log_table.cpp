@@ -0,0 +1,160 @@
+/*
+ test_espnow_log_table.cpp - ESP-NOW log table tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <map>
+#include <string>
+#include <EspnowLogTable.h>
+
+namespace
+{
+
+// counts live values, to check that every stored value is destroyed exactly once
+struct Entry
+{
+    static int live;
+
+    explicit Entry(uint32_t created) : created(created) { ++live; }
+    Entry(const Entry& other) : created(other.created) { ++live; }
+    ~Entry() { --live; }
+
+    uint32_t    created;
+    std::string payload = std::string(40, 'x');  // heap allocated
+};
+int Entry::live = 0;
+
+// like macAndType_td: MAC << 8 | message type
+enum class MacAndType : uint64_t
+{
+};
+
+struct MacOf
+{
+    uint64_t operator()(MacAndType macAndType) const
+    {
+        return static_cast<uint64_t>(macAndType) >> 8;
+    }
+};
+
+using Log = EspnowLogTable<uint64_t, Entry>;
+
+}  // namespace
+
+TEST_CASE("EspnowLogTable insert, find and erase", "[mesh]")
+{
+    {
+        Log log(4);
+        CHECK(log.find({ 1, 1 }) == nullptr);
+
+        Entry* entry = log.insert({ 1, 1 }, Entry(10));
+        REQUIRE(entry != nullptr);
+        CHECK(entry->created == 10);
+        CHECK(log.insert({ 1, 1 }, Entry(20))->created == 10);
+        CHECK(log.size() == 1);
+
+        log.insert({ 1, 2 }, Entry(11));
+        log.insert({ 2, 1 }, Entry(12));
+        CHECK(log.find({ 2, 1 })->created == 12);
+        CHECK(log.erase({ 1, 1 }));
+        CHECK_FALSE(log.erase({ 1, 1 }));
+        CHECK(log.find({ 1, 1 }) == nullptr);
+        CHECK(log.size() == 2);
+        CHECK(Entry::live == 2);
+    }
+    CHECK(Entry::live == 0);
+}
+
+TEST_CASE("EspnowLogTable replaces the oldest entry when full", "[mesh]")
+{
+    Log log(3);
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        REQUIRE(log.insert({ 7, i }, Entry(i)) != nullptr);
+    }
+    CHECK(log.size() == 3);
+    CHECK(log.find({ 7, 1 }) == nullptr);
+    CHECK(log.find({ 7, 2 })->created == 2);
+    CHECK(log.find({ 7, 4 })->created == 4);
+    CHECK(Entry::live == 3);
+
+    log.setCapacity(2);
+    CHECK(log.empty());
+    CHECK(Entry::live == 0);
+    log.insert({ 7, 9 }, Entry(9));
+    CHECK(log.capacity() == 2);
+}
+
+TEST_CASE("EspnowLogTable expiry stops at the first active entry", "[mesh]")
+{
+    Log log(16);
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        log.insert({ i % 3, i }, Entry(i * 100));
+    }
+
+    const uint32_t now     = 1000;
+    size_t         visited = 0;
+    auto           check   = [&](const Log::key_type&, const Entry& entry)
+    {
+        ++visited;
+        return now - entry.created > 550 ? LogEntryStatus::EXPIRED
+                                         : LogEntryStatus::ALL_REMAINING_ACTIVE;
+    };
+
+    CHECK(log.eraseExpired(check) == 5);
+    CHECK(visited == 6);
+    CHECK(log.find({ 1, 4 }) == nullptr);
+    CHECK(log.find({ 2, 5 })->created == 500);
+
+    visited = 0;
+    CHECK(log.eraseExpired(check) == 0);
+    CHECK(visited == 1);
+
+    CHECK(log.eraseIf([](const Log::key_type& key, const Entry&) { return key.second % 2; }) == 3);
+    CHECK(log.size() == 2);
+}
+
+TEST_CASE("EspnowLogTable deletion by peer MAC", "[mesh]")
+{
+    EspnowLogTable<MacAndType, Entry, MacOf> log(64);
+    std::map<uint64_t, int>                  perMac;
+
+    for (uint32_t i = 0; i < 60; i++)
+    {
+        uint64_t mac  = 0x5ccf7fc3ad00 + i % 6;
+        char     type = "QAB"[i % 3];
+        REQUIRE(log.insert({ MacAndType(mac << 8 | type), i }, Entry(i)) != nullptr);
+        perMac[mac]++;
+    }
+
+    // only entries with odd message IDs
+    CHECK(log.eraseByPeerMac(0x5ccf7fc3ad01, [](const std::pair<MacAndType, uint64_t>& key, const Entry&)
+                             { return key.second & 1; })
+          == 10);
+    CHECK(log.eraseByPeerMac(0x5ccf7fc3ad02, [](const std::pair<MacAndType, uint64_t>&, const Entry&)
+                             { return true; })
+          == 10);
+    CHECK(log.eraseByPeerMac(0x5ccf7fc3ad02, [](const std::pair<MacAndType, uint64_t>&, const Entry&)
+                             { return true; })
+          == 0);
+    CHECK(log.eraseByPeerMac(0x123456789abc, [](const std::pair<MacAndType, uint64_t>&, const Entry&)
+                             { return true; })
+          == 0);
+    CHECK(log.size() == 40);
+    CHECK(log.find({ MacAndType(0x5ccf7fc3ad03ULL << 8 | 'Q'), 3 })->created == 3);
+
+    log.clear();
+    CHECK(log.empty());
+    CHECK(Entry::live == 0);
+}
@@ -0,0 +1,221 @@
+/*
+ test_message_data.cpp - ESP-NOW message reassembly tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <string>
+#include <vector>
+#include <MessageData.h>
+#include <EspnowProtocolInterpreter.h>
+
+// The real interpreter reaches into EspnowTransmitter for the encryption
+// setting, these are what it returns for unencrypted messages.
+namespace EspnowProtocolInterpreter
+{
+uint8_t metadataSize()
+{
+    return protocolBytesSize;
+}
+uint32_t getMaxBytesPerTransmission()
+{
+    return 250;
+}
+uint32_t getMaxMessageBytesPerTransmission()
+{
+    return getMaxBytesPerTransmission() - metadataSize();
+}
+uint8_t getTransmissionsRemaining(const uint8_t* transmissionDataArray)
+{
+    return (transmissionDataArray[transmissionsRemainingIndex] & 0x7F);
+}
+}  // namespace EspnowProtocolInterpreter
+
+namespace
+{
+
+using EspnowProtocolInterpreter::getMaxMessageBytesPerTransmission;
+using EspnowProtocolInterpreter::protocolBytesSize;
+
+// binary, with null bytes, so nothing is treated as a string on the way
+std::string payload(size_t length)
+{
+    std::string data(length, '\0');
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = (char)(i * 7 + i / 251);
+    }
+    return data;
+}
+
+// the transmissions espnowSendToNode makes of data
+std::vector<std::vector<uint8_t>> split(const std::string& data)
+{
+    size_t count = (data.size() + getMaxMessageBytesPerTransmission() - 1)
+                   / getMaxMessageBytesPerTransmission();
+    std::vector<std::vector<uint8_t>> transmissions;
+    for (size_t i = 0; i < count; i++)
+    {
+        std::string part = data.substr(i * getMaxMessageBytesPerTransmission(),
+                                       getMaxMessageBytesPerTransmission());
+        std::vector<uint8_t> transmission(protocolBytesSize, 0);
+        transmission[EspnowProtocolInterpreter::messageTypeIndex] = 'Q';
+        transmission[EspnowProtocolInterpreter::transmissionsRemainingIndex]
+            = (count - i - 1) | (i == 0 ? 0x80 : 0);
+        transmission.insert(transmission.end(), part.begin(), part.end());
+        transmissions.push_back(transmission);
+    }
+    return transmissions;
+}
+
+MessageData start(std::vector<uint8_t>& transmission)
+{
+    return MessageData(transmission.data(), transmission.size(), 0);
+}
+
+bool add(MessageData& message, std::vector<uint8_t>& transmission)
+{
+    return message.addToMessage(transmission.data(), transmission.size());
+}
+
+std::string contents(const MessageData& message)
+{
+    return std::string((const char*)message.getTotalMessageBytes(),
+                       message.getTotalMessageLength());
+}
+
+}  // namespace
+
+TEST_CASE("MessageData reassembles transmissions arriving out of order", "[mesh][messagedata]")
+{
+    // longer than what is allocated up front, so the buffer grows on the way
+    std::string data = payload(4 * getMaxMessageBytesPerTransmission() + 17);
+    auto        parts = split(data);
+    REQUIRE(parts.size() == 5);
+
+    MessageData message = start(parts[0]);
+    CHECK(message.getTransmissionsExpected() == 5);
+    CHECK(message.getTransmissionsReceived() == 1);
+
+    for (int i : { 4, 2, 1 })
+    {
+        CHECK(add(message, parts[i]));
+        CHECK_FALSE(message.isComplete());
+        CHECK(message.getTotalMessageLength() == 0);
+    }
+    CHECK(message.getTransmissionsRemaining() == 1);
+    CHECK(add(message, parts[3]));
+
+    REQUIRE(message.isComplete());
+    CHECK(message.getTotalMessageLength() == data.size());
+    CHECK(contents(message) == data);
+    CHECK(message.getTotalMessage().length() == data.size());
+}
+
+TEST_CASE("MessageData ignores duplicate and malformed transmissions", "[mesh][messagedata]")
+{
+    std::string data  = payload(2 * getMaxMessageBytesPerTransmission() + 1);
+    auto        parts = split(data);
+    MessageData message = start(parts[0]);
+
+    // the sender did not get our ack and sent it again
+    CHECK_FALSE(add(message, parts[0]));
+    CHECK(add(message, parts[2]));
+    CHECK_FALSE(add(message, parts[2]));
+    CHECK(message.getTransmissionsReceived() == 2);
+
+    // a transmission that is not the last must be full
+    auto shortPart = parts[1];
+    shortPart.pop_back();
+    CHECK_FALSE(add(message, shortPart));
+
+    // beyond the message, or too short to hold the protocol bytes
+    auto outside = parts[1];
+    outside[EspnowProtocolInterpreter::transmissionsRemainingIndex] = 3;
+    CHECK_FALSE(add(message, outside));
+    std::vector<uint8_t> stub(parts[1].begin(), parts[1].begin() + protocolBytesSize - 1);
+    CHECK_FALSE(add(message, stub));
+
+    CHECK(message.getTransmissionsRemaining() == 1);
+    CHECK(add(message, parts[1]));
+    REQUIRE(message.isComplete());
+    CHECK(contents(message) == data);
+}
+
+TEST_CASE("MessageData tracks every transmission of the longest message", "[mesh][messagedata]")
+{
+    std::string data  = payload(128 * getMaxMessageBytesPerTransmission());
+    auto        parts = split(data);
+    REQUIRE(parts.size() == 128);
+
+    MessageData message = start(parts[0]);
+    // every other transmission first, as after a first round that lost half of them
+    for (int i = 127; i > 0; i -= 2)
+    {
+        CHECK(add(message, parts[i]));
+    }
+    CHECK(message.getTransmissionsReceived() == 65);
+    for (size_t i = 1; i < 128; i += 2)
+    {
+        CHECK_FALSE(add(message, parts[i]));
+    }
+    for (size_t i = 2; i < 128; i += 2)
+    {
+        CHECK(add(message, parts[i]));
+    }
+    REQUIRE(message.isComplete());
+    CHECK(contents(message) == data);
+}
+
+TEST_CASE("MessageData refuses messages longer than the receive limit", "[mesh][messagedata]")
+{
+    auto parts = split(payload(5 * getMaxMessageBytesPerTransmission()));
+
+    MessageData::setMaxTransmissionsPerMessage(4);
+    CHECK_FALSE(MessageData::acceptsMessage(parts[0].data()));
+    MessageData message = start(parts[0]);
+    CHECK(message.getTotalMessageBytes() == nullptr);
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        CHECK_FALSE(add(message, parts[i]));
+    }
+    CHECK_FALSE(message.isComplete());
+
+    MessageData::setMaxTransmissionsPerMessage(5);
+    CHECK(MessageData::acceptsMessage(parts[0].data()));
+    MessageData::setMaxTransmissionsPerMessage(128);
+}
+
+TEST_CASE("TransmissionBitmap set, clear and count", "[mesh][messagedata]")
+{
+    TransmissionBitmap bits;
+    CHECK(bits.count() == 0);
+
+    for (uint8_t i : { 0, 7, 8, 63, 127 })
+    {
+        CHECK(bits.set(i));
+        CHECK_FALSE(bits.set(i));
+    }
+    CHECK(bits.count() == 5);
+    for (uint8_t i = 0; i < 128; i++)
+    {
+        CHECK(bits.test(i) == (i == 0 || i == 7 || i == 8 || i == 63 || i == 127));
+    }
+
+    // what a retransmission round does with the ones acked this time
+    CHECK(bits.clear(8));
+    CHECK_FALSE(bits.clear(8));
+    CHECK_FALSE(bits.clear(9));
+    CHECK(bits.count() == 4);
+    CHECK_FALSE(bits.test(8));
+    CHECK(bits.test(7));
+}
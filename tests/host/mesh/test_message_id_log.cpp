@@ -0,0 +1,264 @@
+/*
+ test_message_id_log.cpp - FloodingMesh message ID log tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <chrono>
+#include <map>
+#include <queue>
+#include <vector>
+#include <MessageIdLog.h>
+
+namespace
+{
+
+// message IDs as FloodingMesh builds them: origin MAC << 16 | per-node counter
+uint64_t messageId(uint64_t mac, uint16_t counter)
+{
+    return mac << 16 | counter;
+}
+
+// the containers MessageIdLog replaced, for comparison
+class MapLog
+{
+public:
+    explicit MapLog(size_t capacity) : capacity(capacity) { }
+
+    uint8_t* insert(uint64_t id, uint8_t value, bool& inserted)
+    {
+        auto result = ids.emplace(id, value);
+        inserted = result.second;
+        if (inserted)
+        {
+            order.push(result.first);
+            if (order.size() > capacity)
+            {
+                ids.erase(order.front());
+                order.pop();
+            }
+        }
+        return &result.first->second;
+    }
+
+    uint8_t* find(uint64_t id)
+    {
+        auto it = ids.find(id);
+        return it == ids.end() ? nullptr : &it->second;
+    }
+
+private:
+    size_t capacity;
+    std::map<uint64_t, uint8_t> ids;
+    std::queue<std::map<uint64_t, uint8_t>::iterator> order;
+};
+
+}  // namespace
+
+TEST_CASE("MessageIdLog insert and find", "[mesh]")
+{
+    MessageIdLog log(3);
+    bool inserted = false;
+
+    REQUIRE(log.capacity() == 3);
+    CHECK(log.find(1) == nullptr);
+
+    uint8_t* value = log.insert(1, 0, inserted);
+    REQUIRE(value != nullptr);
+    CHECK(inserted);
+    *value = 7;
+
+    value = log.insert(1, 0, inserted);
+    CHECK_FALSE(inserted);
+    CHECK(*value == 7);
+    CHECK(*log.find(1) == 7);
+    CHECK(log.size() == 1);
+
+    log.clear();
+    CHECK(log.size() == 0);
+    CHECK(log.find(1) == nullptr);
+}
+
+TEST_CASE("MessageIdLog forgets the oldest IDs first", "[mesh]")
+{
+    MessageIdLog log(4);
+    bool inserted = false;
+
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        log.insert(messageId(0x5ccf7fc3ad51, i), i, inserted);
+        CHECK(inserted);
+        CHECK(log.size() == (i < 4 ? i + 1 : 4));
+    }
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        uint8_t* value = log.find(messageId(0x5ccf7fc3ad51, i));
+        if (i < 6)
+        {
+            CHECK(value == nullptr);
+        }
+        else
+        {
+            REQUIRE(value != nullptr);
+            CHECK(*value == i);
+        }
+    }
+
+    // a duplicate does not refresh the age of an ID
+    log.insert(messageId(0x5ccf7fc3ad51, 6), 0, inserted);
+    CHECK_FALSE(inserted);
+    log.insert(messageId(0x5ccf7fc3ad51, 10), 10, inserted);
+    CHECK(log.find(messageId(0x5ccf7fc3ad51, 6)) == nullptr);
+    CHECK(log.find(messageId(0x5ccf7fc3ad51, 7)) != nullptr);
+}
+
+TEST_CASE("MessageIdLog capacity changes keep the newest IDs", "[mesh]")
+{
+    MessageIdLog log(8);
+    bool inserted = false;
+
+    for (uint16_t i = 0; i < 12; i++)
+    {
+        log.insert(i, i, inserted);
+    }
+    REQUIRE(log.setCapacity(3));
+    CHECK(log.size() == 3);
+    CHECK(log.find(8) == nullptr);
+    CHECK(*log.find(9) == 9);
+    CHECK(*log.find(11) == 11);
+
+    REQUIRE(log.setCapacity(100));
+    CHECK(log.size() == 3);
+    log.insert(12, 12, inserted);
+    CHECK(*log.find(9) == 9);
+    CHECK(*log.find(12) == 12);
+}
+
+TEST_CASE("MessageIdLog matches std::map under churn", "[mesh]")
+{
+    // colliding IDs from a handful of nodes stress probing and backward shift deletion
+    const uint64_t macs[] = { 0x5ccf7fc3ad51, 0x5ccf7fc3ad52, 0x18fe34a1b2c3, 0x000000000001 };
+
+    for (uint16_t capacity : { 1, 2, 7, 100, 257 })
+    {
+        MessageIdLog log(capacity);
+        MapLog       reference(capacity);
+        uint32_t     seed = 12345;
+
+        for (int step = 0; step < 20000; step++)
+        {
+            seed          = seed * 1103515245 + 12345;
+            uint64_t id   = messageId(macs[(seed >> 8) % 4], (seed >> 16) % (3 * capacity + 5));
+            bool     ours = false, theirs = false;
+            uint8_t* a    = log.insert(id, step & 0xff, ours);
+            uint8_t* b    = reference.insert(id, step & 0xff, theirs);
+            REQUIRE(ours == theirs);
+            REQUIRE(*a == *b);
+            if (!ours && *a < 255)
+            {
+                ++*a;
+                ++*b;
+            }
+        }
+
+        for (uint16_t counter = 0; counter < 3 * capacity + 5; counter++)
+        {
+            for (uint64_t mac : macs)
+            {
+                uint8_t* a = log.find(messageId(mac, counter));
+                uint8_t* b = reference.find(messageId(mac, counter));
+                REQUIRE((a == nullptr) == (b == nullptr));
+                if (a)
+                {
+                    CHECK(*a == *b);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("MessageIdLog insert and lookup rates", "[.][benchmark]")
+{
+    using clock_type    = std::chrono::steady_clock;
+    constexpr int total = 1000000;
+
+    // a steady stream of new messages from 10 nodes, then looked up again as redundant receptions
+    // of remembered IDs and as late receptions of forgotten ones
+    std::vector<uint64_t> ids(total);
+    for (int i = 0; i < total; i++)
+    {
+        ids[i] = messageId(0x5ccf7fc3ad00 + i % 10, i / 10);
+    }
+
+    auto rate = [](clock_type::time_point start, int operations)
+    {
+        double s = std::chrono::duration<double>(clock_type::now() - start).count();
+        return operations / s / 1e6;
+    };
+
+    printf("%6s %18s %18s %18s %18s\n", "size", "insert Mops/s", "lookup Mops/s", "map insert", "map lookup");
+    for (uint16_t size : { 100, 500, 1000, 2000 })
+    {
+        MessageIdLog log(size);
+        MapLog       reference(size);
+        bool         inserted = false;
+        size_t       found    = 0;
+        const int    rounds   = total / size;
+
+        auto start = clock_type::now();
+        for (int i = 0; i < total; i++)
+        {
+            log.insert(ids[i], 0, inserted);
+        }
+        double insertRate = rate(start, total);
+
+        start = clock_type::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (int i = total - size; i < total; i++)
+            {
+                found += log.find(ids[i]) != nullptr;
+            }
+            for (int i = 0; i < size; i++)
+            {
+                found += log.find(ids[i]) != nullptr;
+            }
+        }
+        double lookupRate = rate(start, 2 * rounds * size);
+        CHECK(found == size_t(rounds) * size);
+
+        start = clock_type::now();
+        for (int i = 0; i < total; i++)
+        {
+            reference.insert(ids[i], 0, inserted);
+        }
+        double mapInsertRate = rate(start, total);
+
+        start = clock_type::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (int i = total - size; i < total; i++)
+            {
+                found += reference.find(ids[i]) != nullptr;
+            }
+            for (int i = 0; i < size; i++)
+            {
+                found += reference.find(ids[i]) != nullptr;
+            }
+        }
+        double mapLookupRate = rate(start, 2 * rounds * size);
+        CHECK(found == 2u * rounds * size);
+
+        printf("%6u %18.1f %18.1f %18.1f %18.1f\n", size, insertRate, lookupRate, mapInsertRate,
+               mapLookupRate);
+    }
+}
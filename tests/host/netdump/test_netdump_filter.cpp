@@ -0,0 +1,187 @@
+/*
+ test_netdump_filter.cpp - Netdump compiled packet filter tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <NetdumpFilter.h>
+
+using NetCapture::FilterProgram;
+
+namespace
+{
+
+/*
+    capture.pcap, ethernet frames:
+    0  ARP who-has 10.0.0.5 tell 10.0.0.1
+    1  IPv4 TCP 10.0.0.5:80 > 10.0.0.7:51000
+    2  IPv4 TCP 10.0.0.7:51000 > 10.0.0.5:80
+    3  IPv4 UDP 10.0.0.7:5353 > 224.0.0.251:5353
+    4  IPv4 UDP 10.0.0.1:53 > 10.0.0.7:40000
+    5  IPv4 ICMP 10.0.0.7 > 8.8.8.8
+    6  IPv6 TCP fe80::1:443 > fe80::2:50000
+    7  IPv4 TCP 10.0.0.5 > 10.0.0.7, non-first fragment (bytes look like port 80)
+    8  802.1Q IPv4 UDP 192.168.1.10:123 > 192.168.1.1:123
+    9  IPv6 ICMPv6 fe80::1 > ff02::1
+    frames 1, 5, 6, 7, 8, 9 are from 5c:cf:7f:c3:ad:51
+*/
+using Frames = std::vector<std::string>;
+
+const Frames& capture()
+{
+    static Frames frames;
+    if (frames.empty())
+    {
+        std::string   path = std::string(__FILE__);
+        std::ifstream in(path.substr(0, path.find_last_of('/') + 1) + "capture.pcap",
+                         std::ios::binary);
+        REQUIRE(in);
+        char header[24];
+        in.read(header, sizeof(header));
+        uint32_t record[4];
+        while (in.read(reinterpret_cast<char*>(record), sizeof(record)))
+        {
+            std::string frame(record[2], '\0');
+            in.read(&frame[0], record[2]);
+            frames.push_back(frame);
+        }
+    }
+    return frames;
+}
+
+// frame numbers matching expr, as a string like "1 2 7"
+std::string matching(const char* expr)
+{
+    FilterProgram prog;
+    REQUIRE(prog.compile(expr));
+    std::string out;
+    for (size_t i = 0; i < capture().size(); i++)
+    {
+        const std::string& f = capture()[i];
+        if (prog.match(reinterpret_cast<const uint8_t*>(f.data()), f.size()))
+        {
+            out += (out.empty() ? "" : " ") + std::to_string(i);
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+TEST_CASE("Netdump filter protocols", "[netdump]")
+{
+    REQUIRE(capture().size() == 10);
+    CHECK(matching("") == "0 1 2 3 4 5 6 7 8 9");
+    CHECK(matching("arp") == "0");
+    CHECK(matching("ip") == "1 2 3 4 5 7 8");
+    CHECK(matching("ip6") == "6 9");
+    CHECK(matching("tcp") == "1 2 6 7");
+    CHECK(matching("udp") == "3 4 8");
+    CHECK(matching("icmp") == "5");
+    CHECK(matching("icmp6") == "9");
+}
+
+TEST_CASE("Netdump filter addresses and ports", "[netdump]")
+{
+    CHECK(matching("host 10.0.0.5") == "0 1 2 7");
+    CHECK(matching("ip host 10.0.0.5") == "1 2 7");
+    CHECK(matching("src host 10.0.0.5") == "1 7");
+    CHECK(matching("dst 10.0.0.5") == "0 2");
+    CHECK(matching("src and dst net 10.0.0.0/24") == "0 1 2 4 7");
+    CHECK(matching("net 192.168.0.0/16") == "8");
+    CHECK(matching("net 0.0.0.0/0 and not arp") == "1 2 3 4 5 7 8");
+    CHECK(matching("port 80") == "1 2");
+    CHECK(matching("tcp port 80") == "1 2");
+    CHECK(matching("udp port 80") == "");
+    CHECK(matching("tcp src port 80") == "1");
+    CHECK(matching("port 443") == "6");
+    CHECK(matching("udp portrange 100-6000") == "3 8");
+    CHECK(matching("ether src 5c:cf:7f:c3:ad:51") == "1 5 6 7 8 9");
+    CHECK(matching("ether dst host ff:ff:ff:ff:ff:ff") == "0");
+}
+
+TEST_CASE("Netdump filter boolean operators and length", "[netdump]")
+{
+    CHECK(matching("tcp port 80 and host 10.0.0.5") == "1 2");
+    CHECK(matching("udp and not port 53") == "3 8");
+    CHECK(matching("!(tcp || udp)") == "0 5 9");
+    CHECK(matching("arp or icmp or icmp6") == "0 5 9");
+    CHECK(matching("tcp and (src 10.0.0.7 or dst 10.0.0.7)") == "1 2 7");
+    CHECK(matching("not not arp") == "0");
+    CHECK(matching("less 60") == "0 3 7");
+    CHECK(matching("greater 80") == "4 8");
+    CHECK(matching("len == 42") == "0");
+    CHECK(matching("len > 42 and len < 62") == "3 7");
+}
+
+TEST_CASE("Netdump filter syntax errors", "[netdump]")
+{
+    FilterProgram prog;
+    CHECK_FALSE(prog.compile("tcp port"));
+    CHECK_FALSE(prog.valid());
+    CHECK(prog.errorOffset() == 8);
+    CHECK_FALSE(prog.compile("host 10.0.0.256"));
+    CHECK(prog.errorOffset() == 5);
+    CHECK_FALSE(prog.compile("(tcp"));
+    CHECK_FALSE(prog.compile("tcp udp"));
+    CHECK_FALSE(prog.compile("icmp port 7"));
+    CHECK_FALSE(prog.compile("net 10.0.0.0/33"));
+    CHECK_FALSE(prog.compile("portrange 20-10"));
+    CHECK_FALSE(prog.compile("ether host 01:02:03"));
+    CHECK_FALSE(prog.compile("ip6 host 10.0.0.1"));
+    CHECK_FALSE(prog.compile("tcp port 80 $"));
+    CHECK(prog.error() != nullptr);
+
+    std::string deep;
+    for (int i = 0; i < 40; i++)
+    {
+        deep += "tcp or (";
+    }
+    deep += "udp";
+    deep += std::string(40, ')');
+    CHECK_FALSE(prog.compile(deep.c_str()));
+
+    CHECK(prog.compile("  tcp  "));
+    CHECK(prog.valid());
+    CHECK(prog.size() == 1);
+}
+
+TEST_CASE("Netdump filter per-packet cost", "[.][benchmark]")
+{
+    using clock_type          = std::chrono::steady_clock;
+    const char* const exprs[] = { "tcp", "tcp port 80 and host 10.0.0.5",
+                                  "not arp and (udp portrange 100-6000 or net 192.168.0.0/16)",
+                                  "ether src 5c:cf:7f:c3:ad:51 and less 100" };
+    constexpr int rounds = 200000;
+
+    for (const char* expr : exprs)
+    {
+        FilterProgram prog(expr);
+        REQUIRE(prog.valid());
+        size_t hits  = 0;
+        auto   start = clock_type::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (const std::string& f : capture())
+            {
+                hits += prog.match(reinterpret_cast<const uint8_t*>(f.data()), f.size());
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+        printf("%-60s %2zu words %6.1f ns/packet (%zu hits)\n", expr, prog.size(),
+               ns / (rounds * capture().size()), hits);
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ test_asset_bundle.cpp - parsing of bundles built by tools/mkassetbundle.py
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <MD5Builder.h>
+#include <libb64/cencode.h>
+#include <detail/AssetBundle.h>
+
+// generated by the Makefile from webserver/bundle/ and from a directory of numbered files
+#include "test_bundle.h"
+#include "test_bundle_many.h"
+
+using esp8266webserver::AssetBundle;
+
+namespace
+{
+
+std::string fixture(const char* path)
+{
+    std::ifstream f(std::string("webserver/bundle") + path, std::ios::binary);
+    REQUIRE(f.good());
+    return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+// same ETag as calcETag() computes for a file
+std::string eTagOf(const char* data, size_t len)
+{
+    uint8_t     md5[16];
+    MD5Builder  builder;
+    builder.begin();
+    builder.add((const uint8_t*)data, len);
+    builder.calculate();
+    builder.getBytes(md5);
+
+    char                encoded[32];
+    base64_encodestate  state;
+    base64_init_encodestate_nonewlines(&state);
+    int n = base64_encode_block((const char*)md5, sizeof(md5), encoded, &state);
+    n += base64_encode_blockend(encoded + n, &state);
+    return "\"" + std::string(encoded, n) + "\"";
+}
+
+}  // namespace
+
+TEST_CASE("AssetBundle parses the packer header and table", "[webserver][bundle]")
+{
+    AssetBundle bundle(test_bundle);
+    REQUIRE(bundle.valid());
+    // 6 files, plus "/" and "/docs/" for the index pages
+    CHECK(bundle.count() == 8);
+
+    const auto* header = reinterpret_cast<const esp8266webserver::AssetBundleHeader*>(test_bundle);
+    CHECK(header->magic == AssetBundle::MAGIC);
+    CHECK(header->version == AssetBundle::VERSION);
+    CHECK(header->size == sizeof(test_bundle));
+
+    // the table is sorted so that the binary search can find every entry
+    const auto* entries = reinterpret_cast<const esp8266webserver::AssetBundleEntry*>(header + 1);
+    for (size_t i = 1; i < bundle.count(); ++i)
+    {
+        CHECK(strcmp((const char*)test_bundle + entries[i - 1].path,
+                     (const char*)test_bundle + entries[i].path)
+              < 0);
+    }
+    for (size_t i = 0; i < bundle.count(); ++i)
+    {
+        CHECK((entries[i].data + entries[i].len) <= header->size);
+        CHECK((entries[i].data % 4) == 0);
+    }
+}
+
+TEST_CASE("AssetBundle finds assets with their content type and body", "[webserver][bundle]")
+{
+    AssetBundle        bundle(test_bundle);
+    AssetBundle::Asset asset;
+
+    REQUIRE(bundle.find("/tiny.txt", asset));
+    CHECK(strcmp(asset.contentType, "text/plain") == 0);
+    // gzip would make it bigger, it is stored as is
+    CHECK_FALSE(asset.gzip);
+    CHECK(std::string(asset.data, asset.len) == fixture("/tiny.txt"));
+    CHECK(asset.eTag == eTagOf(asset.data, asset.len));
+
+    REQUIRE(bundle.find("/img/dot.png", asset));
+    CHECK(strcmp(asset.contentType, "image/png") == 0);
+    REQUIRE(bundle.find("/data.bin", asset));
+    CHECK(strcmp(asset.contentType, "application/octet-stream") == 0);
+    CHECK(std::string(asset.data, asset.len) == fixture("/data.bin"));
+
+    REQUIRE(bundle.find("/index.html", asset));
+    CHECK(strcmp(asset.contentType, "text/html") == 0);
+    REQUIRE(asset.gzip);
+    CHECK(asset.len < fixture("/index.html").size());
+    CHECK((uint8_t)asset.data[0] == 0x1f);
+    CHECK((uint8_t)asset.data[1] == 0x8b);
+    // the ETag is that of the stored body
+    CHECK(asset.eTag == eTagOf(asset.data, asset.len));
+
+    // index pages are also served for their directory, sharing the body
+    const char*        indexData = asset.data;
+    AssetBundle::Asset dir;
+    REQUIRE(bundle.find("/", dir));
+    CHECK(dir.data == indexData);
+    REQUIRE(bundle.find("/docs/", dir));
+    REQUIRE(bundle.find("/docs/index.htm", asset));
+    CHECK(dir.data == asset.data);
+
+    CHECK_FALSE(bundle.find("/missing.html", asset));
+    CHECK_FALSE(bundle.find("/index", asset));
+    CHECK_FALSE(bundle.find("/docs", asset));
+    CHECK_FALSE(bundle.find("", asset));
+}
+
+TEST_CASE("AssetBundle rejects images it cannot parse", "[webserver][bundle]")
+{
+    CHECK_FALSE(AssetBundle(nullptr).valid());
+
+    // bundles must be 4-byte aligned
+    std::vector<uint8_t> copy(sizeof(test_bundle) + 4);
+    uint8_t*             aligned = copy.data() + (-(uintptr_t)copy.data() & 3);
+    memcpy(aligned + 1, test_bundle, sizeof(test_bundle));
+    CHECK_FALSE(AssetBundle(aligned + 1).valid());
+
+    memcpy(aligned, test_bundle, sizeof(test_bundle));
+    CHECK(AssetBundle(aligned).valid());
+    aligned[0] ^= 0xff;
+    CHECK_FALSE(AssetBundle(aligned).valid());
+    aligned[0] ^= 0xff;
+    aligned[4] = AssetBundle::VERSION + 1;
+    CHECK_FALSE(AssetBundle(aligned).valid());
+}
+
+TEST_CASE("AssetBundle looks up every asset of a large bundle", "[webserver][bundle]")
+{
+    AssetBundle bundle(test_bundle_many);
+    REQUIRE(bundle.valid());
+    REQUIRE(bundle.count() == 300);
+
+    AssetBundle::Asset asset;
+    for (int i = 0; i < 300; ++i)
+    {
+        std::string path = "/f" + std::to_string(i) + ".txt";
+        REQUIRE(bundle.find(path.c_str(), asset));
+        CHECK(std::string(asset.data, asset.len) == "asset " + std::to_string(i) + "\n");
+    }
+    CHECK_FALSE(bundle.find("/f300.txt", asset));
+    CHECK_FALSE(bundle.find("/a", asset));
+    CHECK_FALSE(bundle.find("/z", asset));
+}
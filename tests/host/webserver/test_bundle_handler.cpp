@@ -0,0 +1,190 @@
+/*
+ test_bundle_handler.cpp - ESP8266WebServer::serveBundle() requests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <map>
+#include <string>
+#include <ESP8266WebServer.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// generated by the Makefile from webserver/bundle/
+#include "test_bundle.h"
+
+using esp8266webserver::AssetBundle;
+
+namespace
+{
+
+constexpr uint16_t port = 28266;
+
+struct Response
+{
+    int                                status = 0;
+    std::map<std::string, std::string> headers;
+    std::string                        body;
+
+    bool has(const char* name) const
+    {
+        return headers.count(name) != 0;
+    }
+};
+
+// one request on its own connection, answered by the handler registered in server
+Response request(ESP8266WebServer& server, const std::string& method, const std::string& path,
+                 const std::string& extraHeaders = std::string())
+{
+    int         sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::connect(sock, (sockaddr*)&addr, sizeof(addr)) == 0);
+
+    std::string head = method + " " + path + " HTTP/1.1\r\nHost: esp8266\r\n" + extraHeaders
+                       + "Connection: close\r\n\r\n";
+    REQUIRE(::send(sock, head.data(), head.size(), 0) == (ssize_t)head.size());
+
+    // the request is already there, the server reads and answers it in a few rounds
+    std::string raw;
+    Response    response;
+    size_t      end  = std::string::npos;
+    bool        done = false;
+    for (int i = 0; i < 100 && !done; ++i)
+    {
+        server.handleClient();
+        char    buf[512];
+        ssize_t n;
+        while ((n = ::recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        {
+            raw.append(buf, n);
+        }
+        end = raw.find("\r\n\r\n");
+        if (end == std::string::npos)
+        {
+            continue;
+        }
+        REQUIRE(raw.compare(0, 9, "HTTP/1.1 ") == 0);
+        response.status = std::stoi(raw.substr(9, 3));
+        response.headers.clear();
+        for (size_t line = raw.find("\r\n") + 2; line < end;)
+        {
+            size_t eol   = raw.find("\r\n", line);
+            size_t colon = raw.find(": ", line);
+            REQUIRE(colon < eol);
+            response.headers[raw.substr(line, colon - line)] = raw.substr(colon + 2, eol - colon - 2);
+            line                                             = eol + 2;
+        }
+        size_t length = 0;
+        if ((method != "HEAD") && (response.status != 304) && response.has("Content-Length"))
+        {
+            length = std::stoul(response.headers["Content-Length"]);
+        }
+        done = raw.size() >= end + 4 + length;
+    }
+    ::close(sock);
+    REQUIRE(done);
+    response.body = raw.substr(end + 4);
+
+    // let the server see the connection go
+    for (int i = 0; i < 3; ++i)
+    {
+        server.handleClient();
+    }
+    return response;
+}
+
+AssetBundle::Asset asset(const char* path)
+{
+    AssetBundle::Asset asset;
+    REQUIRE(AssetBundle(test_bundle).find(path, asset));
+    return asset;
+}
+
+}  // namespace
+
+TEST_CASE("serveBundle() answers GET and HEAD from the bundle", "[webserver][bundle]")
+{
+    ESP8266WebServer server(port);
+    server.serveBundle("/static", test_bundle, "max-age=600");
+    server.begin();
+
+    // stored as is
+    auto     tiny     = asset("/tiny.txt");
+    Response response = request(server, "GET", "/static/tiny.txt");
+    CHECK(response.status == 200);
+    CHECK(response.headers["Content-Type"] == "text/plain");
+    CHECK(response.headers["Content-Length"] == std::to_string(tiny.len));
+    CHECK(response.headers["ETag"] == tiny.eTag);
+    CHECK(response.headers["Cache-Control"] == "max-age=600");
+    CHECK_FALSE(response.has("Content-Encoding"));
+    CHECK(response.body == std::string(tiny.data, tiny.len));
+
+    // precompressed, the gzip body goes out untouched with its encoding
+    auto index = asset("/index.html");
+    REQUIRE(index.gzip);
+    response = request(server, "GET", "/static/index.html");
+    CHECK(response.status == 200);
+    CHECK(response.headers["Content-Type"] == "text/html");
+    CHECK(response.headers["Content-Encoding"] == "gzip");
+    CHECK(response.headers["Content-Length"] == std::to_string(index.len));
+    CHECK(response.body == std::string(index.data, index.len));
+
+    // the directory serves its index page
+    response = request(server, "GET", "/static/");
+    CHECK(response.status == 200);
+    CHECK(response.headers["ETag"] == index.eTag);
+    CHECK(response.body == std::string(index.data, index.len));
+
+    // same headers for HEAD, without the body
+    response = request(server, "HEAD", "/static/index.html");
+    CHECK(response.status == 200);
+    CHECK(response.headers["Content-Encoding"] == "gzip");
+    CHECK(response.headers["Content-Length"] == std::to_string(index.len));
+    CHECK(response.headers["ETag"] == index.eTag);
+    CHECK(response.body.empty());
+
+    // not in the bundle, or outside of its uri
+    CHECK(request(server, "GET", "/static/missing.html").status == 404);
+    CHECK(request(server, "GET", "/tiny.txt").status == 404);
+    CHECK(request(server, "POST", "/static/tiny.txt").status == 404);
+}
+
+TEST_CASE("serveBundle() answers a matching If-None-Match with 304", "[webserver][bundle]")
+{
+    ESP8266WebServer server(port);
+    server.serveBundle("/", test_bundle);
+    server.begin();
+
+    auto     css      = asset("/style.css");
+    Response response = request(server, "GET", "/style.css",
+                                std::string("If-None-Match: ") + css.eTag + "\r\n");
+    CHECK(response.status == 304);
+    CHECK(response.body.empty());
+
+    // another asset's tag, or none, gets the body
+    auto tiny = asset("/tiny.txt");
+    response  = request(server, "GET", "/style.css",
+                        std::string("If-None-Match: ") + tiny.eTag + "\r\n");
+    CHECK(response.status == 200);
+    CHECK(response.headers["ETag"] == css.eTag);
+    CHECK_FALSE(response.has("Cache-Control"));
+    CHECK(response.body == std::string(css.data, css.len));
+
+    response = request(server, "HEAD", "/style.css",
+                       std::string("If-None-Match: ") + css.eTag + "\r\n");
+    CHECK(response.status == 304);
+}
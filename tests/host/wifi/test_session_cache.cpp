@@ -0,0 +1,213 @@
+/*
+ test_session_cache.cpp - BearSSL client session cache keying tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <string.h>
+#include <BearSSLHelpers.h>
+
+using BearSSL::SessionCache;
+
+namespace
+{
+
+// a trust anchor as X509List builds them, with made up DN and key bytes
+struct Anchor
+{
+    explicit Anchor(uint8_t seed)
+    {
+        memset(dn, seed, sizeof(dn));
+        memset(n, seed ^ 0x5a, sizeof(n));
+        e[0] = 1;
+        e[1] = 0;
+        e[2] = 1;
+        memset(&ta, 0, sizeof(ta));
+        ta.dn.data = dn;
+        ta.dn.len = sizeof(dn);
+        ta.flags = BR_X509_TA_CA;
+        ta.pkey.key_type = BR_KEYTYPE_RSA;
+        ta.pkey.key.rsa.n = n;
+        ta.pkey.key.rsa.nlen = sizeof(n);
+        ta.pkey.key.rsa.e = e;
+        ta.pkey.key.rsa.elen = sizeof(e);
+    }
+
+    uint8_t dn[24];
+    uint8_t n[64];
+    uint8_t e[3];
+    br_x509_trust_anchor ta;
+};
+
+br_ssl_session_parameters session(uint8_t id)
+{
+    br_ssl_session_parameters params;
+    memset(&params, 0, sizeof(params));
+    memset(params.session_id, id, sizeof(params.session_id));
+    params.session_id_len = sizeof(params.session_id);
+    memset(params.master_secret, id ^ 0xff, sizeof(params.master_secret));
+    return params;
+}
+
+SessionCache::Trust insecure()
+{
+    SessionCache::Trust trust = {};
+    trust.insecure = true;
+    return trust;
+}
+
+SessionCache::Trust anchored(const Anchor& anchor)
+{
+    SessionCache::Trust trust = {};
+    trust.anchors = &anchor.ta;
+    trust.anchorCount = 1;
+    return trust;
+}
+
+}  // namespace
+
+TEST_CASE("SessionCache does not hand an insecure session to a validating client", "[wifi][sessioncache]")
+{
+    SessionCache cache(4);
+    Anchor       ca(1);
+    auto         params = session(0x11);
+
+    // An insecure client connects first and leaves its session behind
+    cache.store(SessionCache::makeKey("example.com", 443, insecure()), &params);
+
+    br_ssl_session_parameters offered;
+    CHECK_FALSE(cache.lookup(SessionCache::makeKey("example.com", 443, anchored(ca)), &offered));
+
+    uint8_t             fp[20] = { 0 };
+    SessionCache::Trust pinned = {};
+    pinned.fingerprint         = fp;
+    CHECK_FALSE(cache.lookup(SessionCache::makeKey("example.com", 443, pinned), &offered));
+
+    SessionCache::Trust selfSigned = insecure();
+    selfSigned.selfSigned          = true;
+    CHECK_FALSE(cache.lookup(SessionCache::makeKey("example.com", 443, selfSigned), &offered));
+
+    // Another insecure client may still resume it
+    REQUIRE(cache.lookup(SessionCache::makeKey("example.com", 443, insecure()), &offered));
+    CHECK(memcmp(&offered, &params, sizeof(params)) == 0);
+}
+
+TEST_CASE("SessionCache keys on trust anchor contents and client identity", "[wifi][sessioncache]")
+{
+    Anchor ca(1), sameCa(1), otherCa(2);
+    auto   trust = [](const SessionCache::Trust& t) { return SessionCache::makeKey("h", 443, t).trust; };
+
+    // Same anchors in another X509List (another address) are the same trust
+    CHECK(trust(anchored(ca)) == trust(anchored(sameCa)));
+    CHECK(trust(anchored(ca)) != trust(anchored(otherCa)));
+
+    // Any change of a pinned fingerprint
+    uint8_t             fp1[20], fp2[20];
+    SessionCache::Trust t1 = {}, t2 = {};
+    memset(fp1, 0xab, sizeof(fp1));
+    memcpy(fp2, fp1, sizeof(fp2));
+    fp2[19] ^= 1;
+    t1.fingerprint = fp1;
+    t2.fingerprint = fp2;
+    CHECK(trust(t1) != trust(t2));
+
+    // Certificate stores are told apart by identity
+    int                 store1, store2;
+    SessionCache::Trust s1 = {}, s2 = {};
+    s1.certStore = &store1;
+    s2.certStore = &store2;
+    CHECK(trust(s1) != trust(s2));
+
+    // Known server keys
+    uint8_t             n1[32], n2[32], e[] = { 1, 0, 1 };
+    br_rsa_public_key   k1 = { n1, sizeof(n1), e, sizeof(e) }, k2 = { n2, sizeof(n2), e, sizeof(e) };
+    SessionCache::Trust r1 = {}, r2 = {};
+    memset(n1, 1, sizeof(n1));
+    memset(n2, 2, sizeof(n2));
+    r1.rsaKey = &k1;
+    r2.rsaKey = &k2;
+    CHECK(trust(r1) != trust(r2));
+
+    // With or without a client certificate
+    uint8_t             der[] = { 0x30, 0x03, 0x02, 0x01, 0x01 };
+    br_x509_certificate cert  = { der, sizeof(der) };
+    SessionCache::Trust c1 = anchored(ca), c2 = anchored(ca);
+    c2.chain      = &cert;
+    c2.chainCount = 1;
+    CHECK(trust(c1) != trust(c2));
+
+    // Host and port are kept as they are
+    auto key = SessionCache::makeKey("h", 8443, c1);
+    CHECK(key.host == "h");
+    CHECK(key.port == 8443);
+    CHECK(key.trust == trust(c1));
+    CHECK(key.hash != SessionCache::makeKey("h", 443, c1).hash);
+    CHECK(SessionCache::makeKey(nullptr, 443, c1).host == "");
+    CHECK(SessionCache::makeKey(nullptr, 443, c1).hash != 0);
+}
+
+TEST_CASE("SessionCache compares the whole key, not only its hash", "[wifi][sessioncache]")
+{
+    SessionCache              cache(4);
+    Anchor                    ca(1), otherCa(2);
+    auto                      params = session(0x22);
+    br_ssl_session_parameters offered;
+
+    auto stored = SessionCache::makeKey("a.example.com", 443, anchored(ca));
+    cache.store(stored, &params);
+
+    // Keys which happen to share the hash of the stored one
+    auto otherHost = SessionCache::makeKey("b.example.com", 443, anchored(ca));
+    auto otherPort = SessionCache::makeKey("a.example.com", 8443, anchored(ca));
+    auto weaker    = SessionCache::makeKey("a.example.com", 443, insecure());
+    auto stronger  = SessionCache::makeKey("a.example.com", 443, anchored(otherCa));
+    for (auto* key : { &otherHost, &otherPort, &weaker, &stronger })
+    {
+        key->hash = stored.hash;
+        CHECK_FALSE(cache.lookup(*key, &offered));
+    }
+
+    // Storing one of them takes another entry, the first session stays
+    cache.store(otherHost, &params);
+    REQUIRE(cache.lookup(stored, &offered));
+    REQUIRE(cache.lookup(otherHost, &offered));
+    CHECK_FALSE(cache.lookup(otherPort, &offered));
+    CHECK(cache.stats().evictions == 0);
+}
+
+TEST_CASE("SessionCache keeps one entry per key and evicts the least recently used", "[wifi][sessioncache]")
+{
+    SessionCache cache(2);
+    Anchor       ca(1);
+    auto         a = session(1), b = session(2), c = session(3);
+    auto         ka = SessionCache::makeKey("a", 443, anchored(ca));
+    auto         kb = SessionCache::makeKey("b", 443, anchored(ca));
+    auto         kc = SessionCache::makeKey("c", 443, anchored(ca));
+
+    br_ssl_session_parameters offered;
+    cache.store(ka, &a);
+    cache.store(kb, &b);
+    cache.store(ka, &a);  // replaces, does not take a second slot
+    CHECK(cache.stats().evictions == 0);
+
+    REQUIRE(cache.lookup(kb, &offered));  // a is now the oldest
+    cache.store(kc, &c);
+    CHECK(cache.stats().evictions == 1);
+    CHECK_FALSE(cache.lookup(ka, &offered));
+    REQUIRE(cache.lookup(kb, &offered));
+    CHECK(offered.session_id[0] == 2);
+    REQUIRE(cache.lookup(kc, &offered));
+    CHECK(offered.session_id[0] == 3);
+
+    cache.clear();
+    CHECK_FALSE(cache.lookup(kc, &offered));
+}
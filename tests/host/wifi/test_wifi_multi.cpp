@@ -0,0 +1,216 @@
+/*
+ test_wifi_multi.cpp - ESP8266WiFiMulti connection state machine tests
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+*/
+
+#include <catch.hpp>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <ESP8266WiFiMulti.h>
+#include <Schedule.h>
+#include <user_interface.h>
+
+namespace
+{
+
+struct Network
+{
+    const char* ssid;
+    uint8_t     id;  // last byte of the BSSID
+    uint8_t     channel;
+    int8_t      rssi;
+};
+
+void air(std::vector<Network> networks)
+{
+    std::vector<bss_info> found(networks.size());
+    for (size_t i = 0; i < networks.size(); i++)
+    {
+        memset(&found[i], 0, sizeof(found[i]));
+        strncpy((char*)found[i].ssid, networks[i].ssid, sizeof(found[i].ssid));
+        found[i].ssid_len = strlen(networks[i].ssid);
+        memset(found[i].bssid, 0xa0, sizeof(found[i].bssid));
+        found[i].bssid[5] = networks[i].id;
+        found[i].channel  = networks[i].channel;
+        found[i].rssi     = networks[i].rssi;
+        found[i].authmode = AUTH_WPA2_PSK;
+    }
+    mock_station_scan(found.data(), found.size());
+}
+
+// the SDK reports the running scan
+void scanDone()
+{
+    run_scheduled_functions();
+}
+
+// what the station was told to join last
+struct Joined
+{
+    std::string ssid;
+    std::string password;
+    int         id;  // -1 when any BSSID will do
+};
+
+Joined joined()
+{
+    station_config config;
+    wifi_station_get_config(&config);
+    return { std::string((const char*)config.ssid), std::string((const char*)config.password),
+             config.bssid_set ? config.bssid[5] : -1 };
+}
+
+// the saved SDK config is tried first after boot, have it fail right away
+void skipSavedConfig(ESP8266WiFiMulti& multi)
+{
+    mock_station_status(STATION_CONNECT_FAIL);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Connecting);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Scanning);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Scanning);
+    scanDone();
+}
+
+}  // namespace
+
+TEST_CASE("WiFiMulti scans, then tries the known networks by signal and the hidden ones",
+          "[wifi][multi]")
+{
+    ESP8266WiFiMulti multi;
+    multi.addAP("home", "home-pw");
+    multi.addAP("office", "office-pw");
+    multi.addAP("attic", "attic-pw");  // hidden, scans do not report it
+    air({ { "neighbour", 1, 11, -30 }, { "home", 2, 1, -70 }, { "office", 3, 6, -50 } });
+
+    skipSavedConfig(multi);
+
+    // strongest known network first, on the BSSID and channel the scan saw
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Connecting);
+    Joined tried = joined();
+    CHECK(tried.ssid == "office");
+    CHECK(tried.password == "office-pw");
+    CHECK(tried.id == 3);
+    CHECK(wifi_get_channel() == 6);
+
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    tried = joined();
+    CHECK(tried.ssid == "home");
+    CHECK(tried.id == 2);
+    CHECK(wifi_get_channel() == 1);
+
+    // the networks the scan did not show, on any BSSID
+    mock_station_status(STATION_WRONG_PASSWORD);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    tried = joined();
+    CHECK(tried.ssid == "attic");
+    CHECK(tried.id == -1);
+
+    // nothing left to try
+    CHECK(multi.poll() == WL_CONNECT_FAILED);
+    CHECK(multi.state() == WifiMultiState::Idle);
+    CHECK(multi.stats().failures == 1);
+    CHECK(multi.stats().scans == 1);
+
+    // the next cycle scans again, the hidden network answers this time
+    mock_station_status(STATION_CONNECT_FAIL);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Scanning);
+    scanDone();
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "attic");
+    mock_station_status(STATION_GOT_IP);
+    CHECK(multi.poll() == WL_CONNECTED);
+    CHECK(multi.state() == WifiMultiState::Idle);
+    CHECK(multi.stats().connects == 1);
+    CHECK(multi.stats().scans == 2);
+
+    WifiFastConnect fast;
+    REQUIRE(multi.getFastConnect(fast));
+    CHECK(fast.ap == 2);
+}
+
+TEST_CASE("WiFiMulti reconnects to the last BSSID without scanning, and scans when it is gone",
+          "[wifi][multi]")
+{
+    ESP8266WiFiMulti multi;
+    multi.addAP("home", "home-pw");
+    multi.addAP("office", "office-pw");
+    air({ { "home", 2, 1, -70 }, { "office", 3, 6, -50 } });
+
+    skipSavedConfig(multi);
+    mock_station_status(STATION_GOT_IP);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.poll() == WL_CONNECTED);
+    CHECK(joined().ssid == "office");
+    CHECK(multi.stats().scans == 1);
+
+    // connection lost, the same AP comes back
+    mock_station_status(STATION_IDLE);
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Connecting);
+    CHECK(joined().id == 3);
+    CHECK(wifi_get_channel() == 6);
+    mock_station_status(STATION_GOT_IP);
+    CHECK(multi.poll() == WL_CONNECTED);
+    CHECK(multi.stats().fastConnects == 1);
+    CHECK(multi.stats().scans == 1);
+
+    // lost again, and the AP moved away: once the attempt times out a scan finds the other one
+    mock_station_status(STATION_IDLE);
+    CHECK(multi.poll(0) == WL_DISCONNECTED);
+    CHECK(joined().id == 3);
+    air({ { "home", 2, 1, -70 } });
+    mock_station_status(STATION_NO_AP_FOUND);
+    CHECK(multi.poll(0) == WL_DISCONNECTED);
+    CHECK(multi.state() == WifiMultiState::Scanning);
+    scanDone();
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "home");
+    mock_station_status(STATION_GOT_IP);
+    CHECK(multi.poll() == WL_CONNECTED);
+    CHECK(multi.stats().scans == 2);
+    CHECK(multi.stats().connects == 3);
+}
+
+TEST_CASE("WiFiMulti takes networks added while it scans or connects", "[wifi][multi]")
+{
+    ESP8266WiFiMulti multi;
+    multi.addAP("home", "home-pw");
+    air({ { "home", 2, 1, -70 }, { "late", 4, 3, -40 } });
+
+    skipSavedConfig(multi);
+
+    // added once the scan is running, it is still a candidate of this cycle
+    multi.addAP("late", "late-pw");
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "late");
+    CHECK(joined().id == 4);
+
+    // added while connecting, tried as a hidden network
+    multi.addAP("later", "later-pw");
+    multi.addAP("latest", "latest-pw");
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "home");
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "later");
+    CHECK(multi.poll() == WL_DISCONNECTED);
+    CHECK(joined().ssid == "latest");
+    CHECK(multi.poll() == WL_CONNECT_FAILED);
+
+    mock_station_status(STATION_GOT_IP);
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# mkassetbundle.py - pack a directory of web assets into a read-only bundle
+# served by ESP8266WebServer::serveBundle()
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# Bundle layout (little endian, every section 4-byte aligned), must match
+# libraries/ESP8266WebServer/src/detail/AssetBundle.h:
+#
+#   header   magic "ESPB", u16 version, u16 count, u32 size, u32 reserved
+#   entries  count * { u32 path, u32 mime, u32 etag, u32 data, u32 len, u32 flags }
+#            sorted by path (byte order), offsets are from the bundle start
+#   strings  NUL terminated path / content type / quoted ETag
+#   data     file bodies, gzip compressed when that makes them smaller
+
+import argparse
+import base64
+import gzip
+import hashlib
+import os
+import struct
+import sys
+
+MAGIC = b'ESPB'
+VERSION = 1
+HEADER = struct.Struct('<4sHHII')
+ENTRY = struct.Struct('<IIIIII')
+FLAG_GZIP = 1
+
+# Same associations as ESP8266WebServer/src/detail/mimetable.cpp
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.htm': 'text/html',
+    '.txt': 'text/plain',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.png': 'image/png',
+    '.gif': 'image/gif',
+    '.jpg': 'image/jpeg',
+    '.jpeg': 'image/jpeg',
+    '.ico': 'image/x-icon',
+    '.svg': 'image/svg+xml',
+    '.ttf': 'application/x-font-ttf',
+    '.otf': 'application/x-font-opentype',
+    '.woff': 'application/font-woff',
+    '.woff2': 'application/font-woff2',
+    '.eot': 'application/vnd.ms-fontobject',
+    '.sfnt': 'application/font-sfnt',
+    '.xml': 'text/xml',
+    '.pdf': 'application/pdf',
+    '.zip': 'application/zip',
+    '.appcache': 'text/cache-manifest',
+    '.gz': 'application/x-gzip',
+}
+DEFAULT_MIME = 'application/octet-stream'
+INDEX_FILES = ('index.htm', 'index.html')
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='Web asset bundle packer')
+    parser.add_argument('dir', help='Directory holding the assets')
+    parser.add_argument('-o', '--out', required=True, help='Output file')
+    parser.add_argument('--header', metavar='NAME', help='Write a C header defining PROGMEM array NAME instead of a binary image')
+    parser.add_argument('--no-gzip', action='store_true', help='Store every file uncompressed')
+    return parser.parse_args()
+
+def align4(buf):
+    buf.extend(b'\0' * (-len(buf) % 4))
+
+def collect(root, use_gzip):
+    """Returns a dict of URL path -> (content type, stored body, gzip flag)."""
+    assets = {}
+    for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
+        for name in sorted(filenames):
+            full = os.path.join(dirpath, name)
+            url = '/' + os.path.relpath(full, root).replace(os.sep, '/')
+            with open(full, 'rb') as f:
+                body = f.read()
+            mime = MIME_TYPES.get(os.path.splitext(name)[1].lower(), DEFAULT_MIME)
+            flags = 0
+            if use_gzip and mime != MIME_TYPES['.gz']:
+                packed = gzip.compress(body, 9, mtime=0)
+                if len(packed) < len(body):
+                    body = packed
+                    flags = FLAG_GZIP
+            assets[url] = (mime, body, flags)
+    # Let "/dir/" resolve to its index page without a second lookup
+    for url in list(assets):
+        base = url.rsplit('/', 1)
+        if base[1] in INDEX_FILES:
+            assets.setdefault(base[0] + '/', assets[url])
+    return assets
+
+def build(assets):
+    paths = sorted(assets, key=lambda p: p.encode('utf-8'))
+    if len(paths) > 0xffff:
+        raise ValueError('too many assets')
+
+    strings = bytearray()
+    def add_string(s):
+        off = len(strings)
+        strings.extend(s.encode('utf-8') + b'\0')
+        return off
+
+    data = bytearray()
+    data_offsets = {}
+    records = []
+    for path in paths:
+        mime, body, flags = assets[path]
+        key = id(body)
+        if key not in data_offsets:  # Index aliases share their body
+            data_offsets[key] = len(data)
+            data.extend(body)
+            align4(data)
+        etag = '"' + base64.b64encode(hashlib.md5(body).digest()).decode('ascii') + '"'
+        records.append((add_string(path), add_string(mime), add_string(etag), data_offsets[key], len(body), flags))
+    align4(strings)
+
+    strings_start = HEADER.size + ENTRY.size * len(paths)
+    data_start = strings_start + len(strings)
+    out = bytearray()
+    out.extend(HEADER.pack(MAGIC, VERSION, len(paths), data_start + len(data), 0))
+    for path_off, mime_off, etag_off, data_off, length, flags in records:
+        out.extend(ENTRY.pack(strings_start + path_off, strings_start + mime_off, strings_start + etag_off,
+                              data_start + data_off, length, flags))
+    out.extend(strings)
+    out.extend(data)
+    return bytes(out)
+
+def write_header(bundle, name, out):
+    out.write('// Generated by tools/mkassetbundle.py, do not edit\n')
+    out.write('#pragma once\n#include <stdint.h>\n#include <pgmspace.h>\n\n')
+    out.write('static const uint8_t %s[%d] PROGMEM __attribute__((aligned(4))) = {\n' % (name, len(bundle)))
+    for i in range(0, len(bundle), 16):
+        out.write('    ' + ', '.join('0x%02x' % b for b in bundle[i:i + 16]) + ',\n')
+    out.write('};\n')
+
+def main():
+    args = parse_args()
+    assets = collect(args.dir, not args.no_gzip)
+    bundle = build(assets)
+    if args.header:
+        with open(args.out, 'w') as out:
+            write_header(bundle, args.header, out)
+    else:
+        with open(args.out, 'wb') as out:
+            out.write(bundle)
+    sys.stderr.write('Bundled %d assets, %d bytes: %s\n' % (len(assets), len(bundle), args.out))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())